@@ -6,6 +6,8 @@
  * specifies the terms and conditions for redistribution.
  */
 
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -202,10 +204,26 @@ static int fastcat(FILE * file)
     int buffsize;
     int n;
     int nwritten;
+    int copied = 0;
     char * buff;
 
     fd = fileno(file);
 
+    /*
+     * Let the kernel move the data if it can, otherwise fall back to
+     * copying through a user buffer.
+     */
+    while ((n = copy_file_range(fd, NULL, fileno(stdout), NULL,
+                                SSIZE_MAX, 0)) > 0) {
+        copied = 1;
+    }
+    if (n == 0)
+        return 0;
+    if (copied || (errno != EINVAL && errno != ENOSYS)) {
+        perror("cat: copy error");
+        return 1;
+    }
+
     if (obsize)
         buffsize = obsize;  /* common case, use output blksize */
     else if (ibsize)
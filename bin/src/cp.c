@@ -7,7 +7,9 @@
  */
 
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -83,7 +85,57 @@ usage:
     return 0;
 }
 
-#define MAXBSIZE 1000
+#define MAXBSIZE 8192
+
+/*
+ * Copy with read and write if the kernel can't copy between the files.
+ */
+static int rwcopy(int fold, const char * from, int fnew, const char * to)
+{
+    char * buf;
+    ssize_t n;
+    int retval = 0;
+
+    buf = malloc(MAXBSIZE);
+    if (!buf) {
+        cp_perror(from);
+        return 1;
+    }
+
+    while ((n = read(fold, buf, MAXBSIZE)) > 0) {
+        if (write(fnew, buf, n) != n) {
+            cp_perror(to);
+            retval = 1;
+            break;
+        }
+    }
+    if (n < 0) {
+        cp_perror(from);
+        retval = 1;
+    }
+
+    free(buf);
+    return retval;
+}
+
+static int copydata(int fold, const char * from, int fnew, const char * to)
+{
+    ssize_t n;
+    int copied = 0;
+
+    while ((n = copy_file_range(fold, NULL, fnew, NULL, SSIZE_MAX, 0)) > 0) {
+        copied = 1;
+    }
+    if (n < 0) {
+        if (!copied && (errno == EINVAL || errno == ENOSYS))
+            return rwcopy(fold, from, fnew, to);
+        cp_perror(from);
+        return 1;
+    }
+
+    return 0;
+}
+
 static int copy(char * from, char * to)
 {
     int fold;
@@ -91,7 +143,6 @@ static int copy(char * from, char * to)
     int n;
     int exists;
     char * destname = NULL;
-    char * buf = NULL;
     struct stat stfrom, stto;
     int retval = 0;
 
@@ -193,25 +244,11 @@ static int copy(char * from, char * to)
     if (exists && pflag)
         (void)fchmod(fnew, stfrom.st_mode & 07777);
 
-    buf = malloc(MAXBSIZE);
-    for (;;) {
-        n = read(fold, buf, sizeof(buf));
-        if (n == 0)
-            break;
-        if (n < 0) {
-            cp_perror(from);
-            (void)close(fold);
-            (void)close(fnew);
-            retval = 1;
-            goto out;
-        }
-        if (write(fnew, buf, n) != n) {
-            cp_perror(to);
-            (void)close(fold);
-            (void)close(fnew);
-            retval = 1;
-            goto out;
-        }
+    if (copydata(fold, from, fnew, to)) {
+        (void)close(fold);
+        (void)close(fnew);
+        retval = 1;
+        goto out;
     }
     (void)close(fold);
     (void)close(fnew);
@@ -219,7 +256,6 @@ static int copy(char * from, char * to)
         retval = setimes(to, &stfrom);
 out:
     free(destname);
-    free(buf);
     return retval;
 }
 
@@ -47,6 +47,8 @@
 
 /* Runtime Invariant Values */
 #define HOST_NAME_MAX   255
+#define IOV_MAX         1024        /*!< Maximum number of iovec structures
+                                     *   in a readv() or writev(). */
 
 /* Pathname Variable Values */
 #define FILESIZEBITS    32
@@ -57,7 +59,9 @@
 #define PATH_MAX        4096        /*!< Maximum path length. */
 #define NGROUPS_MAX     16
 
-/* TODO PIPE_BUF */
+#define PIPE_BUF        4096        /*!< Maximum number of bytes that is
+                                     *   guaranteed to be atomic when writing
+                                     *   to a pipe. */
 
 
 /* Runtime Increasable Values */
@@ -66,6 +70,8 @@
 #define _POSIX2_LINE_MAX    LINE_MAX
 #define _POSIX_ARG_MAX      ARG_MAX
 #define _POSIX_LINK_MAX     LINK_MAX
+#define _POSIX_PIPE_BUF     512
+#define _XOPEN_IOV_MAX      16
 #define _XOPEN_PATH_MAX     PATH_MAX
 
 /* Other Invariant Values */
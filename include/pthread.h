@@ -140,6 +140,7 @@
  */
 #define PTHREAD_NEEDS_INIT          0
 #define PTHREAD_DONE_INIT           1
+#define PTHREAD_DOING_INIT          2
 
 /*
  * Static once initialization values.
@@ -151,7 +152,7 @@
  */
 #define PTHREAD_MUTEX_INITIALIZER {0, 0, -1, -1, -1}
 #define PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP {0, 0, -1, -1, -1}
-#define PTHREAD_COND_INITIALIZER    NULL
+#define PTHREAD_COND_INITIALIZER    {0}
 #define PTHREAD_RWLOCK_INITIALIZER  NULL
 
 /*
@@ -190,7 +191,6 @@ enum pthread_mutextype {
 typedef int pthread_key_t;
 typedef struct _pthread_once {
     int state;
-    pthread_key_t key;
 } pthread_once_t;
 
 struct _pthread_cleanup_info {
@@ -218,6 +218,7 @@ struct _sched_pthread_create_args {
     void          * stack_addr; /*!< Stack address */
     size_t          stack_size; /*!< Size of stack reserved for the thread. */
     unsigned        flags;      /*!< Thread creation flags */
+    uint32_t        cpu_affinity; /*!< CPU affinity mask; 0 = all CPUs. */
     start_routine   start;      /*!< Thread start routine. */
     uintptr_t       arg1;
     uintptr_t       arg2;
@@ -263,6 +264,33 @@ int     pthread_attr_setdetachstate(pthread_attr_t *, int);
 /* TODO Zeke specific functions should be hidden by default? */
 int
 pthread_attr_setname_zeke(pthread_attr_t * attr, const char * restrict name);
+
+/**
+ * Set the CPU affinity mask of a thread.
+ * Bit n of mask is set if the thread is allowed to run on CPU n.
+ * @return 0 if succeed; Otherwise an error number is returned.
+ */
+int pthread_setaffinity_zeke(pthread_t thread, uint32_t mask);
+
+/**
+ * Get the CPU affinity mask of a thread.
+ * @return 0 if succeed; Otherwise an error number is returned.
+ */
+int pthread_getaffinity_zeke(pthread_t thread, uint32_t * mask);
+
+/**
+ * Set the initial CPU affinity mask in a thread attributes object.
+ * A mask of 0 allows the thread to run on all CPUs.
+ * @return 0 if succeed; Otherwise an error number is returned.
+ */
+int pthread_attr_setaffinity_zeke(pthread_attr_t * attr, uint32_t mask);
+
+/**
+ * Get the initial CPU affinity mask from a thread attributes object.
+ * @return 0 if succeed; Otherwise an error number is returned.
+ */
+int pthread_attr_getaffinity_zeke(const pthread_attr_t * attr,
+                                  uint32_t * mask);
 /*
 int     pthread_barrier_destroy(pthread_barrier_t *);
 int     pthread_barrier_init(pthread_barrier_t *,
@@ -298,14 +326,17 @@ int     pthread_barrierattr_setpshared(pthread_barrierattr_t *, int);
  * @}
  */
 
-/*
 int     pthread_condattr_destroy(pthread_condattr_t *);
+/*
 int     pthread_condattr_getclock(const pthread_condattr_t *,
             clockid_t *);
 int     pthread_condattr_getpshared(const pthread_condattr_t *, int *);
+*/
 int     pthread_condattr_init(pthread_condattr_t *);
+/*
 int     pthread_condattr_setclock(pthread_condattr_t *, clockid_t);
 int     pthread_condattr_setpshared(pthread_condattr_t *, int);
+*/
 int     pthread_cond_broadcast(pthread_cond_t *);
 int     pthread_cond_destroy(pthread_cond_t *);
 int     pthread_cond_init(pthread_cond_t *,
@@ -314,7 +345,6 @@ int     pthread_cond_signal(pthread_cond_t *);
 int     pthread_cond_timedwait(pthread_cond_t *,
             pthread_mutex_t *__mutex, const struct timespec *);
 int     pthread_cond_wait(pthread_cond_t *, pthread_mutex_t *__mutex);
-*/
 int     pthread_equal(pthread_t, pthread_t);
 
 void    *pthread_getspecific(pthread_key_t);
@@ -70,6 +70,7 @@ struct sched_param {
 #if defined(__SYSCALL_DEFS__) || defined(KERNEL_INTERNAL)
 #include <sys/types/_id_t.h>
 #include <sys/types/_pthread_t.h>
+#include <stdint.h>
 
 /**
  * Argument struct for SYSCALL_SCHED_SETPOLICY
@@ -78,6 +79,15 @@ struct _setpolicy_args {
     id_t id;
     int policy;
 };
+
+/**
+ * Arguments struct for SYSCALL_THREAD_SETAFFINITY and
+ * SYSCALL_THREAD_GETAFFINITY.
+ */
+struct _set_affinity_args {
+    id_t id;
+    uint32_t mask; /*!< Bit n is set if the thread may run on CPU n. */
+};
 #endif
 
 #ifndef KERNEL_INTERNAL
@@ -109,6 +109,8 @@ int _PDCLIB_fillbuffer( _PDCLIB_file_t * stream );
 _PDCLIB_int_fast64_t _PDCLIB_seek( _PDCLIB_file_t * stream,
                                   _PDCLIB_int_fast64_t offset, int whence );
 
+struct iovec;
+
 /* File backend I/O operations
  *
  * PDCLib will call through to these methods as needed to implement the stdio
@@ -169,6 +171,16 @@ struct _PDCLIB_fileops
      */
     _PDCLIB_bool (*wwrite)( _PDCLIB_fd_t self, const _PDCLIB_wchar_t * buf,
                      size_t length, size_t * numCharsWritten );
+
+    /* Behaves as write does, except that the data is gathered from iovcnt
+     * buffers described by iov.
+     *
+     * This function is optional; if present, fwrite() uses it to write the
+     * buffered data and a large user buffer with a single call instead of
+     * copying the user data through the stream buffer.
+     */
+    _PDCLIB_bool (*writev)( _PDCLIB_fd_t self, const struct iovec * iov,
+                     int iovcnt, size_t * numBytesWritten );
 };
 
 /* struct _PDCLIB_file structure */
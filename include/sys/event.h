@@ -0,0 +1,137 @@
+/**
+ *******************************************************************************
+ * @file    sys/event.h
+ * @author  Olli Vanhoja
+ * @brief   Kernel event notification.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#ifndef SYS_EVENT_H
+#define SYS_EVENT_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <sys/types/_timespec.h>
+
+/**
+ * Kernel event.
+ */
+struct kevent {
+    uintptr_t ident;    /*!< Identifier for this event; A file descriptor. */
+    short filter;       /*!< Filter for the event. */
+    unsigned short flags; /*!< Action flags. */
+    unsigned fflags;    /*!< Filter specific flags. */
+    intptr_t data;      /*!< Filter specific data. */
+    void * udata;       /*!< Opaque user data passed through the kernel. */
+};
+
+/**
+ * Initialize a kevent struct.
+ */
+#define EV_SET(kevp, a, b, c, d, e, f) do { \
+    struct kevent * _kevp = (kevp);         \
+    _kevp->ident = (a);                     \
+    _kevp->filter = (b);                    \
+    _kevp->flags = (c);                     \
+    _kevp->fflags = (d);                    \
+    _kevp->data = (e);                      \
+    _kevp->udata = (f);                     \
+} while (0)
+
+/**
+ * @addtogroup kevent_filters
+ * @{
+ */
+#define EVFILT_READ     (-1) /*!< The file descriptor is readable. */
+#define EVFILT_WRITE    (-2) /*!< The file descriptor is writable. */
+/**
+ * @}
+ */
+
+/**
+ * @addtogroup kevent_flags
+ * @{
+ */
+#define EV_ADD          0x0001 /*!< Add the event to the kqueue. */
+#define EV_DELETE       0x0002 /*!< Remove the event from the kqueue. */
+#define EV_ENABLE       0x0004 /*!< Enable the event. */
+#define EV_DISABLE      0x0008 /*!< Disable the event. */
+#define EV_ONESHOT      0x0010 /*!< Delete the event after it's returned. */
+#define EV_CLEAR        0x0020 /*!< Reset the state after it's returned. */
+#define EV_EOF          0x8000 /*!< EOF detected (returned). */
+#define EV_ERROR        0x4000 /*!< Error (returned). */
+/**
+ * @}
+ */
+
+#if defined(__SYSCALL_DEFS__) || defined(KERNEL_INTERNAL)
+/**
+ * Arguments for SYSCALL_FS_KEVENT.
+ */
+struct _fs_kevent_args {
+    int fd;
+    const struct kevent * changelist;
+    int nchanges;
+    struct kevent * eventlist;
+    int nevents;
+    int timeout; /*!< Timeout in msec or -1 to wait forever. */
+};
+#endif
+
+#ifndef KERNEL_INTERNAL
+__BEGIN_DECLS
+
+/**
+ * Create a new kernel event queue.
+ * @return  Returns a file descriptor;
+ *          Otherwise -1 is returned and errno is set.
+ */
+int kqueue(void);
+
+/**
+ * Register events with a kqueue and return pending events.
+ * Events are level-triggered unless EV_CLEAR is set; A registered file is
+ * kept open by the kqueue until the event is deleted or the kqueue is
+ * closed.
+ * @param kq is the kqueue file descriptor.
+ * @param changelist is an array of changes applied before waiting.
+ * @param nchanges is the number of entries in changelist.
+ * @param eventlist is an array for the returned events.
+ * @param nevents is the size of eventlist.
+ * @param timeout is the max time to wait; NULL to wait forever.
+ * @return  Returns the number of events placed in eventlist;
+ *          Otherwise -1 is returned and errno is set.
+ */
+int kevent(int kq, const struct kevent * changelist, int nchanges,
+           struct kevent * eventlist, int nevents,
+           const struct timespec * timeout);
+
+__END_DECLS
+#endif /* !KERNEL_INTERNAL */
+
+#endif /* SYS_EVENT_H */
@@ -0,0 +1,89 @@
+/**
+ *******************************************************************************
+ * @file    sys/futex.h
+ * @author  Olli Vanhoja
+ * @brief   Fast userspace wait queues.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#ifndef SYS_FUTEX_H
+#define SYS_FUTEX_H
+
+#include <sys/types.h>
+#include <sys/types/_timespec.h>
+
+#if defined(__SYSCALL_DEFS__) || defined(KERNEL_INTERNAL)
+/**
+ * Arguments for SYSCALL_FUTEX_WAIT.
+ */
+struct _futex_wait_args {
+    int * uaddr;            /*!< Address of the futex word. */
+    int val;                /*!< Expected value of the futex word. */
+    int timed;              /*!< Set if timeout is valid. */
+    struct timespec timeout; /*!< Relative timeout. */
+};
+
+/**
+ * Arguments for SYSCALL_FUTEX_WAKE.
+ */
+struct _futex_wake_args {
+    int * uaddr;            /*!< Address of the futex word. */
+    int count;              /*!< Maximum number of threads to wake up. */
+};
+#endif
+
+#ifndef KERNEL_INTERNAL
+__BEGIN_DECLS
+
+/**
+ * Wait on a futex word.
+ * The calling thread is put to sleep if the futex word pointed by uaddr still
+ * contains val; The comparison and going to sleep is atomic with respect to
+ * futex_wake().
+ * @param uaddr is a pointer to the futex word.
+ * @param val is the value the futex word is expected to contain.
+ * @param timeout is an optional relative timeout; NULL to wait forever.
+ * @return  Returns 0 if the thread was woken up by futex_wake();
+ *          Otherwise -1 is returned and errno is set to EAGAIN if the futex
+ *          word didn't contain val, ETIMEDOUT if the timeout expired or
+ *          EINTR if the wait was interrupted by a signal.
+ */
+int futex_wait(int * uaddr, int val, const struct timespec * timeout);
+
+/**
+ * Wake up threads waiting on a futex word.
+ * @param uaddr is a pointer to the futex word.
+ * @param count is the maximum number of threads to wake up.
+ * @return  Returns the number of threads woken up;
+ *          Otherwise -1 is returned and errno is set.
+ */
+int futex_wake(int * uaddr, int count);
+
+__END_DECLS
+#endif
+
+#endif /* SYS_FUTEX_H */
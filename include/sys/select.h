@@ -0,0 +1,115 @@
+/**
+ *******************************************************************************
+ * @file    sys/select.h
+ * @author  Olli Vanhoja
+ * @brief   Select types.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#ifndef SYS_SELECT_H
+#define SYS_SELECT_H
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <sys/types/_suseconds_t.h>
+#include <sys/types/_time_t.h>
+#include <sys/types/_timespec.h>
+#include <sys/types/_timeval.h>
+
+/**
+ * Max number of file descriptors in an fd_set.
+ */
+#define FD_SETSIZE      256
+
+/**
+ * @addtogroup fd_set
+ * File descriptor set.
+ * @{
+ */
+
+typedef unsigned long __fd_mask;
+#define _NFDBITS        (sizeof(__fd_mask) * 8)
+
+typedef struct fd_set {
+    __fd_mask fds_bits[(FD_SETSIZE + _NFDBITS - 1) / _NFDBITS];
+} fd_set;
+
+#define __fdset_mask(n) ((__fd_mask)1 << ((n) % _NFDBITS))
+
+/**
+ * Clear fd from fdset.
+ */
+#define FD_CLR(fd, fdsetp) \
+    ((fdsetp)->fds_bits[(fd) / _NFDBITS] &= ~__fdset_mask(fd))
+
+/**
+ * Test if fd is a member of fdset.
+ */
+#define FD_ISSET(fd, fdsetp) \
+    (((fdsetp)->fds_bits[(fd) / _NFDBITS] & __fdset_mask(fd)) != 0)
+
+/**
+ * Add fd to fdset.
+ */
+#define FD_SET(fd, fdsetp) \
+    ((fdsetp)->fds_bits[(fd) / _NFDBITS] |= __fdset_mask(fd))
+
+/**
+ * Clear all members of fdset.
+ */
+#define FD_ZERO(fdsetp) do {                                        \
+    for (size_t _i = 0; _i < num_elem((fdsetp)->fds_bits); _i++)    \
+        (fdsetp)->fds_bits[_i] = 0;                                 \
+} while (0)
+
+/**
+ * @}
+ */
+
+#ifndef KERNEL_INTERNAL
+__BEGIN_DECLS
+
+/**
+ * Synchronous I/O multiplexing.
+ * select() is implemented on top of poll().
+ * @param nfds is the number of descriptors to be tested, starting from 0.
+ * @param readfds is an optional set of descriptors to be tested for reading.
+ * @param writefds is an optional set of descriptors to be tested for
+ *                 writing.
+ * @param errorfds is an optional set of descriptors to be tested for
+ *                 pending error conditions.
+ * @param timeout is the max time to wait; NULL to wait forever.
+ * @return  Returns the total number of bits set in the returned sets;
+ *          Otherwise -1 is returned and errno is set.
+ */
+int select(int nfds, fd_set * restrict readfds, fd_set * restrict writefds,
+           fd_set * restrict errorfds, struct timeval * restrict timeout);
+
+__END_DECLS
+#endif /* !KERNEL_INTERNAL */
+
+#endif /* SYS_SELECT_H */
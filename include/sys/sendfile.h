@@ -0,0 +1,58 @@
+/**
+ *******************************************************************************
+ * @file    sys/sendfile.h
+ * @author  Olli Vanhoja
+ * @brief   Transfer data between file descriptors.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#ifndef SYS_SENDFILE_H
+#define SYS_SENDFILE_H
+
+#include <sys/cdefs.h>
+#include <sys/types/_off_t.h>
+#include <sys/types/_size_t.h>
+#include <sys/types/_ssize_t.h>
+
+__BEGIN_DECLS
+
+/**
+ * Copy data from in_fd to out_fd inside the kernel.
+ * @param out_fd is the target file descriptor.
+ * @param in_fd is the source file descriptor.
+ * @param offset is a pointer to the source offset, updated to the offset
+ *               following the last byte read; If NULL the file offset of
+ *               in_fd is used and updated.
+ * @param count is the max number of bytes to copy.
+ * @return  Returns the number of bytes copied;
+ *          Otherwise -1 is returned and errno is set.
+ */
+ssize_t sendfile(int out_fd, int in_fd, off_t * offset, size_t count);
+
+__END_DECLS
+
+#endif /* SYS_SENDFILE_H */
@@ -47,7 +47,6 @@
 /* TODO Missing types:
  * - pthread_barrier_t
  * - pthread_barrierattr_t
- * - pthread_cond_t
  * - pthread_condattr_t
  * - pthread_mutex_t
  * - pthread_mutexattr_t
@@ -69,6 +68,7 @@ typedef struct pthread_attr {
     void *          stack_addr; /*!< Stack address */
     size_t          stack_size; /*!< Size of stack reserved for the thread. */
     unsigned        flags;
+    uint32_t        cpu_affinity; /*!< CPU affinity mask; 0 = all CPUs. */
     char            name[_ZEKE_THREAD_NAME_SIZE];
 } pthread_attr_t;
 
@@ -98,6 +98,14 @@ typedef struct pthread_mutex {
   pthread_t owner;  /*!< Thread owning the mutex */
 } pthread_mutex_t;
 
+/**
+ * Condition variable.
+ */
+typedef struct pthread_cond {
+    int seq;        /*!< Incremented on every signal and broadcast; The
+                     *   futex word waiters sleep on. */
+} pthread_cond_t;
+
 /*
  * Once definitions.
  */
@@ -0,0 +1,105 @@
+/**
+ *******************************************************************************
+ * @file    sys/uio.h
+ * @author  Olli Vanhoja
+ * @brief   Vectored I/O.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#ifndef SYS_UIO_H
+#define SYS_UIO_H
+
+#include <sys/cdefs.h>
+#include <sys/types/_off_t.h>
+#include <sys/types/_size_t.h>
+#include <sys/types/_ssize_t.h>
+
+/**
+ * I/O vector segment.
+ */
+struct iovec {
+    void * iov_base;    /*!< Base address of the memory region. */
+    size_t iov_len;     /*!< Size of the memory region. */
+};
+
+#if defined(__SYSCALL_DEFS__) || defined(KERNEL_INTERNAL)
+/**
+ * Arguments for SYSCALL_FS_READV, SYSCALL_FS_WRITEV, SYSCALL_FS_PREADV and
+ * SYSCALL_FS_PWRITEV.
+ */
+struct _fs_readwritev_args {
+    int fildes;
+    const struct iovec * iov;
+    int iovcnt;
+    off_t offset;       /*!< File offset for the positional variants. */
+};
+#endif
+
+#ifndef KERNEL_INTERNAL
+__BEGIN_DECLS
+
+/**
+ * Read from a file descriptor into multiple buffers.
+ * The buffers are filled in the array order and the file offset is
+ * advanced as by read().
+ * @param fildes is the file descriptor.
+ * @param iov is an array of buffers.
+ * @param iovcnt is the number of entries in iov; At most IOV_MAX.
+ * @return  Returns the number of bytes read;
+ *          Otherwise -1 is returned and errno is set.
+ */
+ssize_t readv(int fildes, const struct iovec * iov, int iovcnt);
+
+/**
+ * Write multiple buffers to a file descriptor.
+ * A writev() to a pipe is atomic if the total size is at most PIPE_BUF.
+ * @param fildes is the file descriptor.
+ * @param iov is an array of buffers.
+ * @param iovcnt is the number of entries in iov; At most IOV_MAX.
+ * @return  Returns the number of bytes written;
+ *          Otherwise -1 is returned and errno is set.
+ */
+ssize_t writev(int fildes, const struct iovec * iov, int iovcnt);
+
+/**
+ * Read from a given offset into multiple buffers.
+ * The file offset of fildes is not changed.
+ */
+ssize_t preadv(int fildes, const struct iovec * iov, int iovcnt,
+               off_t offset);
+
+/**
+ * Write multiple buffers at a given offset.
+ * The file offset of fildes is not changed.
+ */
+ssize_t pwritev(int fildes, const struct iovec * iov, int iovcnt,
+                off_t offset);
+
+__END_DECLS
+#endif /* !KERNEL_INTERNAL */
+
+#endif /* SYS_UIO_H */
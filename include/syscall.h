@@ -85,6 +85,7 @@
 #define SYSCALL_GROUP_SHMEM     0xA /*!< Shared memory system call group. */
 #define SYSCALL_GROUP_TIME      0xB /*!< Time system call group. */
 #define SYSCALL_GROUP_PRIV      0xC /*!< Pivileges system call group. */
+#define SYSCALL_GROUP_FUTEX     0xD /*!< Futex system call group. */
 
 /* List of syscalls */
 #define SYSCALL_SCHED_GET_LOADAVG   SYSCALL_MMTOTYPE(SYSCALL_GROUP_SCHED, 0x00)
@@ -97,6 +98,8 @@
 #define SYSCALL_THREAD_GETPOLICY    SYSCALL_MMTOTYPE(SYSCALL_GROUP_THREAD, 0x06)
 #define SYSCALL_THREAD_SETPRIORITY  SYSCALL_MMTOTYPE(SYSCALL_GROUP_THREAD, 0x07)
 #define SYSCALL_THREAD_GETPRIORITY  SYSCALL_MMTOTYPE(SYSCALL_GROUP_THREAD, 0x08)
+#define SYSCALL_THREAD_SETAFFINITY  SYSCALL_MMTOTYPE(SYSCALL_GROUP_THREAD, 0x09)
+#define SYSCALL_THREAD_GETAFFINITY  SYSCALL_MMTOTYPE(SYSCALL_GROUP_THREAD, 0x0A)
 #define SYSCALL_SYSCTL_SYSCTL       SYSCALL_MMTOTYPE(SYSCALL_GROUP_SYSCTL, 0x00)
 #define SYSCALL_SIGNAL_PKILL        SYSCALL_MMTOTYPE(SYSCALL_GROUP_SIGNAL, 0x00)
 #define SYSCALL_SIGNAL_TKILL        SYSCALL_MMTOTYPE(SYSCALL_GROUP_SIGNAL, 0x01)
@@ -158,6 +161,14 @@
 #define SYSCALL_FS_UMASK            SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x14)
 #define SYSCALL_FS_MOUNT            SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x15)
 #define SYSCALL_FS_UMOUNT           SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x16)
+#define SYSCALL_FS_POLL             SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x17)
+#define SYSCALL_FS_KQUEUE           SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x18)
+#define SYSCALL_FS_KEVENT           SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x19)
+#define SYSCALL_FS_READV            SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x1A)
+#define SYSCALL_FS_WRITEV           SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x1B)
+#define SYSCALL_FS_PREADV           SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x1C)
+#define SYSCALL_FS_PWRITEV          SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x1D)
+#define SYSCALL_FS_COPY_FILE_RANGE  SYSCALL_MMTOTYPE(SYSCALL_GROUP_FS, 0x1E)
 #define SYSCALL_IOCTL_GETSET        SYSCALL_MMTOTYPE(SYSCALL_GROUP_IOCTL, 0x00)
 #define SYSCALL_SHMEM_MMAP          SYSCALL_MMTOTYPE(SYSCALL_GROUP_SHMEM, 0x00)
 #define SYSCALL_SHMEM_MUNMAP        SYSCALL_MMTOTYPE(SYSCALL_GROUP_SHMEM, 0x01)
@@ -165,6 +176,8 @@
 #define SYSCALL_TIME_SETTIME        SYSCALL_MMTOTYPE(SYSCALL_GROUP_TIME, 0x01)
 #define SYSCALL_PRIV_PCAP           SYSCALL_MMTOTYPE(SYSCALL_GROUP_PRIV, 0x00)
 #define SYSCALL_PRIV_PCAP_GETALL    SYSCALL_MMTOTYPE(SYSCALL_GROUP_PRIV, 0x01)
+#define SYSCALL_FUTEX_WAIT          SYSCALL_MMTOTYPE(SYSCALL_GROUP_FUTEX, 0x00)
+#define SYSCALL_FUTEX_WAKE          SYSCALL_MMTOTYPE(SYSCALL_GROUP_FUTEX, 0x01)
 
 /* Kernel scope */
 #ifdef KERNEL_INTERNAL
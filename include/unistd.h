@@ -182,6 +182,18 @@ struct _fs_readwrite_args {
     size_t nbytes;
 };
 
+/**
+ * Arguments struct for SYSCALL_FS_COPY_FILE_RANGE
+ */
+struct _fs_copy_file_range_args {
+    int fd_in;
+    off_t * off_in;     /* input and return value */
+    int fd_out;
+    off_t * off_out;    /* input and return value */
+    size_t len;
+    unsigned flags;
+};
+
 /** Arguments struct for SYSCALL_FS_LSEEK */
 struct _fs_lseek_args {
     int fd;
@@ -464,6 +476,24 @@ ssize_t pwrite(int fildes, const void *buf, size_t nbytes, off_t offset);
  */
 ssize_t write(int fildes, const void * buf, size_t nbyte);
 
+/**
+ * Copy a range of data from one file to another.
+ * The data is moved inside the kernel without copying it to user space.
+ * @param fd_in is the source file descriptor.
+ * @param off_in is a pointer to the source offset, updated by the number of
+ *               bytes copied; If NULL the file offset of fd_in is used and
+ *               updated.
+ * @param fd_out is the target file descriptor.
+ * @param off_out is a pointer to the target offset; Same as off_in.
+ * @param len is the max number of bytes to copy.
+ * @param flags must be 0.
+ * @returns Returns the number of bytes copied, which can be less than len;
+ *          0 if the end of the source was reached;
+ *          Otherwise -1 is returned and errno is set.
+ */
+ssize_t copy_file_range(int fd_in, off_t * off_in, int fd_out,
+                        off_t * off_out, size_t len, unsigned flags);
+
 /**
  * Reposition read/write file offset.
  * The lseek function repositions the offset of the file descriptor fildes
@@ -35,73 +35,280 @@
 #include <idle.h>
 #include <kstring.h>
 #include <sys/linker_set.h>
-#include <sys/tree.h>
+#include <sys/sysctl.h>
 #include <sys/types.h>
 #include <buf.h>
 #include <fs/devfs.h>
+#include <hal/hw_timers.h>
 #include <kerror.h>
+#include <kinit.h>
 #include <kmalloc.h>
+#include <libkern.h>
+#include <thread.h>
+
+/**
+ * Number of buckets in the buffer cache hash table.
+ * Must be a power of two.
+ */
+#define BIO_HASH_SIZE       256
+
+/**
+ * Default memory budget of the buffer cache in bytes.
+ */
+#define BIO_MAX_BYTES_DFL   (4 * 1024 * 1024)
+
+/**
+ * Maximum number of buffers collected by one flush pass.
+ */
+#define BIO_FLUSH_MAX_BUFS  32
+
+/**
+ * Maximum size of a single clustered write.
+ */
+#define BIO_CLUSTER_MAX     (64 * 1024)
+
+/**
+ * A thread waiting for I/O completion on a buffer.
+ */
+struct bio_waiter {
+    pthread_t tid;
+    int linked;
+    SLIST_ENTRY(bio_waiter) entry_;
+};
+
+/**
+ * Buffer cache hash bucket.
+ */
+struct bio_bucket {
+    mtx_t lock;
+    LIST_HEAD(bio_bucket_list, buf) head;
+};
+
+/*
+ * Buffer cache.
+ * Cached buffers are found by (vnode, blkno) from the hash table. Each bucket
+ * has its own lock, so lookups of different blocks don't serialize.
+ * Released buffers are kept in the LRU list; the least recently released
+ * buffers are evicted first when the cache is over its memory budget.
+ *
+ * Lock order: bucket lock -> buf lock -> lru_lock.
+ * The eviction code walks the LRU list and uses only trylocks for the
+ * other locks.
+ */
+static struct bio_bucket bio_hash[BIO_HASH_SIZE];
+static mtx_t lru_lock = MTX_INITIALIZER(MTX_TYPE_ADAPTIVE, 0);
+static TAILQ_HEAD(bio_lru_head, buf) bio_lru = TAILQ_HEAD_INITIALIZER(bio_lru);
+static size_t bio_cached_bytes; /* Protected by lru_lock. */
 
 /*
- * Used to protect access caching data structures and synchronizing access
- * to some functions.
+ * Wait queues of the buffers.
+ * Interrupts are disabled while holding the lock so that a thread can't be
+ * preempted after it has blocked itself with thread_block().
  *
- * TODO We'd like to use MTX_TYPE_TICKET here but bio_clean() makes it
- * impossible right now.
+ * Lock order: buf lock -> bio_wq_lock.
  */
-static mtx_t cache_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, MTX_OPT_SLEEP |
-                                                         MTX_OPT_PRICEIL);
-static TAILQ_HEAD(bio_relse_list_head, buf) relse_list =
-     TAILQ_HEAD_INITIALIZER(relse_list);
+static mtx_t bio_wq_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, MTX_OPT_DINT);
 
+/*
+ * Async I/O queue served by the bio worker thread.
+ */
+static mtx_t bio_queue_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, MTX_OPT_DINT);
+static TAILQ_HEAD(bio_queue_head, buf) bio_queue =
+    TAILQ_HEAD_INITIALIZER(bio_queue);
+static pthread_t bio_worker_tid = -1;
+static int bio_worker_idle; /* The worker is blocked, protected by the lock. */
+static pthread_t bio_flusher_tid = -1;
+static int bio_flush_urgent; /* Flush regardless of age on the next pass. */
+
+SYSCTL_DECL(_vfs_bio);
+SYSCTL_NODE(_vfs, OID_AUTO, bio, CTLFLAG_RW, 0,
+            "Buffer cache");
+
+static unsigned bio_max_bytes = BIO_MAX_BYTES_DFL;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, max_bytes, CTLFLAG_RW, &bio_max_bytes, 0,
+            "Memory budget of the buffer cache in bytes.");
+
+SYSCTL_UINT(_vfs_bio, OID_AUTO, cached_bytes, CTLFLAG_RD,
+            ((unsigned *)&bio_cached_bytes), 0,
+            "Amount of memory currently used by the buffer cache.");
+
+static unsigned bio_hits;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, hits, CTLFLAG_RD, &bio_hits, 0,
+            "Number of getblk() calls that found the block in the cache.");
+
+static unsigned bio_misses;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, misses, CTLFLAG_RD, &bio_misses, 0,
+            "Number of getblk() calls that created a new buffer.");
+
+static unsigned bio_evictions;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, evictions, CTLFLAG_RD, &bio_evictions, 0,
+            "Number of buffers evicted from the cache.");
+
+static unsigned bio_dirty_age_ms = 3000;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, dirty_age_ms, CTLFLAG_RW, &bio_dirty_age_ms, 0,
+            "Age of a delayed write before it's written out by the flusher.");
+
+static unsigned bio_flush_interval_ms = 1000;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, flush_interval_ms, CTLFLAG_RW,
+            &bio_flush_interval_ms, 0,
+            "Interval between flusher passes.");
+
+static unsigned bio_flush_bufs;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, flush_bufs, CTLFLAG_RD, &bio_flush_bufs, 0,
+            "Number of delayed write buffers written by the flusher.");
+
+static unsigned bio_flush_writes;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, flush_writes, CTLFLAG_RD, &bio_flush_writes, 0,
+            "Number of device writes issued by the flusher.");
+
+static unsigned bio_ra_issued;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, ra_issued, CTLFLAG_RD, &bio_ra_issued, 0,
+            "Number of read-ahead requests issued.");
+
+static unsigned bio_ra_hits;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, ra_hits, CTLFLAG_RD, &bio_ra_hits, 0,
+            "Number of read-ahead blocks used before released.");
+
+static unsigned bio_ra_wasted;
+SYSCTL_UINT(_vfs_bio, OID_AUTO, ra_wasted, CTLFLAG_RD, &bio_ra_wasted, 0,
+            "Number of read-ahead blocks freed without ever being used.");
+
+static struct buf * bio_find_or_create(vnode_t * vnode, size_t blkno,
+                                       size_t size, int clear, int * created);
 static void _bio_readin(struct buf * bp);
 static void _bio_writeout(struct buf * bp);
+static void bl_wakeup(struct buf * bp);
+static void bl_sleep(struct buf * bp, long timeout);
+static void bl_biodone(struct buf * bp);
 static void bl_brelse(struct buf * bp);
+static void bio_start(struct buf * bp);
+static void bio_evict(size_t target);
+static void bio_flush(unsigned age_ms);
 static int biowait_timo(struct buf * bp, long timeout);
-static void bio_clean(uintptr_t freebufs);
-
-SPLAY_GENERATE(bufhd_splay, buf, sentry_, biobuf_compar);
+static struct buf * bio_getblk(vnode_t * vnode, size_t blkno, size_t size,
+                               int clear);
+static void bio_clean(uintptr_t arg);
 
 /* Init bio, called by vralloc_init() */
 void _bio_init(void)
 {
-    cache_lock.pri.p_lock = NICE_MIN;
+    for (size_t i = 0; i < num_elem(bio_hash); i++) {
+        mtx_init(&bio_hash[i].lock, MTX_TYPE_ADAPTIVE, 0);
+        LIST_INIT(&bio_hash[i].head);
+    }
 }
 
-/*
- * Comparator for buffer splay trees.
+/**
+ * Get the hash bucket of a block.
+ * blkno is usually a byte offset so the low bits are mixed in as well.
+ */
+static struct bio_bucket * bio_hash_bucket(vnode_t * vnode, size_t blkno)
+{
+    uint32_t h;
+
+    h = (uint32_t)(uintptr_t)vnode ^ (uint32_t)blkno ^ ((uint32_t)blkno >> 9);
+    h *= 2654435761u;
+
+    return &bio_hash[(h >> 24) & (BIO_HASH_SIZE - 1)];
+}
+
+/**
+ * Find a buffer from a locked bucket.
  */
-int biobuf_compar(struct buf * a, struct buf * b)
+static struct buf * bucket_find(struct bio_bucket * bucket, vnode_t * vnode,
+                                size_t blkno)
 {
-    KASSERT(a->b_file.vnode == b->b_file.vnode,
-            "vnodes differ in the same tree");
+    struct buf * bp;
+
+    LIST_FOREACH(bp, &bucket->head, hash_entry_) {
+        if (bp->b_file.vnode == vnode && bp->b_blkno == blkno)
+            return bp;
+    }
+
+    return NULL;
+}
 
-    return (a->b_blkno - b->b_blkno);
+/**
+ * Update the amount of memory used by the cache.
+ */
+static void bio_account(ssize_t diff)
+{
+    mtx_lock(&lru_lock);
+    bio_cached_bytes += diff;
+    mtx_unlock(&lru_lock);
 }
 
 int bread(vnode_t * vnode, size_t blkno, int size, struct buf ** bpp)
 {
     struct buf * bp;
+    int err = 0;
 
-    bp = getblk(vnode, blkno, size, 0);
+    bp = bio_getblk(vnode, blkno, size, 0);
     if (!bp)
         return -ENOMEM;
 
     BUF_LOCK(bp);
-    _bio_readin(bp);
+    if (bp->b_flags & B_RAHEAD) {
+        bp->b_flags &= ~B_RAHEAD;
+        bio_ra_hits++;
+    }
+    if (!(bp->b_flags & B_CACHE)) {
+        bp->b_flags &= ~(B_DONE | B_ERROR);
+        bp->b_flags |= B_READ;
+        bp->b_error = 0;
+        _bio_readin(bp);
+        bl_biodone(bp);
+    }
+    if (bp->b_flags & B_ERROR)
+        err = (bp->b_error) ? bp->b_error : -EIO;
     BUF_UNLOCK(bp);
 
     bp->b_bcount = size;
     *bpp = bp;
 
-    return 0;
+    return err;
+}
+
+/**
+ * Start a read-ahead of a block.
+ * The read-ahead is skipped if the block is already in core because then
+ * it's either cached or someone is using it.
+ */
+static void bio_readahead(vnode_t * vnode, size_t blkno, int size)
+{
+    struct buf * bp;
+    int created;
+
+    bp = bio_find_or_create(vnode, blkno, size, 0, &created);
+    if (!bp)
+        return;
+    if (!created) {
+        atomic_dec(&bp->b_wanted);
+        return;
+    }
+
+    BUF_LOCK(bp);
+    bp->b_flags &= ~(B_DONE | B_ERROR);
+    bp->b_flags |= B_READ | B_ASYNC | B_RAHEAD;
+    bp->b_error = 0;
+    BUF_UNLOCK(bp);
+
+    bio_ra_issued++;
+    bio_start(bp);
 }
 
-int  breadn(vnode_t * vnode, size_t blkno, int size, size_t rablks[],
-            int rasizes[], int nrablks, struct buf ** bpp)
+int breadn(vnode_t * vnode, size_t blkno, int size, size_t rablks[],
+           int rasizes[], int nrablks, struct buf ** bpp)
 {
-    /* TODO */
-    return -ENOTSUP;
+    /*
+     * Start the read-ahead first so the device has work queued while we are
+     * waiting for the requested block.
+     */
+    for (int i = 0; i < nrablks; i++) {
+        bio_readahead(vnode, rablks[i], rasizes[i]);
+    }
+
+    return bread(vnode, blkno, size, bpp);
 }
 
 void bio_readin(struct buf * bp)
@@ -111,35 +318,76 @@ void bio_readin(struct buf * bp)
     BUF_UNLOCK(bp);
 }
 
+/**
+ * Get the file that should be used for I/O on a buffer.
+ */
+static file_t * bio_iofile(struct buf * bp)
+{
+    /*
+     * If we have a separate device file associated with the buffer we should
+     * use it.
+     */
+    return (bp->b_devfile.vnode) ? &bp->b_devfile : &bp->b_file;
+}
+
+/**
+ * Get the size of the seek unit of the I/O file of a buffer.
+ * Block devices are seeked in device blocks and everything else in bytes,
+ * so b_blkno is a block number for buffers of a block device.
+ */
+static size_t bio_blkunit(struct buf * bp)
+{
+    const vnode_t * vnode = bio_iofile(bp)->vnode;
+    const struct dev_info * devnfo;
+
+    if (!vnode || !S_ISBLK(vnode->vn_mode))
+        return 1;
+
+    devnfo = (struct dev_info *)vnode->vn_specinfo;
+    return (devnfo && devnfo->block_size > 0) ? devnfo->block_size : 1;
+}
+
+/*
+ * The caller is responsible for B_DONE.
+ */
 static void _bio_readin(struct buf * bp)
 {
     file_t * file;
     vnode_t * vnode;
     struct uio uio;
+    ssize_t retval;
 
     KASSERT(mtx_test(&bp->lock), "bp should be locked\n");
 
-    /*
-     * If we have a separate device file associated with the buffer we should
-     * use it.
-     */
-    if (bp->b_devfile.vnode) {
-        file = &bp->b_devfile;
-    } else {
-        file = &bp->b_file;
-    }
+    file = bio_iofile(bp);
     vnode = file->vnode;
 
-    bp->b_flags &= ~B_DONE;
+    /* The vnode was destroyed by bio_vnode_cleanup(). */
+    if (!vnode) {
+        bp->b_flags |= B_ERROR;
+        bp->b_error = -EIO;
+        return;
+    }
 
     if (uio_buf2kuio(bp, &uio)) {
-        /* TODO Error handling */
+        bp->b_flags |= B_ERROR;
+        bp->b_error = -EINVAL;
         return;
     }
     vnode->vnode_ops->lseek(file, bp->b_blkno, SEEK_SET);
-    vnode->vnode_ops->read(file, &uio, bp->b_bcount);
+    retval = vnode->vnode_ops->read(file, &uio, bp->b_bcount);
+    if (retval < 0) {
+        bp->b_flags |= B_ERROR;
+        bp->b_error = retval;
+        bp->b_flags &= ~B_CACHE;
+        retval = 0;
+    } else {
+        bp->b_flags |= B_CACHE;
+    }
 
-    bp->b_flags |= B_DONE;
+    /* The buffer isn't zeroed on creation so don't leave old data in it. */
+    if ((size_t)retval < bp->b_bufsize)
+        memset((void *)(bp->b_data + retval), 0, bp->b_bufsize - retval);
 }
 
 void bio_writeout(struct buf * bp)
@@ -149,46 +397,203 @@ void bio_writeout(struct buf * bp)
     BUF_UNLOCK(bp);
 }
 
+/**
+ * Write a range of a buffer to its file.
+ */
+static ssize_t bio_write_range(struct buf * bp, file_t * file, size_t off,
+                               size_t len)
+{
+    vnode_t * vnode = file->vnode;
+    struct uio uio;
+
+    if (uio_init_kbuf(&uio, (void *)(bp->b_data + off), len))
+        return -EINVAL;
+    vnode->vnode_ops->lseek(file, bp->b_blkno + off / bio_blkunit(bp),
+                            SEEK_SET);
+    return vnode->vnode_ops->write(file, &uio, len);
+}
+
+/**
+ * Write a range of a demand paged buffer to its file.
+ * Pages that were never read from the file can't be dirty and they are
+ * skipped.
+ */
+static ssize_t bio_write_filled(struct buf * bp, file_t * file, size_t off,
+                                size_t len)
+{
+    const size_t end = off + len;
+    const size_t mapsize = BUF_PAGEMAP_SIZE(bp);
+    size_t run_start = end;
+    size_t pg_off = off & ~(MMU_PGSIZE_COARSE - 1);
+
+    while (pg_off < end) {
+        const size_t pg = pg_off / MMU_PGSIZE_COARSE;
+        const size_t next = pg_off + MMU_PGSIZE_COARSE;
+        const int ready = bitmap_status(bp->b_fill_map, pg, mapsize) == 0;
+
+        if (ready && run_start == end)
+            run_start = max(pg_off, off);
+        if (run_start != end && (!ready || next >= end)) {
+            const size_t run_end = ready ? end : pg_off;
+            ssize_t retval;
+
+            retval = bio_write_range(bp, file, run_start, run_end - run_start);
+            if (retval < 0)
+                return retval;
+            run_start = end;
+        }
+        pg_off = next;
+    }
+
+    return len;
+}
+
 /*
  * It's a good idea to have lock on bp before calling this function.
+ * The caller is responsible for B_DONE.
  */
 static void _bio_writeout(struct buf * bp)
 {
     file_t * file;
-    vnode_t * vnode;
-    struct uio uio;
+    size_t off, len;
+    ssize_t retval;
 
     KASSERT(mtx_test(&bp->lock), "bp should be locked\n");
 
     if (bp->b_flags & B_NOSYNC)
-        goto out;
+        return;
 
-    /*
-     * If we have a separate device file associated with the buffer we should
-     * use it.
-     */
-    if (bp->b_devfile.vnode) {
-        file = &bp->b_devfile;
+    file = bio_iofile(bp);
+    if (!file->vnode) {
+        /* The vnode was destroyed by bio_vnode_cleanup(). */
+        bp->b_flags |= B_ERROR;
+        bp->b_error = -EIO;
+        return;
+    }
+
+    /* Write only the dirty range if it's known. */
+    if (bp->b_dirtyend > bp->b_dirtyoff) {
+        off = bp->b_dirtyoff;
+        len = bp->b_dirtyend - bp->b_dirtyoff;
     } else {
-        file = &bp->b_file;
+        off = 0;
+        len = bp->b_bcount;
     }
-    vnode = file->vnode;
 
-    if (uio_buf2kuio(bp, &uio)) {
-        /* TODO Error handling */
+    if (bp->b_fill_map) {
+        retval = bio_write_filled(bp, file, off, len);
+    } else {
+        retval = bio_write_range(bp, file, off, len);
+    }
+    if (retval < 0) {
+        bp->b_flags |= B_ERROR;
+        bp->b_error = retval;
+    } else {
+        bp->b_flags |= B_CACHE;
+        bp->b_dirtyoff = 0;
+        bp->b_dirtyend = 0;
+    }
+}
+
+void bio_setdirty(struct buf * bp, size_t off, size_t len)
+{
+    const size_t unit = bio_blkunit(bp);
+    size_t end = off + len;
+
+    /* A block device can only be written in whole blocks. */
+    if (unit > 1) {
+        off -= off % unit;
+        end = (end + unit - 1) / unit * unit;
+    }
+    end = imin(end, bp->b_bcount);
+    if (off >= end)
         return;
+
+    BUF_LOCK(bp);
+    if (bp->b_dirtyend > bp->b_dirtyoff) {
+        bp->b_dirtyoff = imin(bp->b_dirtyoff, off);
+        bp->b_dirtyend = imax(bp->b_dirtyend, end);
+    } else {
+        bp->b_dirtyoff = off;
+        bp->b_dirtyend = end;
     }
-    vnode->vnode_ops->lseek(file, bp->b_blkno, SEEK_SET);
-    vnode->vnode_ops->write(file, &uio, bp->b_bcount);
+    BUF_UNLOCK(bp);
+}
 
-out:
-    bp->b_flags |= B_DONE;
+/**
+ * bio worker thread.
+ * Serves the async I/O queue and completes the requests with biodone().
+ */
+static void * bio_worker(void * arg)
+{
+    while (1) {
+        struct buf * bp;
+
+        /*
+         * The worker is blocked while holding the queue lock, so a request
+         * queued by bio_start() after the check releases it.
+         */
+        mtx_lock(&bio_queue_lock);
+        bp = TAILQ_FIRST(&bio_queue);
+        if (bp) {
+            TAILQ_REMOVE(&bio_queue, bp, bioq_entry_);
+        } else {
+            bio_worker_idle = 1;
+            thread_block();
+        }
+        mtx_unlock(&bio_queue_lock);
+
+        if (bp) {
+            BUF_LOCK(bp);
+            if (bp->b_flags & B_READ) {
+                _bio_readin(bp);
+            } else {
+                _bio_writeout(bp);
+            }
+            bl_biodone(bp);
+            BUF_UNLOCK(bp);
+            continue;
+        }
+
+        thread_wait_blocked();
+    }
+
+    return NULL;
+}
+
+/**
+ * Start an async I/O request.
+ * B_READ selects the direction of the transfer. The I/O is done
+ * synchronously if the bio worker is not running.
+ */
+static void bio_start(struct buf * bp)
+{
+    if (bio_worker_tid < 0) {
+        BUF_LOCK(bp);
+        if (bp->b_flags & B_READ) {
+            _bio_readin(bp);
+        } else {
+            _bio_writeout(bp);
+        }
+        bl_biodone(bp);
+        BUF_UNLOCK(bp);
+        return;
+    }
+
+    mtx_lock(&bio_queue_lock);
+    TAILQ_INSERT_TAIL(&bio_queue, bp, bioq_entry_);
+    if (bio_worker_idle) {
+        bio_worker_idle = 0;
+        thread_release(bio_worker_tid);
+    }
+    mtx_unlock(&bio_queue_lock);
 }
 
 int bwrite(struct buf * bp)
 {
     unsigned flags;
     vnode_t * vnode;
+    int err;
 
     KASSERT(bp, "bp != NULL\n");
 
@@ -206,24 +611,29 @@ int bwrite(struct buf * bp)
 
     BUF_LOCK(bp);
     flags = bp->b_flags;
-    bp->b_flags &= ~(B_DONE | B_ERROR | B_ASYNC | B_DELWRI);
+    bp->b_flags &= ~(B_DONE | B_ERROR | B_ASYNC | B_DELWRI | B_READ);
     bp->b_flags |= B_BUSY;
     bp->b_error = 0;
     BUF_UNLOCK(bp);
 
-    /* TODO Use dirty offsets */
     if (flags & B_ASYNC) {
-        /* TODO */
-
-        return 0;
-    } else {
         BUF_LOCK(bp);
-        _bio_writeout(bp);
-        bp->b_flags &= ~B_BUSY;
+        bp->b_flags |= B_ASYNC;
         BUF_UNLOCK(bp);
+
+        bio_start(bp);
+
+        return 0;
     }
 
-    return 0;
+    BUF_LOCK(bp);
+    _bio_writeout(bp);
+    bl_biodone(bp);
+    err = (bp->b_flags & B_ERROR) ? bp->b_error : 0;
+    bl_brelse(bp);
+    BUF_UNLOCK(bp);
+
+    return err;
 }
 
 void bawrite(struct buf * bp)
@@ -237,7 +647,10 @@ void bawrite(struct buf * bp)
 void bdwrite(struct buf * bp)
 {
     BUF_LOCK(bp);
+    if (!(bp->b_flags & B_DELWRI))
+        bp->b_dirtytime = get_utime();
     bp->b_flags |= B_DELWRI;
+    bl_brelse(bp);
     BUF_UNLOCK(bp);
 }
 
@@ -248,13 +661,15 @@ void bio_clrbuf(struct buf * bp)
     KASSERT(bp, "bp != NULL\n");
 
     BUF_LOCK(bp);
-
     flags = bp->b_flags;
+    BUF_UNLOCK(bp);
 
-    if (flags & B_DELWRI) {
-        _bio_writeout(bp);
-    } else if (flags & B_ASYNC) {
+    if (flags & B_ASYNC)
         biowait(bp);
+
+    BUF_LOCK(bp);
+    if (bp->b_flags & B_DELWRI) {
+        _bio_writeout(bp);
     }
     bp->b_flags &= ~(B_DELWRI | B_ERROR);
     bp->b_flags |= B_BUSY;
@@ -264,16 +679,28 @@ void bio_clrbuf(struct buf * bp)
 
     BUF_LOCK(bp);
     bp->b_flags &= ~B_BUSY;
+    bl_wakeup(bp);
     BUF_UNLOCK(bp);
 }
 
+/**
+ * Create a new busy buffer for a block.
+ * The buffer is not inserted to the cache.
+ * @param clear should be set unless the buffer is going to be read in.
+ */
 static struct buf * create_blk(vnode_t * vnode, size_t blkno, size_t size,
-                               int slptimeo)
+                               int clear)
 {
-    struct buf * bp = geteblk(size);
+    struct buf * (*alloc)(size_t) = (clear) ? geteblk : geteblk_noclear;
+    struct buf * bp = alloc(size);
 
-    if (!bp)
-        return NULL;
+    if (!bp) {
+        /* Try to make some room by dropping everything we can. */
+        bio_evict(0);
+        bp = alloc(size);
+        if (!bp)
+            return NULL;
+    }
 
     bp->b_blkno = blkno;
 
@@ -294,88 +721,145 @@ static struct buf * create_blk(vnode_t * vnode, size_t blkno, size_t size,
         bp->b_devfile.vnode = NULL;
     }
 
-    bp->b_flags |= B_DONE;
-    bp->b_flags &= ~B_BUSY; /* Unbusy for now */
+    SLIST_INIT(&bp->b_waiters);
+    bp->b_wanted = ATOMIC_INIT(0);
+    bp->b_flags |= B_DONE | B_BUSY;
+    bp->b_flags &= ~B_CACHE;
 
-    VN_LOCK(vnode);
+    return bp;
+}
 
-    /* Put to the buffer splay tree of the vnode. */
-    if (SPLAY_INSERT(bufhd_splay, &vnode->vn_bpo.sroot, bp))
-        panic("Double insert");
+/**
+ * Find a buffer from the cache or insert a new one.
+ * @param clear tells if a new buffer should be zeroed.
+ * @param[out] created is set if a new buffer was created.
+ * @return  Returns a new busy buffer or an existing buffer with b_wanted
+ *          incremented; NULL if out of memory.
+ */
+static struct buf * bio_find_or_create(vnode_t * vnode, size_t blkno,
+                                       size_t size, int clear, int * created)
+{
+    struct bio_bucket * bucket = bio_hash_bucket(vnode, blkno);
+    struct buf * bp;
+    struct buf * nbp;
+
+    *created = 0;
+
+    mtx_lock(&bucket->lock);
+    bp = bucket_find(bucket, vnode, blkno);
+    if (bp) {
+        atomic_inc(&bp->b_wanted);
+        mtx_unlock(&bucket->lock);
+        bio_hits++;
+        return bp;
+    }
+    mtx_unlock(&bucket->lock);
 
+    bio_misses++;
+    if (bio_cached_bytes + size > bio_max_bytes) {
+        bio_evict(bio_max_bytes - imin(size, bio_max_bytes));
+
+        /* Dirty buffers can't be evicted before they are written. */
+        if (bio_cached_bytes + size > bio_max_bytes && bio_flusher_tid >= 0) {
+            bio_flush_urgent = 1;
+            thread_release(bio_flusher_tid);
+        }
+    }
+
+    nbp = create_blk(vnode, blkno, size, clear);
+    if (!nbp)
+        return NULL;
+
+    mtx_lock(&bucket->lock);
+    bp = bucket_find(bucket, vnode, blkno);
+    if (bp) {
+        /* Someone else was faster. */
+        atomic_inc(&bp->b_wanted);
+        mtx_unlock(&bucket->lock);
+        vrfree(nbp);
+        return bp;
+    }
+    LIST_INSERT_HEAD(&bucket->head, nbp, hash_entry_);
+    mtx_unlock(&bucket->lock);
+
+    VN_LOCK(vnode);
+    LIST_INSERT_HEAD(&vnode->vn_bpo.lhead, nbp, vnode_entry_);
     VN_UNLOCK(vnode);
 
-    return bp;
+    bio_account(nbp->b_bufsize);
+    *created = 1;
+
+    return nbp;
 }
 
 struct buf * getblk(vnode_t * vnode, size_t blkno, size_t size, int slptimeo)
+{
+    return bio_getblk(vnode, blkno, size, 1);
+}
+
+/**
+ * Get a block.
+ * @param clear tells if a new buffer should be zeroed; The caller must read
+ *              in the buffer if this is not set.
+ */
+static struct buf * bio_getblk(vnode_t * vnode, size_t blkno, size_t size,
+                               int clear)
 {
     struct buf * bp;
+    size_t old_size;
+    int created;
 
     if (!vnode)
         return NULL;
 
-    /* For now we want to synchronize access to this function. */
-    mtx_lock(&cache_lock);
-
-    bp = incore(vnode, blkno);
-    if (!bp) { /* Not found, create a new buffer. */
-        bp = create_blk(vnode, blkno, size, slptimeo);
-        if (!bp)
-            goto fail;
-    }
+    bp = bio_find_or_create(vnode, blkno, size, clear, &created);
+    if (!bp || created)
+        return bp;
 
     /* Found */
-retry:
     biowait(bp); /* Wait until I/O has completed. */
 
-    /*
-     * Wait until the buffer is released. It is possible that we don't get it
-     * locked for us on first try, so we just keep trying until it's not set
-     * busy by some other thread.
-     */
-    while (bp->b_flags & B_BUSY)
-        thread_yield(THREAD_YIELD_LAZY);
+    /* Sleep until the buffer is released by brelse(). */
     BUF_LOCK(bp);
-    if (bp->b_flags & B_BUSY) {
-        BUF_UNLOCK(bp);
-        goto retry;
+    while (bp->b_flags & B_BUSY) {
+        bl_sleep(bp, 0);
     }
     bp->b_flags |= B_BUSY;
-    /* Remove from the released list. */
-    TAILQ_REMOVE(&relse_list, bp, relse_entry_);
+    /* Remove from the LRU list. */
+    if (bp->b_flags & B_RELSE) {
+        mtx_lock(&lru_lock);
+        TAILQ_REMOVE(&bio_lru, bp, relse_entry_);
+        bp->b_flags &= ~B_RELSE;
+        mtx_unlock(&lru_lock);
+    }
     BUF_UNLOCK(bp);
+    atomic_dec(&bp->b_wanted);
 
+    old_size = bp->b_bufsize;
     allocbuf(bp, size); /* Resize if necessary */
+    if (bp->b_bufsize != old_size)
+        bio_account((ssize_t)bp->b_bufsize - (ssize_t)old_size);
 
     BUF_LOCK(bp);
     bp->b_flags &= ~B_ERROR;
     bp->b_error = 0;
     BUF_UNLOCK(bp);
 
-fail:
-    mtx_unlock(&cache_lock);
-
     return bp;
 }
 
 struct buf * incore(vnode_t * vnode, size_t blkno)
 {
-    struct bufhd * bf;
+    struct bio_bucket * bucket;
     struct buf * bp;
-    struct buf find;
 
     if (!vnode)
         return NULL;
 
-    bf = &vnode->vn_bpo;
-
-    if (SPLAY_EMPTY(&bf->sroot))
-        return NULL;
-
-    find.b_file.vnode = vnode;
-    find.b_blkno = blkno;
-    bp = SPLAY_FIND(bufhd_splay, &bf->sroot, &find);
+    bucket = bio_hash_bucket(vnode, blkno);
+    mtx_lock(&bucket->lock);
+    bp = bucket_find(bucket, vnode, blkno);
+    mtx_unlock(&bucket->lock);
 
     return bp;
 }
@@ -385,10 +869,19 @@ static void bl_brelse(struct buf * bp)
     KASSERT(mtx_test(&bp->lock), "Lock is required.");
 
     bp->b_flags &= ~B_BUSY;
+    bl_wakeup(bp);
 
-    mtx_lock(&cache_lock);
-    TAILQ_INSERT_TAIL(&relse_list, bp, relse_entry_);
-    mtx_unlock(&cache_lock);
+    if (!(bp->b_flags & B_RELSE)) {
+        mtx_lock(&lru_lock);
+        if (bp->b_flags & B_INVAL) {
+            /* Not cached anymore, free as soon as possible. */
+            TAILQ_INSERT_HEAD(&bio_lru, bp, relse_entry_);
+        } else {
+            TAILQ_INSERT_TAIL(&bio_lru, bp, relse_entry_);
+        }
+        bp->b_flags |= B_RELSE;
+        mtx_unlock(&lru_lock);
+    }
 }
 
 void brelse(struct buf * bp)
@@ -398,27 +891,124 @@ void brelse(struct buf * bp)
     BUF_UNLOCK(bp);
 }
 
-void biodone(struct buf * bp)
+/**
+ * Wake up all threads sleeping on a locked buffer.
+ */
+static void bl_wakeup(struct buf * bp)
+{
+    struct bio_waiter * waiter;
+
+    KASSERT(mtx_test(&bp->lock), "Lock is required.");
+
+    mtx_lock(&bio_wq_lock);
+    while ((waiter = SLIST_FIRST(&bp->b_waiters))) {
+        SLIST_REMOVE_HEAD(&bp->b_waiters, entry_);
+        waiter->linked = 0;
+        thread_release(waiter->tid);
+    }
+    mtx_unlock(&bio_wq_lock);
+}
+
+/**
+ * Sleep on a locked buffer until bl_wakeup() is called.
+ * The lock is released while sleeping. The waiter is queued and the thread
+ * is blocked before the buffer is unlocked, so a wakeup can't be missed.
+ * @param timeout is the timeout in ms; 0 = no timeout.
+ */
+static void bl_sleep(struct buf * bp, long timeout)
 {
+    struct bio_waiter waiter = {
+        .tid = current_thread->id,
+        .linked = 1,
+    };
+    int timer_id = -1;
+
+    KASSERT(mtx_test(&bp->lock), "Lock is required.");
+
+    /*
+     * The buffer is unlocked before bio_wq_lock so the thread can't be
+     * preempted while it's blocked and holding the buffer lock.
+     */
+    mtx_lock(&bio_wq_lock);
+    SLIST_INSERT_HEAD(&bp->b_waiters, &waiter, entry_);
+    thread_block();
+    if (timeout > 0) {
+        timer_id = thread_alarm(timeout);
+        if (timer_id < 0)
+            thread_release(current_thread->id); /* Retry soon. */
+    }
+    BUF_UNLOCK(bp);
+    mtx_unlock(&bio_wq_lock);
+
+    thread_wait_blocked();
+    if (timer_id >= 0)
+        thread_alarm_rele(timer_id);
+
     BUF_LOCK(bp);
+    mtx_lock(&bio_wq_lock);
+    if (waiter.linked)
+        SLIST_REMOVE(&bp->b_waiters, &waiter, bio_waiter, entry_);
+    mtx_unlock(&bio_wq_lock);
+}
 
-    KASSERT(bp->b_flags & B_DONE, "dup biodone");
+/**
+ * Mark I/O complete on a locked buffer.
+ */
+static void bl_biodone(struct buf * bp)
+{
+    KASSERT(mtx_test(&bp->lock), "Lock is required.");
+    KASSERT(!(bp->b_flags & B_DONE), "dup biodone");
 
     bp->b_flags |= B_DONE;
+    bp->b_flags &= ~B_READ;
+
+    bl_wakeup(bp);
 
-    if (bp->b_flags & B_ASYNC)
+    if (bp->b_flags & B_ASYNC) {
+        bp->b_flags &= ~B_ASYNC;
         bl_brelse(bp);
+    }
+}
 
+void biodone(struct buf * bp)
+{
+    BUF_LOCK(bp);
+    bl_biodone(bp);
     BUF_UNLOCK(bp);
 }
 
+/**
+ * Wait for I/O completion on a buffer.
+ * @param timeout is the timeout in ms; 0 = no timeout.
+ * @return Returns 0 if IO was complete; -ETIMEDOUT if timed out;
+ *         Otherwise a negative errno of the I/O error.
+ */
 static int biowait_timo(struct buf * bp, long timeout)
 {
-    /* TODO timeout */
+    const uint64_t deadline = get_utime() + (uint64_t)timeout * 1000;
+    int err = 0;
+
+    BUF_LOCK(bp);
+    while (!(bp->b_flags & B_DONE)) {
+        long wait_ms = 0;
+
+        if (timeout > 0) {
+            const uint64_t now = get_utime();
 
-    while (!(bp->b_flags & B_DONE));
+            if (now >= deadline) {
+                err = -ETIMEDOUT;
+                break;
+            }
+            wait_ms = (long)((deadline - now) / 1000) + 1;
+        }
+
+        bl_sleep(bp, wait_ms);
+    }
+    if (!err && (bp->b_flags & B_ERROR))
+        err = (bp->b_error) ? bp->b_error : -EIO;
+    BUF_UNLOCK(bp);
 
-    return bp->b_error;
+    return err;
 }
 
 int biowait(struct buf * bp)
@@ -427,52 +1017,371 @@ int biowait(struct buf * bp)
 }
 
 /**
- * Cleanup released buffers.
- * @param freebufs  tells if released buffers should be freed after write out.
+ * Free a buffer that has been removed from the cache.
+ * The vnode of the buffer is cleared by bio_vnode_cleanup() if the vnode is
+ * going away.
+ */
+static void bio_free(struct buf * bp)
+{
+    vnode_t * vnode;
+
+    BUF_LOCK(bp);
+    vnode = bp->b_file.vnode;
+    BUF_UNLOCK(bp);
+
+    if (vnode) {
+        VN_LOCK(vnode);
+        if (bp->vnode_entry_.le_prev) {
+            LIST_REMOVE(bp, vnode_entry_);
+            bp->vnode_entry_.le_prev = NULL;
+        }
+        VN_UNLOCK(vnode);
+    }
+
+    vrfree(bp);
+}
+
+/**
+ * Evict released buffers in LRU order.
+ * Buffers already invalidated are always freed.
+ * @param target is the target size of the cache in bytes.
  */
-static void bio_clean(uintptr_t freebufs)
+static void bio_evict(size_t target)
 {
+    struct bio_lru_head evicted = TAILQ_HEAD_INITIALIZER(evicted);
     struct buf * bp;
     struct buf * bp_tmp;
 
-    if (mtx_trylock(&cache_lock))
-        return; /* Don't enter if we don't get exclusive access. */
+    mtx_lock(&lru_lock);
+    TAILQ_FOREACH_SAFE(bp, &bio_lru, relse_entry_, bp_tmp) {
+        if (bio_cached_bytes <= target && !(bp->b_flags & B_INVAL))
+            break;
 
-    TAILQ_FOREACH_SAFE(bp, &relse_list, relse_entry_, bp_tmp) {
-        file_t * file;
-
-        /* Skip if already locked or BUSY */
-        if (mtx_trylock(&bp->lock) || (bp->b_flags & B_BUSY))
+        if (mtx_trylock(&bp->lock))
+            continue;
+        if ((bp->b_flags & (B_BUSY | B_LOCKED | B_DELWRI)) ||
+            atomic_read(&bp->b_wanted) > 0) {
+            BUF_UNLOCK(bp);
             continue;
+        }
 
-        file = &bp->b_file;
+        if (!(bp->b_flags & B_INVAL)) {
+            struct bio_bucket * bucket;
+
+            bucket = bio_hash_bucket(bp->b_file.vnode, bp->b_blkno);
+            if (mtx_trylock(&bucket->lock)) {
+                BUF_UNLOCK(bp);
+                continue;
+            }
+            /* getblk() increments b_wanted only under the bucket lock. */
+            if (atomic_read(&bp->b_wanted) > 0) {
+                mtx_unlock(&bucket->lock);
+                BUF_UNLOCK(bp);
+                continue;
+            }
+            LIST_REMOVE(bp, hash_entry_);
+            bp->b_flags |= B_INVAL;
+            mtx_unlock(&bucket->lock);
+        }
 
-        /* Write out if delayed write was set. */
-        if (bp->b_flags & B_DELWRI) {
-            bp->b_flags |= B_BUSY;
-            bp->b_flags &= ~B_ASYNC;
+        TAILQ_REMOVE(&bio_lru, bp, relse_entry_);
+        bp->b_flags &= ~B_RELSE;
+        bio_cached_bytes -= bp->b_bufsize;
+        bio_evictions++;
+        if (bp->b_flags & B_RAHEAD)
+            bio_ra_wasted++;
+        BUF_UNLOCK(bp);
 
-            _bio_writeout(bp);
+        TAILQ_INSERT_TAIL(&evicted, bp, relse_entry_);
+    }
+    mtx_unlock(&lru_lock);
+
+    while ((bp = TAILQ_FIRST(&evicted))) {
+        TAILQ_REMOVE(&evicted, bp, relse_entry_);
+        bio_free(bp);
+    }
+}
+
+/**
+ * Get the start offset of the dirty range of a buffer on its I/O file.
+ * @return Returns the offset in bytes.
+ */
+static size_t bio_dirty_start(struct buf * bp)
+{
+    return bp->b_blkno * bio_blkunit(bp) +
+        ((bp->b_dirtyend > bp->b_dirtyoff) ? bp->b_dirtyoff : 0);
+}
+
+/**
+ * Get the end offset of the dirty range of a buffer on its I/O file.
+ * @return Returns the offset in bytes.
+ */
+static size_t bio_dirty_end(struct buf * bp)
+{
+    return bp->b_blkno * bio_blkunit(bp) +
+        ((bp->b_dirtyend > bp->b_dirtyoff) ? bp->b_dirtyend : bp->b_bcount);
+}
+
+/**
+ * Sort buffers by the I/O file and the dirty range start.
+ */
+static void bio_sort_bufs(struct buf ** bufs, size_t n)
+{
+    for (size_t i = 1; i < n; i++) {
+        struct buf * bp = bufs[i];
+        const vnode_t * vn = bio_iofile(bp)->vnode;
+        const size_t start = bio_dirty_start(bp);
+        size_t j = i;
+
+        while (j > 0) {
+            struct buf * prev = bufs[j - 1];
+            const vnode_t * pvn = bio_iofile(prev)->vnode;
+
+            if (pvn < vn || (pvn == vn && bio_dirty_start(prev) <= start))
+                break;
+            bufs[j] = prev;
+            j--;
         }
+        bufs[j] = bp;
+    }
+}
 
-        if (freebufs &&
-            !(bp->b_flags & B_LOCKED) &&
-            !VN_TRYLOCK(file->vnode)) {
-            SPLAY_REMOVE(bufhd_splay, &file->vnode->vn_bpo.sroot, bp);
-            TAILQ_REMOVE(&relse_list, bp, relse_entry_);
-            vrfree(bp);
-            VN_UNLOCK(file->vnode);
-        } else {
-            bp->b_flags &= ~B_BUSY;
+/**
+ * Write a cluster of buffers with contiguous dirty ranges with a single
+ * device write.
+ * The buffers must be busy.
+ * @return 0 if succeed; Otherwise a negative errno.
+ */
+static int bio_write_cluster(struct buf ** bufs, size_t n)
+{
+    file_t * file = bio_iofile(bufs[0]);
+    vnode_t * vnode = file->vnode;
+    const size_t start = bio_dirty_start(bufs[0]);
+    const size_t size = bio_dirty_end(bufs[n - 1]) - start;
+    const size_t unit = bio_blkunit(bufs[0]);
+    uint8_t * cbuf;
+    struct uio uio;
+    ssize_t retval;
+
+    cbuf = kmalloc(size);
+    if (!cbuf)
+        return -ENOMEM;
+
+    for (size_t i = 0; i < n; i++) {
+        struct buf * bp = bufs[i];
+        const size_t bstart = bio_dirty_start(bp);
+
+        memcpy(cbuf + (bstart - start),
+               (void *)(bp->b_data + (bstart - bp->b_blkno * unit)),
+               bio_dirty_end(bp) - bstart);
+    }
+
+    uio_init_kbuf(&uio, cbuf, size);
+    vnode->vnode_ops->lseek(file, start / unit, SEEK_SET);
+    retval = vnode->vnode_ops->write(file, &uio, size);
+    kfree(cbuf);
+
+    return (retval < 0) ? (int)retval : 0;
+}
+
+/**
+ * Write out delayed writes older than age_ms.
+ * Dirty buffers are sorted by device offset and adjacent dirty ranges on the
+ * same device are coalesced into a single larger write.
+ */
+static void bio_flush(unsigned age_ms)
+{
+    struct buf * bufs[BIO_FLUSH_MAX_BUFS];
+    const uint64_t now = get_utime();
+    size_t n = 0;
+    struct buf * bp;
+
+    /* Collect old enough dirty buffers and mark them busy. */
+    mtx_lock(&lru_lock);
+    TAILQ_FOREACH(bp, &bio_lru, relse_entry_) {
+        if (n == num_elem(bufs))
+            break;
+        if (!(bp->b_flags & B_DELWRI) ||
+            now - bp->b_dirtytime < (uint64_t)age_ms * 1000 ||
+            mtx_trylock(&bp->lock))
+            continue;
+        if ((bp->b_flags & (B_BUSY | B_DELWRI)) != B_DELWRI) {
             BUF_UNLOCK(bp);
+            continue;
         }
+        bp->b_flags |= B_BUSY;
+        BUF_UNLOCK(bp);
+        bufs[n++] = bp;
     }
+    for (size_t i = 0; i < n; i++) {
+        TAILQ_REMOVE(&bio_lru, bufs[i], relse_entry_);
+        bufs[i]->b_flags &= ~B_RELSE;
+    }
+    mtx_unlock(&lru_lock);
+
+    bio_sort_bufs(bufs, n);
+
+    for (size_t i = 0; i < n;) {
+        const vnode_t * vn = bio_iofile(bufs[i])->vnode;
+        size_t j = i + 1;
+        int err = -EINVAL;
+
+        while (j < n && vn && !(bufs[i]->b_flags & B_NOSYNC) &&
+               !(bufs[j]->b_flags & B_NOSYNC) &&
+               bio_iofile(bufs[j])->vnode == vn &&
+               bio_dirty_start(bufs[j]) == bio_dirty_end(bufs[j - 1]) &&
+               bio_dirty_end(bufs[j]) - bio_dirty_start(bufs[i]) <=
+               BIO_CLUSTER_MAX) {
+            j++;
+        }
+
+        if (j - i > 1)
+            err = bio_write_cluster(bufs + i, j - i);
+
+        for (size_t k = i; k < j; k++) {
+            bp = bufs[k];
+
+            BUF_LOCK(bp);
+            if (err == 0) {
+                bp->b_dirtyoff = 0;
+                bp->b_dirtyend = 0;
+                bp->b_flags |= B_CACHE;
+            } else {
+                /* Not clustered or the clustered write failed. */
+                bp->b_flags &= ~B_ERROR;
+                _bio_writeout(bp);
+                bio_flush_writes++;
+            }
+            /* A buffer without a vnode can't be ever written. */
+            if (!(bp->b_flags & B_ERROR) || !bio_iofile(bp)->vnode)
+                bp->b_flags &= ~B_DELWRI;
+            bl_brelse(bp);
+            BUF_UNLOCK(bp);
+        }
+        if (err == 0)
+            bio_flush_writes++;
+        bio_flush_bufs += j - i;
 
-    mtx_unlock(&cache_lock);
+        i = j;
+    }
 }
-/*
+
+/**
+ * bio flusher thread.
+ * Periodically writes out old enough delayed writes.
+ */
+static void * bio_flusher(void * arg)
+{
+    while (1) {
+        thread_sleep(bio_flush_interval_ms);
+        if (bio_flush_urgent) {
+            bio_flush_urgent = 0;
+            bio_flush(0);
+        } else {
+            bio_flush(bio_dirty_age_ms);
+        }
+    }
+
+    return NULL;
+}
+
+int bio_vnode_sync(vnode_t * vnode)
+{
+    struct {
+        size_t blkno;
+        size_t size;
+    } dirty[16];
+    int retval = 0;
+
+    while (1) {
+        struct buf * bp;
+        size_t n = 0;
+
+        VN_LOCK(vnode);
+        LIST_FOREACH(bp, &vnode->vn_bpo.lhead, vnode_entry_) {
+            if ((bp->b_flags & (B_DELWRI | B_INVAL)) != B_DELWRI)
+                continue;
+            dirty[n].blkno = bp->b_blkno;
+            dirty[n].size = bp->b_bcount;
+            if (++n == num_elem(dirty))
+                break;
+        }
+        VN_UNLOCK(vnode);
+        if (n == 0)
+            break;
+
+        for (size_t i = 0; i < n; i++) {
+            int err;
+
+            bp = getblk(vnode, dirty[i].blkno, dirty[i].size, 0);
+            if (!bp)
+                return -ENOMEM;
+            if (!(bp->b_flags & B_DELWRI)) {
+                /* Written out by the flusher meanwhile. */
+                brelse(bp);
+                continue;
+            }
+
+            /* bwrite() clears B_DELWRI even if the write fails. */
+            err = bwrite(bp);
+            if (err && !retval)
+                retval = err;
+        }
+    }
+
+    return retval;
+}
+
+void bio_vnode_cleanup(vnode_t * vnode)
+{
+    struct buf * bp;
+
+    VN_LOCK(vnode);
+    while ((bp = LIST_FIRST(&vnode->vn_bpo.lhead))) {
+        struct bio_bucket * bucket = bio_hash_bucket(vnode, bp->b_blkno);
+
+        LIST_REMOVE(bp, vnode_entry_);
+        bp->vnode_entry_.le_prev = NULL;
+
+        mtx_lock(&bucket->lock);
+        BUF_LOCK(bp);
+        if (!(bp->b_flags & B_INVAL)) {
+            LIST_REMOVE(bp, hash_entry_);
+            bp->b_flags |= B_INVAL;
+        }
+        mtx_unlock(&bucket->lock);
+
+        /*
+         * The vnode is going away. A delayed write can be still written to
+         * the device but the buffer must not refer to the vnode anymore.
+         */
+        if (!bp->b_devfile.vnode)
+            bp->b_flags &= ~B_DELWRI;
+        bp->b_file.vnode = NULL;
+
+        /* Move to the LRU head to get it freed soon. */
+        if (bp->b_flags & B_RELSE) {
+            mtx_lock(&lru_lock);
+            TAILQ_REMOVE(&bio_lru, bp, relse_entry_);
+            TAILQ_INSERT_HEAD(&bio_lru, bp, relse_entry_);
+            mtx_unlock(&lru_lock);
+        }
+        BUF_UNLOCK(bp);
+    }
+    VN_UNLOCK(vnode);
+}
+
+/**
  * Idle task for cleaning up buffers.
+ * Trims the cache to its budget and writes out delayed writes if the
+ * flusher is not running.
  */
+static void bio_clean(uintptr_t arg)
+{
+    if (bio_flusher_tid < 0)
+        bio_flush(0);
+    bio_evict(bio_max_bytes);
+}
 IDLE_TASK(bio_clean, 0);
 
 int bio_geterror(struct buf * bp)
@@ -492,3 +1401,33 @@ int bio_geterror(struct buf * bp)
 
     return error;
 }
+
+int __kinit__ bio_init(void)
+{
+    SUBSYS_DEP(sched_init);
+    SUBSYS_INIT("bio");
+
+    struct sched_param param = {
+        .sched_policy = SCHED_RR,
+        .sched_priority = NICE_MIN,
+    };
+    pthread_t tid;
+
+    tid = kthread_create("bio", &param, 0, bio_worker, NULL);
+    if (tid < 0) {
+        KERROR(KERROR_ERR, "Failed to create a thread for bio");
+        return tid;
+    }
+    bio_worker_tid = tid;
+
+    param.sched_policy = SCHED_OTHER;
+    param.sched_priority = 0;
+    tid = kthread_create("bioflush", &param, 0, bio_flusher, NULL);
+    if (tid < 0) {
+        KERROR(KERROR_ERR, "Failed to create a flusher thread for bio");
+        return tid;
+    }
+    bio_flusher_tid = tid;
+
+    return 0;
+}
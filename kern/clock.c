@@ -64,10 +64,19 @@ static void _update_time(void)
 
     KASSERT(mtx_test(&timelock), "timelock should be locked");
 
-    /* Update seconds */
-    if (utime >= sec_next) {
+    /*
+     * Update seconds.
+     * There might be more than a second between two updates if the tick is
+     * stretched by the tickless idle.
+     */
+    if (sec_next == 0) {
         uptime.tv_sec++;
         sec_next = utime + SEC_US;
+    } else if (utime >= sec_next) {
+        const uint64_t n = (utime - sec_next) / SEC_US + 1;
+
+        uptime.tv_sec += n;
+        sec_next += n * SEC_US;
     }
 
     /* Update nsecs */
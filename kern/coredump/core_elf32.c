@@ -391,8 +391,9 @@ static int create_pheaders(const struct vm_mm_struct * mm, size_t notes_size,
     return phnum;
 }
 
-static off_t dump_regions(file_t * file, const struct vm_mm_struct * mm)
+static off_t dump_regions(file_t * file, struct proc_info * proc)
 {
+    const struct vm_mm_struct * mm = &proc->mm;
     off_t err, off = 0;
 
     for (int i = 0; i < mm->nr_regions; i++) {
@@ -401,6 +402,10 @@ static off_t dump_regions(file_t * file, const struct vm_mm_struct * mm)
         if (SKIP_REGION(region))
             continue;
 
+        /* b_data must contain all pages of the region. */
+        (void)vr_cow_flush(proc, region);
+        (void)vr_fill_flush(region);
+
         err = write2file(file, (void *)region->b_data, region->b_bufsize);
         if (err != region->b_bufsize)
             return err;
@@ -434,7 +439,7 @@ int core_dump2file(struct proc_info * proc, file_t * file)
     if ((err = write_elf_header(file, phnum)) < 0 ||
         (err = write2file(file, phdr, phsize)) < 0 ||
         (err = write2file(file, notes, notes_size)) < 0 ||
-        (err = dump_regions(file, mm)) < 0) {
+        (err = dump_regions(file, proc)) < 0) {
         retval = err;
         goto out;
     }
@@ -32,8 +32,8 @@
  */
 
 #include <errno.h>
+#include <sys/queue.h>
 #include <sys/sysctl.h>
-#include <bitmap.h>
 #include <dynmem.h>
 #include <kerror.h>
 #include <klocks.h>
@@ -62,20 +62,14 @@
  */
 #define DYNMEM_MAPSIZE  ((configDYNMEM_SIZE) / DYNMEM_PAGE_SIZE)
 
-#if E2BITMAP_SIZE(DYNMEM_MAPSIZE) > 0
-#define DYNMEM_BITMAPSIZE       E2BITMAP_SIZE(DYNMEM_MAPSIZE)
-#else
-#define DYNMEM_BITMAPSIZE       1
-#endif
-
 #define SIZEOF_DYNMEMMAP        (DYNMEM_MAPSIZE * sizeof(uint32_t))
-#define SIZEOF_DYNMEMMAP_BITMAP (DYNMEM_BITMAPSIZE * sizeof(uint32_t))
 
 struct dynmem_desc {
     unsigned control    : 10;
     unsigned ap         : 3;
     unsigned rl         : 1;
-    unsigned _padding   : 2;
+    unsigned rsv        : 1; /*!< Reserved for some other use. */
+    unsigned _padding   : 1;
     unsigned refcount   : 16;
 };
 
@@ -83,7 +77,23 @@ struct dynmem_desc {
  * Dynmemmap allocation table.
  */
 static struct dynmem_desc dynmemmap[DYNMEM_MAPSIZE];
-static uint32_t dynmemmap_bitmap[DYNMEM_BITMAPSIZE];
+
+/**
+ * Buddy allocator page descriptor.
+ */
+struct dynmem_buddy {
+    LIST_ENTRY(dynmem_buddy) entry_;
+    int order; /*!< Order if the first page of a free block; Otherwise -1. */
+};
+
+LIST_HEAD(dynmem_buddy_list, dynmem_buddy);
+
+/**
+ * Buddy allocator state.
+ */
+static struct dynmem_buddy dynmem_buddies[DYNMEM_MAPSIZE];
+static struct dynmem_buddy_list dynmem_free_lists[DYNMEM_MAX_ORDER + 1];
+static int dynmem_buddy_ready;
 
 /**
  * Struct for temporary storage.
@@ -136,6 +146,37 @@ static size_t dynmem_reserved;
 SYSCTL_UINT(_vm_dynmem, OID_AUTO, reserved, CTLFLAG_RD, &dynmem_reserved, 0,
             "Amount of reserved dynmem");
 
+/**
+ * Number of free buddy blocks per order.
+ */
+static unsigned dynmem_nr_free_blocks[DYNMEM_MAX_ORDER + 1];
+
+SYSCTL_DECL(_vm_dynmem_free_blocks);
+SYSCTL_NODE(_vm_dynmem, OID_AUTO, free_blocks, CTLFLAG_RW, 0,
+            "Number of free blocks per order");
+
+#define SYSCTL_DYNMEM_FREE_BLOCKS(n)                                        \
+SYSCTL_UINT(_vm_dynmem_free_blocks, OID_AUTO, order##n, CTLFLAG_RD,        \
+            &dynmem_nr_free_blocks[n], 0,                                   \
+            "Free blocks of 2^" #n " dynmem pages")
+
+SYSCTL_DYNMEM_FREE_BLOCKS(0);
+SYSCTL_DYNMEM_FREE_BLOCKS(1);
+SYSCTL_DYNMEM_FREE_BLOCKS(2);
+SYSCTL_DYNMEM_FREE_BLOCKS(3);
+SYSCTL_DYNMEM_FREE_BLOCKS(4);
+SYSCTL_DYNMEM_FREE_BLOCKS(5);
+SYSCTL_DYNMEM_FREE_BLOCKS(6);
+SYSCTL_DYNMEM_FREE_BLOCKS(7);
+SYSCTL_DYNMEM_FREE_BLOCKS(8);
+SYSCTL_DYNMEM_FREE_BLOCKS(9);
+SYSCTL_DYNMEM_FREE_BLOCKS(10);
+
+static int sysctl_dynmem_largest_free(SYSCTL_HANDLER_ARGS);
+SYSCTL_PROC(_vm_dynmem, OID_AUTO, largest_free, CTLTYPE_UINT | CTLFLAG_RD,
+            NULL, 0, sysctl_dynmem_largest_free, "IU",
+            "Size of the largest free buddy block");
+
 static inline void * dindex2addr(size_t di)
 {
     return (void *)(DYNMEM_START + di * DYNMEM_PAGE_SIZE);
@@ -170,6 +211,130 @@ static int addr_is_valid(const void * addr, int test)
     return !!1;
 }
 
+/**
+ * Free a naturally aligned block of pages and coalesce it with its buddies.
+ * @note dynmem_region_lock must be held before calling this function.
+ * @param di is the index of the first page of the block.
+ * @param order is the order of the block.
+ */
+static void buddy_free_block(size_t di, int order)
+{
+    while (order < DYNMEM_MAX_ORDER) {
+        const size_t bi = di ^ ((size_t)1 << order);
+        struct dynmem_buddy * buddy;
+
+        if (bi + ((size_t)1 << order) > DYNMEM_MAPSIZE)
+            break;
+
+        buddy = dynmem_buddies + bi;
+        if (buddy->order != order)
+            break; /* The buddy is not free or it's split. */
+
+        LIST_REMOVE(buddy, entry_);
+        buddy->order = -1;
+        dynmem_nr_free_blocks[order]--;
+
+        di &= ~((size_t)1 << order);
+        order++;
+    }
+
+    dynmem_buddies[di].order = order;
+    LIST_INSERT_HEAD(&dynmem_free_lists[order], dynmem_buddies + di, entry_);
+    dynmem_nr_free_blocks[order]++;
+}
+
+/**
+ * Free a range of pages.
+ * The range is split into the largest naturally aligned blocks possible.
+ * @note dynmem_region_lock must be held before calling this function.
+ * @param di is the index of the first page.
+ * @param count is the number of pages.
+ */
+static void buddy_free_range(size_t di, size_t count)
+{
+    while (count > 0) {
+        int order = 0;
+
+        while (order < DYNMEM_MAX_ORDER &&
+               (di & ((size_t)1 << order)) == 0 &&
+               ((size_t)2 << order) <= count) {
+            order++;
+        }
+
+        buddy_free_block(di, order);
+        di += (size_t)1 << order;
+        count -= (size_t)1 << order;
+    }
+}
+
+/**
+ * Allocate a range of pages.
+ * The smallest block that fits the range is split and the pages not needed
+ * are freed back.
+ * @note dynmem_region_lock must be held before calling this function.
+ * @param[out] di is the index of the first page allocated.
+ * @param count is the number of pages.
+ * @return 0 or -ENOMEM.
+ */
+static int buddy_alloc_range(size_t * di, size_t count)
+{
+    int order = 0;
+    int i;
+    struct dynmem_buddy * block;
+    size_t bi;
+
+    while (((size_t)1 << order) < count) {
+        if (++order > DYNMEM_MAX_ORDER)
+            return -ENOMEM;
+    }
+
+    for (i = order; i <= DYNMEM_MAX_ORDER; i++) {
+        if (!LIST_EMPTY(&dynmem_free_lists[i]))
+            break;
+    }
+    if (i > DYNMEM_MAX_ORDER)
+        return -ENOMEM;
+
+    block = LIST_FIRST(&dynmem_free_lists[i]);
+    LIST_REMOVE(block, entry_);
+    block->order = -1;
+    dynmem_nr_free_blocks[i]--;
+    bi = block - dynmem_buddies;
+
+    /* Split until the block is of the requested order. */
+    while (i > order) {
+        struct dynmem_buddy * upper;
+
+        i--;
+        upper = dynmem_buddies + bi + ((size_t)1 << i);
+        upper->order = i;
+        LIST_INSERT_HEAD(&dynmem_free_lists[i], upper, entry_);
+        dynmem_nr_free_blocks[i]++;
+    }
+
+    /* Return the tail not needed. */
+    buddy_free_range(bi + count, ((size_t)1 << order) - count);
+
+    *di = bi;
+    return 0;
+}
+
+static int sysctl_dynmem_largest_free(SYSCTL_HANDLER_ARGS)
+{
+    unsigned largest = 0;
+
+    mtx_lock(&dynmem_region_lock);
+    for (int i = DYNMEM_MAX_ORDER; i >= 0; i--) {
+        if (dynmem_nr_free_blocks[i] > 0) {
+            largest = ((size_t)1 << i) * DYNMEM_PAGE_SIZE;
+            break;
+        }
+    }
+    mtx_unlock(&dynmem_region_lock);
+
+    return sysctl_handle_int(oidp, &largest, sizeof(largest), req);
+}
+
 static void mark_reserved_areas(void)
 {
     struct dynmem_reserved_area ** areap;
@@ -182,7 +347,6 @@ static void mark_reserved_areas(void)
         uintptr_t end_addr;
         size_t bytes;
         size_t blkcount;
-        int err;
 
         if (area->caddr_start > DYNMEM_END)
             continue;
@@ -191,20 +355,57 @@ static void mark_reserved_areas(void)
                                                     area->caddr_end;
         bytes = (end_addr - area->caddr_start + 1);
         blkcount = bytes / DYNMEM_PAGE_SIZE;
-        err = bitmap_block_update(dynmemmap_bitmap, 1, pos, blkcount,
-                                  SIZEOF_DYNMEMMAP_BITMAP);
-        KASSERT(err == 0, "vreg map update OOB");
+        KASSERT(pos + blkcount <= DYNMEM_MAPSIZE, "reserved area OOB");
+        for (size_t i = pos; i < pos + blkcount; i++) {
+            dynmemmap[i].rsv = 1;
+        }
         dynmem_free -= bytes;
         dynmem_reserved += bytes;
     }
 }
 
+/**
+ * Initialize the buddy allocator.
+ * This is called on the first allocation if that happens before
+ * dynmem_init().
+ * @note dynmem_region_lock must be held before calling this function.
+ */
+static void buddy_init(void)
+{
+    size_t i = 0;
+
+    if (dynmem_buddy_ready)
+        return;
+
+    for (size_t j = 0; j < DYNMEM_MAPSIZE; j++) {
+        dynmem_buddies[j].order = -1;
+    }
+
+    mark_reserved_areas();
+
+    /* Give all the unreserved pages to the buddy allocator. */
+    while (i < DYNMEM_MAPSIZE) {
+        size_t n = 0;
+
+        while (i + n < DYNMEM_MAPSIZE && !dynmemmap[i + n].rsv) {
+            n++;
+        }
+        if (n > 0)
+            buddy_free_range(i, n);
+        i += n + 1;
+    }
+
+    dynmem_buddy_ready = 1;
+}
+
 /**
  * Called from kinit.c
  */
 void dynmem_init(void)
 {
-    mark_reserved_areas();
+    mtx_lock(&dynmem_region_lock);
+    buddy_init();
+    mtx_unlock(&dynmem_region_lock);
 }
 
 /**
@@ -295,15 +496,14 @@ void * dynmem_alloc_region(size_t size, uint32_t ap, uint32_t ctrl)
 {
     size_t pos;
     void * retval = NULL;
-    int err;
 
     if (size == 0)
         return NULL;
 
     mtx_lock(&dynmem_region_lock);
 
-    if (bitmap_block_search(&pos, size, dynmemmap_bitmap,
-                           SIZEOF_DYNMEMMAP_BITMAP)) {
+    buddy_init();
+    if (buddy_alloc_range(&pos, size)) {
         KERROR(KERROR_ERR, "%s(size %u): Out of dynmem, free %u/%u\n",
                __func__, size, dynmem_free, configDYNMEM_SIZE);
         goto out;
@@ -312,9 +512,6 @@ void * dynmem_alloc_region(size_t size, uint32_t ap, uint32_t ctrl)
     /* Update sysctl stats */
     dynmem_free -= size * DYNMEM_PAGE_SIZE;
 
-    err = bitmap_block_update(dynmemmap_bitmap, 1, pos, size,
-                              SIZEOF_DYNMEMMAP_BITMAP);
-    KASSERT(err == 0, "dynmem map update OOB");
     retval = kmap_allocation(pos, size, ap, ctrl);
 
 out:
@@ -352,7 +549,6 @@ void dynmem_free_region(void * addr)
 {
     size_t i;
     struct dynmem_desc * dp;
-    int err;
 
     mtx_lock(&dynmem_region_lock);
 
@@ -382,9 +578,7 @@ void dynmem_free_region(void * addr)
 
     /* Mark the region as unused. */
     memset(dp, 0, dynmem_region.num_pages * sizeof(struct dynmem_desc));
-    err = bitmap_block_update(dynmemmap_bitmap, 1, i, dynmem_region.num_pages,
-                              SIZEOF_DYNMEMMAP_BITMAP);
-    KASSERT(err == 0, "vreg map update OOB");
+    buddy_free_range(i, dynmem_region.num_pages);
 
     /* Update sysctl stats */
     dynmem_free += dynmem_region.num_pages * DYNMEM_PAGE_SIZE;
@@ -37,6 +37,7 @@
 #include <sys/elf32.h>
 #include <sys/elf_notes.h>
 #include <sys/priv.h>
+#include <sys/sysctl.h>
 #include <buf.h>
 #include <exec.h>
 #include <fs/fs.h>
@@ -61,6 +62,50 @@ struct elf_ctx {
     size_t stack_size; /*!< Preferred minimum stack size. */
 };
 
+/**
+ * Identifies a read-only section of a file.
+ */
+struct text_key {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtim;
+    off_t size;
+    off_t offset;
+    uintptr_t vaddr;
+    size_t memsz;
+    size_t filesz;
+    int prot;
+};
+
+#if configEXEC_TEXT_CACHE > 0
+/**
+ * Cache of read-only sections shared between processes.
+ * Each entry holds a reference to the region.
+ */
+static struct text_cache_entry {
+    struct text_key key;
+    struct buf * region;
+    unsigned last_use;
+} text_cache[configEXEC_TEXT_CACHE];
+static unsigned text_cache_clock;
+/*
+ * Only taken by exec without other locks held, so the holder may block.
+ */
+static mtx_t text_cache_lock = MTX_INITIALIZER(MTX_TYPE_ADAPTIVE, 0);
+
+SYSCTL_DECL(_kern_exec);
+SYSCTL_NODE(_kern, OID_AUTO, exec, CTLFLAG_RW, 0,
+            "exec stats");
+
+static unsigned text_cache_hits;
+SYSCTL_UINT(_kern_exec, OID_AUTO, text_cache_hits, CTLFLAG_RD,
+            &text_cache_hits, 0, "Number of shared sections reused");
+
+static unsigned text_cache_misses;
+SYSCTL_UINT(_kern_exec, OID_AUTO, text_cache_misses, CTLFLAG_RD,
+            &text_cache_misses, 0, "Number of shared sections created");
+#endif
+
 static int check_header(const struct elf32_header * hdr)
 {
     if (!IS_ELF(hdr) ||
@@ -212,36 +257,147 @@ static ssize_t read_section(struct elf_ctx * ctx, size_t sect_index,
     return vn->vnode_ops->read(ctx->file, &uio, size);
 }
 
+#if configEXEC_TEXT_CACHE > 0
+static int text_key_init(struct text_key * key, struct elf_ctx * ctx,
+                         struct elf32_phdr * phdr, int prot)
+{
+    vnode_t * vn = ctx->file->vnode;
+    struct stat stat_buf;
+    int err;
+
+    err = vn->vnode_ops->stat(vn, &stat_buf);
+    if (err)
+        return err;
+
+    memset(key, 0, sizeof(*key));
+    key->dev = stat_buf.st_dev;
+    key->ino = stat_buf.st_ino;
+    key->mtim = stat_buf.st_mtim;
+    key->size = stat_buf.st_size;
+    key->offset = phdr->p_offset;
+    key->vaddr = phdr->p_vaddr + ctx->rbase;
+    key->memsz = phdr->p_memsz;
+    key->filesz = phdr->p_filesz;
+    key->prot = prot;
+
+    return 0;
+}
+
 /**
- * Create a memory region and load a section to it.
+ * Get a reference to a cached section.
+ */
+static struct buf * text_cache_get(const struct text_key * key)
+{
+    struct buf * region = NULL;
+
+    mtx_lock(&text_cache_lock);
+    for (size_t i = 0; i < num_elem(text_cache); i++) {
+        struct text_cache_entry * entry = &text_cache[i];
+
+        if (entry->region && !memcmp(&entry->key, key, sizeof(*key))) {
+            region = entry->region;
+            region->vm_ops->rref(region);
+            entry->last_use = ++text_cache_clock;
+            text_cache_hits++;
+            break;
+        }
+    }
+    mtx_unlock(&text_cache_lock);
+
+    return region;
+}
+
+/**
+ * Insert a section to the cache.
+ * The least recently used entry is replaced if the cache is full.
+ */
+static void text_cache_put(const struct text_key * key, struct buf * region)
+{
+    struct text_cache_entry * victim = &text_cache[0];
+    struct buf * old;
+
+    mtx_lock(&text_cache_lock);
+    for (size_t i = 0; i < num_elem(text_cache); i++) {
+        struct text_cache_entry * entry = &text_cache[i];
+
+        if (!entry->region) {
+            victim = entry;
+            break;
+        }
+        if (entry->last_use < victim->last_use)
+            victim = entry;
+    }
+    old = victim->region;
+    victim->key = *key;
+    victim->region = region;
+    victim->last_use = ++text_cache_clock;
+    region->vm_ops->rref(region);
+    text_cache_misses++;
+    mtx_unlock(&text_cache_lock);
+
+    if (old)
+        old->vm_ops->rfree(old);
+}
+#endif
+
+/**
+ * Create a memory region for a section.
+ * The section is read from the file page by page when it's accessed for the
+ * first time. Read-only sections are shared between processes executing the
+ * same file.
  */
 static int load_section(struct elf_ctx * ctx, size_t sect_index,
                         struct buf ** region)
 {
     struct elf32_phdr * phdr = &ctx->phdr[sect_index];
+    const uintptr_t vaddr = phdr->p_vaddr + ctx->rbase;
     struct buf * sect;
-    void * ldp;
     int prot, err;
+#if configEXEC_TEXT_CACHE > 0
+    struct text_key key;
+    int shared;
+#endif
 
     if (phdr->p_memsz < phdr->p_filesz) {
         return -ENOEXEC;
     }
 
     prot = p_flags2b_uflags(phdr->p_flags);
-    sect = vm_newsect(phdr->p_vaddr + ctx->rbase, phdr->p_memsz, prot);
+
+#if configEXEC_TEXT_CACHE > 0
+    shared = !(prot & VM_PROT_WRITE) &&
+             !text_key_init(&key, ctx, phdr, prot);
+    if (shared) {
+        sect = text_cache_get(&key);
+        if (sect) {
+            *region = sect;
+            return 0;
+        }
+    }
+#endif
+
+    sect = vm_newsect(vaddr, phdr->p_memsz, prot);
     if (!sect) {
         return -ENOMEM;
     }
 
-    ldp = (void *)(sect->b_data + (phdr->p_vaddr - sect->b_mmu.vaddr));
-    err = read_section(ctx, sect_index, ldp, phdr->p_memsz);
-    if (err < 0) {
-        if (sect->vm_ops->rfree) {
-            sect->vm_ops->rfree(sect);
+    if (phdr->p_filesz > 0) {
+        fs_fildes_set(&sect->b_file, ctx->file->vnode, O_RDONLY);
+        sect->b_blkno = phdr->p_offset;
+        err = vr_fill_setup(sect, vaddr - sect->b_mmu.vaddr, phdr->p_filesz);
+        if (err) {
+            if (sect->vm_ops->rfree) {
+                sect->vm_ops->rfree(sect);
+            }
+            return err;
         }
-        return -ENOEXEC;
     }
 
+#if configEXEC_TEXT_CACHE > 0
+    if (shared)
+        text_cache_put(&key, sect);
+#endif
+
     *region = sect;
     return 0;
 }
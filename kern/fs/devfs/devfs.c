@@ -32,6 +32,7 @@
  */
 
 #include <errno.h>
+#include <poll.h>
 #include <sys/dev_major.h>
 #include <sys/ioctl.h>
 #include <fs/devfs.h>
@@ -60,12 +61,14 @@ static void devfs_event_fd_closed(struct proc_info * p, file_t * file);
 static int devfs_stat(vnode_t * vnode, struct stat * buf);
 static int dev_ioctl(file_t * file, unsigned request,
                      void * arg, size_t arg_len);
+static int dev_poll(file_t * file, int events, struct poll_table * pt);
 
 vnode_ops_t devfs_vnode_ops = {
     .read = dev_read,
     .write = dev_write,
     .lseek = dev_lseek,
     .ioctl = dev_ioctl,
+    .poll = dev_poll,
     .event_fd_created = devfs_event_fd_created,
     .event_fd_closed = devfs_event_fd_closed,
     .stat = devfs_stat,
@@ -390,3 +393,16 @@ static int dev_ioctl(file_t * file, unsigned request, void * arg, size_t arg_len
         return -EINVAL;
     }
 }
+
+static int dev_poll(file_t * file, int events, struct poll_table * pt)
+{
+    struct dev_info * devnfo = (struct dev_info *)file->vnode->vn_specinfo;
+
+    if (!devnfo)
+        return POLLNVAL;
+
+    if (devnfo->poll)
+        return devnfo->poll(file, devnfo, events, pt);
+
+    return events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+}
@@ -38,6 +38,7 @@
 #include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <buf.h>
 #include <kerror.h>
 #include <kinit.h>
 #include <kstring.h>
@@ -52,6 +53,7 @@ static int fatfs_mount(fs_t * fs, const char * source, uint32_t mode,
         const char * parm, int parm_len, struct fs_superblock ** sb);
 static int fatfs_umount(struct fs_superblock * fs_sb);
 static char * format_fpath(struct fatfs_inode * indir, const char * name);
+static void fatfs_drop_clmt(struct fatfs_inode * in);
 static int create_inode(struct fatfs_inode ** result, struct fatfs_sb * sb,
                         char * fpath, size_t vn_hash, int oflags);
 static void finalize_inode(vnode_t * vnode);
@@ -70,6 +72,7 @@ static int fresult2errno(int fresult);
 static struct fs fatfs_fs = {
     .fsname = FATFS_FSNAME,
     .fs_majornum = VDEV_MJNR_FATFS,
+    .fs_flags = FS_FLAG_NAMECACHE,
     .mount = fatfs_mount,
     .sblist_head = SLIST_HEAD_INITIALIZER(),
 };
@@ -175,6 +178,7 @@ static int fatfs_mount(fs_t * fs, const char * source, uint32_t mode,
     static dev_t fatfs_vdev_minor;
     struct fatfs_sb * fatfs_sb = NULL;
     vnode_t * vndev;
+    ssize_t nblocks = 0;
     int err, opt = 0, retval = 0;
 
     /* Get device vnode */
@@ -248,6 +252,11 @@ static int fatfs_mount(fs_t * fs, const char * source, uint32_t mode,
     }
 
     fs_fildes_set(&fatfs_sb->ff_devfile, vndev, O_RDWR);
+    if (vndev->vnode_ops->ioctl(&fatfs_sb->ff_devfile, IOCTL_GETBLKCNT,
+                                &nblocks, sizeof(nblocks)) == 0 &&
+        nblocks > 0) {
+        fatfs_sb->ff_devblocks = nblocks;
+    }
     fatfs_sb->sb.vdev_id = DEV_MMTODEV(VDEV_MJNR_FATFS, fatfs_vdev_minor++);
 
     /*
@@ -301,8 +310,10 @@ fail:
     } else {
         *sb = &fatfs_sb->sb;
     }
-    if (retval)
+    if (retval) {
+        bio_vnode_cleanup(vndev);
         vrele(vndev);
+    }
     return retval;
 }
 
@@ -318,6 +329,8 @@ static int fatfs_umount(struct fs_superblock * fs_sb)
      */
     fs_remove_superblock(fs_sb->fs, &fatfs_sb->sb);
     f_umount(&fatfs_sb->ff_fs);
+    bio_vnode_sync(fatfs_sb->ff_devfile.vnode);
+    bio_vnode_cleanup(fatfs_sb->ff_devfile.vnode);
     vrele(fatfs_sb->ff_devfile.vnode);
     inpool_destroy(&fatfs_sb->inpool);
     kfree(fatfs_sb);
@@ -498,6 +511,8 @@ static void finalize_inode(vnode_t * vnode)
             f_sync(&in->fp);
     }
 
+    if (S_ISREG(vnode->vn_mode))
+        fatfs_drop_clmt(in);
     kfree(in->in_fpath);
     memset(in, 0, sizeof(*in));
 }
@@ -725,6 +740,71 @@ static int fatfs_lookup(vnode_t * dir, const char * name, vnode_t ** result)
     return retval;
 }
 
+/**
+ * Create a cluster link map for fast seek.
+ * The map is kept until the cluster chain of the file may change. Failing to
+ * create the map is not an error as the normal seek works without it.
+ */
+static void fatfs_create_clmt(struct fatfs_inode * in)
+{
+    FF_FIL * fp = &in->fp;
+    DWORD * tbl = NULL;
+    DWORD size = FATFS_CLMT_INITSIZE;
+    FRESULT err;
+
+    do {
+        DWORD * new_tbl;
+
+        new_tbl = krealloc(tbl, size * sizeof(DWORD));
+        if (!new_tbl) {
+            kfree(tbl);
+            return;
+        }
+        tbl = new_tbl;
+        tbl[0] = size;
+
+        fp->cltbl = tbl;
+        err = f_lseek(fp, CREATE_LINKMAP);
+        fp->cltbl = NULL;
+
+        size = tbl[0]; /* The required size. */
+    } while (err == FR_NOT_ENOUGH_CORE);
+
+    if (err) {
+        kfree(tbl);
+        return;
+    }
+
+    fp->cltbl = tbl;
+}
+
+static void fatfs_drop_clmt(struct fatfs_inode * in)
+{
+    kfree(in->fp.cltbl);
+    in->fp.cltbl = NULL;
+}
+
+/**
+ * Seek to the file position of file if it's not already there.
+ */
+static int fatfs_seek(struct fatfs_inode * in, file_t * file)
+{
+    FF_FIL * fp = &in->fp;
+
+    if (f_tell(fp) == file->seek_pos)
+        return 0;
+
+    /*
+     * A random access to a file spanning several clusters would otherwise
+     * walk the FAT chain from the beginning.
+     */
+    if (!fp->cltbl && fp->fs &&
+        fp->fsize > FATFS_CLMT_MIN_CLUST * fp->fs->csize * fp->fs->ssize)
+        fatfs_create_clmt(in);
+
+    return f_lseek(fp, file->seek_pos) ? -EIO : 0;
+}
+
 ssize_t fatfs_read(file_t * file, struct uio * uio, size_t count)
 {
     void * buf;
@@ -735,9 +815,9 @@ ssize_t fatfs_read(file_t * file, struct uio * uio, size_t count)
     if (!S_ISREG(file->vnode->vn_mode))
         return -EOPNOTSUPP;
 
-    err = f_lseek(&in->fp, file->seek_pos);
+    err = fatfs_seek(in, file);
     if (err)
-        return -EIO;
+        return err;
 
     err = uio_get_kaddr(uio, &buf);
     if (err)
@@ -761,9 +841,16 @@ ssize_t fatfs_write(file_t * file, struct uio * uio, size_t count)
     if (!S_ISREG(file->vnode->vn_mode))
         return -EOPNOTSUPP;
 
-    err = f_lseek(&in->fp, file->seek_pos);
+    /*
+     * Fast seek can't stretch the cluster chain, so the link map is dropped
+     * if the file might grow.
+     */
+    if (in->fp.cltbl && file->seek_pos + count > in->fp.fsize)
+        fatfs_drop_clmt(in);
+
+    err = fatfs_seek(in, file);
     if (err)
-        return -EIO;
+        return err;
 
     err = uio_get_kaddr(uio, &buf);
     if (err)
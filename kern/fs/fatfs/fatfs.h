@@ -51,6 +51,29 @@
 
 #define FATFS_FSNAME            "fatfs"
 
+/**
+ * Min file size in clusters for creating a cluster link map.
+ */
+#define FATFS_CLMT_MIN_CLUST    4
+
+/**
+ * Initial size of a cluster link map in DWORDs.
+ * Holds 15 fragments; grown if the file is more fragmented.
+ */
+#define FATFS_CLMT_INITSIZE     32
+
+/**
+ * Size of a buffer cache block used for the device I/O.
+ * Device sectors are cached in blocks of this size and a block is always
+ * aligned to its own size on the device.
+ */
+#define FATFS_BIO_BSIZE         4096
+
+/**
+ * Max number of buffer cache blocks read ahead by a multi-sector read.
+ */
+#define FATFS_BIO_NRA           4
+
 struct fatfs_inode {
     vnode_t in_vnode;   /*!< vnode for this inode. */
     char * in_fpath;    /*!< Full path to this node from the sb root. */
@@ -60,7 +83,7 @@ struct fatfs_inode {
      * file pointer or directory pointer, check in_vnode->vn_mode.
      */
     union {
-    FF_FIL fp;
+    FF_FIL fp;  /*!< fp.cltbl is the cluster link map if set. */
     FF_DIR dp;
     };
 };
@@ -72,6 +95,7 @@ struct fatfs_sb {
     struct fs_superblock sb;    /*!< Superblock node. */
     inpool_t inpool;            /*!< inode pool. */
     file_t ff_devfile;          /*!< Fs device. */
+    size_t ff_devblocks;        /*!< Size of the device in sectors or 0. */
     FATFS ff_fs;                /*!< ff descriptor. */
     char fpath_root[2];         /*!< fpath for root. */
 };
@@ -36,14 +36,45 @@
 #include <sys/ioctl.h>
 #include <kstring.h>
 #include <libkern.h>
+#include <buf.h>
 #include <hal/core.h>
 #include <kerror.h>
 #include <fs/fs.h>
 #include <fs/devfs.h>
 #include "fatfs.h"
 
+/**
+ * Get the buffer cache block containing a sector.
+ * @param[in]  sector   is a sector address in LBA.
+ * @param[out] blkno    is the first sector of the block.
+ * @param[out] nsect    is the number of sectors in the block.
+ */
+static void fatfs_bio_blk(FATFS * ff_fs, DWORD sector, size_t * blkno,
+                          size_t * nsect)
+{
+    const size_t devblocks = get_ffsb_of_fffs(ff_fs)->ff_devblocks;
+    size_t spb = max(FATFS_BIO_BSIZE / ff_fs->ssize, 1);
+
+    /*
+     * If the size of the device is unknown a multi-sector block could go
+     * over the end of the device, so fall back to one sector per block.
+     */
+    if (devblocks == 0)
+        spb = 1;
+
+    *blkno = sector - sector % spb;
+    *nsect = spb;
+
+    /* The last block of the device may be shorter. */
+    if (devblocks > *blkno && devblocks - *blkno < spb)
+        *nsect = devblocks - *blkno;
+}
+
 /**
  * Read sector(s).
+ * The sectors are read through the buffer cache, a read spanning several
+ * cache blocks reads the following blocks ahead while the first one is
+ * copied.
  * @param buff      is a data buffer to store read data.
  * @param sector    is a sector address in LBA.
  * @param count     is the number of bytes to read.
@@ -52,34 +83,49 @@
 DRESULT fatfs_disk_read(FATFS * ff_fs, uint8_t * buff, DWORD sector,
                         unsigned int count)
 {
-    file_t * file = &get_ffsb_of_fffs(ff_fs)->ff_devfile;
-    struct vnode_ops * vnops = file->vnode->vnode_ops;
-    struct uio uio;
-    ssize_t retval;
+    vnode_t * vndev = get_ffsb_of_fffs(ff_fs)->ff_devfile.vnode;
+    const size_t ssize = ff_fs->ssize;
+    const size_t end = sector + ((ssize) ? count / ssize : 0);
 
-    retval = vnops->lseek(file, sector, SEEK_SET);
-    if (retval < 0) {
-#ifdef configFATFS_DEBUG
-        KERROR(KERROR_ERR, "%s(): err %i\n", __func__, retval);
-#endif
-        return RES_ERROR;
-    }
-
-    uio_init_kbuf(&uio, buff, count);
-    retval = vnops->read(file, &uio, count);
-    if (retval < 0) {
-#ifdef configFATFS_DEBUG
-        KERROR(KERROR_ERR, "%s(): err %i\n", __func__, retval);
-#endif
-        return RES_ERROR;
-    }
+    if (ssize == 0 || count % ssize)
+        return RES_PARERR;
 
-    if (retval != (ssize_t)count) {
+    while (count > 0) {
+        size_t rablks[FATFS_BIO_NRA];
+        int rasizes[FATFS_BIO_NRA];
+        int nra = 0;
+        size_t blkno, nsect, next, off, len;
+        struct buf * bp = NULL;
+        int err;
+
+        fatfs_bio_blk(ff_fs, sector, &blkno, &nsect);
+        off = (sector - blkno) * ssize;
+        len = min(nsect * ssize - off, count);
+
+        next = blkno + nsect;
+        while (nra < FATFS_BIO_NRA && next < end) {
+            size_t ra_nsect;
+
+            fatfs_bio_blk(ff_fs, next, &rablks[nra], &ra_nsect);
+            rasizes[nra++] = ra_nsect * ssize;
+            next += ra_nsect;
+        }
+
+        err = breadn(vndev, blkno, nsect * ssize, rablks, rasizes, nra, &bp);
+        if (err) {
+            if (bp)
+                brelse(bp);
 #ifdef configFATFS_DEBUG
-        KERROR(KERROR_WARN, "retval(%i) != count(%i)\n",
-                (uint32_t)retval, (uint32_t)count);
+            KERROR(KERROR_WARN, "%s(): bread err %i\n", __func__, err);
 #endif
-        return RES_PARERR;
+            return RES_ERROR;
+        }
+        memcpy(buff, (void *)(bp->b_data + off), len);
+        brelse(bp);
+
+        buff += len;
+        sector += len / ssize;
+        count -= len;
     }
 
     return 0;
@@ -87,6 +133,8 @@ DRESULT fatfs_disk_read(FATFS * ff_fs, uint8_t * buff, DWORD sector,
 
 /**
  * Write sector(s).
+ * The sectors are written to the buffer cache as delayed writes, the
+ * buffer cache coalesces adjacent dirty blocks into larger device writes.
  * @param buff      is the data buffer to be written.
  * @param sector    is a sector address in LBA.
  * @param count     is the number of bytes to write.
@@ -94,31 +142,52 @@ DRESULT fatfs_disk_read(FATFS * ff_fs, uint8_t * buff, DWORD sector,
 DRESULT fatfs_disk_write(FATFS * ff_fs, const uint8_t * buff, DWORD sector,
                          unsigned int count)
 {
-    file_t * file = &get_ffsb_of_fffs(ff_fs)->ff_devfile;
-    struct vnode_ops * vnops = file->vnode->vnode_ops;
-    struct uio uio;
-    ssize_t retval;
+    vnode_t * vndev = get_ffsb_of_fffs(ff_fs)->ff_devfile.vnode;
+    const size_t ssize = ff_fs->ssize;
 
-    retval = vnops->lseek(file, sector, SEEK_SET);
-    if (retval < 0) {
-#ifdef configFATFS_DEBUG
-        KERROR(KERROR_ERR, "%s(): err %i\n", __func__, retval);
-#endif
-        return RES_ERROR;
-    }
+    if (ssize == 0 || count % ssize)
+        return RES_PARERR;
 
-    uio_init_kbuf(&uio, (void *)buff, count);
-    retval = vnops->write(file, &uio, count);
-    if (retval < 0) {
+    while (count > 0) {
+        size_t blkno, nsect, off, len;
+        struct buf * bp = NULL;
+
+        fatfs_bio_blk(ff_fs, sector, &blkno, &nsect);
+        off = (sector - blkno) * ssize;
+        len = min(nsect * ssize - off, count);
+
+        if (len == nsect * ssize) {
+            /* The whole block is overwritten, no need to read it. */
+            bp = getblk(vndev, blkno, len, 0);
+            if (!bp)
+                return RES_ERROR;
+            bp->b_bcount = len;
+        } else {
+            int err;
+
+            err = bread(vndev, blkno, nsect * ssize, &bp);
+            if (err) {
+                if (bp)
+                    brelse(bp);
 #ifdef configFATFS_DEBUG
-        KERROR(KERROR_ERR, "%s(): err %i\n", __func__, retval);
+                KERROR(KERROR_WARN, "%s(): bread err %i\n", __func__, err);
 #endif
-        return RES_ERROR;
+                return RES_ERROR;
+            }
+        }
+
+        memcpy((void *)(bp->b_data + off), buff, len);
+        BUF_LOCK(bp);
+        bp->b_flags |= B_CACHE;
+        BUF_UNLOCK(bp);
+        bio_setdirty(bp, off, len);
+        bdwrite(bp);
+
+        buff += len;
+        sector += len / ssize;
+        count -= len;
     }
 
-    if (retval != (ssize_t)count)
-        return RES_PARERR;
-
     return 0;
 }
 
@@ -139,6 +208,12 @@ DRESULT fatfs_disk_ioctl(FATFS * ff_fs, unsigned cmd, void * buff, size_t bsize)
 
     switch (cmd) {
     case CTRL_SYNC:
+        return (bio_vnode_sync(file->vnode)) ? RES_ERROR : 0;
+    case IOCTL_FLSBLKBUF:
+        /* Write out the delayed writes before flushing the device. */
+        if (bio_vnode_sync(file->vnode))
+            return RES_ERROR;
+        break;
     case CTRL_ERASE_SECTOR:
         /* TODO Not implemented yet. */
         return 0;
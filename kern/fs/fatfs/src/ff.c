@@ -1753,7 +1753,11 @@ FRESULT f_mount(FATFS * fs, uint8_t opt, int codepage_id)
         return FR_INVALID_PARAMETER;
     }
 
-    mtx_init(&fs->sobj, MTX_TYPE_TICKET, MTX_OPT_PRICEIL);
+    /*
+     * Held over disk I/O, so waiters should block rather than spin. Page fills
+     * read the file without holding the region lock, see vr_fill_page().
+     */
+    mtx_init(&fs->sobj, MTX_TYPE_ADAPTIVE, 0);
 
     if (lock_fs(fs))
         return FR_TIMEOUT;
@@ -39,6 +39,7 @@
 #include <unistd.h>
 #include <buf.h>
 #include <fs/fs.h>
+#include <fs/fs_namecache.h>
 #include <fs/fs_util.h>
 #include <fs/mbr.h>
 #include <kerror.h>
@@ -238,6 +239,8 @@ int fs_mount(vnode_t * target, const char * source, const char * fsname,
 
     /* TODO inherit permissions */
 
+    fs_namecache_purge_all();
+
     KERROR_DBG("Mount OK\n");
 
     return 0;
@@ -284,14 +287,64 @@ int fs_umount(struct fs_superblock * sb)
     root->vn_prev_mountpoint = root;
     VN_UNLOCK(root);
 
+    /* Drop the vnode references held by the name cache. */
+    fs_namecache_purge_all();
+
     return sb->umount(sb);
 }
 
+/**
+ * Copy the next component of a path to name.
+ * @param pathp is a pointer to the path pointer, updated to point after the
+ *              component.
+ * @return  Returns the length of the component; 0 if there are no more
+ *          components; -ENAMETOOLONG if the component doesn't fit in name.
+ */
+static int next_component(const char ** pathp, char name[NAME_MAX + 1])
+{
+    const char * p = *pathp;
+    size_t n = 0;
+
+    while (*p == '/') {
+        p++;
+    }
+    while (p[n] != '\0' && p[n] != '/') {
+        if (n == NAME_MAX)
+            return -ENAMETOOLONG;
+        name[n] = p[n];
+        n++;
+    }
+    name[n] = '\0';
+    *pathp = p + n;
+
+    return n;
+}
+
+/**
+ * Lookup a name in dir through the name cache.
+ */
+static int lookup_cached(vnode_t * dir, const char * name, vnode_t ** result)
+{
+    unsigned gen;
+    int err;
+
+    if (fs_namecache_lookup(dir, name, result))
+        return (*result) ? 0 : -ENOENT;
+
+    gen = fs_namecache_gen();
+    err = dir->vnode_ops->lookup(dir, name, result);
+    if (err == 0)
+        fs_namecache_enter(dir, name, *result, gen);
+    else if (err == -ENOENT)
+        fs_namecache_enter(dir, name, NULL, gen);
+
+    return err;
+}
+
 int lookup_vnode(vnode_t ** result, vnode_t * root, const char * str, int oflags)
 {
-    char * path;
-    char * nodename;
-    char * lasts;
+    char nodename[NAME_MAX + 1];
+    int len;
     int retval = 0;
 
     KERROR_DBG("%s(result %p, root %pV, str \"%s\", oflags %x)\n",
@@ -300,14 +353,9 @@ int lookup_vnode(vnode_t ** result, vnode_t * root, const char * str, int oflags
     if (!(result && root && root->vnode_ops && str))
         return -EINVAL;
 
-    path = kstrdup(str, PATH_MAX);
-    if (!path)
-        return -ENOMEM;
-
-    if (!(nodename = kstrtok(path, PATH_DELIMS, &lasts))) {
-        retval = -EINVAL;
-        goto out;
-    }
+    len = next_component(&str, nodename);
+    if (len <= 0)
+        return (len == 0) ? -EINVAL : len;
 
     /*
      * Start looking up for a vnode.
@@ -330,7 +378,7 @@ int lookup_vnode(vnode_t ** result, vnode_t * root, const char * str, int oflags
 
 again:  /* Get vnode by name in this dir. */
         vnode = NULL;
-        retval = (*result)->vnode_ops->lookup(*result, nodename, &vnode);
+        retval = lookup_cached(*result, nodename, &vnode);
         vrele(*result);
         KASSERT((retval == 0 && vnode != NULL) || (retval != 0),
                 "vnode should be valid if !retval");
@@ -370,7 +418,13 @@ again:  /* Get vnode by name in this dir. */
         retval = 0;
 
         KASSERT(*result != NULL, "vfs is in inconsistent state");
-    } while ((nodename = kstrtok(0, PATH_DELIMS, &lasts)));
+    } while ((len = next_component(&str, nodename)) > 0);
+
+    if (len < 0) {
+        vrele(*result);
+        retval = len;
+        goto out;
+    }
 
     if ((oflags & O_DIRECTORY) && !S_ISDIR((*result)->vn_mode)) {
         vrele(*result);
@@ -385,7 +439,6 @@ out:
     if (retval && retval != -EDOM) {
         *result = NULL;
     }
-    kfree(path);
     return retval;
 }
 
@@ -854,6 +907,7 @@ int fs_creat_curproc(const char * pathname, mode_t mode, vnode_t ** result)
     mode &= ~S_IFMT; /* Filter out file type bits */
     mode &= ~curproc->files->umask;
     retval = dir->vnode_ops->create(dir, name, mode, result);
+    fs_namecache_purge(dir, name);
 
     KERROR_DBG("%s() result: %p\n", __func__, *result);
 
@@ -905,7 +959,10 @@ int fs_link_curproc(int fd1, const char * path1,
         return err;
     }
 
-    return vndir_dst->vnode_ops->link(vndir_dst, vn_src, targetname);
+    err = vndir_dst->vnode_ops->link(vndir_dst, vn_src, targetname);
+    fs_namecache_purge(vndir_dst, targetname);
+
+    return err;
 }
 
 int fs_unlink_curproc(int fd, const char * path, int atflags)
@@ -956,7 +1013,10 @@ int fs_unlink_curproc(int fd, const char * path, int atflags)
         return err;
     }
 
-    return dir->vnode_ops->unlink(dir, filename);
+    err = dir->vnode_ops->unlink(dir, filename);
+    fs_namecache_purge(dir, filename);
+
+    return err;
 }
 
 int fs_mkdir_curproc(const char * pathname, mode_t mode)
@@ -978,7 +1038,10 @@ int fs_mkdir_curproc(const char * pathname, mode_t mode)
 
     mode &= ~S_IFMT; /* Filter out file type bits */
     mode &= ~curproc->files->umask;
-    return dir->vnode_ops->mkdir(dir, name, mode);
+    err = dir->vnode_ops->mkdir(dir, name, mode);
+    fs_namecache_purge(dir, name);
+
+    return err;
 }
 
 int fs_rmdir_curproc(const char * pathname)
@@ -1003,7 +1066,10 @@ int fs_rmdir_curproc(const char * pathname)
         return err;
     }
 
-    return dir->vnode_ops->rmdir(dir, name);
+    err = dir->vnode_ops->rmdir(dir, name);
+    fs_namecache_purge(dir, name);
+
+    return err;
 }
 
 int fs_utimes_curproc(int fildes, const struct timespec times[2])
@@ -0,0 +1,251 @@
+/**
+ *******************************************************************************
+ * @file    fs_copy.c
+ * @author  Olli Vanhoja
+ * @brief   In-kernel copy between files.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <buf.h>
+#include <fs/fs.h>
+#include <hal/mmu.h>
+#include <libkern.h>
+#include <proc.h>
+#include <uio.h>
+
+/**
+ * Max size of the kernel buffer used by a copy.
+ */
+#define FS_COPY_BUFSIZE (4 * MMU_PGSIZE_COARSE)
+
+static unsigned long fs_copy_bytes;
+SYSCTL_ULONG(_vfs, OID_AUTO, copy_bytes, CTLFLAG_RD, &fs_copy_bytes, 0,
+             "Bytes copied in kernel by copy_file_range.");
+
+static unsigned long fs_copy_shared_bytes;
+SYSCTL_ULONG(_vfs, OID_AUTO, copy_shared_bytes, CTLFLAG_RD,
+             &fs_copy_shared_bytes, 0,
+             "Bytes copied by sharing the data between files.");
+
+static int fs_copy_seekable(vnode_t * vnode)
+{
+    return !(S_ISFIFO(vnode->vn_mode) || S_ISSOCK(vnode->vn_mode));
+}
+
+/**
+ * Read or write a file at *off without touching the file offset, or at the
+ * file offset if off is NULL.
+ */
+static ssize_t fs_copy_rw(file_t * file, off_t * off, struct uio * uio,
+                          size_t count, int write)
+{
+    const vnode_ops_t * vnops = file->vnode->vnode_ops;
+    file_t pfile;
+    ssize_t retval;
+
+    if (!off)
+        return (write) ? vnops->write(file, uio, count) :
+                         vnops->read(file, uio, count);
+
+    pfile = *file;
+    pfile.seek_pos = *off;
+    retval = (write) ? vnops->write(&pfile, uio, count) :
+                       vnops->read(&pfile, uio, count);
+    if (retval > 0)
+        *off += retval;
+
+    return retval;
+}
+
+/**
+ * Copy from fin to fout with the copy_range op of the file system.
+ * @return Returns the number of bytes copied;
+ *         Otherwise a negative errno code is returned.
+ */
+static ssize_t fs_copy_range(file_t * fin, off_t * off_in, file_t * fout,
+                             off_t * off_out, size_t len)
+{
+    const vnode_ops_t * vnops = fin->vnode->vnode_ops;
+    ssize_t retval;
+
+    if (!fs_copy_seekable(fin->vnode) || !fs_copy_seekable(fout->vnode))
+        return -ENOTSUP;
+
+    retval = vnops->copy_range(fin, (off_in) ? *off_in : fin->seek_pos,
+                               fout, (off_out) ? *off_out : fout->seek_pos,
+                               len);
+    if (retval <= 0)
+        return retval;
+
+    if (off_in)
+        *off_in += retval;
+    else
+        fin->seek_pos += retval;
+    if (off_out)
+        *off_out += retval;
+    else
+        fout->seek_pos += retval;
+    fs_copy_shared_bytes += retval;
+
+    return retval;
+}
+
+/**
+ * Copy from fin to fout.
+ * The data is shared between the files if the file system supports it;
+ * Otherwise the data is copied through a kernel buffer.
+ * Bytes read but not written are given back to fin if it's seekable.
+ */
+static ssize_t fs_copy(file_t * fin, off_t * off_in, file_t * fout,
+                       off_t * off_out, size_t len)
+{
+    struct buf * bp;
+    ssize_t total;
+    ssize_t err = 0;
+
+    total = fs_copy_range(fin, off_in, fout, off_out, len);
+    if (total < 0) {
+        if (total != -ENOTSUP)
+            return total;
+        total = 0;
+    }
+    len -= total;
+    if (len == 0)
+        goto out;
+
+    bp = geteblk(min(len, FS_COPY_BUFSIZE));
+    if (!bp) {
+        err = -ENOMEM;
+        goto out;
+    }
+
+    while (len > 0) {
+        const size_t chunk = min(len, bp->b_bufsize);
+        struct uio uio;
+        ssize_t nread;
+        size_t nwritten = 0;
+
+        uio_init_kbuf(&uio, (void *)bp->b_data, chunk);
+        nread = fs_copy_rw(fin, off_in, &uio, chunk, 0);
+        if (nread <= 0) {
+            err = nread;
+            break;
+        }
+
+        while (nwritten < (size_t)nread) {
+            const size_t left = nread - nwritten;
+            ssize_t n;
+
+            uio_init_kbuf(&uio, (void *)(bp->b_data + nwritten), left);
+            n = fs_copy_rw(fout, off_out, &uio, left, 1);
+            if (n <= 0) {
+                err = (n < 0) ? n : -EIO;
+                break;
+            }
+            nwritten += n;
+        }
+        total += nwritten;
+
+        if (nwritten < (size_t)nread) {
+            const off_t unwritten = nread - nwritten;
+
+            if (off_in)
+                *off_in -= unwritten;
+            else if (fs_copy_seekable(fin->vnode))
+                fin->vnode->vnode_ops->lseek(fin, -unwritten, SEEK_CUR);
+            break;
+        }
+
+        len -= nread;
+        if ((size_t)nread < chunk)
+            break;
+    }
+
+    bp->vm_ops->rfree(bp);
+out:
+    fs_copy_bytes += total;
+
+    return (total > 0) ? total : err;
+}
+
+ssize_t fs_copy_file_range_curproc(int fd_in, off_t * off_in,
+                                   int fd_out, off_t * off_out, size_t len)
+{
+    file_t * fin;
+    file_t * fout;
+    vnode_t * vn_in;
+    vnode_t * vn_out;
+    ssize_t retval;
+
+    fin = fs_fildes_ref(curproc->files, fd_in, 1);
+    if (!fin)
+        return -EBADF;
+
+    fout = fs_fildes_ref(curproc->files, fd_out, 1);
+    if (!fout) {
+        retval = -EBADF;
+        goto out_in;
+    }
+
+    vn_in = fin->vnode;
+    vn_out = fout->vnode;
+    if (!((fin->oflags & O_RDONLY) && vn_in &&
+          (fout->oflags & O_WRONLY) && vn_out)) {
+        retval = -EBADF;
+        goto out;
+    }
+
+    if (S_ISDIR(vn_in->vn_mode) || S_ISDIR(vn_out->vn_mode)) {
+        retval = -EISDIR;
+        goto out;
+    }
+
+    if ((off_in && !fs_copy_seekable(vn_in)) ||
+        (off_out && !fs_copy_seekable(vn_out))) {
+        retval = -ESPIPE;
+        goto out;
+    }
+
+    if ((off_in && *off_in < 0) || (off_out && *off_out < 0) ||
+        vn_in == vn_out) {
+        retval = -EINVAL;
+        goto out;
+    }
+
+    retval = (len > 0) ? fs_copy(fin, off_in, fout, off_out, len) : 0;
+
+out:
+    fs_fildes_ref(curproc->files, fd_out, -1);
+out_in:
+    fs_fildes_ref(curproc->files, fd_in, -1);
+
+    return retval;
+}
@@ -0,0 +1,549 @@
+/**
+ *******************************************************************************
+ * @file    fs_kqueue.c
+ * @author  Olli Vanhoja
+ * @brief   Kernel event queues.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/event.h>
+#include <sys/queue.h>
+#include <fs/fs.h>
+#include <fs/fs_poll.h>
+#include <fs/fs_util.h>
+#include <hal/hw_timers.h>
+#include <kinit.h>
+#include <kmalloc.h>
+#include <kstring.h>
+#include <libkern.h>
+#include <proc.h>
+#include <vm/vm.h>
+
+/**
+ * Max number of events returned by a single kevent call.
+ */
+#define KQ_NEVENTS_MAX  64
+
+#define KN_ACTIVE       0x01 /*!< Queued to kq_active. */
+#define KN_DISABLED     0x02 /*!< Disabled with EV_DISABLE. */
+#define KN_NOWQ         0x04 /*!< The file has no wait queue. */
+
+/**
+ * A registered event.
+ */
+struct knote {
+    struct kqueue * kn_kq;
+    file_t * kn_file;           /*!< Referenced file. */
+    uintptr_t kn_ident;         /*!< The fd number used to register. */
+    short kn_filter;
+    unsigned short kn_flags;    /*!< EV_ONESHOT and EV_CLEAR. */
+    int kn_status;              /*!< KN_ flags, protected by kq_wq_lock. */
+    void * kn_udata;
+    struct poll_entry kn_pe[FS_POLL_NWQ];
+    struct poll_table kn_pt;
+    LIST_ENTRY(knote) kn_link;
+    TAILQ_ENTRY(knote) kn_active;
+};
+
+TAILQ_HEAD(knote_activeq, knote);
+
+/**
+ * Kqueue descriptor pointed by file->stream.
+ */
+struct kqueue {
+    struct vnode kq_vnode;
+    file_t kq_file;
+    mtx_t kq_lock;      /*!< Protects kq_knotes. */
+    mtx_t kq_wq_lock;   /*!< Protects kq_active, kq_waiters and kn_status. */
+    LIST_HEAD(, knote) kq_knotes;
+    struct knote_activeq kq_active;
+    LIST_HEAD(, poll_waiter) kq_waiters;
+    struct pollwaitq kq_pwq; /*!< Pollers of the kqueue itself. */
+};
+
+static int kqueue_poll(file_t * file, int events, struct poll_table * pt);
+static int kqueue_stat(vnode_t * vnode, struct stat * stat);
+static int kqueue_destroy(vnode_t * vnode);
+
+static vnode_ops_t kqueue_ops = {
+    .poll = kqueue_poll,
+    .stat = kqueue_stat,
+};
+
+static struct fs kqueue_fs = {
+    .fsname = "kqueuefs",
+    .mount = NULL,
+    .sblist_head = SLIST_HEAD_INITIALIZER(),
+};
+
+static struct fs_superblock kqueue_sb = {
+    .fs = &kqueue_fs,
+    .delete_vnode = kqueue_destroy,
+    .umount = NULL,
+};
+
+int __kinit__ fs_kqueue_init(void)
+{
+    SUBSYS_INIT("fs_kqueue");
+
+    FS_GIANT_INIT(&kqueue_fs.fs_giant);
+    fs_inherit_vnops(&kqueue_ops, &nofs_vnode_ops);
+
+    return 0;
+}
+
+/**
+ * Queue a knote to the active list.
+ * Must be called with kq_wq_lock held.
+ */
+static void knote_activate(struct knote * kn)
+{
+    struct kqueue * kq = kn->kn_kq;
+    struct poll_waiter * w;
+
+    if (kn->kn_status & (KN_ACTIVE | KN_DISABLED))
+        return;
+
+    kn->kn_status |= KN_ACTIVE;
+    TAILQ_INSERT_TAIL(&kq->kq_active, kn, kn_active);
+    LIST_FOREACH(w, &kq->kq_waiters, entry_) {
+        poll_waiter_wake(w);
+    }
+}
+
+/**
+ * Poll entry wakeup callback of a knote.
+ */
+static void knote_wakeup(struct poll_entry * pe)
+{
+    struct knote * kn = (struct knote *)pe->arg;
+    struct kqueue * kq = kn->kn_kq;
+
+    mtx_lock(&kq->kq_wq_lock);
+    knote_activate(kn);
+    mtx_unlock(&kq->kq_wq_lock);
+
+    pollwakeup(&kq->kq_pwq);
+}
+
+static int knote_events(struct knote * kn)
+{
+    return (kn->kn_filter == EVFILT_READ) ? POLLIN | POLLRDNORM
+                                          : POLLOUT | POLLWRNORM;
+}
+
+static struct knote * knote_find(struct kqueue * kq, uintptr_t ident,
+                                 short filter)
+{
+    struct knote * kn;
+
+    LIST_FOREACH(kn, &kq->kq_knotes, kn_link) {
+        if (kn->kn_ident == ident && kn->kn_filter == filter)
+            return kn;
+    }
+
+    return NULL;
+}
+
+/**
+ * Remove a knote from a kqueue.
+ * Must be called with kq_lock held.
+ */
+static void knote_drop(struct kqueue * kq, struct knote * kn)
+{
+    /* No wakeups can run after the entries are detached. */
+    poll_table_detach(&kn->kn_pt);
+
+    mtx_lock(&kq->kq_wq_lock);
+    if (kn->kn_status & KN_ACTIVE)
+        TAILQ_REMOVE(&kq->kq_active, kn, kn_active);
+    mtx_unlock(&kq->kq_wq_lock);
+
+    LIST_REMOVE(kn, kn_link);
+    kobj_unref(&kn->kn_file->f_obj);
+    kfree(kn);
+}
+
+static int knote_attach(struct kqueue * kq, const struct kevent * kev,
+                        struct knote ** knp)
+{
+    struct knote * kn;
+    file_t * file;
+
+    if (kev->ident > INT_MAX)
+        return -EBADF;
+
+    file = fs_fildes_ref(curproc->files, (int)kev->ident, 1);
+    if (!file)
+        return -EBADF;
+
+    if (file->vnode->vnode_ops == &kqueue_ops) {
+        /* Nested kqueues are not supported. */
+        fs_fildes_ref(curproc->files, (int)kev->ident, -1);
+        return -EINVAL;
+    }
+
+    kn = kzalloc(sizeof(struct knote));
+    if (!kn) {
+        fs_fildes_ref(curproc->files, (int)kev->ident, -1);
+        return -ENOMEM;
+    }
+
+    kn->kn_kq = kq;
+    kn->kn_file = file;
+    kn->kn_ident = kev->ident;
+    kn->kn_filter = kev->filter;
+    kn->kn_pt = (struct poll_table){
+        .entries = kn->kn_pe,
+        .nr_entries = num_elem(kn->kn_pe),
+        .wakeup = knote_wakeup,
+        .arg = kn,
+    };
+    LIST_INSERT_HEAD(&kq->kq_knotes, kn, kn_link);
+
+    /* Register and get the initial state on the first scan. */
+    file->vnode->vnode_ops->poll(file, knote_events(kn), &kn->kn_pt);
+    mtx_lock(&kq->kq_wq_lock);
+    if (kn->kn_pt.nowq)
+        kn->kn_status |= KN_NOWQ;
+    knote_activate(kn);
+    mtx_unlock(&kq->kq_wq_lock);
+
+    *knp = kn;
+    return 0;
+}
+
+/**
+ * Apply a change to a kqueue.
+ * Must be called with kq_lock held.
+ */
+static int kqueue_register(struct kqueue * kq, const struct kevent * kev)
+{
+    struct knote * kn;
+    int err;
+
+    if (kev->filter != EVFILT_READ && kev->filter != EVFILT_WRITE)
+        return -EINVAL;
+
+    kn = knote_find(kq, kev->ident, kev->filter);
+    if (kev->flags & EV_DELETE) {
+        if (!kn)
+            return -ENOENT;
+        knote_drop(kq, kn);
+        return 0;
+    }
+
+    if (!kn) {
+        if (!(kev->flags & EV_ADD))
+            return -ENOENT;
+        err = knote_attach(kq, kev, &kn);
+        if (err)
+            return err;
+    }
+
+    kn->kn_flags = kev->flags & (EV_ONESHOT | EV_CLEAR);
+    kn->kn_udata = kev->udata;
+
+    mtx_lock(&kq->kq_wq_lock);
+    if (kev->flags & EV_DISABLE) {
+        kn->kn_status |= KN_DISABLED;
+        if (kn->kn_status & KN_ACTIVE) {
+            TAILQ_REMOVE(&kq->kq_active, kn, kn_active);
+            kn->kn_status &= ~KN_ACTIVE;
+        }
+    } else if (kev->flags & EV_ENABLE) {
+        kn->kn_status &= ~KN_DISABLED;
+        knote_activate(kn);
+    }
+    mtx_unlock(&kq->kq_wq_lock);
+
+    return 0;
+}
+
+/**
+ * Collect ready events from the active list.
+ * Only knotes that were woken up are polled, so the cost of a scan depends
+ * on the number of active knotes instead of the number of registered ones.
+ * Must be called with kq_lock held.
+ * @param[out] nowq is set if a knote without a wait queue is pending.
+ */
+static int kqueue_scan(struct kqueue * kq, struct kevent * kevs, int nevents,
+                       int * nowq)
+{
+    struct knote_activeq requeue = TAILQ_HEAD_INITIALIZER(requeue);
+    struct knote * kn;
+    int n = 0;
+
+    *nowq = 0;
+
+    mtx_lock(&kq->kq_wq_lock);
+    while (n < nevents && (kn = TAILQ_FIRST(&kq->kq_active))) {
+        file_t * file = kn->kn_file;
+        int revents;
+        int keep;
+
+        TAILQ_REMOVE(&kq->kq_active, kn, kn_active);
+        kn->kn_status &= ~KN_ACTIVE;
+        if (kn->kn_status & KN_DISABLED)
+            continue; /* Polled again once enabled. */
+        mtx_unlock(&kq->kq_wq_lock);
+
+        revents = file->vnode->vnode_ops->poll(file, knote_events(kn), NULL);
+        if (revents) {
+            struct kevent * kev = &kevs[n++];
+
+            kev->ident = kn->kn_ident;
+            kev->filter = kn->kn_filter;
+            kev->flags = kn->kn_flags;
+            if (revents & (POLLHUP | POLLERR))
+                kev->flags |= EV_EOF;
+            kev->fflags = 0;
+            kev->data = 0;
+            kev->udata = kn->kn_udata;
+
+            if (kn->kn_flags & EV_ONESHOT) {
+                knote_drop(kq, kn);
+                mtx_lock(&kq->kq_wq_lock);
+                continue;
+            }
+        }
+
+        /*
+         * Level-triggered knotes stay active while they are ready and knotes
+         * without a wait queue stay active until they become ready.
+         */
+        keep = (revents && !(kn->kn_flags & EV_CLEAR)) ||
+               (!revents && (kn->kn_status & KN_NOWQ));
+
+        mtx_lock(&kq->kq_wq_lock);
+        if (keep && !(kn->kn_status & (KN_ACTIVE | KN_DISABLED))) {
+            kn->kn_status |= KN_ACTIVE;
+            TAILQ_INSERT_TAIL(&requeue, kn, kn_active);
+            if (!revents)
+                *nowq = 1;
+        }
+    }
+    TAILQ_CONCAT(&kq->kq_active, &requeue, kn_active);
+    mtx_unlock(&kq->kq_wq_lock);
+
+    return n;
+}
+
+int fs_kevent_curproc(int fd, __user const struct kevent * changelist,
+                      int nchanges, __user struct kevent * eventlist,
+                      int nevents, int timeout)
+{
+    struct poll_waiter waiter;
+    struct kqueue * kq;
+    struct kevent * kevs = NULL;
+    file_t * file;
+    uint64_t deadline = 0;
+    int n = 0;
+    int err = 0;
+
+    if (nchanges < 0 || nevents < 0)
+        return -EINVAL;
+
+    file = fs_fildes_ref(curproc->files, fd, 1);
+    if (!file)
+        return -EBADF;
+    if (file->vnode->vnode_ops != &kqueue_ops) {
+        err = -EBADF;
+        goto out;
+    }
+    kq = (struct kqueue *)file->stream;
+
+    mtx_lock(&kq->kq_lock);
+
+    for (int i = 0; i < nchanges; i++) {
+        struct kevent kev;
+
+        err = copyin(&changelist[i], &kev, sizeof(kev));
+        if (err) {
+            err = -EFAULT;
+            goto out_unlock;
+        }
+
+        err = kqueue_register(kq, &kev);
+        if (err)
+            goto out_unlock;
+    }
+
+    if (nevents == 0)
+        goto out_unlock;
+
+    nevents = min(nevents, KQ_NEVENTS_MAX);
+    kevs = kmalloc(nevents * sizeof(struct kevent));
+    if (!kevs) {
+        err = -ENOMEM;
+        goto out_unlock;
+    }
+
+    if (timeout > 0)
+        deadline = get_utime() + (uint64_t)timeout * 1000;
+
+    poll_waiter_init(&waiter);
+    mtx_lock(&kq->kq_wq_lock);
+    LIST_INSERT_HEAD(&kq->kq_waiters, &waiter, entry_);
+    mtx_unlock(&kq->kq_wq_lock);
+
+    for (;;) {
+        uint64_t usec = 0;
+        int nowq;
+
+        poll_waiter_clear(&waiter);
+        n = kqueue_scan(kq, kevs, nevents, &nowq);
+        if (n > 0 || timeout == 0)
+            break;
+
+        if (timeout > 0) {
+            uint64_t now = get_utime();
+
+            if (now >= deadline)
+                break;
+            usec = deadline - now;
+        }
+        if (nowq && (usec == 0 || usec > FS_POLL_RESCAN_MS * 1000))
+            usec = FS_POLL_RESCAN_MS * 1000;
+
+        mtx_unlock(&kq->kq_lock);
+        err = poll_waiter_sleep(&waiter, usec);
+        mtx_lock(&kq->kq_lock);
+        if (err)
+            break;
+    }
+
+    mtx_lock(&kq->kq_wq_lock);
+    LIST_REMOVE(&waiter, entry_);
+    mtx_unlock(&kq->kq_wq_lock);
+
+    if (!err && n > 0 && copyout(kevs, eventlist, n * sizeof(struct kevent)))
+        err = -EFAULT;
+
+out_unlock:
+    mtx_unlock(&kq->kq_lock);
+    kfree(kevs);
+out:
+    fs_fildes_ref(curproc->files, fd, -1);
+
+    return (err) ? err : n;
+}
+
+static int kqueue_poll(file_t * file, int events, struct poll_table * pt)
+{
+    struct kqueue * kq = (struct kqueue *)file->stream;
+    int revents = 0;
+
+    poll_record(pt, &kq->kq_pwq);
+
+    mtx_lock(&kq->kq_wq_lock);
+    if (!TAILQ_EMPTY(&kq->kq_active))
+        revents |= POLLIN | POLLRDNORM;
+    mtx_unlock(&kq->kq_wq_lock);
+
+    return revents & events;
+}
+
+static int kqueue_stat(vnode_t * vnode, struct stat * stat)
+{
+    memset(stat, 0, sizeof(struct stat));
+    stat->st_ino = vnode->vn_num;
+    stat->st_mode = vnode->vn_mode;
+    stat->st_nlink = 1;
+    stat->st_uid = curproc->cred.euid;
+    stat->st_gid = curproc->cred.egid;
+
+    return 0;
+}
+
+/**
+ * Called when the last reference to the kqueue file is gone.
+ */
+static void kqueue_file_dtor(struct kobj * obj)
+{
+    file_t * file = containerof(obj, struct file, f_obj);
+    struct kqueue * kq = (struct kqueue *)file->stream;
+    struct knote * kn;
+
+    mtx_lock(&kq->kq_lock);
+    while ((kn = LIST_FIRST(&kq->kq_knotes))) {
+        knote_drop(kq, kn);
+    }
+    mtx_unlock(&kq->kq_lock);
+
+    vrele(file->vnode);
+}
+
+static int kqueue_destroy(vnode_t * vnode)
+{
+    struct kqueue * kq = (struct kqueue *)vnode->vn_specinfo;
+
+    pollwaitq_destroy(&kq->kq_pwq);
+    kfree(kq);
+
+    return 0;
+}
+
+int fs_kqueue_curproc_creat(void)
+{
+    struct kqueue * kq;
+    vnode_t * vnode;
+    file_t * file;
+    int fd;
+
+    kq = kzalloc(sizeof(struct kqueue));
+    if (!kq)
+        return -ENOMEM;
+    vnode = &kq->kq_vnode;
+    file = &kq->kq_file;
+
+    mtx_init(&kq->kq_lock, MTX_TYPE_TICKET, 0);
+    mtx_init(&kq->kq_wq_lock, MTX_TYPE_SPIN, MTX_OPT_DINT);
+    LIST_INIT(&kq->kq_knotes);
+    TAILQ_INIT(&kq->kq_active);
+    LIST_INIT(&kq->kq_waiters);
+    pollwaitq_init(&kq->kq_pwq);
+
+    fs_vnode_init(vnode, 0, &kqueue_sb, &kqueue_ops);
+    vrefset(vnode, 1);
+    vnode->vn_mode = S_IFIFO | S_IRUSR;
+    vnode->vn_specinfo = kq;
+
+    fs_fildes_set(file, vnode, O_RDONLY);
+    file->stream = kq;
+    kobj_init(&file->f_obj, kqueue_file_dtor);
+
+    fd = fs_fildes_curproc_next(file, 0);
+    if (fd < 0)
+        kfree(kq);
+
+    return fd;
+}
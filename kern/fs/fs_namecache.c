@@ -0,0 +1,304 @@
+/**
+ *******************************************************************************
+ * @file    fs_namecache.c
+ * @author  Olli Vanhoja
+ * @brief   VFS name lookup cache.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <stdint.h>
+#include <sys/queue.h>
+#include <sys/sysctl.h>
+#include <fs/fs.h>
+#include <fs/fs_namecache.h>
+#include <kinit.h>
+#include <klocks.h>
+#include <kmalloc.h>
+#include <kstring.h>
+#include <libkern.h>
+
+/**
+ * Number of hash buckets, must be a power of two.
+ */
+#define NC_HASH_SIZE    128
+
+/**
+ * Longer names are not cached.
+ */
+#define NC_NAME_MAX     31
+
+/**
+ * A name cache entry.
+ * An entry holds a reference to the directory and, if positive, to the
+ * vnode found.
+ */
+struct nc_entry {
+    LIST_ENTRY(nc_entry) nc_hashent;
+    TAILQ_ENTRY(nc_entry) nc_lruent;
+    vnode_t * nc_dir;
+    vnode_t * nc_vnode;     /*!< NULL for a negative entry. */
+    uint32_t nc_hash;
+    char nc_name[NC_NAME_MAX + 1];
+};
+
+LIST_HEAD(nc_bucket, nc_entry);
+TAILQ_HEAD(nc_list, nc_entry);
+
+static struct nc_bucket nc_hashtbl[NC_HASH_SIZE];
+static struct nc_list nc_lru = TAILQ_HEAD_INITIALIZER(nc_lru);
+static mtx_t nc_lock = MTX_INITIALIZER(MTX_TYPE_TICKET, 0);
+static uint32_t nc_key[2];
+static unsigned nc_generation;
+
+SYSCTL_DECL(_vfs_namecache);
+SYSCTL_NODE(_vfs, OID_AUTO, namecache, CTLFLAG_RW, 0,
+            "Name lookup cache");
+
+static int nc_max_entries = configFS_NAMECACHE_SIZE;
+SYSCTL_INT(_vfs_namecache, OID_AUTO, max_entries, CTLFLAG_RW,
+           &nc_max_entries, 0,
+           "Max number of entries in the name cache.");
+
+static unsigned nc_nr_entries;
+SYSCTL_UINT(_vfs_namecache, OID_AUTO, entries, CTLFLAG_RD,
+            &nc_nr_entries, 0,
+            "Number of entries in the name cache.");
+
+static unsigned nc_hits;
+SYSCTL_UINT(_vfs_namecache, OID_AUTO, hits, CTLFLAG_RD, &nc_hits, 0,
+            "Number of positive name cache hits.");
+
+static unsigned nc_neg_hits;
+SYSCTL_UINT(_vfs_namecache, OID_AUTO, neg_hits, CTLFLAG_RD, &nc_neg_hits, 0,
+            "Number of negative name cache hits.");
+
+static unsigned nc_misses;
+SYSCTL_UINT(_vfs_namecache, OID_AUTO, misses, CTLFLAG_RD, &nc_misses, 0,
+            "Number of name cache misses.");
+
+static int nc_cacheable(vnode_t * dir, const char * name)
+{
+    if (nc_max_entries <= 0 ||
+        !(dir->sb && dir->sb->fs &&
+          (dir->sb->fs->fs_flags & FS_FLAG_NAMECACHE)))
+        return 0;
+
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        return 0;
+
+    return strlenn(name, NC_NAME_MAX + 1) <= NC_NAME_MAX;
+}
+
+static uint32_t nc_hash(vnode_t * dir, const char * name)
+{
+    return halfsiphash32(name, strlenn(name, NC_NAME_MAX), nc_key) ^
+           (uint32_t)((uintptr_t)dir >> 3);
+}
+
+static struct nc_entry * nc_find(vnode_t * dir, const char * name,
+                                 uint32_t hash)
+{
+    struct nc_entry * e;
+
+    LIST_FOREACH(e, &nc_hashtbl[hash & (NC_HASH_SIZE - 1)], nc_hashent) {
+        if (e->nc_hash == hash && e->nc_dir == dir &&
+            !strcmp(e->nc_name, name))
+            return e;
+    }
+
+    return NULL;
+}
+
+/**
+ * Move an entry from the cache to a list of entries to be freed.
+ * @note nc_lock must be held.
+ */
+static void nc_remove(struct nc_entry * e, struct nc_list * freelist)
+{
+    LIST_REMOVE(e, nc_hashent);
+    TAILQ_REMOVE(&nc_lru, e, nc_lruent);
+    TAILQ_INSERT_TAIL(freelist, e, nc_lruent);
+    nc_nr_entries--;
+}
+
+/**
+ * Free entries removed from the cache.
+ * Releasing a vnode may call the file system, so this must be called
+ * without nc_lock held.
+ */
+static void nc_free_list(struct nc_list * freelist)
+{
+    struct nc_entry * e;
+    struct nc_entry * e_tmp;
+
+    TAILQ_FOREACH_SAFE(e, freelist, nc_lruent, e_tmp) {
+        vrele(e->nc_vnode);
+        vrele(e->nc_dir);
+        kfree(e);
+    }
+}
+
+unsigned fs_namecache_gen(void)
+{
+    unsigned gen;
+
+    mtx_lock(&nc_lock);
+    gen = nc_generation;
+    mtx_unlock(&nc_lock);
+
+    return gen;
+}
+
+int fs_namecache_lookup(vnode_t * dir, const char * name, vnode_t ** result)
+{
+    struct nc_entry * e;
+    uint32_t hash;
+
+    if (!nc_cacheable(dir, name))
+        return 0;
+
+    hash = nc_hash(dir, name);
+
+    mtx_lock(&nc_lock);
+    e = nc_find(dir, name, hash);
+    if (!e) {
+        nc_misses++;
+        mtx_unlock(&nc_lock);
+        return 0;
+    }
+
+    TAILQ_REMOVE(&nc_lru, e, nc_lruent);
+    TAILQ_INSERT_TAIL(&nc_lru, e, nc_lruent);
+    *result = e->nc_vnode;
+    if (e->nc_vnode) {
+        vref(e->nc_vnode);
+        nc_hits++;
+    } else {
+        nc_neg_hits++;
+    }
+    mtx_unlock(&nc_lock);
+
+    return 1;
+}
+
+void fs_namecache_enter(vnode_t * dir, const char * name, vnode_t * vnode,
+                        unsigned gen)
+{
+    struct nc_list freelist = TAILQ_HEAD_INITIALIZER(freelist);
+    struct nc_entry * e;
+
+    if (!nc_cacheable(dir, name))
+        return;
+
+    e = kmalloc(sizeof(struct nc_entry));
+    if (!e)
+        return;
+
+    e->nc_dir = dir;
+    e->nc_vnode = vnode;
+    e->nc_hash = nc_hash(dir, name);
+    strlcpy(e->nc_name, name, sizeof(e->nc_name));
+    vref(dir);
+    if (vnode)
+        vref(vnode);
+
+    mtx_lock(&nc_lock);
+    if (gen != nc_generation || nc_find(dir, name, e->nc_hash)) {
+        TAILQ_INSERT_TAIL(&freelist, e, nc_lruent);
+    } else {
+        LIST_INSERT_HEAD(&nc_hashtbl[e->nc_hash & (NC_HASH_SIZE - 1)], e,
+                         nc_hashent);
+        TAILQ_INSERT_TAIL(&nc_lru, e, nc_lruent);
+        nc_nr_entries++;
+
+        while (nc_nr_entries > (unsigned)max(nc_max_entries, 0)) {
+            nc_remove(TAILQ_FIRST(&nc_lru), &freelist);
+        }
+    }
+    mtx_unlock(&nc_lock);
+
+    nc_free_list(&freelist);
+}
+
+void fs_namecache_purge(vnode_t * dir, const char * name)
+{
+    struct nc_list freelist = TAILQ_HEAD_INITIALIZER(freelist);
+    struct nc_entry * e;
+    uint32_t hash = 0;
+    int cacheable;
+
+    cacheable = nc_cacheable(dir, name);
+    if (cacheable)
+        hash = nc_hash(dir, name);
+
+    mtx_lock(&nc_lock);
+    nc_generation++;
+    if (cacheable && (e = nc_find(dir, name, hash))) {
+        vnode_t * vn = e->nc_vnode;
+
+        nc_remove(e, &freelist);
+        if (vn && S_ISDIR(vn->vn_mode)) {
+            struct nc_entry * e_tmp;
+
+            TAILQ_FOREACH_SAFE(e, &nc_lru, nc_lruent, e_tmp) {
+                if (e->nc_dir == vn)
+                    nc_remove(e, &freelist);
+            }
+        }
+    }
+    mtx_unlock(&nc_lock);
+
+    nc_free_list(&freelist);
+}
+
+void fs_namecache_purge_all(void)
+{
+    struct nc_list freelist = TAILQ_HEAD_INITIALIZER(freelist);
+    struct nc_entry * e;
+
+    mtx_lock(&nc_lock);
+    nc_generation++;
+    while ((e = TAILQ_FIRST(&nc_lru))) {
+        nc_remove(e, &freelist);
+    }
+    mtx_unlock(&nc_lock);
+
+    nc_free_list(&freelist);
+}
+
+int __kinit__ fs_namecache_init(void)
+{
+    SUBSYS_INIT("fs_namecache");
+
+    nc_key[0] = krandom();
+    nc_key[1] = krandom();
+    /* Entries hashed with the old key can't be found anymore. */
+    fs_namecache_purge_all();
+
+    return 0;
+}
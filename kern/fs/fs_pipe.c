@@ -32,45 +32,65 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <buf.h>
 #include <fs/fs.h>
+#include <fs/fs_poll.h>
 #include <fs/fs_util.h>
 #include <kerror.h>
 #include <kinit.h>
 #include <kmalloc.h>
 #include <libkern.h>
 #include <proc.h>
-#include <queue_r.h>
+#include <thread.h>
 #include <kern_ipc.h>
 
 /*
  * TODO
- * - We should guarantee atomicity for transactions uder PIPE_BUF bytes
  * - Setting O_ASYNC should cause SIGIO to be sent if new input becomes
  *   available
  */
 
-/*
- * Just a humble guess that lazy yield may render improved performance on
- * MP system.
+/**
+ * A thread sleeping on a pipe.
  */
-#ifdef configMP
-#define PIPE_YIELD_STRATEGY THREAD_YIELD_LAZY
-#else
-#define PIPE_YIELD_STRATEGY THREAD_YIELD_IMMEDIATE
-#endif
+struct pipe_waiter {
+    pthread_t tid;
+    int linked; /*!< Cleared by the waker. */
+    SLIST_ENTRY(pipe_waiter) entry_;
+};
+
+SLIST_HEAD(pipe_waitq, pipe_waiter);
 
 /**
  * Pipe descriptor pointed by file->stream.
  */
 struct stream_pipe {
     struct vnode vnode;
-    struct queue_cb q;
     struct buf * bp;
+    /**
+     * Ring buffer.
+     * rd and wr are free running byte counters; wr - rd is the number of
+     * bytes in the ring.
+     */
+    struct pipe_ring {
+        char * data;
+        size_t size;
+        size_t rd;
+        size_t wr;
+    } ring;
+    mtx_t lock;     /*!< Protects the ring and the closed flags. */
+    mtx_t wq_lock;  /*!< Protects the wait queues. */
+    struct pipe_waitq rd_waiters; /*!< Threads waiting for data. */
+    struct pipe_waitq wr_waiters; /*!< Threads waiting for space. */
+    struct pollwaitq pwq; /*!< Pollers of either end. */
+    int rd_closed;  /*!< All read ends closed. */
+    int wr_closed;  /*!< All write ends closed. */
     file_t file0; /*!< Read end. */
     file_t file1; /*!< Write end. */
     uid_t owner;
@@ -83,6 +103,7 @@ struct stream_pipe {
 
 static ssize_t fs_pipe_write(file_t * file, struct uio * uio, size_t count);
 static ssize_t fs_pipe_read(file_t * file, struct uio * uio, size_t count);
+static int fs_pipe_poll(file_t * file, int events, struct poll_table * pt);
 static int fs_pipe_stat(vnode_t * vnode, struct stat * stat);
 static int fs_pipe_chmod(vnode_t * vnode, mode_t mode);
 static int fs_pipe_chown(vnode_t * vnode, uid_t owner, gid_t group);
@@ -90,6 +111,7 @@ static int fs_pipe_chown(vnode_t * vnode, uid_t owner, gid_t group);
 static vnode_ops_t fs_pipe_ops = {
     .write = fs_pipe_write,
     .read = fs_pipe_read,
+    .poll = fs_pipe_poll,
     .stat = fs_pipe_stat,
     .chmod = fs_pipe_chmod,
     .chown = fs_pipe_chown,
@@ -97,6 +119,7 @@ static vnode_ops_t fs_pipe_ops = {
 
 static struct fs fs_pipe_fs = {
     .fsname = "pipefs",
+    .fs_flags = FS_FLAG_UIO_VEC,
     .mount = NULL,
     .sblist_head = SLIST_HEAD_INITIALIZER(),
 };
@@ -118,6 +141,8 @@ int __kinit__ fs_pipe_init(void)
     return 0;
 }
 
+static void fs_pipe_file_dtor(struct kobj * obj);
+
 static void init_file(file_t * file, vnode_t * vn, struct stream_pipe * pipe,
                       int oflags)
 {
@@ -125,6 +150,9 @@ static void init_file(file_t * file, vnode_t * vn, struct stream_pipe * pipe,
 
     file->oflags &= ~O_CLOEXEC;
     file->stream = pipe;
+
+    /* We want to know when the last reference to either end is gone. */
+    kobj_init(&file->f_obj, fs_pipe_file_dtor);
 }
 
 static void init_times(struct stream_pipe * pipe)
@@ -152,7 +180,7 @@ int fs_pipe_curproc_creat(struct files_struct * files, int fildes[2],
     vnode_t * vnode;
     struct buf * bp;
 
-    len = memalign_size(len, MMU_PGSIZE_COARSE);
+    len = memalign_size(max(len, PIPE_BUF), MMU_PGSIZE_COARSE);
 
     /*
      * Allocate space for structs and get a buffer.
@@ -161,7 +189,7 @@ int fs_pipe_curproc_creat(struct files_struct * files, int fildes[2],
      * | pipe       |<--.
      * +------------+   |
      * | bp         |----------.
-     * | q          |   |      |
+     * | ring       |   |      |
      * |  data      |-------------------.
      * | file0      |   |      |        |
      * |  stream    |---+      |        |
@@ -195,9 +223,15 @@ int fs_pipe_curproc_creat(struct files_struct * files, int fildes[2],
     file1 = &pipe->file1;
     vnode = &pipe->vnode;
 
-    /* Init queue */
+    /* Init the ring */
     pipe->bp = bp;
-    pipe->q = queue_create((char *)bp->b_data, sizeof(char), len);
+    pipe->ring.data = (char *)bp->b_data;
+    pipe->ring.size = len;
+    mtx_init(&pipe->lock, MTX_TYPE_TICKET, 0);
+    mtx_init(&pipe->wq_lock, MTX_TYPE_SPIN, MTX_OPT_DINT);
+    SLIST_INIT(&pipe->rd_waiters);
+    SLIST_INIT(&pipe->wr_waiters);
+    pollwaitq_init(&pipe->pwq);
     pipe->owner = curproc->cred.euid;
     pipe->group = curproc->cred.egid;
 
@@ -235,81 +269,232 @@ int fs_pipe_destroy(vnode_t * vnode)
     return 0;
 }
 
+/**
+ * Wake up all threads sleeping on a pipe wait queue and the pollers of
+ * the pipe.
+ */
+static void pipe_wakeup(struct stream_pipe * pipe, struct pipe_waitq * waitq)
+{
+    struct pipe_waiter * waiter;
+
+    mtx_lock(&pipe->wq_lock);
+    while ((waiter = SLIST_FIRST(waitq))) {
+        SLIST_REMOVE_HEAD(waitq, entry_);
+        waiter->linked = 0;
+        thread_release(waiter->tid);
+    }
+    mtx_unlock(&pipe->wq_lock);
+
+    pollwakeup(&pipe->pwq);
+}
+
+/**
+ * Sleep on a pipe wait queue.
+ * Must be called with pipe->lock held; The lock is released while sleeping.
+ * The waiter is queued before pipe->lock is released and the thread is only
+ * blocked if it's still queued, so a pipe_wakeup() can't be missed.
+ * @return  Returns 0 if woken up by pipe_wakeup();
+ *          -EINTR if woken up by a signal.
+ */
+static int pipe_wait(struct stream_pipe * pipe, struct pipe_waitq * waitq)
+{
+    struct pipe_waiter waiter = {
+        .tid = current_thread->id,
+        .linked = 1,
+    };
+    int linked;
+
+    mtx_lock(&pipe->wq_lock);
+    SLIST_INSERT_HEAD(waitq, &waiter, entry_);
+    mtx_unlock(&pipe->wq_lock);
+    mtx_unlock(&pipe->lock);
+
+    mtx_lock(&pipe->wq_lock);
+    if (waiter.linked)
+        thread_block();
+    mtx_unlock(&pipe->wq_lock);
+    thread_wait_blocked();
+
+    mtx_lock(&pipe->wq_lock);
+    linked = waiter.linked;
+    if (linked)
+        SLIST_REMOVE(waitq, &waiter, pipe_waiter, entry_);
+    mtx_unlock(&pipe->wq_lock);
+    mtx_lock(&pipe->lock);
+
+    return (linked) ? -EINTR : 0;
+}
+
+/**
+ * Copy from a uio to the ring.
+ * The caller must make sure that there is at least len bytes of space.
+ */
+static int ring_copyin(struct pipe_ring * ring, struct uio * uio,
+                       size_t offset, size_t len)
+{
+    const size_t i = ring->wr % ring->size;
+    const size_t n = min(len, ring->size - i);
+    int err;
+
+    err = uio_copyin(uio, ring->data + i, offset, n);
+    if (!err && n < len)
+        err = uio_copyin(uio, ring->data, offset + n, len - n);
+    if (!err)
+        ring->wr += len;
+
+    return err;
+}
+
+/**
+ * Copy from the ring to a uio.
+ * The caller must make sure that there is at least len bytes in the ring.
+ */
+static int ring_copyout(struct pipe_ring * ring, struct uio * uio, size_t len)
+{
+    const size_t i = ring->rd % ring->size;
+    const size_t n = min(len, ring->size - i);
+    int err;
+
+    err = uio_copyout(ring->data + i, uio, 0, n);
+    if (!err && n < len)
+        err = uio_copyout(ring->data, uio, n, len - n);
+    if (!err)
+        ring->rd += len;
+
+    return err;
+}
+
 static ssize_t fs_pipe_write(file_t * file, struct uio * uio, size_t count)
 {
     struct stream_pipe * pipe = (struct stream_pipe *)file->stream;
-    char * buf_addr;
-    int err;
+    struct pipe_ring * ring = &pipe->ring;
+    size_t done = 0;
+    int err = 0;
 
     if (!(file->oflags & O_WRONLY))
         return -EBADF;
 
-    if (kobj_ref(&pipe->file0.f_obj)) {
-        return -EPIPE;
-    }
-
-    err = uio_get_kaddr(uio, (void **)(&buf_addr));
-    if (err)
-        return err;
+    mtx_lock(&pipe->lock);
+    while (done < count) {
+        size_t space;
 
-    /* TODO Implement O_NONBLOCK */
+        if (pipe->rd_closed) {
+            err = -EPIPE;
+            break;
+        }
 
-    for (size_t i = 0; i < count;) {
-        if (queue_push(&pipe->q, buf_addr + i))
-            i++;
         /*
-         * FIXME Yielding is really needed but currently there seems to some
-         *       strange performance issues.
+         * Writes of at most PIPE_BUF bytes must not be interleaved with
+         * other writes, so we wait until the whole write fits.
          */
-#if 0
-        thread_yield(PIPE_YIELD_STRATEGY);
-#endif
+        space = ring->size - (ring->wr - ring->rd);
+        if (space == 0 || (count <= PIPE_BUF && space < count)) {
+            if (file->oflags & O_NONBLOCK) {
+                err = -EAGAIN;
+                break;
+            }
+            err = pipe_wait(pipe, &pipe->wr_waiters);
+            if (err)
+                break;
+            continue;
+        }
+
+        space = min(space, count - done);
+        err = ring_copyin(ring, uio, done, space);
+        if (err)
+            break;
+        done += space;
+        pipe_wakeup(pipe, &pipe->rd_waiters);
     }
+    mtx_unlock(&pipe->lock);
 
-    return count;
+    return (done > 0) ? (ssize_t)done : err;
 }
 
 static ssize_t fs_pipe_read(file_t * file, struct uio * uio, size_t count)
 {
     struct stream_pipe * pipe = (struct stream_pipe *)file->stream;
-    char * buf_addr;
-    int oflags = file->oflags;
-    int trycount = 0;
-    int err;
+    struct pipe_ring * ring = &pipe->ring;
+    size_t avail;
+    int err = 0;
 
-    /*
-     * TODO Atomic pipes
-     *
-     * Instead of using that trycount we should actually make pipes atomic per
-     * PIPE_BUF and return immediately after some data is received.
-     */
-
-    if (!(oflags & O_RDONLY))
+    if (!(file->oflags & O_RDONLY))
         return -EBADF;
 
-    err = uio_get_kaddr(uio, (void **)(&buf_addr));
-    if (err)
-        return err;
-
-    for (size_t i = 0; i < count;) {
-        if (queue_isempty(&pipe->q) &&
-            ((trycount++ > 5 && (i > 0 || (oflags & O_NONBLOCK))) ||
-            kobj_ref(&pipe->file1.f_obj))) {
-            return i;
+    mtx_lock(&pipe->lock);
+    while ((avail = ring->wr - ring->rd) == 0) {
+        if (pipe->wr_closed) {
+            mtx_unlock(&pipe->lock);
+            return 0; /* EOF */
+        }
+        if (file->oflags & O_NONBLOCK) {
+            err = -EAGAIN;
+            goto out;
         }
+        err = pipe_wait(pipe, &pipe->rd_waiters);
+        if (err)
+            goto out;
+    }
 
-        if (queue_pop(&pipe->q, buf_addr + i))
-            i++;
-        /*
-         * FIXME Yielding is really needed but currently there seems to some
-         *       strange performance issues.
-         */
-#if 0
-        thread_yield(PIPE_YIELD_STRATEGY);
-#endif
+    /* Return whatever is available right now. */
+    avail = min(avail, count);
+    err = ring_copyout(ring, uio, avail);
+    if (!err)
+        pipe_wakeup(pipe, &pipe->wr_waiters);
+out:
+    mtx_unlock(&pipe->lock);
+
+    return (err) ? err : (ssize_t)avail;
+}
+
+static int fs_pipe_poll(file_t * file, int events, struct poll_table * pt)
+{
+    struct stream_pipe * pipe = (struct stream_pipe *)file->stream;
+    struct pipe_ring * ring = &pipe->ring;
+    size_t avail;
+    int revents = 0;
+
+    poll_record(pt, &pipe->pwq);
+
+    mtx_lock(&pipe->lock);
+    avail = ring->wr - ring->rd;
+    if (file->oflags & O_RDONLY) {
+        if (avail > 0 || pipe->wr_closed)
+            revents |= POLLIN | POLLRDNORM;
+        if (pipe->wr_closed)
+            revents |= POLLHUP;
     }
+    if (file->oflags & O_WRONLY) {
+        if (pipe->rd_closed)
+            revents |= POLLERR;
+        else if (ring->size - avail >= PIPE_BUF)
+            revents |= POLLOUT | POLLWRNORM;
+    }
+    mtx_unlock(&pipe->lock);
+
+    return revents & (events | POLLERR | POLLHUP);
+}
+
+/**
+ * Called when the last reference to either end of a pipe is gone.
+ */
+static void fs_pipe_file_dtor(struct kobj * obj)
+{
+    file_t * file = containerof(obj, struct file, f_obj);
+    struct stream_pipe * pipe = (struct stream_pipe *)file->stream;
+
+    mtx_lock(&pipe->lock);
+    if (file == &pipe->file0)
+        pipe->rd_closed = 1;
+    else
+        pipe->wr_closed = 1;
+    mtx_unlock(&pipe->lock);
+
+    /* Let the other end see EOF or EPIPE. */
+    pipe_wakeup(pipe, &pipe->rd_waiters);
+    pipe_wakeup(pipe, &pipe->wr_waiters);
 
-    return count;
+    vrele(file->vnode);
 }
 
 int fs_pipe_stat(vnode_t * vnode, struct stat * stat)
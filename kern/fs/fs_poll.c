@@ -0,0 +1,306 @@
+/**
+ *******************************************************************************
+ * @file    fs_poll.c
+ * @author  Olli Vanhoja
+ * @brief   Poll wait queues and poll().
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/sysctl.h>
+#include <fs/fs.h>
+#include <fs/fs_poll.h>
+#include <hal/hw_timers.h>
+#include <kmalloc.h>
+#include <libkern.h>
+#include <proc.h>
+#include <thread.h>
+#include <timers.h>
+
+SYSCTL_DECL(_kern_poll);
+SYSCTL_NODE(_kern, OID_AUTO, poll, CTLFLAG_RW, 0,
+            "Poll wait queues");
+
+static unsigned poll_sleeps;
+SYSCTL_UINT(_kern_poll, OID_AUTO, sleeps, CTLFLAG_RD, &poll_sleeps, 0,
+            "Number of times a thread went to sleep in poll.");
+
+static unsigned poll_wakeups;
+SYSCTL_UINT(_kern_poll, OID_AUTO, wakeups, CTLFLAG_RD, &poll_wakeups, 0,
+            "Number of poll wait queue wakeups.");
+
+static unsigned poll_rescans;
+SYSCTL_UINT(_kern_poll, OID_AUTO, rescans, CTLFLAG_RD, &poll_rescans, 0,
+            "Number of rescans of files without a wait queue.");
+
+void poll_waiter_init(struct poll_waiter * w)
+{
+    mtx_init(&w->lock, MTX_TYPE_SPIN, MTX_OPT_DINT);
+    w->tid = current_thread->id;
+    w->woken = 0;
+    w->blocked = 0;
+}
+
+void poll_waiter_clear(struct poll_waiter * w)
+{
+    mtx_lock(&w->lock);
+    w->woken = 0;
+    mtx_unlock(&w->lock);
+}
+
+void poll_waiter_wake(struct poll_waiter * w)
+{
+    mtx_lock(&w->lock);
+    w->woken = 1;
+    if (w->blocked) {
+        w->blocked = 0;
+        thread_release(w->tid);
+    }
+    mtx_unlock(&w->lock);
+}
+
+static void poll_timeout_event(void * event_arg)
+{
+    poll_waiter_wake((struct poll_waiter *)event_arg);
+}
+
+int poll_waiter_sleep(struct poll_waiter * w, uint64_t usec)
+{
+    int tim = -1;
+    int woken;
+
+    if (usec) {
+        tim = timers_add(poll_timeout_event, w, TIMERS_FLAG_ONESHOT, usec);
+        if (tim < 0)
+            return -EAGAIN;
+    }
+
+    /*
+     * The thread is only blocked if nobody has woken the waiter since it was
+     * cleared, so a wakeup that raced with the readiness check isn't lost.
+     */
+    mtx_lock(&w->lock);
+    if (!w->woken) {
+        w->blocked = 1;
+        thread_block();
+        poll_sleeps++;
+    }
+    if (tim >= 0)
+        timers_start(tim);
+    mtx_unlock(&w->lock);
+
+    thread_wait_blocked();
+
+    if (tim >= 0)
+        timers_release(tim);
+
+    mtx_lock(&w->lock);
+    woken = w->woken;
+    w->blocked = 0;
+    mtx_unlock(&w->lock);
+
+    return (woken) ? 0 : -EINTR;
+}
+
+void pollwaitq_init(struct pollwaitq * wq)
+{
+    mtx_init(&wq->lock, MTX_TYPE_SPIN, MTX_OPT_DINT);
+    LIST_INIT(&wq->head);
+}
+
+void pollwaitq_destroy(struct pollwaitq * wq)
+{
+    struct poll_entry * pe;
+
+    mtx_lock(&wq->lock);
+    while ((pe = LIST_FIRST(&wq->head))) {
+        LIST_REMOVE(pe, entry_);
+        pe->wq = NULL;
+        pe->wakeup(pe);
+    }
+    mtx_unlock(&wq->lock);
+}
+
+void poll_record(struct poll_table * pt, struct pollwaitq * wq)
+{
+    struct poll_entry * pe;
+
+    if (!pt)
+        return;
+
+    if (pt->nr_used >= pt->nr_entries) {
+        /* Out of entries, fall back to rescanning. */
+        pt->nowq = 1;
+        return;
+    }
+
+    pe = &pt->entries[pt->nr_used++];
+    pe->wakeup = pt->wakeup;
+    pe->arg = pt->arg;
+
+    mtx_lock(&wq->lock);
+    pe->wq = wq;
+    LIST_INSERT_HEAD(&wq->head, pe, entry_);
+    mtx_unlock(&wq->lock);
+}
+
+void poll_table_detach(struct poll_table * pt)
+{
+    for (size_t i = 0; i < pt->nr_used; i++) {
+        struct poll_entry * pe = &pt->entries[i];
+        struct pollwaitq * wq = pe->wq;
+
+        if (!wq)
+            continue;
+
+        mtx_lock(&wq->lock);
+        if (pe->wq) {
+            LIST_REMOVE(pe, entry_);
+            pe->wq = NULL;
+        }
+        mtx_unlock(&wq->lock);
+    }
+    pt->nr_used = 0;
+}
+
+void pollwakeup(struct pollwaitq * wq)
+{
+    struct poll_entry * pe;
+
+    mtx_lock(&wq->lock);
+    LIST_FOREACH(pe, &wq->head, entry_) {
+        pe->wakeup(pe);
+        poll_wakeups++;
+    }
+    mtx_unlock(&wq->lock);
+}
+
+static void poll_entry_wakeup(struct poll_entry * pe)
+{
+    poll_waiter_wake((struct poll_waiter *)pe->arg);
+}
+
+/**
+ * Check the readiness of all fds.
+ * @param pt is the poll table used to register on the wait queues of the
+ *           files or NULL if the files are already registered.
+ */
+static int poll_scan(struct pollfd * fds, size_t nfds, struct poll_table * pt)
+{
+    int count = 0;
+
+    for (size_t i = 0; i < nfds; i++) {
+        struct pollfd * pfd = &fds[i];
+        const int events = pfd->events | POLLERR | POLLHUP;
+        file_t * file;
+        int revents;
+
+        if (pfd->fd < 0) {
+            pfd->revents = 0;
+            continue;
+        }
+
+        file = fs_fildes_ref(curproc->files, pfd->fd, 1);
+        if (!file) {
+            pfd->revents = POLLNVAL;
+            count++;
+            continue;
+        }
+
+        if (pt)
+            pt->nr_entries = (i + 1) * FS_POLL_NWQ;
+        revents = file->vnode->vnode_ops->poll(file, events, pt);
+        fs_fildes_ref(curproc->files, pfd->fd, -1);
+
+        pfd->revents = revents & events;
+        if (pfd->revents)
+            count++;
+    }
+
+    return count;
+}
+
+int fs_poll_curproc(struct pollfd * fds, size_t nfds, int timeout)
+{
+    struct poll_waiter waiter;
+    struct poll_table pt = {
+        .wakeup = poll_entry_wakeup,
+        .arg = &waiter,
+    };
+    struct poll_table * ptp = &pt;
+    uint64_t deadline = 0;
+    int count;
+    int err = 0;
+
+    if (nfds > (size_t)curproc->files->count)
+        return -EINVAL;
+
+    if (timeout != 0 && nfds > 0) {
+        pt.entries = kcalloc(nfds * FS_POLL_NWQ, sizeof(struct poll_entry));
+        if (!pt.entries)
+            return -EAGAIN;
+    } else {
+        /* Nothing to wait for or a pure readiness check. */
+        ptp = NULL;
+    }
+
+    if (timeout > 0)
+        deadline = get_utime() + (uint64_t)timeout * 1000;
+
+    poll_waiter_init(&waiter);
+    for (;;) {
+        uint64_t usec = 0;
+
+        poll_waiter_clear(&waiter);
+        count = poll_scan(fds, nfds, ptp);
+        ptp = NULL; /* Only register on the first scan. */
+        if (count > 0 || timeout == 0)
+            break;
+
+        if (timeout > 0) {
+            uint64_t now = get_utime();
+
+            if (now >= deadline)
+                break;
+            usec = deadline - now;
+        }
+        if (pt.nowq && (usec == 0 || usec > FS_POLL_RESCAN_MS * 1000)) {
+            usec = FS_POLL_RESCAN_MS * 1000;
+            poll_rescans++;
+        }
+
+        err = poll_waiter_sleep(&waiter, usec);
+        if (err)
+            break;
+    }
+
+    poll_table_detach(&pt);
+    kfree(pt.entries);
+
+    return (err) ? err : count;
+}
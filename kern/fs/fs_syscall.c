@@ -38,6 +38,10 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/event.h>
+#include <sys/uio.h>
 #include <syscall.h>
 #include <errno.h>
 #include <kerror.h>
@@ -51,7 +55,9 @@
 #include <ksignal.h>
 #include <fs/devfs.h>
 #include <fs/fs.h>
+#include <fs/fs_poll.h>
 #include <fs/fs_util.h>
+#include <kmalloc.h>
 
 static int sys_readwrite(__user void * user_args, int write)
 {
@@ -114,6 +120,199 @@ static intptr_t sys_write(__user void * user_args)
     return sys_readwrite(user_args, !0);
 }
 
+/**
+ * Call the read or write vnode op for a vectored uio.
+ * If the file system doesn't accept multi-segment uios the segments are
+ * transferred one by one until a short transfer or an error.
+ */
+static ssize_t fs_readwritev(file_t * file, struct uio * uio, int write)
+{
+    vnode_t * vnode = file->vnode;
+    ssize_t (*op)(file_t *, struct uio *, size_t);
+    const int nsegs = uio_nsegs(uio);
+    ssize_t total = 0;
+
+    op = (write) ? vnode->vnode_ops->write : vnode->vnode_ops->read;
+
+    if (nsegs == 1 ||
+        (vnode->sb && (vnode->sb->fs->fs_flags & FS_FLAG_UIO_VEC)))
+        return op(file, uio, uio->bufsize);
+
+    for (int i = 0; i < nsegs; i++) {
+        struct uio seg;
+        ssize_t retval;
+
+        uio_get_seg(uio, i, &seg);
+        if (seg.bufsize == 0)
+            continue;
+
+        retval = op(file, &seg, seg.bufsize);
+        if (retval < 0)
+            return (total > 0) ? total : retval;
+        total += retval;
+        if ((size_t)retval < seg.bufsize)
+            break;
+    }
+
+    return total;
+}
+
+static intptr_t sys_readwritev(__user void * user_args, int write, int pos)
+{
+    struct _fs_readwritev_args args;
+    struct iovec * iov;
+    file_t * file;
+    vnode_t * vnode;
+    struct uio uio;
+    int err;
+    ssize_t retval;
+
+    if (copyin(user_args, &args, sizeof(args))) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    if (args.iovcnt <= 0 || args.iovcnt > IOV_MAX) {
+        set_errno(EINVAL);
+        return -1;
+    }
+
+    iov = kmalloc(args.iovcnt * sizeof(struct iovec));
+    if (!iov) {
+        set_errno(ENOMEM);
+        return -1;
+    }
+
+    if (copyin((__user void *)args.iov, iov,
+               args.iovcnt * sizeof(struct iovec))) {
+        set_errno(EFAULT);
+        retval = -1;
+        goto free_iov;
+    }
+
+    err = uio_init_uvec(&uio, iov, args.iovcnt,
+                        (write) ? VM_PROT_WRITE : VM_PROT_READ);
+    if (err) {
+        set_errno(-err);
+        retval = -1;
+        goto free_iov;
+    }
+
+    file = fs_fildes_ref(curproc->files, args.fildes, 1);
+    if (!file) {
+        set_errno(EBADF);
+        retval = -1;
+        goto free_iov;
+    }
+    vnode = file->vnode;
+
+    if (!((file->oflags & ((write) ? O_WRONLY : O_RDONLY)) && vnode)) {
+        set_errno(EBADF);
+        retval = -1;
+        goto out;
+    }
+
+    if (pos) {
+        file_t pfile;
+
+        if (S_ISFIFO(vnode->vn_mode) || S_ISSOCK(vnode->vn_mode)) {
+            set_errno(ESPIPE);
+            retval = -1;
+            goto out;
+        }
+        if (args.offset < 0) {
+            set_errno(EINVAL);
+            retval = -1;
+            goto out;
+        }
+
+        /*
+         * The positional variants must not change the file offset, so the
+         * op is called with a private copy of the file.
+         */
+        pfile = *file;
+        pfile.seek_pos = args.offset;
+        retval = fs_readwritev(&pfile, &uio, write);
+    } else {
+        retval = fs_readwritev(file, &uio, write);
+    }
+    if (retval < 0) {
+        set_errno(-retval);
+        retval = -1;
+    }
+
+out:
+    fs_fildes_ref(curproc->files, args.fildes, -1);
+free_iov:
+    kfree(iov);
+    return retval;
+}
+
+static intptr_t sys_readv(__user void * user_args)
+{
+    return sys_readwritev(user_args, 0, 0);
+}
+
+static intptr_t sys_writev(__user void * user_args)
+{
+    return sys_readwritev(user_args, !0, 0);
+}
+
+static intptr_t sys_preadv(__user void * user_args)
+{
+    return sys_readwritev(user_args, 0, !0);
+}
+
+static intptr_t sys_pwritev(__user void * user_args)
+{
+    return sys_readwritev(user_args, !0, !0);
+}
+
+static intptr_t sys_copy_file_range(__user void * user_args)
+{
+    struct _fs_copy_file_range_args args;
+    off_t off_in, off_out;
+    ssize_t retval;
+
+    if (copyin(user_args, &args, sizeof(args))) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    if (args.flags != 0) {
+        set_errno(EINVAL);
+        return -1;
+    }
+
+    if ((args.off_in && copyin((__user void *)args.off_in, &off_in,
+                               sizeof(off_t))) ||
+        (args.off_out && copyin((__user void *)args.off_out, &off_out,
+                                sizeof(off_t)))) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    retval = fs_copy_file_range_curproc(args.fd_in,
+                                        (args.off_in) ? &off_in : NULL,
+                                        args.fd_out,
+                                        (args.off_out) ? &off_out : NULL,
+                                        args.len);
+    if (retval < 0) {
+        set_errno(-retval);
+        return -1;
+    }
+
+    if ((args.off_in && copyout(&off_in, (__user void *)args.off_in,
+                                sizeof(off_t))) ||
+        (args.off_out && copyout(&off_out, (__user void *)args.off_out,
+                                 sizeof(off_t)))) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    return retval;
+}
+
 static intptr_t sys_lseek(__user void * user_args)
 {
     struct _fs_lseek_args args;
@@ -1096,6 +1295,91 @@ out:
     return retval;
 }
 
+static intptr_t sys_poll(__user void * user_args)
+{
+    struct _fs_poll_args args;
+    struct pollfd * fds = NULL;
+    size_t size;
+    int retval;
+
+    if (copyin(user_args, &args, sizeof(args))) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    if (args.nfds > (nfds_t)curproc->files->count) {
+        set_errno(EINVAL);
+        return -1;
+    }
+
+    size = args.nfds * sizeof(struct pollfd);
+    if (size > 0) {
+        fds = kmalloc(size);
+        if (!fds) {
+            set_errno(EAGAIN);
+            return -1;
+        }
+
+        if (copyin((__user void *)args.fds, fds, size)) {
+            set_errno(EFAULT);
+            retval = -1;
+            goto out;
+        }
+    }
+
+    retval = fs_poll_curproc(fds, args.nfds, args.timeout);
+    if (retval < 0) {
+        set_errno(-retval);
+        retval = -1;
+        goto out;
+    }
+
+    if (size > 0 && copyout(fds, (__user void *)args.fds, size)) {
+        set_errno(EFAULT);
+        retval = -1;
+    }
+
+out:
+    kfree(fds);
+    return retval;
+}
+
+static intptr_t sys_kqueue(__user void * user_args)
+{
+    int fd;
+
+    fd = fs_kqueue_curproc_creat();
+    if (fd < 0) {
+        set_errno(-fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static intptr_t sys_kevent(__user void * user_args)
+{
+    struct _fs_kevent_args args;
+    int retval;
+
+    if (copyin(user_args, &args, sizeof(args))) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    retval = fs_kevent_curproc(args.fd,
+                               (__user const struct kevent *)args.changelist,
+                               args.nchanges,
+                               (__user struct kevent *)args.eventlist,
+                               args.nevents, args.timeout);
+    if (retval < 0) {
+        set_errno(-retval);
+        return -1;
+    }
+
+    return retval;
+}
+
 /**
  * Declarations of fs syscall functions.
  */
@@ -1123,5 +1407,13 @@ static const syscall_handler_t fs_sysfnmap[] = {
     ARRDECL_SYSCALL_HNDL(SYSCALL_FS_UMASK, sys_umask),
     ARRDECL_SYSCALL_HNDL(SYSCALL_FS_MOUNT, sys_mount),
     ARRDECL_SYSCALL_HNDL(SYSCALL_FS_UMOUNT, sys_umount),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FS_POLL, sys_poll),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FS_KQUEUE, sys_kqueue),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FS_KEVENT, sys_kevent),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FS_READV, sys_readv),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FS_WRITEV, sys_writev),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FS_PREADV, sys_preadv),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FS_PWRITEV, sys_pwritev),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FS_COPY_FILE_RANGE, sys_copy_file_range),
 };
 SYSCALL_HANDLERDEF(fs_syscall, fs_sysfnmap)
@@ -40,303 +40,254 @@
 #include <fs/dehtable.h>
 
 /*
- * Chains
- * ------
+ * Chains and slots
+ * ----------------
  *
- * Dirent hash table uses chaining to solve collisions. Chains are dh_dirent
- * arrays that are dynamically resized when necessary.
+ * Every directory entry is a separate allocation that is linked to two
+ * places: a hash chain used for lookups and a slot array used for iteration.
  *
- * To keep a chain unbroken there shall be no empty slots between two entries.
- * If an entry is removed in the middle the chain must be restructured so that
- * empty slot is filled. There is no need to free the space left after
- * restructuring a chain because it will either completely reused on next link
- * or of partly freed if more than one entries have been removed before the next
- * insert.
+ * Each entry stores the full hash of its name, so a lookup only compares the
+ * names of entries having the same hash, and the chains can be redistributed
+ * without rehashing the names when the number of chains is doubled.
  *
- * dh_link tag must be used to mark the end of chain.
+ * The slot of an entry never changes, which makes the slot index a stable
+ * readdir cursor that can be resumed without walking the chains.
  */
 
-/**
- * Chain info struct.
- */
-typedef struct chain_info {
-    size_t i_last; /*!< Index of the last node of the chain. */
-    size_t i_size; /*!< Size of the chain. */
-} chain_info_t;
-
 #define DIRENT_SIZE (sizeof(dh_dirent_t) - sizeof(char))
 
-#define CH_NOLINK   0
-#define CH_LINK     1
-
-/**
- * Get reference to a directory entry in array.
- * @param dea is a directory entry array.
- * @param offset is the offset of dh_dirent in the array.
- * @return Pointer to a dh_dirent struct.
- */
-#define get_dirent(dea, offset) \
-    ((dh_dirent_t *)((size_t)(dea) + (offset)))
-
-/**
- * Returns true if given dirent node has an invalid dh_size.
- * Invalid dh_size would lead to invalid offset and possibly segmentation fault.
- * @param denode is a directory entry node.
- * @return 0 if dh_size is valid; Otherwise value other than zero.
- */
-#define is_invalid_offset(denode) \
-    ((denode)->dh_size > (DIRENT_SIZE + NAME_MAX + 1))
-
 /**
  * Hash function.
- * @note Only upto 32 bits.
  * @param str is the string to be hashed.
+ * @param len is the length of str.
  * @return Hash value.
  */
-static size_t hash_fname(const char * str, uint32_t k[2])
+static uint32_t hash_fname(const char * str, size_t len, uint32_t k[2])
 {
-    size_t len = strlenn(str, NAME_MAX + 1);
-    int mask;
-    int chunks = NBITS(DEHTABLE_SIZE);
-    uint32_t hash, retval = 0;
-
-    hash = halfsiphash32(str, len, k);
-
-    /* fold */
-    mask = (DEHTABLE_SIZE - 1);
-    while (chunks--) {
-        retval += hash & mask;
-        mask <<= (DEHTABLE_SIZE - 1);
-    }
-
-    /* truncate */
-    retval &= (DEHTABLE_SIZE - 1);
+    return halfsiphash32(str, len, k);
+}
 
-    return retval;
+static inline struct dh_dirent ** get_chain(dh_table_t * dir, uint32_t hash)
+{
+    return &dir->htable[hash & dir->hmask];
 }
 
 /**
- * Find a specific dirent node in chain.
- * @param chain     is the chain array.
+ * Find a specific dirent node.
+ * @param dir       is the dh_table.
  * @param name      is the name of the node searched for.
  * @param name_len  is the length of the name.
- * @return Returns a pointer to the node; Or null if node not found.
+ * @param hash      is the hash of the name.
+ * @return Returns a pointer to the pointer pointing to the node in its chain;
+ *         Or null if node not found.
  */
-static dh_dirent_t * find_node(dh_dirent_t * chain, const char * name)
+static dh_dirent_t ** find_node(dh_table_t * dir, const char * name,
+                                size_t name_len, uint32_t hash)
 {
-    size_t name_len = strlenn(name, NAME_MAX + 1) + 1;
-    size_t offset = 0;
-    dh_dirent_t * node;
-    dh_dirent_t * retval = 0;
+    dh_dirent_t ** nodep;
 
-    do {
-        node = get_dirent(chain, offset);
-        if (is_invalid_offset(node)) {
-            KERROR(KERROR_ERR, "Invalid offset in deh node");
-            break;
-        }
+    if (!dir->htable)
+        return NULL;
 
-        if (strncmp(node->dh_name, name, name_len) == 0) {
-            retval = node;
-            break;
-        }
-        offset += node->dh_size;
-    } while (node->dh_link == CH_LINK);
+    for (nodep = get_chain(dir, hash); *nodep; nodep = &(*nodep)->dh_next) {
+        const dh_dirent_t * node = *nodep;
 
-    return retval;
+        if (node->dh_hash == hash &&
+            strncmp(node->dh_name, name, name_len + 1) == 0)
+            return nodep;
+    }
+
+    return NULL;
 }
 
 /**
- * Find the last node of the chain.
- * @param chain is the dirent chain array.
- * @return Returns the updated chain_info struct.
+ * Double the number of hash chains.
+ * The table is left untouched if memory can't be allocated.
  */
-static chain_info_t find_last_node(dh_dirent_t * chain)
+static void grow_htable(dh_table_t * dir)
 {
-    dh_dirent_t * node;
-    chain_info_t chinfo;
+    const size_t old_size = dir->hmask + 1;
+    dh_dirent_t ** old = dir->htable;
+    dh_dirent_t ** new;
 
-    chinfo.i_size = 0;
-    do {
-        node = get_dirent(chain, chinfo.i_size);
-        if (is_invalid_offset(node)) {
-            KERROR(KERROR_ERR, "Invalid offset in deh node: %u",
-                     node->dh_size);
+    new = kcalloc(old_size << 1, sizeof(dh_dirent_t *));
+    if (!new)
+        return;
 
-            break;
-        }
-        chinfo.i_size += node->dh_size;
-    } while (node->dh_link == CH_LINK);
-    chinfo.i_last = chinfo.i_size - node->dh_size;
+    dir->htable = new;
+    dir->hmask = (old_size << 1) - 1;
 
-    return chinfo;
-}
+    for (size_t i = 0; i < old_size; i++) {
+        dh_dirent_t * node = old[i];
 
-static int rm_node(dh_dirent_t ** chain, const char * name)
-{
-    const chain_info_t chinfo = find_last_node(*chain);
-    size_t old_offset = 0;
-    size_t new_offset = 0;
-    size_t prev_noffset = 0;
-    dh_dirent_t * new_chain;
-    int match = 0;
-
-    if (chinfo.i_size < sizeof(void *))
-        return -ENOENT;
-
-    new_chain = kzalloc(chinfo.i_size);
-    if (!new_chain)
-        return -ENOMEM;
+        while (node) {
+            dh_dirent_t * next = node->dh_next;
+            dh_dirent_t ** chain = get_chain(dir, node->dh_hash);
 
-    /* Initial empty first entry. */
-    *get_dirent(new_chain, 0) = (dh_dirent_t){ .dh_size = 0 };
+            node->dh_next = *chain;
+            *chain = node;
+            node = next;
+        }
+    }
 
-    while (1) {
-        const dh_dirent_t * const node = get_dirent(*chain, old_offset);
+    kfree(old);
+}
 
-        if (is_invalid_offset(node)) {
-            KERROR(KERROR_ERR, "Invalid offset in deh node");
+/**
+ * Get a free slot index.
+ * @return Returns a slot index; Or SIZE_MAX if out of memory.
+ */
+static size_t get_free_slot(dh_table_t * dir)
+{
+    size_t i;
 
-            kfree(new_chain);
-            return -ENOTRECOVERABLE;
+    for (i = dir->first_hole; i < dir->nr_slots; i++) {
+        if (!dir->slots[i]) {
+            dir->first_hole = i + 1;
+            return i;
         }
+    }
 
-        /* Copy if no match or already matched. */
-        if (match || strncmp(node->dh_name, name, NAME_MAX + 1) != 0) {
-            dh_dirent_t * new_node = get_dirent(new_chain, new_offset);
-
-            memcpy(new_node, node, node->dh_size);
-            prev_noffset = new_offset;
-            new_offset += node->dh_size;
-        } else {
-            match = 1;
-        }
-        old_offset += node->dh_size;
+    if (dir->nr_slots == dir->slots_size) {
+        const size_t new_size = dir->slots_size ? dir->slots_size << 1
+                                                : DEHTABLE_SIZE;
+        dh_dirent_t ** new;
 
-        if (node->dh_link == CH_NOLINK)
-            break;
+        new = krealloc(dir->slots, new_size * sizeof(dh_dirent_t *));
+        if (!new)
+            return SIZE_MAX;
+        dir->slots = new;
+        dir->slots_size = new_size;
     }
 
-    get_dirent(new_chain, prev_noffset)->dh_link = CH_NOLINK;
+    i = dir->nr_slots++;
+    dir->first_hole = dir->nr_slots;
 
-    /* Check if new_chain is empty */
-    if (get_dirent(new_chain, 0)->dh_size == 0) {
-        kfree(new_chain);
-        new_chain = NULL;
-    }
+    return i;
+}
 
-    /* Replace old chain. */
-    kfree(*chain);
-    *chain = new_chain;
+static void put_slot(dh_table_t * dir, size_t i)
+{
+    dir->slots[i] = NULL;
+    if (i < dir->first_hole)
+        dir->first_hole = i;
 
-    return 0;
+    /* Trim trailing holes. */
+    while (dir->nr_slots > 0 && !dir->slots[dir->nr_slots - 1]) {
+        dir->nr_slots--;
+    }
+    if (dir->first_hole > dir->nr_slots)
+        dir->first_hole = dir->nr_slots;
 }
 
 void dh_init(dh_table_t * dir)
 {
+    memset(dir, 0, sizeof(dh_table_t));
     dir->k[0] = krandom();
     dir->k[1] = krandom();
-    memset(dir, 0, sizeof(dir->htable));
 }
 
 int dh_link(dh_table_t * dir, ino_t vnode_num, uint8_t d_type,
             const char * name)
 {
-    size_t name_len = strlenn(name, NAME_MAX + 1) + 1;
-    const size_t h = hash_fname(name, dir->k);
-    const size_t entry_size = memalign(DIRENT_SIZE + name_len);
-    dh_dirent_t * dea;
-    chain_info_t chinfo;
-    int retval = 0;
+    const size_t name_len = strlenn(name, NAME_MAX + 1);
+    const uint32_t hash = hash_fname(name, name_len, dir->k);
+    const size_t entry_size = memalign(DIRENT_SIZE + name_len + 1);
+    dh_dirent_t * node;
+    dh_dirent_t ** chain;
+    size_t slot;
 
     /* Verify that link doesn't exist */
-    if (!dh_lookup(dir, name, NULL)) {
-        retval = -EEXIST;
-        goto out;
+    if (find_node(dir, name, name_len, hash))
+        return -EEXIST;
+
+    if (!dir->htable) {
+        dir->htable = kcalloc(DEHTABLE_SIZE, sizeof(dh_dirent_t *));
+        if (!dir->htable)
+            return -ENOMEM;
+        dir->hmask = DEHTABLE_SIZE - 1;
     }
 
-    dea = dir->htable[h];
-    if (!dea) { /* Chain array not yet created. */
-        dea = kzalloc(entry_size);
-
-        chinfo.i_last = 0;
-        chinfo.i_size = 0; /* Set size to 0 to fool the assignment code as
-                            * this is the first entry. */
-    } else { /* Chain array found. */
-        /* Find the last node of the chain and realloc a longer chain. */
-        chinfo = find_last_node(dea);
-        dea = krealloc(dea, chinfo.i_size + entry_size);
-    }
-    if (!dea) {
-        /* OOM, can't add new entries. */
-        retval = -ENOMEM;
-        goto out;
+    node = kmalloc(entry_size);
+    if (!node)
+        return -ENOMEM;
+
+    slot = get_free_slot(dir);
+    if (slot == SIZE_MAX) {
+        kfree(node);
+        return -ENOMEM;
     }
-    dir->htable[h] = dea;
-
-    /* Create a link */
-    get_dirent(dea, chinfo.i_last)->dh_link = CH_LINK;
-    /* New node */
-    get_dirent(dea, chinfo.i_size)->dh_ino = vnode_num;
-    get_dirent(dea, chinfo.i_size)->dh_type = d_type;
-    get_dirent(dea, chinfo.i_size)->dh_size = entry_size;
-    get_dirent(dea, chinfo.i_size)->dh_link = CH_NOLINK;
-    strlcpy(get_dirent(dea, chinfo.i_size)->dh_name, name, name_len + 1);
-
-out:
-    return retval;
+
+    node->dh_ino = vnode_num;
+    node->dh_hash = hash;
+    node->dh_type = d_type;
+    node->dh_size = entry_size;
+    node->dh_slot = slot;
+    strlcpy(node->dh_name, name, name_len + 1);
+
+    chain = get_chain(dir, hash);
+    node->dh_next = *chain;
+    *chain = node;
+    dir->slots[slot] = node;
+
+    if (++dir->nr_entries > DEHTABLE_LOAD * (dir->hmask + 1))
+        grow_htable(dir);
+
+    return 0;
 }
 
 int dh_unlink(dh_table_t * dir, const char * name)
 {
-    const size_t h = hash_fname(name, dir->k);
-    dh_dirent_t ** dea;
-    int err;
+    const size_t name_len = strlenn(name, NAME_MAX + 1);
+    const uint32_t hash = hash_fname(name, name_len, dir->k);
+    dh_dirent_t ** nodep;
+    dh_dirent_t * node;
 
-    dea = &dir->htable[h];
-    if (!dea)
+    nodep = find_node(dir, name, name_len, hash);
+    if (!nodep)
         return -ENOENT;
 
-    err = rm_node(dea, name);
-    if (err)
-        return err;
+    node = *nodep;
+    *nodep = node->dh_next;
+    put_slot(dir, node->dh_slot);
+    dir->nr_entries--;
+    kfree(node);
 
     return 0;
 }
 
 void dh_destroy_all(dh_table_t * dir)
 {
-    size_t i;
-
-    /* Free all dir entry chains. */
-    for (i = 0; i < DEHTABLE_SIZE; i++) {
+    /* Free all dir entries. */
+    for (size_t i = 0; i < dir->nr_slots; i++) {
         /* No NuLL check needed. */
-        kfree(dir->htable[i]);
+        kfree(dir->slots[i]);
     }
+    kfree(dir->slots);
+    kfree(dir->htable);
+
+    dir->nr_entries = 0;
+    dir->hmask = 0;
+    dir->htable = NULL;
+    dir->slots = NULL;
+    dir->nr_slots = 0;
+    dir->slots_size = 0;
+    dir->first_hole = 0;
 }
 
-
 int dh_lookup(dh_table_t * dir, const char * name, ino_t * vnode_num)
 {
-    const size_t h = hash_fname(name, dir->k);
-    dh_dirent_t * dea;
-    dh_dirent_t * dent;
-    int retval = -ENOENT;
-
-    dea = dir->htable[h];
-    if (!dea)
-        goto out;
+    const size_t name_len = strlenn(name, NAME_MAX + 1);
+    dh_dirent_t ** nodep;
 
-    dent = find_node(dea, name);
-    if (!dent)
-        goto out;
+    nodep = find_node(dir, name, name_len, hash_fname(name, name_len, dir->k));
+    if (!nodep)
+        return -ENOENT;
 
     if (vnode_num)
-        *vnode_num = dent->dh_ino;
+        *vnode_num = (*nodep)->dh_ino;
 
-    retval = 0;
-out:
-    return retval;
+    return 0;
 }
 
 int dh_revlookup(dh_table_t * dir, ino_t ino, char * name, size_t name_len)
@@ -359,11 +310,15 @@ int dh_revlookup(dh_table_t * dir, ino_t ino, char * name, size_t name_len)
 }
 
 dh_dir_iter_t dh_get_iter(dh_table_t * dir)
+{
+    return dh_get_iter_at(dir, 0);
+}
+
+dh_dir_iter_t dh_get_iter_at(dh_table_t * dir, size_t cursor)
 {
     dh_dir_iter_t it = {
         .dir = dir,
-        .dea_ind = 0,
-        .ch_ind = SIZE_MAX
+        .slot = cursor,
     };
 
     return it;
@@ -371,55 +326,22 @@ dh_dir_iter_t dh_get_iter(dh_table_t * dir)
 
 dh_dirent_t * dh_iter_next(dh_dir_iter_t * it)
 {
-    dh_dirent_t * dea; /* Dir entry array (chain). */
-    dh_dirent_t * node; /* Dir entry node in chain. */
+    dh_table_t * dir = it->dir;
 
-    /* Already iterated over all nodes? */
-    if (!it->dir || it->dea_ind >= DEHTABLE_SIZE)
+    if (!dir)
         return NULL;
 
-    if (it->ch_ind == SIZE_MAX) { /* Get a next chain array */
-        size_t i = it->dea_ind;
-
-        it->ch_ind = 0; /* Reset chain index */
+    while (it->slot < dir->nr_slots) {
+        dh_dirent_t * node = dir->slots[it->slot++];
 
-        /* Get a dir entry array */
-        do {
-            dea = it->dir->htable[i];
-            i++;
-        } while (!dea && i < DEHTABLE_SIZE);
-
-        it->dea_ind = i - 1;
-    } else { /* Still iterating the old chain. */
-        dea = it->dir->htable[it->dea_ind];
-    }
-    if (!dea)
-        return NULL; /* Empty hash table or No more entries. */
-
-    /* Get a node from the chain. */
-    node = get_dirent(dea, it->ch_ind);
-    if (is_invalid_offset(node))
-        return NULL; /* Broken dirent hash table. */
-
-    if (node->dh_link == CH_LINK) {
-        it->ch_ind += node->dh_size;
-    } else {
-        it->dea_ind++;
-        it->ch_ind = SIZE_MAX; /* It's quite safe to assume the array is
-                                * shorter than SIZE_MAX. */
+        if (node)
+            return node;
     }
 
-    return node;
+    return NULL;
 }
 
 size_t dh_nr_entries(dh_table_t * dir)
 {
-    dh_dir_iter_t it = dh_get_iter(dir);
-    size_t n = 0;
-
-    while (dh_iter_next(&it)) {
-        n++;
-    }
-
-    return n;
+    return dir->nr_entries;
 }
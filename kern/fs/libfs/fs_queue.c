@@ -33,6 +33,7 @@
 
 #include <errno.h>
 #include <machine/atomic.h>
+#include <poll.h>
 #include <fs/fs_queue.h>
 #include <kerror.h>
 #include <libkern.h>
@@ -60,6 +61,7 @@ struct fs_queue * fs_queue_create(size_t nr_blocks, size_t block_size)
     fsq->qcb = queue_create(fsq->packet, block_size, nr_blocks);
     mtx_init(&fsq->wr_lock, MTX_TYPE_TICKET, MTX_OPT_DEFAULT);
     mtx_init(&fsq->rd_lock, MTX_TYPE_TICKET, MTX_OPT_DEFAULT);
+    pollwaitq_init(&fsq->pwq);
     fsq->bp = bp;
 
     return fsq;
@@ -72,6 +74,8 @@ void fs_queue_destroy(struct fs_queue * fsq)
     if (!fsq)
         return;
 
+    pollwaitq_destroy(&fsq->pwq);
+
     bp = fsq->bp;
     KASSERT(bp != NULL, "bp should be valid");
     if (bp->vm_ops->rfree)
@@ -234,6 +238,7 @@ ssize_t fs_queue_write(struct fs_queue * fsq, uint8_t * buf, size_t count,
 
         queue_alloc_commit(&fsq->qcb);
         fsq_sigsend(fsq, FSQ_WAIT4WRITE);
+        pollwakeup(&fsq->pwq);
     }
 
     if (bytes > 0 && !(flags & FS_QUEUE_FLAGS_PACKET)) {
@@ -318,5 +323,20 @@ ssize_t fs_queue_read(struct fs_queue * fsq, uint8_t * buf, size_t count,
 out:
     fsq_sigsend(fsq, FSQ_WAIT4READ);
     mtx_unlock(&fsq->rd_lock);
+    pollwakeup(&fsq->pwq);
     return rd;
 }
+
+int fs_queue_poll(struct fs_queue * fsq, int events, struct poll_table * pt)
+{
+    int revents = 0;
+
+    poll_record(pt, &fsq->pwq);
+
+    if (!queue_isempty(&fsq->qcb))
+        revents |= POLLIN | POLLRDNORM;
+    if (!queue_isfull(&fsq->qcb))
+        revents |= POLLOUT | POLLWRNORM;
+
+    return revents & events;
+}
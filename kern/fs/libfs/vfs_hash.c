@@ -32,35 +32,187 @@
 #include <fs/vfs_hash.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <subr_hash.h>
 #include <sys/mount.h>
 #include <sys/param.h>
 #include <sys/queue.h>
+#include <sys/sysctl.h>
+#include <hal/core.h>
 #include <kinit.h>
 #include <klocks.h>
 #include <kmalloc.h>
+#include <kstring.h>
+#include <rcu.h>
+
+/**
+ * Number of writer locks per context.
+ * Bucket i is protected by the lock i & (VFS_HASH_NLOCKS - 1). As the table
+ * size is always a power of two and at least VFS_HASH_NLOCKS, the lock of
+ * a given key doesn't change when the table grows.
+ */
+#define VFS_HASH_NLOCKS         64
+
+/**
+ * Max number of buckets in a table.
+ */
+#define VFS_HASH_MAX_BUCKETS    (1 << 16)
+
+/**
+ * Max average chain length before the table is doubled.
+ */
+#define VFS_HASH_LOAD           2
+
+/**
+ * Number of lockless lookup attempts before falling back to a locked lookup.
+ */
+#define VFS_HASH_RETRIES        3
+
+/**
+ * Tag bit set in vn_hashnext when a vnode is removed from a chain.
+ * The rest of the pointer is left intact so that RCU readers standing on a
+ * removed vnode can still continue the walk.
+ */
+#define VFS_HASH_REMOVED        ((uintptr_t)1)
+
+/**
+ * Hash table.
+ * Tables are replaced, never resized in place, so readers can keep walking
+ * an old table until the end of their RCU read section.
+ */
+struct vfs_hash_tbl {
+    size_t tbl_mask;
+    struct rcu_cb tbl_rcu;
+    struct vnode * tbl_head[];
+};
 
 struct vfs_hash_ctx {
     const char * ctx_fsname;
-    LIST_HEAD(vfs_hash_head, vnode) * ctx_hash_tbl;
-    size_t ctx_hash_mask;
+    struct vfs_hash_tbl * ctx_tbl; /*!< RCU managed pointer to the table. */
     vfs_hash_cmp_t * ctx_cmp_fn;
-    mtx_t ctx_lock;
+    atomic_t ctx_nentries;
+    /**
+     * Writer sequence.
+     * Incremented before and after each modification. A lockless reader can
+     * only trust a miss if no writer was active during the walk.
+     */
+    atomic_t ctx_wr_begin;
+    atomic_t ctx_wr_end;
+    atomic_t ctx_resizing;
+    atomic_t ctx_resizes;
+    SLIST_ENTRY(vfs_hash_ctx) ctx_link;
+    mtx_t ctx_lock[VFS_HASH_NLOCKS];
 };
 
+static SLIST_HEAD(vfs_hash_ctx_list, vfs_hash_ctx) vfs_hash_ctx_list =
+    SLIST_HEAD_INITIALIZER(vfs_hash_ctx_list);
+static mtx_t vfs_hash_ctx_list_lock = MTX_INITIALIZER(MTX_TYPE_SPIN,
+                                                      MTX_OPT_DEFAULT);
+
+SYSCTL_DECL(_vfs_hash);
+SYSCTL_NODE(_vfs, OID_AUTO, hash, CTLFLAG_RW, 0,
+            "vfs_hash vnode lookup tables");
+
+static atomic_t vfs_hash_rcu_hits;
+SYSCTL_INT(_vfs_hash, OID_AUTO, rcu_hits, CTLFLAG_RD,
+           &vfs_hash_rcu_hits, 0,
+           "Number of vfs_hash_get() calls served without locking.");
+
+static atomic_t vfs_hash_retries;
+SYSCTL_INT(_vfs_hash, OID_AUTO, retries, CTLFLAG_RD,
+           &vfs_hash_retries, 0,
+           "Number of lockless lookups retried due to a concurrent writer.");
+
+static atomic_t vfs_hash_locked_lookups;
+SYSCTL_INT(_vfs_hash, OID_AUTO, locked_lookups, CTLFLAG_RD,
+           &vfs_hash_locked_lookups, 0,
+           "Number of vfs_hash_get() calls served under a bucket lock.");
+
+static atomic_t vfs_hash_resizes;
+SYSCTL_INT(_vfs_hash, OID_AUTO, resizes, CTLFLAG_RD,
+           &vfs_hash_resizes, 0,
+           "Number of times a vfs_hash table has been grown.");
+
+static inline struct vnode * vn_hash_next(struct vnode * vp)
+{
+    return (struct vnode *)((uintptr_t)ACCESS_ONCE(vp->vn_hashnext) &
+                            ~VFS_HASH_REMOVED);
+}
+
+static inline int vn_hash_removed(struct vnode * vp)
+{
+    return !!((uintptr_t)ACCESS_ONCE(vp->vn_hashnext) & VFS_HASH_REMOVED);
+}
+
+static inline mtx_t * vfs_hash_lock(struct vfs_hash_ctx * ctx, size_t key)
+{
+    return &ctx->ctx_lock[key & (VFS_HASH_NLOCKS - 1)];
+}
+
+static inline struct vnode ** vfs_hash_head(struct vfs_hash_tbl * tbl,
+                                            size_t key)
+{
+    return &tbl->tbl_head[key & tbl->tbl_mask];
+}
+
+static inline void vfs_hash_wr_begin(struct vfs_hash_ctx * ctx)
+{
+    atomic_inc(&ctx->ctx_wr_begin);
+    cpu_wmb();
+}
+
+static inline void vfs_hash_wr_end(struct vfs_hash_ctx * ctx)
+{
+    cpu_wmb();
+    atomic_inc(&ctx->ctx_wr_end);
+}
+
+static struct vfs_hash_tbl * vfs_hash_tbl_alloc(size_t nbuckets)
+{
+    struct vfs_hash_tbl * tbl;
+
+    tbl = kzalloc(sizeof(struct vfs_hash_tbl) +
+                  nbuckets * sizeof(struct vnode *));
+    if (!tbl)
+        return NULL;
+
+    tbl->tbl_mask = nbuckets - 1;
+
+    return tbl;
+}
+
+static void vfs_hash_tbl_free(struct rcu_cb * cb)
+{
+    kfree(containerof(cb, struct vfs_hash_tbl, tbl_rcu));
+}
+
 vfs_hash_ctx_t vfs_hash_new_ctx(const char * fsname, unsigned desiredvnodes,
                                 vfs_hash_cmp_t * cmp_fn)
 {
     struct vfs_hash_ctx * ctx;
+    size_t nbuckets = VFS_HASH_NLOCKS;
 
-    ctx = kmalloc(sizeof(struct vfs_hash_ctx));
+    ctx = kzalloc(sizeof(struct vfs_hash_ctx));
     if (!ctx)
         return NULL;
 
+    while (nbuckets < VFS_HASH_MAX_BUCKETS &&
+           VFS_HASH_LOAD * (nbuckets << 1) <= desiredvnodes) {
+        nbuckets <<= 1;
+    }
+    ctx->ctx_tbl = vfs_hash_tbl_alloc(nbuckets);
+    if (!ctx->ctx_tbl) {
+        kfree(ctx);
+        return NULL;
+    }
+
     ctx->ctx_fsname = fsname;
-    ctx->ctx_hash_tbl = hashinit(desiredvnodes, &ctx->ctx_hash_mask);
     ctx->ctx_cmp_fn = cmp_fn;
-    mtx_init(&ctx->ctx_lock, MTX_TYPE_SPIN, MTX_OPT_DEFAULT);
+    for (size_t i = 0; i < VFS_HASH_NLOCKS; i++) {
+        mtx_init(&ctx->ctx_lock[i], MTX_TYPE_SPIN, MTX_OPT_DEFAULT);
+    }
+
+    mtx_lock(&vfs_hash_ctx_list_lock);
+    SLIST_INSERT_HEAD(&vfs_hash_ctx_list, ctx, ctx_link);
+    mtx_unlock(&vfs_hash_ctx_list_lock);
 
     return ctx;
 }
@@ -70,75 +222,265 @@ size_t vfs_hash_index(struct vnode * vp)
     return vp->vn_hash + vp->sb->sb_hashseed;
 }
 
-static inline struct vfs_hash_head *
-vfs_hash_bucket(struct vfs_hash_ctx * ctx,
-                const struct fs_superblock * mp,
-                size_t hash)
+/**
+ * Double the size of the table of a context.
+ * Writers are excluded by taking all the writer locks; readers keep walking
+ * either table and detect the move by the writer sequence.
+ */
+static void vfs_hash_grow(struct vfs_hash_ctx * ctx)
 {
-    return &ctx->ctx_hash_tbl[(hash + mp->sb_hashseed) & ctx->ctx_hash_mask];
+    struct vfs_hash_tbl * old;
+    struct vfs_hash_tbl * new;
+    size_t nbuckets;
+
+    if (atomic_test_and_set(&ctx->ctx_resizing))
+        return; /* Already being resized. */
+
+    /* Only the resizer can change ctx_tbl. */
+    nbuckets = (ctx->ctx_tbl->tbl_mask + 1) << 1;
+    if (nbuckets > VFS_HASH_MAX_BUCKETS)
+        goto out;
+
+    new = vfs_hash_tbl_alloc(nbuckets);
+    if (!new)
+        goto out;
+
+    for (size_t i = 0; i < VFS_HASH_NLOCKS; i++) {
+        mtx_lock(&ctx->ctx_lock[i]);
+    }
+    old = ctx->ctx_tbl;
+
+    vfs_hash_wr_begin(ctx);
+    for (size_t i = 0; i <= old->tbl_mask; i++) {
+        struct vnode * vp;
+
+        /*
+         * Move the vnodes one by one to the head of their new chain. A reader
+         * standing on a moved vnode continues on its new chain, which is
+         * always terminated.
+         */
+        while ((vp = old->tbl_head[i])) {
+            struct vnode ** head = vfs_hash_head(new, vfs_hash_index(vp));
+
+            ACCESS_ONCE(old->tbl_head[i]) = vp->vn_hashnext;
+            vp->vn_hashnext = *head;
+            *head = vp;
+        }
+    }
+    rcu_assign_pointer(ctx->ctx_tbl, new);
+    atomic_inc(&ctx->ctx_resizes);
+    vfs_hash_wr_end(ctx);
+
+    for (size_t i = VFS_HASH_NLOCKS; i > 0; i--) {
+        mtx_unlock(&ctx->ctx_lock[i - 1]);
+    }
+
+    rcu_call(&old->tbl_rcu, vfs_hash_tbl_free);
+    atomic_inc(&vfs_hash_resizes);
+out:
+    atomic_set(&ctx->ctx_resizing, 0);
+}
+
+/**
+ * Find a vnode from a table.
+ * The writer lock of the key must be held.
+ */
+static struct vnode * vfs_hash_find(struct vfs_hash_ctx * ctx,
+                                    struct vfs_hash_tbl * tbl,
+                                    const struct fs_superblock * mp,
+                                    size_t hash, void * cmp_arg)
+{
+    struct vnode * vp;
+
+    for (vp = *vfs_hash_head(tbl, hash + mp->sb_hashseed); vp;
+         vp = vp->vn_hashnext) {
+        if (vp->vn_hash != hash)
+            continue;
+        if (vp->sb != mp)
+            continue;
+        if (ctx->ctx_cmp_fn && ctx->ctx_cmp_fn(vp, cmp_arg))
+            continue;
+        return vp;
+    }
+
+    return NULL;
+}
+
+/**
+ * Unlink a vnode from a chain.
+ * The writer lock of the chain must be held.
+ * @return Returns 0 if the vnode was unlinked;
+ *         -ENOENT if the vnode wasn't found from the chain.
+ */
+static int vfs_hash_unlink(struct vfs_hash_ctx * ctx, struct vnode ** head,
+                           struct vnode * vp)
+{
+    struct vnode ** prevp;
+
+    for (prevp = head; *prevp; prevp = &(*prevp)->vn_hashnext) {
+        if (*prevp == vp) {
+            struct vnode * next = vp->vn_hashnext;
+
+            ACCESS_ONCE(vp->vn_hashnext) =
+                (struct vnode *)((uintptr_t)next | VFS_HASH_REMOVED);
+            rcu_assign_pointer(*prevp, next);
+            atomic_dec(&ctx->ctx_nentries);
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+/**
+ * Lockless lookup.
+ * @return Returns 0 if *vpp is valid, i.e. the vnode was found and referenced
+ *         or the result is a reliable miss; -EAGAIN if the lookup must be
+ *         retried.
+ */
+static int vfs_hash_get_rcu(struct vfs_hash_ctx * ctx,
+                            const struct fs_superblock * mp,
+                            size_t hash, struct vnode ** vpp)
+{
+    struct rcu_lock_ctx rcu;
+    struct vfs_hash_tbl * tbl;
+    struct vnode * vp;
+    int seq;
+    int retval = -EAGAIN;
+
+    rcu = rcu_read_lock();
+    seq = atomic_read(&ctx->ctx_wr_begin);
+    cpu_wmb();
+    if (seq != atomic_read(&ctx->ctx_wr_end))
+        goto out; /* A writer is active. */
+
+    tbl = rcu_dereference(ctx->ctx_tbl);
+    for (vp = rcu_dereference(*vfs_hash_head(tbl, hash + mp->sb_hashseed));
+         vp; vp = vn_hash_next(vp)) {
+        if (vp->vn_hash != hash)
+            continue;
+        if (vp->sb != mp)
+            continue;
+
+        if (vref(vp))
+            goto out;
+        /*
+         * The vnode may have been removed and recycled while we were walking
+         * the chain, so check it again now that we hold a reference.
+         */
+        if (vn_hash_removed(vp) || vp->vn_hash != hash || vp->sb != mp) {
+            vrele_nunlink(vp);
+            goto out;
+        }
+
+        *vpp = vp;
+        retval = 0;
+        goto out;
+    }
+
+    cpu_wmb();
+    if (atomic_read(&ctx->ctx_wr_begin) == seq) {
+        *vpp = NULL;
+        retval = 0;
+    }
+out:
+    rcu_read_unlock(&rcu);
+    return retval;
 }
 
 int vfs_hash_get(vfs_hash_ctx_t ctx, const struct fs_superblock * mp,
                  size_t hash, struct vnode ** vpp, void * cmp_arg)
 {
+    const size_t key = hash + mp->sb_hashseed;
+    mtx_t * lock = vfs_hash_lock(ctx, key);
     struct vnode * vp;
 
-    while (1) {
-        mtx_lock(&ctx->ctx_lock);
-        LIST_FOREACH(vp, vfs_hash_bucket(ctx, mp, hash), vn_hashlist) {
-            if (vp->vn_hash != hash)
-                continue;
-            if (vp->sb != mp)
-                continue;
-            if (ctx->ctx_cmp_fn && ctx->ctx_cmp_fn(vp, cmp_arg))
-                continue;
-            //VN_LOCK(vp);
-            mtx_unlock(&ctx->ctx_lock);
-            vref(vp);
-            *vpp = vp;
-            return 0; /* TODO Return or break? */
-        }
-        if (vp == NULL) {
-            mtx_unlock(&ctx->ctx_lock);
-            *vpp = NULL;
-            return 0;
+    /*
+     * The comparator may need data that is freed right after
+     * vfs_hash_remove(), so it's only ever called with the lock held.
+     */
+    if (!ctx->ctx_cmp_fn) {
+        for (int i = 0; i < VFS_HASH_RETRIES; i++) {
+            if (vfs_hash_get_rcu(ctx, mp, hash, vpp) == 0) {
+                if (*vpp)
+                    atomic_inc(&vfs_hash_rcu_hits);
+                return 0;
+            }
+            atomic_inc(&vfs_hash_retries);
         }
     }
+
+    atomic_inc(&vfs_hash_locked_lookups);
+    mtx_lock(lock);
+    vp = vfs_hash_find(ctx, ctx->ctx_tbl, mp, hash, cmp_arg);
+    if (vp) {
+        //VN_LOCK(vp);
+        vref(vp);
+    }
+    mtx_unlock(lock);
+
+    *vpp = vp;
+    return 0;
 }
 
 int vfs_hash_remove(vfs_hash_ctx_t ctx, struct vnode * vp)
 {
+    const size_t key = vfs_hash_index(vp);
+    mtx_t * lock = vfs_hash_lock(ctx, key);
+    int err;
 
-    mtx_lock(&ctx->ctx_lock);
-    LIST_REMOVE(vp, vn_hashlist);
-    mtx_unlock(&ctx->ctx_lock);
+    mtx_lock(lock);
+    vfs_hash_wr_begin(ctx);
+    err = vfs_hash_unlink(ctx, vfs_hash_head(ctx->ctx_tbl, key), vp);
+    vfs_hash_wr_end(ctx);
+    mtx_unlock(lock);
 
-    return 0;
+    return err;
 }
 
 int vfs_hash_foreach(vfs_hash_ctx_t ctx, const struct fs_superblock * mp,
                      void (*cb)(struct vnode *))
 {
-    struct vfs_hash_head * bucket;
-
     if (!ctx) {
         return -EINVAL;
     }
 
-    mtx_lock(&ctx->ctx_lock);
-    HASH_FOREACH_BUCKET_BEGIN(ctx->ctx_hash_tbl, mp->sb_hashseed, bucket) {
-        struct vnode * vp;
-        struct vnode * vp_tmp;
+    for (size_t i = 0; i < VFS_HASH_NLOCKS; i++) {
+        mtx_t * lock = &ctx->ctx_lock[i];
+        size_t bucket = i;
+        int resizes;
+
+        mtx_lock(lock);
+        resizes = atomic_read(&ctx->ctx_resizes);
+        while (bucket <= ctx->ctx_tbl->tbl_mask) {
+            struct vnode ** head = &ctx->ctx_tbl->tbl_head[bucket];
+            struct vnode * vp;
 
-        LIST_FOREACH_SAFE(vp, bucket, vn_hashlist, vp_tmp) {
-            if (vp->sb != mp)
+            for (vp = *head; vp; vp = vp->vn_hashnext) {
+                if (vp->sb == mp)
+                    break;
+            }
+            if (!vp) {
+                bucket += VFS_HASH_NLOCKS;
                 continue;
-            mtx_unlock(&ctx->ctx_lock);
+            }
+
+            vfs_hash_wr_begin(ctx);
+            (void)vfs_hash_unlink(ctx, head, vp);
+            vfs_hash_wr_end(ctx);
+
+            mtx_unlock(lock);
             cb(vp);
-            mtx_lock(&ctx->ctx_lock);
+            mtx_lock(lock);
+
+            /* Start over if the table was replaced while unlocked. */
+            if (atomic_read(&ctx->ctx_resizes) != resizes) {
+                resizes = atomic_read(&ctx->ctx_resizes);
+                bucket = i;
+            }
         }
-    } HASH_FOREACH_BUCKET_END();
-    mtx_unlock(&ctx->ctx_lock);
+        mtx_unlock(lock);
+    }
 
     return 0;
 }
@@ -146,36 +488,139 @@ int vfs_hash_foreach(vfs_hash_ctx_t ctx, const struct fs_superblock * mp,
 int vfs_hash_insert(vfs_hash_ctx_t ctx, struct vnode * vp, size_t hash,
                     struct vnode ** vpp, void * cmp_arg)
 {
+    const size_t key = hash + vp->sb->sb_hashseed;
+    mtx_t * lock = vfs_hash_lock(ctx, key);
+    struct vnode ** head;
     struct vnode * vp2;
+    size_t nbuckets;
+    int grow;
 
     *vpp = NULL;
-    mtx_lock(&ctx->ctx_lock);
-    LIST_FOREACH(vp2, vfs_hash_bucket(ctx, vp->sb, hash), vn_hashlist) {
-        if (vp2->vn_hash != hash)
-            continue;
-        if (vp2->sb != vp->sb)
-            continue;
-        if (ctx->ctx_cmp_fn && ctx->ctx_cmp_fn(vp2, cmp_arg))
-            continue;
-        mtx_unlock(&ctx->ctx_lock);
+    mtx_lock(lock);
+    vp2 = vfs_hash_find(ctx, ctx->ctx_tbl, vp->sb, hash, cmp_arg);
+    if (vp2) {
+        mtx_unlock(lock);
         /* TODO incr refcount of vp2 */
         *vpp = vp2;
         return 0;
     }
+
+    head = vfs_hash_head(ctx->ctx_tbl, key);
+    vfs_hash_wr_begin(ctx);
     vp->vn_hash = hash;
-    LIST_INSERT_HEAD(vfs_hash_bucket(ctx, vp->sb, hash), vp, vn_hashlist);
-    mtx_unlock(&ctx->ctx_lock);
+    vp->vn_hashnext = *head;
+    rcu_assign_pointer(*head, vp);
+    vfs_hash_wr_end(ctx);
+
+    nbuckets = ctx->ctx_tbl->tbl_mask + 1;
+    grow = atomic_inc(&ctx->ctx_nentries) + 1 > VFS_HASH_LOAD * nbuckets;
+    mtx_unlock(lock);
+
+    if (grow)
+        vfs_hash_grow(ctx);
 
     return 0;
 }
 
 int vfs_hash_rehash(vfs_hash_ctx_t ctx, struct vnode * vp, size_t hash)
 {
-    mtx_lock(&ctx->ctx_lock);
-    LIST_REMOVE(vp, vn_hashlist);
-    LIST_INSERT_HEAD(vfs_hash_bucket(ctx, vp->sb, hash), vp, vn_hashlist);
+    const size_t old_key = vfs_hash_index(vp);
+    const size_t new_key = hash + vp->sb->sb_hashseed;
+    mtx_t * lock1 = vfs_hash_lock(ctx, old_key);
+    mtx_t * lock2 = vfs_hash_lock(ctx, new_key);
+    struct vnode ** head;
+
+    if (lock1 > lock2) {
+        mtx_t * tmp = lock1;
+
+        lock1 = lock2;
+        lock2 = tmp;
+    }
+    mtx_lock(lock1);
+    if (lock2 != lock1)
+        mtx_lock(lock2);
+
+    vfs_hash_wr_begin(ctx);
+    (void)vfs_hash_unlink(ctx, vfs_hash_head(ctx->ctx_tbl, old_key), vp);
+    head = vfs_hash_head(ctx->ctx_tbl, new_key);
     vp->vn_hash = hash;
-    mtx_unlock(&ctx->ctx_lock);
+    vp->vn_hashnext = *head;
+    rcu_assign_pointer(*head, vp);
+    atomic_inc(&ctx->ctx_nentries);
+    vfs_hash_wr_end(ctx);
+
+    if (lock2 != lock1)
+        mtx_unlock(lock2);
+    mtx_unlock(lock1);
 
     return 0;
 }
+
+/*
+ * Chain length histogram.
+ */
+
+#define VFS_HASH_NR_HIST 6
+
+static size_t vfs_hash_hist_bin(size_t len)
+{
+    if (len <= 2)
+        return len;
+    else if (len <= 4)
+        return 3;
+    else if (len <= 8)
+        return 4;
+    return 5;
+}
+
+static void vfs_hash_hist(unsigned hist[VFS_HASH_NR_HIST])
+{
+    struct vfs_hash_ctx * ctx;
+
+    memset(hist, 0, VFS_HASH_NR_HIST * sizeof(unsigned));
+
+    mtx_lock(&vfs_hash_ctx_list_lock);
+    SLIST_FOREACH(ctx, &vfs_hash_ctx_list, ctx_link) {
+        struct rcu_lock_ctx rcu;
+        struct vfs_hash_tbl * tbl;
+
+        rcu = rcu_read_lock();
+        tbl = rcu_dereference(ctx->ctx_tbl);
+        for (size_t i = 0; i <= tbl->tbl_mask; i++) {
+            struct vnode * vp;
+            size_t len = 0;
+
+            for (vp = rcu_dereference(tbl->tbl_head[i]); vp;
+                 vp = vn_hash_next(vp)) {
+                len++;
+            }
+            hist[vfs_hash_hist_bin(len)]++;
+        }
+        rcu_read_unlock(&rcu);
+    }
+    mtx_unlock(&vfs_hash_ctx_list_lock);
+}
+
+static int sysctl_vfs_hash_chains(SYSCTL_HANDLER_ARGS)
+{
+    unsigned hist[VFS_HASH_NR_HIST];
+    unsigned count;
+
+    vfs_hash_hist(hist);
+    count = hist[arg2];
+
+    return sysctl_handle_int(oidp, &count, sizeof(count), req);
+}
+
+#define SYSCTL_VFS_HASH_CHAINS(bin, name, desc)             \
+SYSCTL_PROC(_vfs_hash, OID_AUTO, chains_##name,             \
+            CTLTYPE_UINT | CTLFLAG_RD, NULL, bin,           \
+            sysctl_vfs_hash_chains,                         \
+            "IU", "Number of hash chains " desc ".")
+
+SYSCTL_VFS_HASH_CHAINS(0, 0, "that are empty");
+SYSCTL_VFS_HASH_CHAINS(1, 1, "with one vnode");
+SYSCTL_VFS_HASH_CHAINS(2, 2, "with two vnodes");
+SYSCTL_VFS_HASH_CHAINS(3, 3_4, "with 3 to 4 vnodes");
+SYSCTL_VFS_HASH_CHAINS(4, 5_8, "with 5 to 8 vnodes");
+SYSCTL_VFS_HASH_CHAINS(5, 9_, "with more than 8 vnodes");
@@ -33,7 +33,9 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <fs/fs.h>
+#include <fs/fs_poll.h>
 #include <kstring.h>
 #include <proc.h>
 
@@ -42,8 +44,10 @@ const vnode_ops_t nofs_vnode_ops = {
     .release = fs_enotsup_release,
     .read = fs_enotsup_read,
     .write = fs_enotsup_write,
+    .copy_range = fs_enotsup_copy_range,
     .lseek = fs_enotsup_lseek,
     .ioctl = fs_enotsup_ioctl,
+    .poll = nofs_poll,
     .event_vnode_opened = fs_enotsup_event_vnode_opened,
     .event_fd_created = fs_enotsup_event_fd_created,
     .event_fd_closed = fs_enotsup_event_fd_closed,
@@ -84,6 +88,12 @@ ssize_t fs_enotsup_write(file_t * file, struct uio * uio, size_t count)
     return -ENOTSUP;
 }
 
+ssize_t fs_enotsup_copy_range(file_t * fin, off_t off_in, file_t * fout,
+                              off_t off_out, size_t len)
+{
+    return -ENOTSUP;
+}
+
 off_t fs_enotsup_lseek(file_t * file, off_t offset, int whence)
 {
     vnode_t * vn = file->vnode;
@@ -183,6 +193,15 @@ int nofs_revlookup(vnode_t * dir, ino_t * ino, char * name, size_t name_len)
     return err;
 }
 
+/*
+ * Regular files and directories never block, so they are always ready for
+ * reading and writing.
+ */
+int nofs_poll(file_t * file, int events, struct poll_table * pt)
+{
+    return events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+}
+
 int fs_enotsup_link(vnode_t * dir, vnode_t * vnode, const char * name)
 {
     return -EACCES;
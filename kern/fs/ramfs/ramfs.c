@@ -47,6 +47,7 @@
 #include <kmalloc.h>
 #include <buf.h>
 #include <proc.h>
+#include <rcu.h>
 #include <fs/dehtable.h>
 #include <fs/inpool.h>
 #include <fs/fs.h>
@@ -94,6 +95,7 @@ typedef struct ramfs_inode {
         dh_table_t * dir;
     } in;
     rwlock_t in_lock;
+    struct rcu_cb in_rcu; /*!< Used to free the inode. */
 } ramfs_inode_t;
 
 /**
@@ -132,6 +134,7 @@ static void destroy_vnode(vnode_t * vnode);
 static void destroy_inode(ramfs_inode_t * inode);
 static void destroy_inode_data(ramfs_inode_t * inode);
 static int insert_inode(ramfs_inode_t * inode);
+static int unshare_block(ramfs_inode_t * inode, off_t offset);
 static struct ramfs_dp get_dp_by_offset(ramfs_inode_t * inode, off_t offset);
 
 /**
@@ -167,6 +170,7 @@ static int ramfs_get_vnode(struct fs_superblock * sb, ino_t * vnode_num,
 vnode_ops_t ramfs_vnode_ops = {
     .read = ramfs_read,
     .write = ramfs_write,
+    .copy_range = ramfs_copy_range,
     .event_vnode_opened = ramfs_event_vnode_opened,
     .create = ramfs_create,
     .mknod = ramfs_mknod,
@@ -205,6 +209,7 @@ int __kinit__ ramfs_init(void)
     static fs_t ramfs_fs = {
         .fsname = RAMFS_FSNAME,
         .fs_majornum = VDEV_MJNR_RAMFS,
+        .fs_flags = FS_FLAG_UIO_VEC | FS_FLAG_NAMECACHE,
         .mount = ramfs_mount,
         .sblist_head = SLIST_HEAD_INITIALIZER(),
     };
@@ -462,6 +467,77 @@ ssize_t ramfs_write(file_t * file, struct uio * uio, size_t count)
     return bytes_wr;
 }
 
+ssize_t ramfs_copy_range(file_t * fin, off_t off_in, file_t * fout,
+                         off_t off_out, size_t len)
+{
+    vnode_t * vn_in = fin->vnode;
+    vnode_t * vn_out = fout->vnode;
+    ramfs_inode_t * inode_in = get_inode_of_vnode(vn_in);
+    ramfs_inode_t * inode_out = get_inode_of_vnode(vn_out);
+    const blksize_t blksize = inode_in->in_blksize;
+    struct buf ** new_data;
+    size_t bi_in, bi_out, nblocks;
+    blkcnt_t blkcnt;
+
+    /*
+     * Blocks can be shared only between regular files of ramfs, e.g. devfs
+     * inherits this op but doesn't store any data in the blocks.
+     */
+    if (vn_in->vnode_ops != &ramfs_vnode_ops ||
+        vn_out->vnode_ops != &ramfs_vnode_ops ||
+        !S_ISREG(vn_in->vn_mode) || !S_ISREG(vn_out->vn_mode) ||
+        inode_out->in_blksize != blksize ||
+        (off_in & (blksize - 1)) || (off_out & (blksize - 1)))
+        return -ENOTSUP;
+
+    /* Only whole blocks are shared, the caller copies the rest. */
+    if (off_in >= vn_in->vn_len)
+        return 0;
+    nblocks = min(len, (size_t)(vn_in->vn_len - off_in)) / blksize;
+    if (nblocks == 0)
+        return 0;
+
+    bi_in = (size_t)(off_in / blksize);
+    bi_out = (size_t)(off_out / blksize);
+    blkcnt = (blkcnt_t)(bi_out + nblocks);
+
+    /* Allocate the blocks before off_out if the target is extended. */
+    if (inode_out->in_blocks < (blkcnt_t)bi_out) {
+        int err;
+
+        err = ramfs_set_filesize(vn_out, off_out);
+        if (err)
+            return err;
+    }
+
+    if (inode_out->in_blocks < blkcnt) {
+        new_data = krealloc(inode_out->in.data,
+                            sizeof(struct buf *) * blkcnt);
+        if (!new_data)
+            return -ENOMEM;
+        for (size_t i = inode_out->in_blocks; i < (size_t)blkcnt; i++) {
+            new_data[i] = NULL;
+        }
+        inode_out->in.data = new_data;
+    }
+
+    for (size_t i = 0; i < nblocks; i++) {
+        struct buf * bp = inode_in->in.data[bi_in + i];
+        struct buf * old = inode_out->in.data[bi_out + i];
+
+        bp->vm_ops->rref(bp);
+        inode_out->in.data[bi_out + i] = bp;
+        if (old)
+            vrfree(old);
+    }
+    inode_out->in_blocks = max(inode_out->in_blocks, blkcnt);
+
+    vn_out->vn_len = max(vn_out->vn_len, off_out + (off_t)(nblocks * blksize));
+    ramfs_vnode_modified(vn_out);
+
+    return nblocks * blksize;
+}
+
 int ramfs_event_vnode_opened(struct proc_info * p, vnode_t * vnode)
 {
     ramfs_vnode_accessed(vnode);
@@ -795,8 +871,6 @@ int ramfs_rmdir(vnode_t * dir,  const char * name)
 
 int ramfs_readdir(vnode_t * dir, struct dirent * d, off_t * off)
 {
-    const off_t dea_ind_mask = 0x7FFFFFFF00000000;
-    const off_t ch_ind_mask  = DIRENT_SEEK_START;
     dh_dir_iter_t it;
     dh_dirent_t * dh;
 
@@ -805,26 +879,21 @@ int ramfs_readdir(vnode_t * dir, struct dirent * d, off_t * off)
 
     /*
      * Dirent to iterator translation.
-     * We assume here that off_t is a 64-bit signed integer, so we can store the
-     * dea index to upper bits as it's definitely shorter than chain index which
-     * will be the low 32-bits.
-     * Note: For the first iteration ch_ind must be set to 0xFFFFFFFF.
+     * The offset is the dehtable cursor, which is stable over links and
+     * unlinks, so the iteration can be resumed directly from it.
      */
-    it.dir = get_inode_of_vnode(dir)->in.dir;
-    it.dea_ind = (*off & dea_ind_mask) >> 32;
-    it.ch_ind  = (*off & ch_ind_mask);
-    if (it.ch_ind == ch_ind_mask)
-        it.ch_ind = SIZE_MAX; /* Just to make sure that the requirements of the
-                               * iterator are met on systems with different
-                               * architectures. (i.e. len of size_t) */
+    if (*off == DIRENT_SEEK_START)
+        *off = 0;
+    else if (*off < 0)
+        return -ESPIPE;
+    it = dh_get_iter_at(get_inode_of_vnode(dir)->in.dir, (size_t)*off);
 
     dh = dh_iter_next(&it);
     if (!dh || dh->dh_size == 0)
         return -ESPIPE; /* End of dir. */
 
     /* Translate iterator back to dirent. */
-    *off = ((((off_t)it.dea_ind) << 32) & dea_ind_mask) |
-           (off_t)(it.ch_ind & ch_ind_mask);
+    *off = (off_t)dh_iter_cursor(&it);
     d->d_ino = dh->dh_ino;
     d->d_type = dh->dh_type;
     strlcpy(d->d_name, dh->dh_name, member_size(struct dirent, d_name));
@@ -995,6 +1064,11 @@ static void destroy_vnode(vnode_t * vnode)
     destroy_inode(get_inode_of_vnode(vnode));
 }
 
+static void free_inode(struct rcu_cb * cb)
+{
+    kfree(containerof(cb, ramfs_inode_t, in_rcu));
+}
+
 /**
  * Destroy a ramfs_inode struct and its contents.
  * @note This should be normally called only if there is no more references and
@@ -1007,7 +1081,8 @@ static void destroy_inode(ramfs_inode_t * inode)
 
     atomic_dec(&ramfs_sb->nr_inodes);
     destroy_inode_data(inode);
-    kfree(inode);
+    /* Lockless vfs_hash lookups may still see the vnode. */
+    rcu_call(&inode->in_rcu, free_inode);
 }
 
 /**
@@ -1086,6 +1161,11 @@ ssize_t ramfs_wr_regular(vnode_t * file, const off_t * restrict offset,
         size_t curr_wr_len;
         int err;
 
+        /* The block might be still shared with another file. */
+        err = unshare_block(inode, *offset + bytes_wr);
+        if (err)
+            return err;
+
         /* Get next block pointer. */
         dp = get_dp_by_offset(inode, *offset + bytes_wr);
         if (!dp.p) { /* Extend the file first. */
@@ -1224,6 +1304,34 @@ int ramfs_set_filesize(vnode_t * vnode, off_t new_size)
     return 0;
 }
 
+/**
+ * Replace a block shared by ramfs_copy_range() with a private copy.
+ * @param inode     is a ramfs inode.
+ * @param offset    is an offset in the block.
+ * @return Returns 0 if succeed; Otherwise a negative errno code.
+ */
+static int unshare_block(ramfs_inode_t * inode, off_t offset)
+{
+    const size_t bi = (size_t)(offset / inode->in_blksize);
+    struct buf * bp;
+    struct buf * copy;
+
+    if (bi >= (size_t)inode->in_blocks || !inode->in.data)
+        return 0;
+
+    bp = inode->in.data[bi];
+    if (kobj_refcnt(&bp->b_obj) <= 1)
+        return 0;
+
+    copy = bp->vm_ops->rclone(bp);
+    if (!copy)
+        return -ENOMEM;
+    inode->in.data[bi] = copy;
+    vrfree(bp);
+
+    return 0;
+}
+
 /**
  * Get data pointer by given offset.
  * @note This function may return pointers that are pointing to a memory
@@ -0,0 +1,338 @@
+/**
+ *******************************************************************************
+ * @file    futex.c
+ * @author  Olli Vanhoja
+ * @brief   Fast userspace wait queues.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <sys/futex.h>
+#include <sys/linker_set.h>
+#include <sys/queue.h>
+#include <sys/sysctl.h>
+#include <syscall.h>
+#include <kinit.h>
+#include <klocks.h>
+#include <ksched.h>
+#include <proc.h>
+#include <thread.h>
+#include <timers.h>
+#include <vm/vm.h>
+
+/**
+ * Number of buckets in the futex hash table.
+ * Must be a power of two.
+ */
+#define FUTEX_HASH_SIZE 64
+
+/**
+ * A futex hash bucket.
+ * Waiters of all futexes hashing to the same bucket are kept in the same
+ * queue in the order they started waiting.
+ */
+struct futex_bucket {
+    mtx_t lock;
+    TAILQ_HEAD(futex_waitq, thread_info) waitq;
+};
+
+static struct futex_bucket futex_hash[FUTEX_HASH_SIZE];
+
+SYSCTL_DECL(_kern_futex);
+SYSCTL_NODE(_kern, OID_AUTO, futex, CTLFLAG_RW, 0,
+            "Futex wait queues");
+
+static unsigned futex_waits;
+SYSCTL_UINT(_kern_futex, OID_AUTO, waits, CTLFLAG_RD, &futex_waits, 0,
+            "Number of times a thread went to sleep on a futex.");
+
+static unsigned futex_wakes;
+SYSCTL_UINT(_kern_futex, OID_AUTO, wakes, CTLFLAG_RD, &futex_wakes, 0,
+            "Number of threads woken up by futex wake.");
+
+static unsigned futex_timeouts;
+SYSCTL_UINT(_kern_futex, OID_AUTO, timeouts, CTLFLAG_RD, &futex_timeouts, 0,
+            "Number of futex waits that timed out.");
+
+static struct futex_bucket * futex_bucket(uintptr_t key)
+{
+    return &futex_hash[((key >> 2) ^ (key >> 12)) & (FUTEX_HASH_SIZE - 1)];
+}
+
+/**
+ * Get the futex key of a user address.
+ * The key is the kernel address of the futex word, so a futex located in
+ * a shared mapping has the same key in every process mapping it. The page
+ * is made private first, so a pending copy-on-write or a page that hasn't
+ * been read yet won't change the key under the waiter.
+ * @param uaddr is the user space address of the futex word.
+ * @param[out] kaddr is set to the kernel address of the futex word.
+ * @return 0 if succeed; Otherwise a negative errno is returned.
+ */
+static int futex_get_key(__user int * uaddr, int ** kaddr)
+{
+    int err;
+
+    if (((uintptr_t)uaddr & (sizeof(int) - 1)) != 0)
+        return -EINVAL;
+
+    if (!useracc(uaddr, sizeof(int), VM_PROT_WRITE))
+        return -EFAULT;
+
+    err = vm_prepare_write(curproc, uaddr, sizeof(int));
+    if (err)
+        return err;
+
+    *kaddr = vm_uaddr2kaddr(curproc, uaddr, sizeof(int));
+    if (!*kaddr)
+        return -EFAULT;
+
+    return 0;
+}
+
+static void futex_timeout_event(void * event_arg)
+{
+    struct thread_info * thread = (struct thread_info *)event_arg;
+
+    thread->futex.timedout = 1;
+    thread_release(thread->id);
+}
+
+/**
+ * Wait on a futex.
+ * @param uaddr is the user space address of the futex word.
+ * @param val is the expected value of the futex word.
+ * @param usec is the timeout in usec; 0 to wait forever.
+ * @return  Returns 0 if the thread was woken up by futex_wake_key();
+ *          Otherwise a negative errno is returned.
+ */
+static int futex_wait_key(__user int * uaddr, int val, uint64_t usec)
+{
+    struct thread_info * const td = current_thread;
+    struct futex_bucket * bucket;
+    int * kaddr;
+    int tim = -1;
+    int err;
+
+    err = futex_get_key(uaddr, &kaddr);
+    if (err)
+        return err;
+
+    td->futex.woken = 0;
+    td->futex.timedout = 0;
+    if (usec) {
+        tim = timers_add(futex_timeout_event, td, TIMERS_FLAG_ONESHOT, usec);
+        if (tim < 0)
+            return -EAGAIN;
+    }
+
+    bucket = futex_bucket((uintptr_t)kaddr);
+    mtx_lock(&bucket->lock);
+    if (*(volatile int *)kaddr != val) {
+        mtx_unlock(&bucket->lock);
+        if (tim >= 0)
+            timers_release(tim);
+        return -EAGAIN;
+    }
+
+    /*
+     * The thread is marked blocked before the bucket is unlocked to make
+     * sure that a futex_wake_key() called right after unlock won't be lost.
+     */
+    td->futex.key = (uintptr_t)kaddr;
+    TAILQ_INSERT_TAIL(&bucket->waitq, td, futex.entry_);
+    thread_block();
+    if (tim >= 0)
+        timers_start(tim);
+    mtx_unlock(&bucket->lock);
+    futex_waits++;
+
+    thread_wait_blocked();
+
+    if (tim >= 0)
+        timers_release(tim);
+
+    mtx_lock(&bucket->lock);
+    if (td->futex.woken) {
+        err = 0;
+    } else {
+        TAILQ_REMOVE(&bucket->waitq, td, futex.entry_);
+        if (td->futex.timedout) {
+            futex_timeouts++;
+            err = -ETIMEDOUT;
+        } else {
+            err = -EINTR;
+        }
+    }
+    td->futex.key = 0;
+    mtx_unlock(&bucket->lock);
+
+    return err;
+}
+
+/**
+ * Wake up threads waiting on a futex.
+ * @param uaddr is the user space address of the futex word.
+ * @param count is the maximum number of threads to wake up.
+ * @return  Returns the number of threads woken up;
+ *          Otherwise a negative errno is returned.
+ */
+static int futex_wake_key(__user int * uaddr, int count)
+{
+    struct futex_bucket * bucket;
+    struct thread_info * td;
+    struct thread_info * td_tmp;
+    uintptr_t key;
+    int * kaddr;
+    int n = 0;
+    int err;
+
+    err = futex_get_key(uaddr, &kaddr);
+    if (err)
+        return err;
+    key = (uintptr_t)kaddr;
+
+    bucket = futex_bucket(key);
+    mtx_lock(&bucket->lock);
+    TAILQ_FOREACH_SAFE(td, &bucket->waitq, futex.entry_, td_tmp) {
+        if (n >= count)
+            break;
+        if (td->futex.key != key)
+            continue;
+
+        TAILQ_REMOVE(&bucket->waitq, td, futex.entry_);
+        td->futex.woken = 1;
+        thread_release(td->id);
+        n++;
+    }
+    mtx_unlock(&bucket->lock);
+    futex_wakes += n;
+
+    return n;
+}
+
+/**
+ * Remove a dying thread from a futex wait queue.
+ */
+static void futex_thread_dtor(struct thread_info * td)
+{
+    struct futex_bucket * bucket;
+
+    if (!td->futex.key)
+        return;
+
+    bucket = futex_bucket(td->futex.key);
+    mtx_lock(&bucket->lock);
+    if (td->futex.key && !td->futex.woken) {
+        TAILQ_REMOVE(&bucket->waitq, td, futex.entry_);
+    }
+    td->futex.key = 0;
+    mtx_unlock(&bucket->lock);
+}
+SCHED_THREAD_DTOR(futex_thread_dtor);
+
+int __kinit__ futex_init(void)
+{
+    SUBSYS_INIT("futex");
+
+    for (size_t i = 0; i < num_elem(futex_hash); i++) {
+        struct futex_bucket * bucket = &futex_hash[i];
+
+        mtx_init(&bucket->lock, MTX_TYPE_SPIN, MTX_OPT_DINT);
+        TAILQ_INIT(&bucket->waitq);
+    }
+
+    return 0;
+}
+
+static intptr_t sys_futex_wait(__user void * user_args)
+{
+    struct _futex_wait_args args;
+    uint64_t usec = 0;
+    int err;
+
+    err = copyin(user_args, &args, sizeof(args));
+    if (err) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    if (args.timed) {
+        if (args.timeout.tv_sec < 0 || args.timeout.tv_nsec < 0 ||
+            args.timeout.tv_nsec >= 1000000000) {
+            set_errno(EINVAL);
+            return -1;
+        }
+        usec = (uint64_t)args.timeout.tv_sec * 1000000 +
+               args.timeout.tv_nsec / 1000;
+        if (usec == 0) {
+            set_errno(ETIMEDOUT);
+            return -1;
+        }
+    }
+
+    err = futex_wait_key((__user int *)args.uaddr, args.val, usec);
+    if (err) {
+        set_errno(-err);
+        return -1;
+    }
+
+    return 0;
+}
+
+static intptr_t sys_futex_wake(__user void * user_args)
+{
+    struct _futex_wake_args args;
+    int retval;
+
+    if (copyin(user_args, &args, sizeof(args))) {
+        set_errno(EFAULT);
+        return -1;
+    }
+
+    if (args.count <= 0) {
+        set_errno(EINVAL);
+        return -1;
+    }
+
+    retval = futex_wake_key((__user int *)args.uaddr, args.count);
+    if (retval < 0) {
+        set_errno(-retval);
+        return -1;
+    }
+
+    return retval;
+}
+
+/**
+ * Declarations of futex syscall functions.
+ */
+static const syscall_handler_t futex_sysfnmap[] = {
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FUTEX_WAIT, sys_futex_wait),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_FUTEX_WAKE, sys_futex_wake),
+};
+SYSCALL_HANDLERDEF(futex_syscall, futex_sysfnmap)
@@ -154,6 +154,11 @@ istate_t get_interrupt_state(void)
     return state;
 }
 
+int interrupts_enabled(void)
+{
+    return !(get_interrupt_state() & PSR_INT_I);
+}
+
 void set_interrupt_state(istate_t state)
 {
     __asm__ volatile (
@@ -218,6 +218,19 @@ void core_set_tls_addr(__user struct _sched_tls_desc * tls);
     __asm__ volatile ("SEV");               \
 } while (0)
 
+/**
+ * Get the index of the current CPU.
+ * Reads the CPU ID field of the MPIDR.
+ */
+static inline int cpu_get_index(void)
+{
+    uint32_t mpidr;
+
+    __asm__ volatile ("MRC p15, 0, %[rd], c0, c0, 5" : [rd]"=r" (mpidr));
+
+    return (int)(mpidr & 0x3);
+}
+
 #endif /* configMP */
 
 /**
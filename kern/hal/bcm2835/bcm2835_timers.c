@@ -73,7 +73,23 @@
 #define ARM_TIMER_EN            0x80
 #define ARM_TIMER_INT_EN        0x20
 
+#define ARM_TIMER_MAX_LOAD      0x7fffff /* 23-bit counter */
+
 #define SYS_CLOCK               700000 /* kHz */
+#define ARM_TIMER_KHZ           (SYS_CLOCK / 16)
+
+/**
+ * The periodic reload value of the ARM timer.
+ */
+static uint32_t arm_timer_reload;
+
+#ifdef configQEMU_GUEST
+/**
+ * Set if the ARM timer is programmed for a single event and must be returned
+ * to the periodic tick on the next interrupt.
+ */
+static int arm_timer_oneshot;
+#endif
 
 static enum irq_ack arm_timer_ack(int irq)
 {
@@ -84,6 +100,13 @@ static enum irq_ack arm_timer_ack(int irq)
     mmio_start(&s_entry);
     if (mmio_read(ARM_TIMER_MASK_IRQ)) {
         mmio_write(ARM_TIMER_IRQ_CLEAR, 0);
+#ifdef configQEMU_GUEST
+        if (arm_timer_oneshot) {
+            mmio_write(ARM_TIMER_LOAD, arm_timer_reload);
+            mmio_write(ARM_TIMER_RELOAD, arm_timer_reload);
+            arm_timer_oneshot = 0;
+        }
+#endif
         retval = IRQ_NEEDS_HANDLING;
     }
     mmio_end(&s_entry);
@@ -121,10 +144,12 @@ static int enable_arm_timer(unsigned freq_hz)
         return -ENOTSUP;
     }
 
+    arm_timer_reload = SYS_CLOCK / (freq_hz * 16);
+
     mmio_start(&s_entry);
     /* Interrupt every (value * prescaler) timer ticks */
-    mmio_write(ARM_TIMER_LOAD, (SYS_CLOCK / (freq_hz * 16)));
-    mmio_write(ARM_TIMER_RELOAD, (SYS_CLOCK / (freq_hz * 16)));
+    mmio_write(ARM_TIMER_LOAD, arm_timer_reload);
+    mmio_write(ARM_TIMER_RELOAD, arm_timer_reload);
     mmio_write(ARM_TIMER_IRQ_CLEAR, 0);
     mmio_write(ARM_TIMER_CONTROL,
                ARM_TIMER_PRESCALE_16 | ARM_TIMER_EN |
@@ -135,6 +160,44 @@ static int enable_arm_timer(unsigned freq_hz)
     return irq_register(0, &bcm2835_timer_irq_handler);
 }
 
+/*
+ * Writing the load register restarts the count down immediately, while the
+ * reload register is only used once the counter reaches zero. Therefore the
+ * next event is programmed to the load register and the timer returns to the
+ * periodic tick by itself after the event.
+ *
+ * The ARM timer emulated by QEMU can't be trusted to keep the load and reload
+ * registers separate, so a QEMU guest programs both of them with the event
+ * and restores the periodic reload value when the event interrupt is acked.
+ */
+int hw_timers_set_next_event(uint32_t usec)
+{
+    istate_t s_entry;
+    uint64_t load;
+
+    if (arm_timer_reload == 0)
+        return -ENOTSUP; /* Not enabled yet. */
+
+    load = ((uint64_t)usec * ARM_TIMER_KHZ) / 1000;
+    if (load == 0)
+        load = 1;
+    else if (load > ARM_TIMER_MAX_LOAD)
+        load = ARM_TIMER_MAX_LOAD;
+
+    mmio_start(&s_entry);
+#ifdef configQEMU_GUEST
+    mmio_write(ARM_TIMER_RELOAD, (uint32_t)load);
+    mmio_write(ARM_TIMER_LOAD, (uint32_t)load);
+    arm_timer_oneshot = 1;
+#else
+    mmio_write(ARM_TIMER_LOAD, (uint32_t)load);
+    mmio_write(ARM_TIMER_RELOAD, arm_timer_reload);
+#endif
+    mmio_end(&s_entry);
+
+    return 0;
+}
+
 __weak_reference(bcm_udelay, udelay);
 void bcm_udelay(uint32_t delay)
 {
@@ -30,11 +30,19 @@
  *******************************************************************************
  */
 
+#include <errno.h>
 #include <sys/linker_set.h>
 #include <hal/hw_timers.h>
 
 SET_DECLARE(timer_tasks, timer_task_t);
 
+int hw_timers_set_next_event_nosupp(uint32_t usec);
+__weak_reference(hw_timers_set_next_event_nosupp, hw_timers_set_next_event);
+int hw_timers_set_next_event_nosupp(uint32_t usec)
+{
+    return -ENOTSUP;
+}
+
 void hw_timers_run(void)
 {
     timer_task_t ** task_p;
@@ -42,8 +42,7 @@
 #include <thread.h>
 
 /* Definitions for Page fault counter *****************************************/
-#define PFC_FREQ    (int)configSCHED_HZ /* We wan't to compute pf/s once per
-                                         * second. */
+#define PFC_PERIOD  1000000ULL      /*!< Compute pf/s once per second. */
 #define FSHIFT      11              /*!< nr of bits of precision */
 #define FEXP_1      753             /*!< 1 sec */
 #define FIXED_1     (1 << FSHIFT)   /*!< 1.0 in fixed-point */
@@ -254,7 +253,9 @@ void mmu_pf_event(void)
  */
 static void mmu_calc_pfcps(void)
 {
-    static int count = PFC_FREQ;
+    static uint64_t last_calc;
+    const uint64_t now = get_utime();
+    uint64_t elapsed;
 
     /* Tanenbaum suggests in one of his books that pf/s count could be first
      * averaged and then on each iteration summed with the current value and
@@ -262,12 +263,18 @@ static void mmu_calc_pfcps(void)
      * for loadavg.
      */
 
-    count--;
-    if (count < 0) {
+    /*
+     * The period is measured in time rather than in ticks because the ticks
+     * are not periodic when the tickless idle is enabled, so the count is
+     * also scaled to the actual period.
+     */
+    elapsed = now - last_calc;
+    if (elapsed >= PFC_PERIOD) {
         unsigned long pfc;
 
-        count = PFC_FREQ;
-        pfc = (_pf_raw_count * FIXED_1);
+        last_calc = now;
+        pfc = (unsigned long)(((uint64_t)_pf_raw_count * FIXED_1 *
+                               PFC_PERIOD) / elapsed);
         CALC_PFC(mmu_pfps, pfc);
         _pf_raw_count = 0;
     }
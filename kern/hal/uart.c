@@ -32,12 +32,14 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/dev_major.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <thread.h>
 #include <fs/devfs.h>
+#include <fs/fs_poll.h>
 #include <hal/uart.h>
 #include <kinit.h>
 #include <kstring.h>
@@ -55,6 +57,8 @@ static ssize_t uart_read(struct tty * tty, off_t blkno,
                          uint8_t * buf, size_t bcount, int oflags);
 static ssize_t uart_write(struct tty * tty, off_t blkno,
                           uint8_t * buf, size_t bcount, int oflags);
+static int uart_poll(struct file * file, struct tty * tty, int events,
+                     struct poll_table * pt);
 static int uart_ioctl(struct dev_info * devnfo, uint32_t request,
                       void * arg, size_t arg_len);
 
@@ -99,6 +103,7 @@ static int make_uartdev(struct uart_port * port, int port_num)
     tty->write = uart_write;
     tty->setconf = port->setconf;
     tty->ioctl = uart_ioctl;
+    tty->poll = uart_poll;
 
     if (make_ttydev(tty)) {
         tty_free(tty);
@@ -188,6 +193,26 @@ static ssize_t uart_write(struct tty * tty, off_t blkno,
     return 1;
 }
 
+/*
+ * There is no rx interrupt hook to wake up pollers, so the port is
+ * registered without a wait queue and the poller rescans it periodically.
+ */
+static int uart_poll(struct file * file, struct tty * tty, int events,
+                     struct poll_table * pt)
+{
+    struct uart_port * port = (struct uart_port *)tty->opt_data;
+    int revents = POLLOUT | POLLWRNORM;
+
+    if (!port)
+        return POLLNVAL;
+
+    poll_record_nowq(pt);
+    if (port->peek(port))
+        revents |= POLLIN | POLLRDNORM;
+
+    return revents & events;
+}
+
 static int uart_ioctl(struct dev_info * devnfo, uint32_t request,
                       void * arg, size_t arg_len)
 {
@@ -93,6 +93,24 @@ int bitmap_block_search(size_t * retval, size_t block_len,
 int bitmap_block_search_s(size_t start, size_t * retval, size_t block_len,
                           const bitmap_t * bitmap, size_t size);
 
+/**
+ * Search for a contiguous block of zeroes of block_len in bitmap using a
+ * next-fit hint.
+ * The search starts from the hint and wraps around to the beginning of the
+ * bitmap.
+ * @param[in,out] hint      is the next-fit hint of the bitmap; Updated to
+ *                          point after the block found.
+ * @param[out] retval       is the index of the first contiguous block of
+ *                          the requested length.
+ * @param       block_len   is the length of contiguous block searched for.
+ * @param       bitmap      is a bitmap of block reservations.
+ * @param       size        is the size of bitmap in bytes.
+ * @return  Returns zero if a free block found; Value other than zero if there
+ *          is no free contiguous block of requested length.
+ */
+int bitmap_block_search_nf(size_t * hint, size_t * retval, size_t block_len,
+                           const bitmap_t * bitmap, size_t size);
+
 /**
  * Check status of a bit in a bitmap pointed by bitmap.
  * @param bitmap            is a bitmap.
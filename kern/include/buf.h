@@ -36,11 +36,14 @@
 #define BUF_H
 
 #include <sys/queue.h>
+#include <bitmap.h>
 #include <fs/fs.h>
 #include <hal/mmu.h>
 #include <kobj.h>
 
 struct vm_pt;
+struct bio_waiter;
+struct proc_info;
 
 /**
  * @addtogroup buffercache vralloc bread breadn bwrite bawrite bdwrite getblk geteblk incore allocbuf brelse biodone biowait
@@ -70,11 +73,26 @@ struct buf {
     mmu_region_t b_mmu;     /*!< MMU struct for user space or special access. */
     int b_uflags;           /*!< Actual user space permissions and flags. */
 
+    /* Page granular copy-on-write. */
+    struct buf * b_cow_src; /*!< Region holding the pages not copied yet. */
+    bitmap_t * b_cow_map;   /*!< Bitmap of pages not copied from b_cow_src. */
+    size_t b_cow_pending;   /*!< Number of pages not copied yet. */
+
+    /* Demand paging from b_file. */
+    bitmap_t * b_fill_map;  /*!< Bitmap of pages not read from b_file yet. */
+    size_t b_fill_pending;  /*!< Number of pages not read yet. */
+    size_t b_fill_off;      /*!< Offset of the file data in the buffer.
+                             *   The data is read from the file offset
+                             *   b_blkno. */
+    size_t b_fill_len;      /*!< Length of the file data. The rest of the
+                             *   buffer is zeroed. */
+
     /* IO Buffer */
     file_t b_file;          /*!< File descriptor for the buffered vnode. */
     file_t b_devfile;       /*!< File descriptor for the buffered device. */
     size_t b_dirtyoff;      /*!< Offset in buffer of dirty region. */
     size_t b_dirtyend;      /*!< Offset of end of dirty region. */
+    uint64_t b_dirtytime;   /*!< Time when the buffer became dirty [us]. */
 
     /* Status */
     unsigned long b_flags;  /*!< Buffer control flags. */
@@ -90,9 +108,16 @@ struct buf {
     const struct vm_ops * vm_ops;
 
     void * allocator_data;  /*!< Allocator specific data. */
-    SPLAY_ENTRY(buf) sentry_;
+    LIST_ENTRY(buf) hash_entry_; /*!< bio cache hash bucket entry. */
+    LIST_ENTRY(buf) vnode_entry_; /*!< Entry in the buffer list of a vnode. */
     LIST_ENTRY(buf) shmem_entry_; /*!< shmem sync list entry. */
-    TAILQ_ENTRY(buf) relse_entry_; /*!< bio relse list entry. */
+    TAILQ_ENTRY(buf) relse_entry_; /*!< bio LRU list entry. */
+    TAILQ_ENTRY(buf) bioq_entry_; /*!< bio async I/O queue entry. */
+    SLIST_HEAD(bio_waiters, bio_waiter) b_waiters; /*!< Threads sleeping on
+                                                    *   the buffer. */
+
+    atomic_t b_wanted;      /*!< Number of threads waiting to get this
+                             *   buffer from the cache. */
 
     struct kobj b_obj;
     mtx_t lock;
@@ -138,14 +163,50 @@ typedef struct vm_ops {
      * just call `this->rclone()`.
      */
     int (*rmmap)(struct buf * this, struct vm_pt * pt);
+
+    /**
+     * Resolve a write to a copy-on-write page of this region.
+     * If this region is shared the function returns a private copy of it
+     * that should replace this region in the faulting process. Only the
+     * page at off is copied, the rest of the pages are copied when they are
+     * first written. If the page belongs to a private copy the page is
+     * copied and remapped writable in pt.
+     * @note Can be null, rclone() is used instead.
+     * @param this is the current region.
+     * @param off is the offset of the page written in the region.
+     * @param pt is the page table of the faulting process.
+     * @param[out] new_region is set to the new region or NULL if this
+     *                        region was modified in place.
+     * @return  Returns 0 if succeed;
+     *          -EACCES if the page is not a copy-on-write page;
+     *          Otherwise a negative errno.
+     */
+    int (*rcow)(struct buf * this, size_t off, struct vm_pt * pt,
+                struct buf ** new_region);
+
+    /**
+     * Read a page of a demand paged region from its file and map it to pt.
+     * The page is mapped even if it was already read for another process.
+     * @note Can be null if the region is never demand paged.
+     * @param this is the current region.
+     * @param off is the offset of the page accessed in the region.
+     * @param pt is the page table of the faulting process.
+     * @return  Returns 0 if succeed; Otherwise a negative errno.
+     */
+    int (*rfill)(struct buf * this, size_t off, struct vm_pt * pt);
 } vm_ops_t;
 
 /* generic */
+#define B_READ      0x0000001  /*!< Read I/O request, otherwise write. */
 #define B_DONE      0x0000002  /*!< Transaction finished. */
 #define B_ERROR     0x0000004  /*!< Transaction aborted. */
 #define B_BUSY      0x0000008  /*!< Buffer busy. */
 #define B_LOCKED    0x0000010  /*!< Locked in memory. */
 #define B_DIRTY     0x0000020
+#define B_CACHE     0x0000040  /*!< Buffer contents are valid. */
+#define B_RELSE     0x0000080  /*!< Buffer is in the released list. */
+#define B_RAHEAD    0x0000200  /*!< Filled by read-ahead and not used yet. */
+#define B_INVAL     0x0000400  /*!< Removed from the cache, will be freed. */
 #define B_NOCOPY    0x0000100  /*!< Don't copy-on-write this buf. */
 #define B_NOSYNC    0x0001000  /*!< Never synch to the fs. */
 #define B_ASYNC     0x0002000  /*!< Start I/O but don't wait for completion. */
@@ -159,8 +220,13 @@ typedef struct vm_ops {
 #define BUF_LOCK(bp)    mtx_lock(&(bp)->lock)
 #define BUF_UNLOCK(bp)  mtx_unlock(&(bp)->lock)
 
-int biobuf_compar(struct buf * a, struct buf * b);
-SPLAY_PROTOTYPE(bufhd_splay, buf, sentry_, biobuf_compar);
+/**
+ * Size of a page bitmap of a buffer in bytes.
+ * @param bp is a pointer to the buffer.
+ */
+#define BUF_PAGEMAP_SIZE(bp) \
+    ((((bp)->b_bufsize / MMU_PGSIZE_COARSE + 8 * sizeof(bitmap_t) - 1) / \
+      (8 * sizeof(bitmap_t))) * sizeof(bitmap_t))
 
 /**
  * Read a block corresponding to vnode and blkno.
@@ -188,9 +254,9 @@ int bread(vnode_t * vnode, size_t blkno, int size, struct buf ** bpp);
  * @param[in]   vnode   is a pointer to a vnode.
  * @param[in]   blkno   is a block number.
  * @param[in]   size    is the size to be read.
- * @param[in]   rablks
- * @param[in]   rasizes
- * @param[in]   nrablks
+ * @param[in]   rablks  is an array of block numbers to be read ahead.
+ * @param[in]   rasizes is an array of sizes of the read-ahead blocks.
+ * @param[in]   nrablks is the number of elements in rablks and rasizes.
  * @param[out]  bpp     points to the returned buffer.
  * @return      Returns 0 if succeed; A negative errno if failed.
  */
@@ -199,24 +265,39 @@ int  breadn(vnode_t * vnode, size_t blkno, int size, size_t rablks[],
 
 /**
  * Write a block.
- * This will block until IO is complete.
- * @param[in] buf   is the associated buffer.
+ * This will block until IO is complete unless B_ASYNC is set.
+ * The buffer is released once the write is complete.
+ * @param[in] buf   is the associated buffer.
  * @return  0 if IO was complete; -EIO in case of IO error.
  */
 int bwrite(struct buf * bp);
 
 /**
  * Write a block asynchronously.
- * @param[in] buf   is the associated buffer.
+ * The write is started and the buffer is released by biodone() once the I/O
+ * is complete.
+ * @param[in] buf   is the associated buffer.
  */
 void bawrite(struct buf * bp);
 
 /**
  * Delayed write.
- * @param[in] buf   is the associated buffer.
+ * Marks the buffer dirty and releases it, the write happens later.
+ * @param[in] buf   is the associated buffer.
  */
 void bdwrite(struct buf * bp);
 
+/**
+ * Mark a byte range of a buffer dirty.
+ * The dirty range is extended to cover the new range and only the dirty range
+ * is written out by the next write. If no range is set the whole buffer is
+ * written.
+ * @param[in] bp    is the associated buffer.
+ * @param[in] off   is the offset of the modified range in the buffer.
+ * @param[in] len   is the length of the modified range.
+ */
+void bio_setdirty(struct buf * bp, size_t off, size_t len);
+
 /**
  * Clear a buffer.
  */
@@ -240,6 +321,16 @@ struct buf * getblk(vnode_t * vnode, size_t blkno, size_t size, int slptimeo)
 struct buf * geteblk(size_t size)
     __attribute__ ((warn_unused_result));
 
+/**
+ * Allocate a disassociated block without zeroing it.
+ * The buffer may contain old data, so the caller must overwrite all of it
+ * before it's exposed anywhere.
+ * @param[in] size is the size of the new buffer.
+ * @return  Returns the new buffer.
+ */
+struct buf * geteblk_noclear(size_t size)
+    __attribute__ ((warn_unused_result));
+
 /**
  * Get a special block that has a mapping in ksect area as well as regular
  * mapping in kernel space.
@@ -259,6 +350,21 @@ struct buf * geteblk_special(size_t size, uint32_t control)
  */
 struct buf * incore(vnode_t * vnode, size_t blkno);
 
+/**
+ * Write out all delayed writes of a vnode.
+ * @param vnode is a vnode pointer.
+ * @return  Returns 0 if succeed; Otherwise the first negative errno returned
+ *          by a write.
+ */
+int bio_vnode_sync(vnode_t * vnode);
+
+/**
+ * Remove all buffers of a vnode from the buffer cache.
+ * The buffers are freed once they are released.
+ * @param vnode is the vnode going away.
+ */
+void bio_vnode_cleanup(vnode_t * vnode);
+
 /**
  * Readin file backed buffer.
  * @param bp is the buffer.
@@ -291,12 +397,15 @@ void brelse(struct buf * bp);
 
 /**
  * Mark I/O complete on a buffer.
+ * Wakes up threads waiting in biowait() and releases the buffer if it was
+ * an asynchronous I/O request.
  * @param[in] buf   is the buffer.
  */
 void biodone(struct buf * bp);
 
 /**
  * Wait for operations on the buffer to complete.
+ * The calling thread sleeps until biodone() is called for the buffer.
  * @param[in] buf   is the buffer.
  * @return  Returns 0 if IO was complete; In case of IO error -EIO.
  */
@@ -317,6 +426,38 @@ int bio_geterror(struct buf * bp);
  */
 int clone2vr(struct buf * src, struct buf ** out);
 
+/**
+ * Copy all pages of a region that are still shared with the original
+ * region after a copy-on-write fault.
+ * This must be called before a region can be shared again.
+ * @param proc is the process mapping the region.
+ * @param region is the region.
+ * @return Returns zero if succeed; Otherwise a negative errno is returned.
+ */
+int vr_cow_flush(struct proc_info * proc, struct buf * region);
+
+/**
+ * Make a region demand paged.
+ * The pages of the region are read from region->b_file when they are
+ * accessed for the first time. region->b_file and region->b_blkno must be
+ * set by the caller.
+ * @param region is a region allocated with geteblk().
+ * @param off is the offset of the file data in the region.
+ * @param len is the length of the file data, the rest of the region is
+ *            zeroed.
+ * @return Returns zero if succeed; Otherwise a negative errno is returned.
+ */
+int vr_fill_setup(struct buf * region, size_t off, size_t len);
+
+/**
+ * Read all pages of a demand paged region that are not read yet.
+ * The file is read without holding region->lock but the caller must not
+ * hold any non-sleepable locks either as the read may sleep.
+ * @param region is the region.
+ * @return Returns zero if succeed; Otherwise a negative errno is returned.
+ */
+int vr_fill_flush(struct buf * region);
+
 /**
  * Free allocated vregion.
  * Dereferences a vregion.
@@ -50,6 +50,12 @@
  */
 #define DYNMEM_PAGE_SIZE    MMU_PGSIZE_SECTION
 
+/**
+ * Max order of a dynmem buddy block.
+ * A block of order n is 2^n dynmem pages.
+ */
+#define DYNMEM_MAX_ORDER    10
+
 /**
  * Struct describing a reserved memory area that should not be used by
  * dynmem.
@@ -41,26 +41,50 @@
 
 #include <fs/fs.h>
 
+/**
+ * Initial number of hash chains.
+ * The number of chains is doubled when the number of entries exceeds
+ * DEHTABLE_LOAD times the number of chains.
+ */
 #define DEHTABLE_SIZE 16
 
+/**
+ * Max average chain length.
+ */
+#define DEHTABLE_LOAD 2
+
 /**
  * Directory entry.
  */
 typedef struct dh_dirent {
     ino_t dh_ino; /*!< File serial number. */
+    uint32_t dh_hash; /*!< Full hash of dh_name. */
     uint8_t dh_type; /*!< Dirent type. */
     size_t dh_size; /*!< Size of this directory entry. */
-    uint8_t dh_link; /*!< Internal link tag. If 0 chain ends here; otherwise
-                      * chain linking continues. */
+    size_t dh_slot; /*!< Index of this entry in the slot array. */
+    struct dh_dirent * dh_next; /*!< Next entry in the hash chain. */
     char dh_name[1]; /*!< Name of the entry. */
 } dh_dirent_t;
 
 /**
- * Directory entry hash table array type.
+ * Directory entry hash table.
+ * A zeroed dh_table is a valid empty table.
  */
 typedef struct dh_table {
     uint32_t k[2];
-    struct dh_dirent * htable[DEHTABLE_SIZE];
+    size_t nr_entries;
+    size_t hmask; /*!< Number of hash chains - 1. */
+    struct dh_dirent ** htable; /*!< Hash chains. */
+    /**
+     * Entries in iteration order.
+     * An entry never moves to another slot, so a slot index is a stable
+     * readdir cursor. Removed entries leave a NULL slot that is reused by
+     * the next dh_link().
+     */
+    struct dh_dirent ** slots;
+    size_t nr_slots; /*!< Number of slots in use, including holes. */
+    size_t slots_size; /*!< Number of slots allocated. */
+    size_t first_hole; /*!< No holes before this slot. */
 } dh_table_t;
 
 /**
@@ -68,8 +92,7 @@ typedef struct dh_table {
  */
 typedef struct dh_dir_iter {
     dh_table_t * dir;
-    size_t dea_ind;
-    size_t ch_ind;
+    size_t slot; /*!< Next slot to be checked. */
 } dh_dir_iter_t;
 
 /**
@@ -131,6 +154,22 @@ int dh_revlookup(dh_table_t * dir, ino_t ino, char * name, size_t name_len);
  */
 dh_dir_iter_t dh_get_iter(dh_table_t * dir);
 
+/**
+ * Get a dirent hashtable iterator starting from a cursor.
+ * @param dir is a directory entry hash table.
+ * @param cursor is a value previously returned by dh_iter_cursor().
+ */
+dh_dir_iter_t dh_get_iter_at(dh_table_t * dir, size_t cursor);
+
+/**
+ * Get the cursor of an iterator.
+ * The cursor stays valid over dh_link() and dh_unlink() calls.
+ */
+static inline size_t dh_iter_cursor(dh_dir_iter_t * it)
+{
+    return it->slot;
+}
+
 /**
  * Get the next directory entry from iterator it.
  * @param it is a dirent hash table iterator.
@@ -93,6 +93,15 @@ struct dev_info {
     int (*mmap)(struct dev_info * devnfo, size_t blkno, size_t bsize, int flags,
                 struct buf ** bp_out);
 
+    /**
+     * Poll a device.
+     * See poll in vnode_ops. A device without a poll function is always
+     * ready for reading and writing.
+     * @note This function is optional and can be NULL.
+     */
+    int (*poll)(file_t * file, struct dev_info * devnfo, int events,
+                struct poll_table * pt);
+
     /**
      * The function is called if set and vnode deletion is triggered by
      * one of the vnode release functions.
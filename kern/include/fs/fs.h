@@ -57,6 +57,13 @@
 
 #define FS_FLAG_INIT    0x01 /*!< File system initialized. */
 #define FS_FLAG_FAIL    0x08 /*!< File system has failed. */
+#define FS_FLAG_UIO_VEC 0x10 /*!< read() and write() vnode ops only access
+                              *   the uio with uio_copyin() and uio_copyout()
+                              *   and thus accept multi-segment uios. */
+#define FS_FLAG_NAMECACHE 0x20 /*!< Lookups can be cached by the VFS name
+                                *   cache; Names are only created and
+                                *   removed through the fs_*_curproc()
+                                *   functions. */
 
 #define PATH_DELIMS     "/"
 
@@ -92,13 +99,14 @@
 
 struct cred;
 struct proc_info;
+struct poll_table;
 
 /*
  * Types for buffer pointer storage object in vnode.
  */
-SPLAY_HEAD(bufhd_splay, buf);
+LIST_HEAD(bufhd_list, buf);
 struct bufhd {
-    struct bufhd_splay sroot;
+    struct bufhd_list lhead;
 };
 
 typedef struct vnode {
@@ -149,8 +157,10 @@ typedef struct vnode {
     /**
      * vfs_hash:    (mount + inode) -> vnode hash. The hash value itself is
      *              grouped with other int fields, to avoid padding.
+     *              RCU managed, the lowest bit is set when the vnode is
+     *              removed from the hash.
      */
-    LIST_ENTRY(vnode) vn_hashlist;
+    struct vnode * vn_hashnext;
 #endif
 
     mtx_t vn_lock;
@@ -215,6 +225,7 @@ typedef struct files_struct {
 typedef struct fs {
     char fsname[MFSNAMELEN];
     unsigned fs_majornum; /*!< Virtual major device number of the filesystem. */
+    unsigned fs_flags;    /*!< FS_FLAG_ flags. */
     mtx_t fs_giant;
 
     /**
@@ -314,6 +325,20 @@ typedef struct vnode_ops {
      *          Otherwise a negative errno code is returned.
      */
     ssize_t (*write)(file_t * file, struct uio * uio, size_t count);
+    /**
+     * Copy data between two files without passing it through a buffer.
+     * The file offsets are not changed. The op may copy less than len
+     * bytes and the caller shall copy the rest with read and write.
+     * @param fin       is the source file.
+     * @param off_in    is the offset in the source file.
+     * @param fout      is the target file.
+     * @param off_out   is the offset in the target file.
+     * @param len       is the number of bytes to be copied.
+     * @return  Returns the number of bytes copied;
+     *          Otherwise a negative errno code is returned.
+     */
+    ssize_t (*copy_range)(file_t * fin, off_t off_in, file_t * fout,
+                          off_t off_out, size_t len);
     /**
      * Seek a file.
      * @param file      is a file stored in the file system.
@@ -334,6 +359,18 @@ typedef struct vnode_ops {
      *                  Otherwise a negative errno code is returned.
      */
     int (*ioctl)(file_t * file, unsigned request, void * arg, size_t arg_len);
+    /**
+     * Poll the readiness of an open file.
+     * If pt is set the op must call poll_record() for every wait queue that
+     * is woken up when the readiness of the file changes and do it before
+     * checking the readiness; Files without a wait queue shall call
+     * poll_record_nowq() instead.
+     * @param file      is the open file polled.
+     * @param events    is a mask of POLL* events of interest.
+     * @param pt        is the poll table or NULL.
+     * @return          Returns a mask of POLL* events currently true.
+     */
+    int (*poll)(file_t * file, int events, struct poll_table * pt);
     /* Event handlers
      * -------------- */
     /**
@@ -756,6 +793,21 @@ int fs_chflags_curproc(int fildes, fflags_t flags);
  */
 int fs_chown_curproc(int fildes, uid_t owner, gid_t group);
 
+/**
+ * Copy data between two files of the current process inside the kernel.
+ * @param fd_in     is the source file descriptor.
+ * @param off_in    is a pointer to the source offset, updated by the number
+ *                  of bytes read; If NULL the file offset of fd_in is used
+ *                  and updated instead.
+ * @param fd_out    is the target file descriptor.
+ * @param off_out   is a pointer to the target offset; Same as off_in.
+ * @param len       is the number of bytes to copy.
+ * @return  Returns the number of bytes copied, 0 at the end of the source;
+ *          Otherwise a negative errno is returned.
+ */
+ssize_t fs_copy_file_range_curproc(int fd_in, off_t * off_in,
+                                   int fd_out, off_t * off_out, size_t len);
+
 /**
  * Returns the refcount of a vnode.
  */
@@ -833,6 +885,8 @@ int fs_enotsup_lock(file_t * file);
 int fs_enotsup_release(file_t * file);
 ssize_t fs_enotsup_read(file_t * file, struct uio * uio, size_t count);
 ssize_t fs_enotsup_write(file_t * file, struct uio * uio, size_t count);
+ssize_t fs_enotsup_copy_range(file_t * fin, off_t off_in, file_t * fout,
+                              off_t off_out, size_t len);
 off_t fs_enotsup_lseek(file_t * file, off_t offset, int whence);
 int fs_enotsup_ioctl(file_t * file, unsigned request, void * arg,
                      size_t arg_len);
@@ -845,6 +899,7 @@ int fs_enotsup_mknod(vnode_t * dir, const char * name, int mode,
                      void * specinfo, vnode_t ** result);
 int fs_enotsup_lookup(vnode_t * dir, const char * name, vnode_t ** result);
 int nofs_revlookup(vnode_t * dir, ino_t * ino, char * name, size_t name_len);
+int nofs_poll(file_t * file, int events, struct poll_table * pt);
 int fs_enotsup_link(vnode_t * dir, vnode_t * vnode, const char * name);
 int fs_enotsup_unlink(vnode_t * dir, const char * name);
 int fs_enotsup_mkdir(vnode_t * dir,  const char * name, mode_t mode);
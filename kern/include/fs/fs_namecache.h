@@ -0,0 +1,89 @@
+/**
+ *******************************************************************************
+ * @file    fs_namecache.h
+ * @author  Olli Vanhoja
+ * @brief   VFS name lookup cache.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup fs
+ * @{
+ */
+
+#ifndef _FS_NAMECACHE_H_
+#define _FS_NAMECACHE_H_
+
+struct vnode;
+
+/**
+ * Get the current generation of the name cache.
+ * The generation is incremented by every purge; A lookup result obtained from
+ * a file system must be entered with the generation read before the lookup
+ * so that a result racing with a purge is never cached.
+ */
+unsigned fs_namecache_gen(void);
+
+/**
+ * Lookup a name from the name cache.
+ * @param dir is the directory vnode.
+ * @param name is the name of the entry in dir.
+ * @param[out] result returns a referenced vnode on a positive hit and NULL
+ *                    on a negative hit.
+ * @return  Returns 1 on a hit; Otherwise 0.
+ */
+int fs_namecache_lookup(struct vnode * dir, const char * name,
+                        struct vnode ** result);
+
+/**
+ * Enter a lookup result to the name cache.
+ * Only names in file systems with FS_FLAG_NAMECACHE set are cached.
+ * @param dir is the directory vnode.
+ * @param name is the name of the entry in dir.
+ * @param vnode is the vnode found or NULL if the name doesn't exist.
+ * @param gen is the value returned by fs_namecache_gen() before the lookup.
+ */
+void fs_namecache_enter(struct vnode * dir, const char * name,
+                        struct vnode * vnode, unsigned gen);
+
+/**
+ * Remove a name from the name cache.
+ * Must be called after a name was created or removed in dir.
+ * If the name was a directory the entries under it are removed too.
+ */
+void fs_namecache_purge(struct vnode * dir, const char * name);
+
+/**
+ * Remove all entries from the name cache.
+ */
+void fs_namecache_purge_all(void);
+
+#endif /* _FS_NAMECACHE_H_ */
+
+/**
+ * @}
+ */
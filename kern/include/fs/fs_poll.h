@@ -0,0 +1,213 @@
+/**
+ *******************************************************************************
+ * @file    fs_poll.h
+ * @author  Olli Vanhoja
+ * @brief   Readiness notification for poll(), select() and kqueue.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup fs
+ * @{
+ */
+
+#ifndef _FS_POLL_H_
+#define _FS_POLL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/queue.h>
+#include <sys/types.h>
+#include <klocks.h>
+
+struct file;
+struct kevent;
+struct poll_entry;
+struct pollfd;
+
+/**
+ * Max number of wait queues a single poll op may record per file.
+ */
+#define FS_POLL_NWQ         2
+
+/**
+ * Rescan interval used when a polled file has no wait queue.
+ */
+#define FS_POLL_RESCAN_MS   50
+
+/**
+ * Readiness wait queue.
+ * An object that can become readable or writable embeds a pollwaitq and
+ * calls pollwakeup() whenever its readiness may have changed.
+ */
+struct pollwaitq {
+    mtx_t lock;
+    LIST_HEAD(poll_entry_list, poll_entry) head;
+};
+
+/**
+ * A registration on a pollwaitq.
+ * Entries are owned by the poller; wq is cleared when the entry is detached.
+ */
+struct poll_entry {
+    LIST_ENTRY(poll_entry) entry_;
+    struct pollwaitq * wq;
+    /**
+     * Wakeup callback.
+     * Called with wq->lock held, possibly from an interrupt handler.
+     */
+    void (*wakeup)(struct poll_entry * pe);
+    void * arg;
+};
+
+/**
+ * Poll table passed to the poll vnode op.
+ */
+struct poll_table {
+    struct poll_entry * entries;
+    size_t nr_entries;
+    size_t nr_used;
+    void (*wakeup)(struct poll_entry * pe);
+    void * arg;
+    int nowq; /*!< Set if a file couldn't be registered on a wait queue. */
+};
+
+/**
+ * A thread waiting for any of the entries of a poll table to wake up.
+ */
+struct poll_waiter {
+    mtx_t lock;
+    pthread_t tid;
+    int woken;      /*!< Set by poll_waiter_wake(). */
+    int blocked;    /*!< Set while the thread is blocked. */
+    LIST_ENTRY(poll_waiter) entry_;
+};
+
+/**
+ * Initialize a poll waiter for the current thread.
+ */
+void poll_waiter_init(struct poll_waiter * w);
+
+/**
+ * Clear the woken state of a poll waiter.
+ * Must be called before the readiness of the polled objects is checked.
+ */
+void poll_waiter_clear(struct poll_waiter * w);
+
+/**
+ * Wake up a poll waiter.
+ * Can be called from an interrupt handler.
+ */
+void poll_waiter_wake(struct poll_waiter * w);
+
+/**
+ * Sleep until the waiter is woken up or usec has elapsed.
+ * Returns immediately if the waiter was woken up after the last
+ * poll_waiter_clear().
+ * @param w is the waiter of the current thread.
+ * @param usec is the max time to sleep in usec; 0 to sleep forever.
+ * @return  Returns 0 if woken up or the time elapsed;
+ *          -EINTR if woken up by a signal.
+ */
+int poll_waiter_sleep(struct poll_waiter * w, uint64_t usec);
+
+/**
+ * Initialize a poll wait queue.
+ */
+void pollwaitq_init(struct pollwaitq * wq);
+
+/**
+ * Detach and wake up all pollers of a wait queue that is going away.
+ */
+void pollwaitq_destroy(struct pollwaitq * wq);
+
+/**
+ * Register the caller of a poll op on a wait queue.
+ * A poll op must call this before checking the readiness of the object,
+ * otherwise a wakeup between the check and the registration could be lost.
+ * @param pt is the poll table; Can be NULL if the caller only wants to
+ *           check the current readiness.
+ * @param wq is the wait queue of the object polled.
+ */
+void poll_record(struct poll_table * pt, struct pollwaitq * wq);
+
+/**
+ * Mark that a file has no wait queue and must be rescanned periodically.
+ */
+static inline void poll_record_nowq(struct poll_table * pt)
+{
+    if (pt)
+        pt->nowq = 1;
+}
+
+/**
+ * Detach all entries recorded in a poll table.
+ */
+void poll_table_detach(struct poll_table * pt);
+
+/**
+ * Wake up all pollers of a wait queue.
+ */
+void pollwakeup(struct pollwaitq * wq);
+
+/**
+ * Poll files of the current process.
+ * @param fds is a kernel copy of the pollfd array; revents are updated.
+ * @param nfds is the number of entries in fds.
+ * @param timeout is the timeout in msec; -1 to wait forever.
+ * @return  Returns the number of entries with non-zero revents;
+ *          Otherwise a negative errno is returned.
+ */
+int fs_poll_curproc(struct pollfd * fds, size_t nfds, int timeout);
+
+/**
+ * Create a new kqueue for the current process.
+ * @return  Returns a file descriptor number;
+ *          Otherwise a negative errno is returned.
+ */
+int fs_kqueue_curproc_creat(void);
+
+/**
+ * Register events and wait for events on a kqueue.
+ * @param fd is the kqueue file descriptor.
+ * @param changelist is a user space array of changes.
+ * @param nchanges is the number of entries in changelist.
+ * @param eventlist is a user space array for the returned events.
+ * @param nevents is the max number of entries in eventlist.
+ * @param timeout is the timeout in msec; -1 to wait forever.
+ * @return  Returns the number of events returned;
+ *          Otherwise a negative errno is returned.
+ */
+int fs_kevent_curproc(int fd, __user const struct kevent * changelist,
+                      int nchanges, __user struct kevent * eventlist,
+                      int nevents, int timeout);
+
+#endif /* _FS_POLL_H_ */
+
+/**
+ * @}
+ */
@@ -35,6 +35,7 @@
 
 #include <fcntl.h>
 #include <buf.h>
+#include <fs/fs_poll.h>
 #include <queue_r.h>
 #include <ksignal.h>
 
@@ -56,6 +57,7 @@ struct fs_queue {
     mtx_t rd_lock;
     struct signals * waiting4read;
     struct signals * waiting4write;
+    struct pollwaitq pwq; /*!< Pollers of the queue. */
     struct fs_queue_packet packet[];
 };
 
@@ -96,4 +98,15 @@ ssize_t fs_queue_write(struct fs_queue * fsq, uint8_t * buf, size_t count,
 ssize_t fs_queue_read(struct fs_queue * fsq, uint8_t * buf, size_t count,
                       int flags);
 
+/**
+ * Poll a fs queue.
+ * POLLIN is reported if the queue is not empty and POLLOUT if there is
+ * space for at least one block.
+ * @param fsq is a pointer to the fs queue object.
+ * @param events is a mask of POLL* events of interest.
+ * @param pt is the poll table or NULL.
+ * @return Returns a mask of POLL* events currently true.
+ */
+int fs_queue_poll(struct fs_queue * fsq, int events, struct poll_table * pt);
+
 #endif /* _FS_QUEUE_H_ */
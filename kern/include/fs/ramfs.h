@@ -104,6 +104,13 @@ ssize_t ramfs_rd_regular(vnode_t * file, const off_t * restrict offset,
 /* vnode ops */
 ssize_t ramfs_read(struct file * file, struct uio * uio, size_t count);
 ssize_t ramfs_write(struct file * file, struct uio * uio, size_t count);
+
+/**
+ * Share whole blocks of a regular file with another regular file.
+ * The shared blocks are copied when either of the files is written.
+ */
+ssize_t ramfs_copy_range(struct file * fin, off_t off_in, struct file * fout,
+                         off_t off_out, size_t len);
 int ramfs_event_vnode_opened(struct proc_info * p, vnode_t * vnode);
 int ramfs_create(struct vnode * dir, const char * name, mode_t mode,
                  struct vnode ** result);
@@ -39,12 +39,15 @@ typedef struct vfs_hash_ctx * vfs_hash_ctx_t;
 
 /**
  * vnode comparator function type.
+ * The comparator is always called with a writer lock of the context held.
  */
 typedef int vfs_hash_cmp_t(struct vnode * vp, void * arg);
 
 
 /**
  * Get a new vfs_hash context.
+ * The table is sized for desiredvnodes and grown when the average chain gets
+ * too long.
  * @note Not thread-safe.
  * @return A pointer to the context.
  */
@@ -53,6 +56,10 @@ vfs_hash_ctx_t vfs_hash_new_ctx(const char * fsname, unsigned desiredvnodes,
 
 /**
  * Get a vnode pointer from vfs_hash.
+ * If the context has no comparator the lookup is lockless and a removed
+ * vnode may still be walked by the lookup until the next RCU grace period,
+ * therefore a file system must not free the memory of a removed vnode
+ * before that.
  * @retval -EINVAL if cid is invalid.
  */
 int vfs_hash_get(vfs_hash_ctx_t ctx, const struct fs_superblock * mp,
@@ -63,7 +70,8 @@ size_t vfs_hash_index(struct vnode * vp)
     __attribute__((nonnull(1)));
 
 /**
- * Walkthrough each vnode belonging to the given mp and call a callback cb.
+ * Remove each vnode belonging to the given mp and call a callback cb.
+ * cb is called without locks after the vnode has been removed.
  */
 int vfs_hash_foreach(vfs_hash_ctx_t ctx, const struct fs_superblock * mp,
                      void (*cb)(struct vnode *))
@@ -86,7 +94,8 @@ int vfs_hash_rehash(vfs_hash_ctx_t ctx, struct vnode * vp, size_t hash)
 
 /**
  * Remove a vnode from the hashmap of a vfs_hash context.
- * @retval -EINVAL if cid is invalid.
+ * Never blocks.
+ * @retval -ENOENT if the vnode was not in the hash.
  */
 int vfs_hash_remove(vfs_hash_ctx_t ctx, struct vnode * vp)
     __attribute__((nonnull(1, 2)));
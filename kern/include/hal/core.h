@@ -107,6 +107,12 @@ void svc_setretval(intptr_t retval);
  */
 istate_t get_interrupt_state(void);
 
+/**
+ * Test if interrupts are enabled on the current CPU.
+ * @return Returns non-zero if IRQs are enabled.
+ */
+int interrupts_enabled(void);
+
 /**
  * Set interrupt state.
  * Sets interrupt state flags previously preserved with get_interrupt_state().
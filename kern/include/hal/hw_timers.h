@@ -59,6 +59,17 @@ typedef void timer_task_t(void);
 #define TIMER_TASK(fun) \
     DATA_SET(timer_tasks, fun)
 
+/**
+ * Program the next scheduler timer event.
+ * The event fires once after usec and then the timer continues with the
+ * periodic configSCHED_HZ tick. The HW back end may clamp the delay to the
+ * range supported by the timer.
+ * @param usec is the delay to the next event in microseconds.
+ * @return  0 if succeed;
+ *          -ENOTSUP if the timer doesn't support one-shot events.
+ */
+int hw_timers_set_next_event(uint32_t usec);
+
 /**
  * Run timer tasks.
  * Shall be called by the HW specific timer handler.
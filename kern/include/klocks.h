@@ -42,13 +42,54 @@
 #ifndef KLOCKS_H_
 #define KLOCKS_H_
 
+#include <sys/queue.h>
 #include <sys/types_pthread.h>
 #include <machine/atomic.h>
 #include <hal/core.h>
-#ifdef configLOCK_DEBUG
+#if defined(configLOCK_DEBUG) || defined(configLOCK_PROFILE)
 #include <kerror.h>
+/**
+ * The lock functions take the acquisition site as an argument.
+ */
+#define KLOCKS_WHERE
 #endif
 
+/**
+ * @addtogroup lockprof
+ * Lock profiling.
+ * Each mtx, rwlock and semaphore acquisition site gets a record of
+ * acquisitions, contention, wait time and hold time. The records are shown
+ * in /proc/lockprof.
+ * @{
+ */
+
+#ifdef configLOCK_PROFILE
+struct lock_prof;
+
+/**
+ * Record a lock acquisition.
+ * @param type is the lock type name.
+ * @param whr is the acquisition site.
+ * @param start is the time when the locking was started.
+ * @param contended should be set if the lock wasn't free on the first try.
+ * @return Returns the record of the site if it's profiled;
+ *         Otherwise NULL.
+ */
+struct lock_prof * lockprof_acquire(const char * type, const char * whr,
+                                    uint64_t start, int contended);
+
+/**
+ * Record the release of a lock.
+ * @param lp is the record returned by lockprof_acquire().
+ * @param acquired is the time when the lock was acquired.
+ */
+void lockprof_release(struct lock_prof * lp, uint64_t acquired);
+#endif
+
+/**
+ * @}
+ */
+
 /**
  * @addtogroup mtx mtx_init, mtx_lock, mtx_trylock
  * Kernel mutex lock functions.
@@ -73,8 +114,11 @@
  * MTX_TYPE_UNDEF       -
  * MTX_TYPE_SPIN        MTX_OPT_SLEEP, MTX_OPT_PRICEIL, MTX_OPT_DINT
  * MTX_TYPE_TICKET      MTX_OPT_PRICEIL, MTX_OPT_DINT
+ * MTX_TYPE_ADAPTIVE    MTX_OPT_DINT
  */
 
+struct thread_info;
+
 /**
  * Lock type.
  */
@@ -84,6 +128,13 @@ enum mtx_type {
     MTX_TYPE_TICKET,        /*!< Use ticket spin locking. This will also use
                              *   yield which may not be sufficient for blocking
                              *   interrupt handlers and such. */
+    MTX_TYPE_ADAPTIVE,      /*!< Ticket lock that spins briefly and then
+                             *   blocks the thread on the turnstile of the
+                             *   lock. The lock is handed directly to the
+                             *   next waiter and the owner inherits the
+                             *   priority of the waiters. A thread running
+                             *   with interrupts disabled and the idle thread
+                             *   yield instead of blocking. */
 };
 
 
@@ -132,9 +183,25 @@ typedef struct mtx {
         int p_lock;
         int p_saved;
     } pri;
+    /**
+     * Turnstile of an adaptive mutex.
+     */
+    struct mtx_turnstile {
+        atomic_t ts_lock;       /*!< Interlock for the turnstile. */
+        pthread_t ts_owner;     /*!< Current owner of the mutex. */
+        pthread_t ts_boosted;   /*!< Thread having an inherited priority. */
+        int ts_boost;           /*!< Set if ts_boosted is valid. */
+        int ts_saved_prio;      /*!< Priority of ts_boosted before boost. */
+        int ts_boost_prio;      /*!< Inherited priority. */
+        LIST_HEAD(mtx_ts_waiters, thread_info) ts_waiters;
+    } ts;
 #ifdef configLOCK_DEBUG
     char * mtx_ldebug;
 #endif
+#ifdef configLOCK_PROFILE
+    struct lock_prof * mtx_prof;    /*!< Record of the current owner. */
+    uint64_t mtx_prof_time;         /*!< Time of the acquisition. */
+#endif
 } mtx_t;
 
 #define MTX_OPT(mtx, typ) (!!((mtx)->mod.mtx_flags & (typ)))
@@ -166,11 +233,11 @@ void mtx_init(mtx_t * mtx, enum mtx_type type, unsigned int opt);
 }
 
 /* Mutex functions */
-#ifndef configLOCK_DEBUG
+#ifndef KLOCKS_WHERE
 int mtx_lock(mtx_t * mtx);
 int mtx_sleep(mtx_t * mtx, long timeout);
 int mtx_trylock(mtx_t * mtx);
-#else /* Debug versions */
+#else /* Debug and profiling versions */
 #define mtx_lock(mtx)   _mtx_lock(mtx, _KERROR_WHERESTR)
 #define mtx_sleep(mtx, timeout) _mtx_sleep(mtx, timeout, _KERROR_WHERESTR)
 #define mtx_trylock(mtx)    _mtx_trylock(mtx, _KERROR_WHERESTR)
@@ -212,6 +279,10 @@ typedef struct rwlock {
     int state; /*!< Lock state. 0 = no lock, -1 = wrlock and 0 < rdlock. */
     int wr_waiting; /*!< writers waiting. */
     struct mtx lock; /*!< Mutex protecting attributes. */
+#ifdef configLOCK_PROFILE
+    struct lock_prof * wr_prof; /*!< Record of the current writer. */
+    uint64_t wr_prof_time;      /*!< Time of the write lock acquisition. */
+#endif
 } rwlock_t;
 
 /* Rwlock functions */
@@ -226,14 +297,24 @@ void rwlock_init(rwlock_t * l);
  * Get write lock to rwlock.
  * @param l is the rwlock.
  */
+#ifndef KLOCKS_WHERE
 void rwlock_wrlock(rwlock_t * l);
+#else
+#define rwlock_wrlock(l) _rwlock_wrlock(l, _KERROR_WHERESTR)
+void _rwlock_wrlock(rwlock_t * l, char * whr);
+#endif
 
 /**
  * Try to get write lock.
  * @param l is the rwlock.
  * @return Returns 0 if lock achieved; Otherwise value other than zero.
  */
+#ifndef KLOCKS_WHERE
 int rwlock_trywrlock(rwlock_t * l);
+#else
+#define rwlock_trywrlock(l) _rwlock_trywrlock(l, _KERROR_WHERESTR)
+int _rwlock_trywrlock(rwlock_t * l, char * whr);
+#endif
 
 /**
  * Async wait for the write turn on an rwlock.
@@ -258,14 +339,24 @@ void rwlock_wrunlock(rwlock_t * l);
  * Get reader's lock.
  * @param l is the rwlock.
  */
+#ifndef KLOCKS_WHERE
 void rwlock_rdlock(rwlock_t * l);
+#else
+#define rwlock_rdlock(l) _rwlock_rdlock(l, _KERROR_WHERESTR)
+void _rwlock_rdlock(rwlock_t * l, char * whr);
+#endif
 
 /**
  * Try to get reader's lock.
  * @param is the rwlock.
  * @return Returns 0 if lock achieved; Otherwise value other than zero.
  */
+#ifndef KLOCKS_WHERE
 int rwlock_tryrdlock(rwlock_t * l);
+#else
+#define rwlock_tryrdlock(l) _rwlock_tryrdlock(l, _KERROR_WHERESTR)
+int _rwlock_tryrdlock(rwlock_t * l, char * whr);
+#endif
 
 /**
  * Release reader's lock.
@@ -370,7 +461,12 @@ static inline void sema_init(sema_t * s, int val)
  * Decrement the semaphore counter.
  * @param s is a pointer to the semaphore.
  */
+#ifndef KLOCKS_WHERE
 void sema_down(sema_t * s);
+#else
+#define sema_down(s) _sema_down(s, _KERROR_WHERESTR)
+void _sema_down(sema_t * s, char * whr);
+#endif
 
 /**
  * Increment the semaphore counter.
@@ -46,7 +46,19 @@
 
 struct thread_info;
 
+/**
+ * Maximum number of CPUs supported by the scheduler.
+ */
+#if defined(configMP) && defined(configSCHED_MAX_CPUS)
+#define KSCHED_CPU_COUNT    configSCHED_MAX_CPUS
+#else
 #define KSCHED_CPU_COUNT    1
+#endif
+
+/**
+ * CPU affinity mask allowing all CPUs.
+ */
+#define KSCHED_CPU_MASK_ALL ((uint32_t)((1ull << KSCHED_CPU_COUNT) - 1))
 
 /**
  * Struct describing a generic thread scheduler.
@@ -63,6 +75,12 @@ struct scheduler {
      * @return  Zero if succeeded; Otherwise a negative errno code is returned.
      */
     int (*insert)(struct scheduler * sobj, struct thread_info * thread);
+    /**
+     * Remove a thread from the run queue of this policy.
+     * @param sobj is a pointer to the scheduling object.
+     * @param thread is a pointer to the thread to be removed.
+     */
+    void (*remove)(struct scheduler * sobj, struct thread_info * thread);
     /**
      * Run the scheduler.
      * @param sobj is a pointer to the scheduling object.
@@ -82,9 +100,10 @@ struct scheduler {
 
 /**
  * The type of scheduler constructor creating a new thread scheduler object.
+ * @param cpu_index is the index of the CPU the scheduler is created for.
  * @return  Returns a pointer to a new thread scheduler; Otherwise -ENOMEM.
  */
-typedef struct scheduler * sched_constructor(void);
+typedef struct scheduler * sched_constructor(int cpu_index);
 
 /**
  * Scheduler task type.
@@ -140,12 +159,23 @@ int get_cpu_index(void);
 
 /**
  * Return load averages in integer format scaled to 100.
+ * The system load is the sum of the loads of all CPUs.
  * @param[out] loads load averages.
  */
 void sched_get_loads(uint32_t loads[3]);
 
 void sched_handler(void);
 
+#ifdef configSCHED_TICKLESS
+/**
+ * Notify the scheduler about a new earliest timer deadline.
+ * Reprograms the next timer event if the tick is stretched beyond the
+ * deadline. Must be called with interrupts disabled.
+ * @param expires is the expiration time of the timer in usec.
+ */
+void sched_timers_deadline(uint64_t expires);
+#endif
+
 #endif /* KSCHED_H */
 
 /**
@@ -0,0 +1,147 @@
+/**
+ *******************************************************************************
+ * @file    ksched_prioq.h
+ * @author  Olli Vanhoja
+ * @brief   Bitmap indexed priority run queue for thread schedulers.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+/**
+ * @addtogroup sched
+ * @{
+ */
+
+#pragma once
+#ifndef KSCHED_PRIOQ_H
+#define KSCHED_PRIOQ_H
+
+#include <stdint.h>
+#include <sys/queue.h>
+#include <sched.h>
+#include <libkern.h>
+#include <thread.h>
+
+/**
+ * Number of priority levels in a priority run queue.
+ * One level per each effective thread priority.
+ */
+#define SCHED_PRIOQ_NLEVELS (NICE_MAX - NICE_MIN + 1)
+
+#define SCHED_PRIOQ_ENTRY   sched.runq_entry_
+
+TAILQ_HEAD(sched_prioq_level, thread_info);
+
+/**
+ * A priority run queue.
+ * Threads are kept in a FIFO queue per priority level and a bitmap tells
+ * which levels are non-empty, so the first thread of the highest priority
+ * level can be found with a single find-first-set operation.
+ */
+struct sched_prioq {
+    uint64_t bmap; /*!< Bit n is set if level n is non-empty. */
+    struct sched_prioq_level level[SCHED_PRIOQ_NLEVELS];
+};
+
+static inline void sched_prioq_init(struct sched_prioq * q)
+{
+    q->bmap = 0;
+    for (size_t i = 0; i < SCHED_PRIOQ_NLEVELS; i++) {
+        TAILQ_INIT(&q->level[i]);
+    }
+}
+
+/**
+ * Convert an effective thread priority to a run queue level.
+ * Level 0 is the highest priority.
+ */
+static inline int sched_prioq_prio2level(int prio)
+{
+    return imin(imax(prio, NICE_MIN), NICE_MAX) - NICE_MIN;
+}
+
+/**
+ * Insert a thread to the tail of its priority level.
+ * The level is selected by thread->sched.prio.
+ */
+static inline void sched_prioq_insert_tail(struct sched_prioq * q,
+                                           struct thread_info * thread)
+{
+    const int level = sched_prioq_prio2level(thread->sched.prio);
+
+    TAILQ_INSERT_TAIL(&q->level[level], thread, SCHED_PRIOQ_ENTRY);
+    q->bmap |= (uint64_t)1 << level;
+}
+
+/**
+ * Remove a thread from the priority queue.
+ * The thread must be in the queue and thread->sched.prio must not have been
+ * changed since it was inserted.
+ */
+static inline void sched_prioq_remove(struct sched_prioq * q,
+                                      struct thread_info * thread)
+{
+    const int level = sched_prioq_prio2level(thread->sched.prio);
+
+    TAILQ_REMOVE(&q->level[level], thread, SCHED_PRIOQ_ENTRY);
+    if (TAILQ_EMPTY(&q->level[level])) {
+        q->bmap &= ~((uint64_t)1 << level);
+    }
+}
+
+/**
+ * Get the first thread of the highest priority non-empty level.
+ * @return A pointer to the thread; NULL if the queue is empty.
+ */
+static inline struct thread_info * sched_prioq_first(struct sched_prioq * q)
+{
+    if (q->bmap == 0)
+        return NULL;
+
+    return TAILQ_FIRST(&q->level[ffsll(q->bmap) - 1]);
+}
+
+/**
+ * Move all threads from a temporary list back to the tail of their levels.
+ * @param q     is the priority queue.
+ * @param list  is the list of threads to be inserted.
+ */
+static inline void sched_prioq_requeue(struct sched_prioq * q,
+                                       struct sched_prioq_level * list)
+{
+    struct thread_info * thread;
+
+    while ((thread = TAILQ_FIRST(list))) {
+        TAILQ_REMOVE(list, thread, SCHED_PRIOQ_ENTRY);
+        sched_prioq_insert_tail(q, thread);
+    }
+}
+
+#endif /* KSCHED_PRIOQ_H */
+
+/**
+ * @}
+ */
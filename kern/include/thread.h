@@ -45,6 +45,7 @@
 #include <machine/atomic.h>
 #include <hal/core.h>
 #include <hal/mmu.h>
+#include <ksched.h>
 #include <ksignal.h>
 
 /**
@@ -127,21 +128,19 @@ struct thread_info {
         mtx_t tdlock;               /*!< Lock for data in this substruct. */
         RB_ENTRY(thread_info) ttentry_; /*!< Thread table entry. */
         STAILQ_ENTRY(thread_info) readyq_entry_;
-
-        /* Scheduling policy specific data. */
-        union {
-            /* FIFO policy */
-            struct thread_sched_fifo {
-                int prio;           /*!< EXEC time priority. */
-                RB_ENTRY(thread_info) runq_entry_;
-            } fifo;
-            /* RR policy */
-            struct thread_sched_rr {
-                TAILQ_ENTRY(thread_info) runq_entry_;
-            } rr;
-        };
+        int cpu;                    /*!< Index of the CPU scheduling this
+                                     *   thread. */
+
+        /*
+         * Scheduling policy run queue data.
+         * A thread can be only in the run queue of a single policy at time.
+         */
+        int prio;                   /*!< EXEC time priority. */
+        TAILQ_ENTRY(thread_info) runq_entry_;
     } sched;
     struct sched_param param;       /*!< Scheduling parameters set by user. */
+    uint32_t cpu_affinity;          /*!< Mask of CPUs allowed to run this
+                                     *   thread. */
 
     /* Timers */
     int wait_tim;                   /*!< Reference to a timeout timer. */
@@ -160,6 +159,21 @@ struct thread_info {
     struct signals sigs;            /*!< Signals. */
     struct ksiginfo * sigwait_retval; /*!< Return value for sigwait(). */
 
+    /* Adaptive mutex */
+    struct mtx_wait {
+        struct mtx * mtx;           /*!< Adaptive mutex waited on. */
+        int ticket;                 /*!< Ticket of the wait. */
+        LIST_ENTRY(thread_info) entry_; /*!< Turnstile entry. */
+    } mtxwait;
+
+    /* Futex */
+    struct futex_wait {
+        uintptr_t key;              /*!< Key of the futex waited on. */
+        int woken;                  /*!< Set by futex wake. */
+        int timedout;               /*!< Set by the futex timeout timer. */
+        TAILQ_ENTRY(thread_info) entry_; /*!< Futex wait queue entry. */
+    } futex;
+
     /**
      * Thread inheritance; Parent and child thread pointers.
      *
@@ -194,7 +208,15 @@ enum thread_eyield_strategy {
 };
 
 /* External variables *********************************************************/
+#if KSCHED_CPU_COUNT > 1
+/**
+ * Currently executing thread of each CPU.
+ */
+extern struct thread_info * current_thread_arr[KSCHED_CPU_COUNT];
+#define current_thread (current_thread_arr[get_cpu_index()])
+#else
 extern struct thread_info * current_thread;
+#endif
 
 /**
  * Compare two thread_info structs.
@@ -338,6 +360,20 @@ struct thread_info * thread_remove_ready(void);
  */
 void thread_wait(void);
 
+/**
+ * Mark the current thread blocked without waiting.
+ * This can be used to close the window between publishing the current thread
+ * as a waiter of an event and calling thread_wait_blocked(); A
+ * thread_release() called in between won't be lost.
+ */
+void thread_block(void);
+
+/**
+ * Wait until the current thread is released.
+ * The thread must have been marked blocked with thread_block().
+ */
+void thread_wait_blocked(void);
+
 /**
  * Release a waiting thread.
  */
@@ -377,6 +413,24 @@ int thread_set_policy(pthread_t thread_id, unsigned policy);
  */
 unsigned thread_get_policy(pthread_t thread_id);
 
+/**
+ * Set the CPU affinity mask of a thread.
+ * If the current CPU of the thread is not allowed anymore the thread is
+ * moved to an allowed CPU the next time it's selected to run.
+ * @param thread_id is the thread.
+ * @param mask      is a mask of allowed CPUs.
+ * @return 0 if succeed; Otherwise a negative errno is returned.
+ */
+int thread_set_affinity(pthread_t thread_id, uint32_t mask);
+
+/**
+ * Get the CPU affinity mask of a thread.
+ * @param thread_id     is the thread.
+ * @param[out] mask     is the mask of allowed CPUs.
+ * @return 0 if succeed; Otherwise a negative errno is returned.
+ */
+int thread_get_affinity(pthread_t thread_id, uint32_t * mask);
+
 /**
  * Set thread priority.
  * @param   thread_id Thread id.
@@ -71,6 +71,16 @@ void timers_run(void);
 int timers_add(void (*event_fn)(void *), void * event_arg,
                timers_flags_t flags, uint64_t usec);
 
+/**
+ * Get the expiration time of the earliest armed timer.
+ * Can be called with interrupts disabled.
+ * @param[out] expires is set to the expiration time in usec.
+ * @return  0 if succeed;
+ *          -ENOENT if there are no armed timers;
+ *          -EAGAIN if the timers are being modified.
+ */
+int timers_next_expiry(uint64_t * expires);
+
 /**
  * Get split time from a timer.
  * @param tim is the timer index.
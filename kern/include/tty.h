@@ -37,6 +37,7 @@
 #include <stdint.h>
 
 struct file;
+struct poll_table;
 struct vnode;
 struct termios;
 struct winsize;
@@ -86,6 +87,13 @@ struct tty {
      */
     int (*ioctl)(struct dev_info * devnfo, uint32_t request,
                  void * arg, size_t arg_len);
+
+    /**
+     * Poll the tty.
+     * @note Can be NULL.
+     */
+    int (*poll)(struct file * file, struct tty * tty, int events,
+                struct poll_table * pt);
 };
 
 /**
@@ -42,16 +42,21 @@
 #include <stddef.h>
 
 struct buf;
+struct iovec;
 struct proc_info;
 
 /**
  * User IO buffer descriptor.
+ * A descriptor initialized with uio_init_uvec() describes a list of user
+ * segments that are accessed as a single buffer of bufsize bytes.
  */
 struct uio {
     __kernel void * kbuf;
     __user void * ubuf;
     struct proc_info * proc;
     size_t bufsize;
+    const struct iovec * iov;   /*!< Kernel copy of the user segments. */
+    int iovcnt;                 /*!< Number of segments in iov. */
 };
 
 /**
@@ -73,6 +78,34 @@ int uio_init_kbuf(struct uio * uio, __kernel void * kbuf, size_t size);
 int uio_init_ubuf(struct uio * uio, __user void * ubuf, size_t size,
                      int rw);
 
+/**
+ * Initialize a user IO buffer with a list of user segments.
+ * @param uio is a pointer to the UIO descriptor.
+ * @param iov is a kernel copy of the user iovec array; The array must stay
+ *            valid while the uio is in use.
+ * @param iovcnt is the number of entries in iov.
+ * @param rw is the access needed.
+ * @return Returns 0 if succeed; Otherwise a negative errno code.
+ */
+int uio_init_uvec(struct uio * uio, const struct iovec * iov, int iovcnt,
+                  int rw);
+
+/**
+ * Get the number of segments in a UIO buffer.
+ */
+static inline int uio_nsegs(struct uio * uio)
+{
+    return (uio->iovcnt > 0) ? uio->iovcnt : 1;
+}
+
+/**
+ * Get a single segment of a UIO buffer as a new UIO buffer.
+ * @param uio is a pointer to the UIO descriptor.
+ * @param i is the segment index.
+ * @param[out] seg is the UIO descriptor for the segment.
+ */
+void uio_get_seg(struct uio * uio, int i, struct uio * seg);
+
 /**
  * INITIAlize a user IO buffer from struct buf.
  * @param[in] bp is a buffer allocated from core.
@@ -102,6 +135,8 @@ int uio_copyin(struct uio * uio, void * dst, size_t offset, size_t size);
 
 /**
  * Get UIO kernel address.
+ * Only a single segment UIO buffer can be mapped; Use uio_get_seg() to
+ * access the segments of a multi-segment buffer.
  * @param uio is a pointer to the UIO descriptor.
  * @param[out] addr returns a kernel mapped address of the UIO buffer.
  * @return  Returns 0 if succeed;
@@ -402,6 +402,49 @@ int vm_unmapproc_region(struct proc_info * proc, struct buf * region);
  */
 int vm_unload_regions(struct proc_info * proc, int start, int end);
 
+/**
+ * Resolve a write to a copy-on-write page of a process.
+ * @param proc is the process.
+ * @param region_nr is the region number.
+ * @param region is the region mapping vaddr.
+ * @param vaddr is the address written.
+ * @return  Returns zero if succeed;
+ *          -EACCES if the page is not a copy-on-write page;
+ *          Otherwise a negative errno.
+ */
+int vm_resolve_cow(struct proc_info * proc, int region_nr, struct buf * region,
+                   uintptr_t vaddr);
+
+/**
+ * Read a page of a demand paged region and map it to a process.
+ * @param proc is the process.
+ * @param region is the region mapping vaddr.
+ * @param vaddr is the address accessed.
+ * @return Returns zero if succeed; Otherwise a negative errno.
+ */
+int vm_fill_page(struct proc_info * proc, struct buf * region, uintptr_t vaddr);
+
+/**
+ * Read demand paged pages of a process before the kernel reads them.
+ * @param proc is the process.
+ * @param uaddr is the user space address.
+ * @param len is the length of the range read.
+ * @return Returns zero if succeed; Otherwise a negative errno.
+ */
+int vm_prepare_read(struct proc_info * proc, __user const void * uaddr,
+                    size_t len);
+
+/**
+ * Resolve copy-on-write pages of a process before the kernel writes to them.
+ * Demand paged pages are read first.
+ * @param proc is the process.
+ * @param uaddr is the user space address.
+ * @param len is the length of the range written.
+ * @return Returns zero if succeed; Otherwise a negative errno.
+ */
+int vm_prepare_write(struct proc_info * proc, __user const void * uaddr,
+                     size_t len);
+
 /**
  * Remap everything that should be mapped to the proc.
  * This can be used to fix racy remapping after a new process image has been
@@ -52,6 +52,16 @@
             (mod)->mtx_modcsum,                                 \
             "mtx mod unmodified")
 
+/**
+ * Number of lock attempts before a contended adaptive mutex blocks.
+ * Spinning is only useful if the owner can run on another CPU meanwhile.
+ */
+#ifdef configMP
+#define MTX_ADAPTIVE_SPINS  100
+#else
+#define MTX_ADAPTIVE_SPINS  1
+#endif
+
 /**
  * istate for MTX_OPT_DINT.
  * TODO Per CPU istate.
@@ -78,6 +88,144 @@ static void priceil_restore(mtx_t * mtx)
     }
 }
 
+/**
+ * Lock the turnstile interlock of an adaptive mutex.
+ * Interrupts are disabled while the interlock is held.
+ * @return Returns the interrupt state to be restored by ts_unlock().
+ */
+static istate_t ts_lock(mtx_t * mtx)
+{
+    istate_t s = get_interrupt_state();
+
+    disable_interrupt();
+    while (atomic_test_and_set(&mtx->ts.ts_lock)) {
+#ifdef configMP
+        cpu_wfe();
+#endif
+    }
+
+    return s;
+}
+
+static void ts_unlock(mtx_t * mtx, istate_t s)
+{
+    atomic_set(&mtx->ts.ts_lock, 0);
+    set_interrupt_state(s);
+#ifdef configMP
+    cpu_sev();
+#endif
+}
+
+/**
+ * Lend the priority of a waiter to the owner of an adaptive mutex.
+ * The caller must hold the interlock.
+ */
+static void ts_boost(mtx_t * mtx, struct thread_info * waiter)
+{
+    const pthread_t owner = mtx->ts.ts_owner;
+    const int prio = waiter->param.sched_priority;
+    int owner_prio;
+
+    if (owner == waiter->id)
+        return;
+
+    owner_prio = thread_get_priority(owner);
+    if (owner_prio == NICE_ERR || owner_prio <= prio)
+        return; /* The owner already runs at the same or higher priority. */
+
+    if (mtx->ts.ts_boost && mtx->ts.ts_boosted != owner) {
+        /* Left over from a previous owner. */
+        if (thread_get_priority(mtx->ts.ts_boosted) == mtx->ts.ts_boost_prio)
+            thread_set_priority(mtx->ts.ts_boosted, mtx->ts.ts_saved_prio);
+        mtx->ts.ts_boost = 0;
+    }
+    if (!mtx->ts.ts_boost) {
+        mtx->ts.ts_boosted = owner;
+        mtx->ts.ts_saved_prio = owner_prio;
+        mtx->ts.ts_boost = 1;
+    }
+    mtx->ts.ts_boost_prio = prio;
+    thread_set_priority(owner, prio);
+}
+
+/**
+ * Restore the priority lent to an owner of an adaptive mutex.
+ */
+static void ts_unboost(mtx_t * mtx)
+{
+    istate_t s;
+
+    s = ts_lock(mtx);
+    if (mtx->ts.ts_boost) {
+        /*
+         * The priority isn't restored if it was changed by someone else while
+         * boosted.
+         */
+        if (thread_get_priority(mtx->ts.ts_boosted) == mtx->ts.ts_boost_prio)
+            thread_set_priority(mtx->ts.ts_boosted, mtx->ts.ts_saved_prio);
+        mtx->ts.ts_boost = 0;
+    }
+    ts_unlock(mtx, s);
+}
+
+/**
+ * Block the current thread on the turnstile of an adaptive mutex until the
+ * lock is handed over to it or it's woken up otherwise.
+ * The caller must recheck the ticket after this function returns.
+ */
+static void ts_block(mtx_t * mtx, int ticket)
+{
+    struct thread_info * td = current_thread;
+    istate_t s;
+
+    s = ts_lock(mtx);
+    /*
+     * The unlocker updates dequeue before it looks for a waiter to hand the
+     * lock to, so if dequeue is not ours now the unlocker will find us.
+     */
+    if (atomic_read(&mtx->ticket.dequeue) == ticket) {
+        ts_unlock(mtx, s);
+        return;
+    }
+    td->mtxwait.mtx = mtx;
+    td->mtxwait.ticket = ticket;
+    LIST_INSERT_HEAD(&mtx->ts.ts_waiters, td, mtxwait.entry_);
+    ts_boost(mtx, td);
+    thread_block();
+    ts_unlock(mtx, s);
+
+    thread_wait_blocked();
+
+    /* We might have been released by someone else than the unlocker. */
+    s = ts_lock(mtx);
+    if (td->mtxwait.mtx) {
+        LIST_REMOVE(td, mtxwait.entry_);
+        td->mtxwait.mtx = NULL;
+    }
+    ts_unlock(mtx, s);
+}
+
+/**
+ * Hand an adaptive mutex over to the thread holding the given ticket if it's
+ * blocked on the turnstile.
+ */
+static void ts_handoff(mtx_t * mtx, int ticket)
+{
+    struct thread_info * td;
+    istate_t s;
+
+    s = ts_lock(mtx);
+    LIST_FOREACH(td, &mtx->ts.ts_waiters, mtxwait.entry_) {
+        if (td->mtxwait.ticket == ticket) {
+            LIST_REMOVE(td, mtxwait.entry_);
+            td->mtxwait.mtx = NULL;
+            thread_release(td->id);
+            break;
+        }
+    }
+    ts_unlock(mtx, s);
+}
+
 void mtx_init(mtx_t * mtx, enum mtx_type type, unsigned int opt)
 {
     mtx->mod.mtx_type = type;
@@ -86,28 +234,42 @@ void mtx_init(mtx_t * mtx, enum mtx_type type, unsigned int opt)
     mtx->mtx_lock = ATOMIC_INIT(0);
     mtx->ticket.queue = ATOMIC_INIT(0);
     mtx->ticket.dequeue = ATOMIC_INIT(0);
+    mtx->ts.ts_lock = ATOMIC_INIT(0);
+    mtx->ts.ts_owner = 0;
+    mtx->ts.ts_boost = 0;
+    LIST_INIT(&mtx->ts.ts_waiters);
 #ifdef configLOCK_DEBUG
     mtx->mtx_ldebug = NULL;
 #endif
+#ifdef configLOCK_PROFILE
+    mtx->mtx_prof = NULL;
+#endif
 }
 
-#ifndef configLOCK_DEBUG
+#ifndef KLOCKS_WHERE
 int mtx_lock(mtx_t * mtx)
 #else
 int _mtx_lock(mtx_t * mtx, char * whr)
 #endif
 {
     int ticket;
+    int spins = 0;
     const int sleep_mode = MTX_OPT(mtx, MTX_OPT_SLEEP);
     const int opt_timeout = (mtx->mod.mtx_flags & 0xf) * 1000;
+#ifdef configLOCK_PROFILE
+    uint64_t start_time = get_utime();
+    int tries = 0;
+#else
     uint64_t start_time = (opt_timeout) ? get_utime() : 0;
+#endif
 #ifdef configLOCK_DEBUG
     unsigned deadlock_cnt = 0;
 
     MTX_MOD_ASSERT(&mtx->mod);
 #endif
 
-    if (mtx->mod.mtx_type == MTX_TYPE_TICKET) {
+    if (mtx->mod.mtx_type == MTX_TYPE_TICKET ||
+        mtx->mod.mtx_type == MTX_TYPE_ADAPTIVE) {
         ticket = atomic_inc(&mtx->ticket.queue);
     }
 
@@ -117,6 +279,9 @@ int _mtx_lock(mtx_t * mtx, char * whr)
     }
 
     while (1) {
+#ifdef configLOCK_PROFILE
+        tries++;
+#endif
 #if defined(configLOCK_DEBUG) && (configKLOCK_DLTHRES > 0)
         /*
          * TODO Deadlock detection threshold should depend on lock type and
@@ -157,6 +322,25 @@ int _mtx_lock(mtx_t * mtx, char * whr)
             thread_yield(THREAD_YIELD_LAZY);
             break;
 
+        case MTX_TYPE_ADAPTIVE:
+            if (atomic_read(&mtx->ticket.dequeue) == ticket) {
+                atomic_set(&mtx->mtx_lock, 1);
+                mtx->ts.ts_owner = (current_thread) ? current_thread->id : 0;
+                goto out;
+            }
+
+            if (++spins < MTX_ADAPTIVE_SPINS)
+                break;
+            if (current_thread && interrupts_enabled() &&
+                !thread_flags_is_set(current_thread, SCHED_INTERNAL_FLAG)) {
+                ts_block(mtx, ticket);
+                continue;
+            }
+
+            /* We can't block in an interrupt handler or in the idle thread. */
+            thread_yield(THREAD_YIELD_LAZY);
+            break;
+
         default:
             MTX_TYPE_NOTSUP();
             if (MTX_OPT(mtx, MTX_OPT_DINT))
@@ -178,6 +362,10 @@ out:
     KASSERT(whr, "whr should be non-null");
     mtx->mtx_ldebug = whr;
 #endif
+#ifdef configLOCK_PROFILE
+    mtx->mtx_prof = lockprof_acquire("mtx", whr, start_time, tries > 1);
+    mtx->mtx_prof_time = get_utime();
+#endif
 
     return 0;
 }
@@ -188,7 +376,7 @@ static void mtx_wakeup(void * arg)
     current_thread->wait_tim = -2; /* Magic */
 }
 
-#ifndef configLOCK_DEBUG
+#ifndef KLOCKS_WHERE
 int mtx_sleep(mtx_t * mtx, long timeout)
 #else
 int _mtx_sleep(mtx_t * mtx, long timeout, char * whr)
@@ -211,11 +399,19 @@ int _mtx_sleep(mtx_t * mtx, long timeout, char * whr)
         if (current_thread->wait_tim < 0)
             return -EWOULDBLOCK;
 
+#ifndef KLOCKS_WHERE
         retval = mtx_lock(mtx);
+#else
+        retval = _mtx_lock(mtx, whr);
+#endif
         timers_release(current_thread->wait_tim);
         current_thread->wait_tim = TMNOVAL;
     } else if (mtx->mod.mtx_type == MTX_TYPE_SPIN) {
+#ifndef KLOCKS_WHERE
         retval = mtx_lock(mtx);
+#else
+        retval = _mtx_lock(mtx, whr);
+#endif
     } else {
 fail:
         MTX_TYPE_NOTSUP();
@@ -225,7 +421,7 @@ fail:
     return retval;
 }
 
-#ifndef configLOCK_DEBUG
+#ifndef KLOCKS_WHERE
 int mtx_trylock(mtx_t * mtx)
 #else
 int _mtx_trylock(mtx_t * mtx, char * whr)
@@ -253,7 +449,7 @@ int _mtx_trylock(mtx_t * mtx, char * whr)
 
         if (atomic_read(&mtx->ticket.dequeue) == ticket) {
             atomic_set(&mtx->mtx_lock, 1);
-            return 0; /* Got it */
+            retval = 0; /* Got it */
         } else {
             atomic_dec(&mtx->ticket.queue);
              if (MTX_OPT(mtx, MTX_OPT_DINT))
@@ -262,6 +458,20 @@ int _mtx_trylock(mtx_t * mtx, char * whr)
         }
         break;
 
+    case MTX_TYPE_ADAPTIVE:
+        /* Take a ticket only if it's the one being served. */
+        ticket = atomic_read(&mtx->ticket.dequeue);
+        if (atomic_cmpxchg(&mtx->ticket.queue, ticket, ticket + 1) == ticket) {
+            atomic_set(&mtx->mtx_lock, 1);
+            mtx->ts.ts_owner = (current_thread) ? current_thread->id : 0;
+            retval = 0;
+        } else {
+            if (MTX_OPT(mtx, MTX_OPT_DINT))
+                set_interrupt_state(cpu_istate);
+            return 1;
+        }
+        break;
+
     default:
         MTX_TYPE_NOTSUP();
         if (MTX_OPT(mtx, MTX_OPT_DINT))
@@ -277,6 +487,12 @@ int _mtx_trylock(mtx_t * mtx, char * whr)
     KASSERT(whr, "whr should be non-null");
     mtx->mtx_ldebug = whr;
 #endif
+#ifdef configLOCK_PROFILE
+    if (retval == 0) {
+        mtx->mtx_prof_time = get_utime();
+        mtx->mtx_prof = lockprof_acquire("mtx", whr, mtx->mtx_prof_time, 0);
+    }
+#endif
 
     return retval;
 }
@@ -295,10 +511,30 @@ void mtx_unlock(mtx_t * mtx)
 #ifdef configLOCK_DEBUG
     mtx->mtx_ldebug = NULL;
 #endif
+#ifdef configLOCK_PROFILE
+    if (mtx->mtx_prof) {
+        struct lock_prof * lp = mtx->mtx_prof;
 
-    if (mtx->mod.mtx_type == MTX_TYPE_TICKET)
-        atomic_inc(&mtx->ticket.dequeue);
-    atomic_set(&mtx->mtx_lock, 0);
+        mtx->mtx_prof = NULL;
+        lockprof_release(lp, mtx->mtx_prof_time);
+    }
+#endif
+
+    if (mtx->mod.mtx_type == MTX_TYPE_ADAPTIVE) {
+        int next;
+
+        if (mtx->ts.ts_boost)
+            ts_unboost(mtx);
+
+        atomic_set(&mtx->mtx_lock, 0);
+        next = atomic_inc(&mtx->ticket.dequeue) + 1;
+        if (atomic_read(&mtx->ticket.queue) != next)
+            ts_handoff(mtx, next); /* Someone is waiting. */
+    } else {
+        if (mtx->mod.mtx_type == MTX_TYPE_TICKET)
+            atomic_inc(&mtx->ticket.dequeue);
+        atomic_set(&mtx->mtx_lock, 0);
+    }
 
     if (MTX_OPT(mtx, MTX_OPT_DINT))
         set_interrupt_state(cpu_istate);
@@ -0,0 +1,294 @@
+/**
+ *******************************************************************************
+ * @file    klocks_prof.c
+ * @author  Olli Vanhoja
+ * @brief   Lock contention profiler.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <fs/procfs.h>
+#include <hal/hw_timers.h>
+#include <kmalloc.h>
+#include <kstring.h>
+#include <libkern.h>
+#include <sys/sysctl.h>
+#include <klocks.h>
+
+/**
+ * Max number of probes when looking up the record of a site.
+ */
+#define LOCKPROF_PROBES 16
+
+/**
+ * Per acquisition site record.
+ * The counters are updated without locking, so on MP some samples may be
+ * lost, which is fine for statistics.
+ */
+struct lock_prof {
+    const char * lp_where;      /*!< Acquisition site; NULL if free. */
+    const char * lp_type;       /*!< Lock type. */
+    atomic_t acquired;          /*!< Number of acquisitions. */
+    atomic_t contended;         /*!< Number of contended acquisitions. */
+    uint64_t wait_total;        /*!< Total wait time in usec. */
+    uint64_t wait_max;          /*!< Max wait time in usec. */
+    uint64_t hold_total;        /*!< Total hold time in usec. */
+};
+
+static struct lock_prof lockprof_sites[configLOCK_PROFILE_SITES];
+static atomic_t lockprof_dropped = ATOMIC_INIT(0);
+
+SYSCTL_DECL(_kern_lockprof);
+SYSCTL_NODE(_kern, OID_AUTO, lockprof, CTLFLAG_RW, 0,
+            "Lock contention profiler");
+
+static int lockprof_enable = 1;
+SYSCTL_INT(_kern_lockprof, OID_AUTO, enable, CTLFLAG_RW,
+           &lockprof_enable, 0, "Enable lock profiling");
+
+enum lockprof_sort {
+    LOCKPROF_SORT_WAIT_TOTAL = 0,
+    LOCKPROF_SORT_ACQUIRED,
+    LOCKPROF_SORT_CONTENDED,
+    LOCKPROF_SORT_WAIT_MAX,
+    LOCKPROF_SORT_HOLD_TOTAL,
+};
+
+static int lockprof_sort = LOCKPROF_SORT_WAIT_TOTAL;
+SYSCTL_INT(_kern_lockprof, OID_AUTO, sort, CTLFLAG_RW,
+           &lockprof_sort, 0,
+           "Sort key of /proc/lockprof: "
+           "0 = wait_total, 1 = acquired, 2 = contended, 3 = wait_max, "
+           "4 = hold_total");
+
+SYSCTL_INT(_kern_lockprof, OID_AUTO, dropped, CTLFLAG_RD,
+           &lockprof_dropped, 0,
+           "Acquisitions not recorded because the site table was full");
+
+static struct lock_prof * lockprof_get(const char * type, const char * whr)
+{
+    size_t i = ((uintptr_t)whr >> 2) * 2654435761u;
+
+    for (size_t n = 0; n < LOCKPROF_PROBES; n++, i++) {
+        struct lock_prof * lp = &lockprof_sites[i % configLOCK_PROFILE_SITES];
+        const char * where = lp->lp_where;
+
+        if (where == whr)
+            return lp;
+        if (!where) {
+            where = atomic_cmpxchg_ptr((void **)(&lp->lp_where), NULL,
+                                       (void *)whr);
+            if (!where) {
+                lp->lp_type = type;
+                return lp;
+            } else if (where == whr) {
+                return lp;
+            }
+        }
+    }
+
+    atomic_inc(&lockprof_dropped);
+    return NULL;
+}
+
+struct lock_prof * lockprof_acquire(const char * type, const char * whr,
+                                    uint64_t start, int contended)
+{
+    struct lock_prof * lp;
+    uint64_t wait;
+
+    if (!lockprof_enable || !whr)
+        return NULL;
+
+    lp = lockprof_get(type, whr);
+    if (!lp)
+        return NULL;
+
+    wait = get_utime() - start;
+    atomic_inc(&lp->acquired);
+    if (contended)
+        atomic_inc(&lp->contended);
+    lp->wait_total += wait;
+    if (wait > lp->wait_max)
+        lp->wait_max = wait;
+
+    return lp;
+}
+
+void lockprof_release(struct lock_prof * lp, uint64_t acquired)
+{
+    if (!lp)
+        return;
+
+    lp->hold_total += get_utime() - acquired;
+}
+
+static int sysctl_lockprof_reset(SYSCTL_HANDLER_ARGS)
+{
+    int reset = 0;
+    int error;
+
+    error = sysctl_handle_int(oidp, &reset, sizeof(reset), req);
+    if (error || !req->newptr || !reset)
+        return error;
+
+    /*
+     * The sites are kept so the records already handed out to the current
+     * lock owners stay valid.
+     */
+    for (size_t i = 0; i < num_elem(lockprof_sites); i++) {
+        struct lock_prof * lp = &lockprof_sites[i];
+
+        atomic_set(&lp->acquired, 0);
+        atomic_set(&lp->contended, 0);
+        lp->wait_total = 0;
+        lp->wait_max = 0;
+        lp->hold_total = 0;
+    }
+    atomic_set(&lockprof_dropped, 0);
+
+    return 0;
+}
+
+SYSCTL_PROC(_kern_lockprof, OID_AUTO, reset, CTLTYPE_INT | CTLFLAG_RW,
+            NULL, 0, sysctl_lockprof_reset, "I",
+            "Write non-zero to reset the lock profiling counters");
+
+static uint64_t lockprof_key(struct lock_prof * lp)
+{
+    switch (lockprof_sort) {
+    case LOCKPROF_SORT_ACQUIRED:
+        return (unsigned)atomic_read(&lp->acquired);
+    case LOCKPROF_SORT_CONTENDED:
+        return (unsigned)atomic_read(&lp->contended);
+    case LOCKPROF_SORT_WAIT_MAX:
+        return lp->wait_max;
+    case LOCKPROF_SORT_HOLD_TOTAL:
+        return lp->hold_total;
+    case LOCKPROF_SORT_WAIT_TOTAL:
+    default:
+        return lp->wait_total;
+    }
+}
+
+/**
+ * Take a snapshot of the used records sorted in descending order.
+ * @param[out] nr is the number of records returned.
+ */
+static struct lock_prof * lockprof_snapshot(size_t * nr)
+{
+    struct lock_prof * snap;
+    uint64_t * keys;
+    size_t n = 0;
+
+    snap = kmalloc(sizeof(lockprof_sites));
+    keys = kmalloc(num_elem(lockprof_sites) * sizeof(uint64_t));
+    if (!snap || !keys) {
+        kfree(snap);
+        kfree(keys);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < num_elem(lockprof_sites); i++) {
+        struct lock_prof * lp = &lockprof_sites[i];
+        struct lock_prof tmp;
+        uint64_t key;
+        size_t j;
+
+        if (!lp->lp_where || atomic_read(&lp->acquired) == 0)
+            continue;
+
+        tmp = *lp;
+        key = lockprof_key(&tmp);
+
+        /* Insertion sort; the table is small. */
+        for (j = n; j > 0 && keys[j - 1] < key; j--) {
+            snap[j] = snap[j - 1];
+            keys[j] = keys[j - 1];
+        }
+        snap[j] = tmp;
+        keys[j] = key;
+        n++;
+    }
+
+    kfree(keys);
+    *nr = n;
+    return snap;
+}
+
+#define LOCKPROF_HDR \
+    "type\tacquired\tcontended\twait_total\twait_max\thold_total\twhere\n"
+#define LOCKPROF_LINE_MAX 160
+
+static struct procfs_stream * procfs_read_lockprof(
+        const struct procfs_file * spec)
+{
+    struct procfs_stream * stream;
+    struct lock_prof * snap;
+    size_t nr, bufsize;
+    ssize_t bytes;
+
+    snap = lockprof_snapshot(&nr);
+    if (!snap)
+        return NULL;
+
+    bufsize = sizeof(LOCKPROF_HDR) + nr * LOCKPROF_LINE_MAX;
+    stream = kmalloc(sizeof(struct procfs_stream) + bufsize);
+    if (!stream) {
+        kfree(snap);
+        return NULL;
+    }
+
+    bytes = ksprintf(stream->buf, bufsize, "%s", LOCKPROF_HDR) - 1;
+    for (size_t i = 0; i < nr; i++) {
+        struct lock_prof * lp = &snap[i];
+
+        bytes += ksprintf(stream->buf + bytes, bufsize - bytes,
+                          "%s\t%u\t%u\t%llu\t%llu\t%llu\t%s\n",
+                          (lp->lp_type) ? lp->lp_type : "?",
+                          (unsigned)atomic_read(&lp->acquired),
+                          (unsigned)atomic_read(&lp->contended),
+                          lp->wait_total, lp->wait_max, lp->hold_total,
+                          lp->lp_where) - 1;
+    }
+    stream->bytes = bytes;
+
+    kfree(snap);
+    return stream;
+}
+
+static void procfs_rele_lockprof(struct procfs_stream * stream)
+{
+    kfree(stream);
+}
+
+static struct procfs_file procfs_file_lockprof = {
+    .filename = "lockprof",
+    .readfn = procfs_read_lockprof,
+    .relefn = procfs_rele_lockprof,
+};
+DATA_SET(procfs_files, procfs_file_lockprof);
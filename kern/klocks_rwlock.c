@@ -32,6 +32,7 @@
 
 #include <errno.h>
 #include <hal/core.h>
+#include <hal/hw_timers.h>
 #include <kerror.h>
 #include <klocks.h>
 #include <kstring.h>
@@ -42,10 +43,22 @@ void rwlock_init(rwlock_t * l)
     l->state = 0;
     l->wr_waiting = 0;
     mtx_init(&l->lock, MTX_TYPE_SPIN, 0);
+#ifdef configLOCK_PROFILE
+    l->wr_prof = NULL;
+#endif
 }
 
+#ifndef KLOCKS_WHERE
 void rwlock_wrlock(rwlock_t * l)
+#else
+void _rwlock_wrlock(rwlock_t * l, char * whr)
+#endif
 {
+#ifdef configLOCK_PROFILE
+    const uint64_t start = get_utime();
+    int contended = 0;
+#endif
+
     mtx_lock(&(l->lock));
     if (l->state == 0) {
         goto get_wrlock;
@@ -53,6 +66,9 @@ void rwlock_wrlock(rwlock_t * l)
         l->wr_waiting++;
     }
     mtx_unlock(&l->lock);
+#ifdef configLOCK_PROFILE
+    contended = 1;
+#endif
 
     /* Try to minimize locked time. */
     while (1) {
@@ -68,10 +84,18 @@ void rwlock_wrlock(rwlock_t * l)
 
 get_wrlock:
     l->state = -1;
+#ifdef configLOCK_PROFILE
+    l->wr_prof = lockprof_acquire("rw_wr", whr, start, contended);
+    l->wr_prof_time = get_utime();
+#endif
     mtx_unlock(&l->lock);
 }
 
+#ifndef KLOCKS_WHERE
 int rwlock_trywrlock(rwlock_t * l)
+#else
+int _rwlock_trywrlock(rwlock_t * l, char * whr)
+#endif
 {
     int retval = 1;
 
@@ -81,6 +105,10 @@ int rwlock_trywrlock(rwlock_t * l)
     if (l->state == 0) {
         l->state = -1;
         retval = 0;
+#ifdef configLOCK_PROFILE
+        l->wr_prof_time = get_utime();
+        l->wr_prof = lockprof_acquire("rw_wr", whr, l->wr_prof_time, 0);
+#endif
     }
     mtx_unlock(&l->lock);
 
@@ -105,19 +133,37 @@ void rwlock_wrunlock(rwlock_t * l)
 {
     mtx_lock(&(l->lock));
     if (l->state == -1) {
+#ifdef configLOCK_PROFILE
+        if (l->wr_prof) {
+            lockprof_release(l->wr_prof, l->wr_prof_time);
+            l->wr_prof = NULL;
+        }
+#endif
         l->state = 0;
     }
     mtx_unlock(&l->lock);
 }
 
+#ifndef KLOCKS_WHERE
 void rwlock_rdlock(rwlock_t * l)
+#else
+void _rwlock_rdlock(rwlock_t * l, char * whr)
+#endif
 {
+#ifdef configLOCK_PROFILE
+    const uint64_t start = get_utime();
+    int contended = 0;
+#endif
+
     mtx_lock(&(l->lock));
     /* Don't take lock if any writer is waiting. */
     if (l->wr_waiting == 0 && l->state >= 0) {
         goto get_rdlock;
     }
     mtx_unlock(&(l->lock));
+#ifdef configLOCK_PROFILE
+    contended = 1;
+#endif
 
     /* Try to minimize locked time. */
     while (1) {
@@ -133,9 +179,17 @@ void rwlock_rdlock(rwlock_t * l)
 get_rdlock:
     l->state++;
     mtx_unlock(&(l->lock));
+#ifdef configLOCK_PROFILE
+    /* The hold time of readers is not tracked. */
+    (void)lockprof_acquire("rw_rd", whr, start, contended);
+#endif
 }
 
+#ifndef KLOCKS_WHERE
 int rwlock_tryrdlock(rwlock_t * l)
+#else
+int _rwlock_tryrdlock(rwlock_t * l, char * whr)
+#endif
 {
     int retval = 1;
 
@@ -145,6 +199,9 @@ int rwlock_tryrdlock(rwlock_t * l)
     if (l->wr_waiting == 0 && l->state >= 0) {
         l->state++;
         retval = 0;
+#ifdef configLOCK_PROFILE
+        (void)lockprof_acquire("rw_rd", whr, get_utime(), 0);
+#endif
     }
     mtx_unlock(&l->lock);
 
@@ -30,15 +30,27 @@
  *******************************************************************************
  */
 
+#include <hal/hw_timers.h>
 #include <thread.h>
 #include <klocks.h>
 
+#ifndef KLOCKS_WHERE
 void sema_down(sema_t * s)
+#else
+void _sema_down(sema_t * s, char * whr)
+#endif
 {
+#ifdef configLOCK_PROFILE
+    const uint64_t start = get_utime();
+#endif
     int old = atomic_dec(s);
 
-    if (old >= 0)
+    if (old >= 0) {
+#ifdef configLOCK_PROFILE
+        (void)lockprof_acquire("sema", whr, start, 0);
+#endif
         return; /* OK */
+    }
 
     /*
      * If we end up waiting for semaphore we can proceed when the value is same
@@ -47,4 +59,7 @@ void sema_down(sema_t * s)
     while (atomic_read(s) >= old) {
         thread_yield(THREAD_YIELD_IMMEDIATE);
     }
+#ifdef configLOCK_PROFILE
+    (void)lockprof_acquire("sema", whr, start, 1);
+#endif
 }
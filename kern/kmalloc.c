@@ -33,6 +33,7 @@
 #include <machine/atomic.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/queue.h>
 #include <sys/sysctl.h>
 #include <dynmem.h>
 #include <hal/core.h>
@@ -40,6 +41,7 @@
 #include <idle.h>
 #include <kerror.h>
 #include <klocks.h>
+#include <ksched.h>
 #include <kstring.h>
 #include <libkern.h>
 #include <queue_r.h>
@@ -50,6 +52,7 @@
  */
 #define KM_SIGNATURE_VALID      0XBAADF00D /*!< a valid mblock entry. */
 #define KM_SIGNATURE_INVALID    0xDEADF00D /*!< an invalid mblock entry. */
+#define KM_SIGNATURE_SLAB       0xBAADCAFE /*!< a valid slab object. */
 
 /**
  * kmalloc statistics strcut.
@@ -75,9 +78,6 @@ SYSCTL_UINT(_vm_kmalloc, OID_AUTO, res, CTLFLAG_RD,
 SYSCTL_UINT(_vm_kmalloc, OID_AUTO, max, CTLFLAG_RD,
         ((unsigned int *)&(kmalloc_stat.kms_mem_max)), 0,
         "Maximum peak amount of memory reserved for kmalloc.");
-SYSCTL_UINT(_vm_kmalloc, OID_AUTO, alloc, CTLFLAG_RD,
-        ((unsigned int *)&(kmalloc_stat.kms_mem_alloc)), 0,
-        "Amount of memory currectly allocated with kmalloc.");
 SYSCTL_UINT(_vm_kmalloc, OID_AUTO, alloc_max, CTLFLAG_RD,
         ((unsigned int *)&(kmalloc_stat.kms_mem_alloc_max)), 0,
         "Maximum peak amount of memory allocated with kmalloc");
@@ -88,6 +88,8 @@ SYSCTL_INT(_vm_kmalloc, OID_AUTO, fragm_rat, CTLFLAG_RD,
 
 /**
  * Memory block descriptor.
+ * The same descriptor is used for slab objects, in which case next is the
+ * free list link of the object and prev points to the slab owning the object.
  */
 typedef struct mblock {
     unsigned signature;     /* Magic number for extra security. */
@@ -110,7 +112,11 @@ typedef struct mblock {
  */
 void * kmalloc_base;
 
-static mtx_t kmalloc_giant_lock = MTX_INITIALIZER(MTX_TYPE_TICKET, 0);
+/*
+ * A caller running with interrupts disabled, e.g. holding an MTX_OPT_DINT lock,
+ * yields instead of blocking on this lock.
+ */
+static mtx_t kmalloc_giant_lock = MTX_INITIALIZER(MTX_TYPE_ADAPTIVE, 0);
 
 /*
  * CB and data pointer array for lazy freeing data.
@@ -135,6 +141,95 @@ static struct queue_cb lazy_free_queue = QUEUE_INITIALIZER(lazy_free_queue_data,
  */
 #define MB_TO_BYTES(v) ((v) * 1024 * 1024)
 
+#ifdef configKMALLOC_SLAB
+/*
+ * Slab allocator for small objects.
+ * Small allocations are served from per size class slabs carved from large
+ * mblocks. Each CPU has a magazine of free objects per class so that the
+ * common case doesn't need to take any lock, the magazines are refilled from
+ * and flushed to the slabs of the class in batches.
+ */
+
+/**
+ * Number of objects in a per-CPU magazine.
+ */
+#define SLAB_MAG_SIZE   16
+
+/**
+ * Number of objects moved between a magazine and the slabs at once.
+ */
+#define SLAB_MAG_BATCH  (SLAB_MAG_SIZE / 2)
+
+/**
+ * Target size of a slab, including the slab header.
+ */
+#define SLAB_SIZE       16384
+
+/**
+ * Minimum number of objects in a slab.
+ */
+#define SLAB_MIN_OBJS   8
+
+struct kmalloc_slab_class;
+
+/**
+ * Slab descriptor.
+ * A slab is a kmalloc'd mblock containing a number of equally sized objects.
+ */
+struct kmalloc_slab {
+    struct kmalloc_slab_class * cls;
+    TAILQ_ENTRY(kmalloc_slab) link; /*!< Link in the partial list. */
+    mblock_t * free;        /*!< Free list of objects in this slab. */
+    unsigned nr_free;       /*!< Number of objects in the free list. */
+    unsigned nr_objs;       /*!< Total number of objects in this slab. */
+};
+
+/**
+ * Per-CPU cache of free objects.
+ */
+struct kmalloc_slab_mag {
+    unsigned nr;
+    unsigned hits;          /*!< Allocations served from the magazine. */
+    mblock_t * obj[SLAB_MAG_SIZE];
+};
+
+/**
+ * Slab size class.
+ */
+struct kmalloc_slab_class {
+    size_t size;            /*!< Data size of an object. */
+    mtx_t lock;             /*!< Protects the slab lists and counters. */
+    TAILQ_HEAD(slab_list, kmalloc_slab) partial; /*!< Slabs with free objs. */
+    unsigned nr_empty;      /*!< Number of completely free slabs. */
+    unsigned nr_objs;       /*!< Number of objects in all slabs. */
+    unsigned nr_free;       /*!< Number of objects free in all slabs. */
+    size_t nr_bytes;        /*!< Size of the mblocks of all slabs. */
+    unsigned misses;        /*!< Allocations that missed the magazine. */
+    struct kmalloc_slab_mag mag[KSCHED_CPU_COUNT];
+};
+
+#define SLAB_CLASS_INIT(_idx_, _size_) [_idx_] = {                 \
+    .size = (_size_),                                               \
+    .lock = MTX_INITIALIZER(MTX_TYPE_SPIN, 0),                      \
+    .partial = TAILQ_HEAD_INITIALIZER(slab_class[_idx_].partial),   \
+}
+
+static struct kmalloc_slab_class slab_class[] = {
+    SLAB_CLASS_INIT(0, 32),
+    SLAB_CLASS_INIT(1, 64),
+    SLAB_CLASS_INIT(2, 128),
+    SLAB_CLASS_INIT(3, 256),
+    SLAB_CLASS_INIT(4, 512),
+    SLAB_CLASS_INIT(5, 1024),
+    SLAB_CLASS_INIT(6, 2048),
+};
+
+static mblock_t * slab_alloc(struct kmalloc_slab_class * cls);
+static void slab_free(mblock_t * b);
+#endif /* configKMALLOC_SLAB */
+
+static mblock_t * mblock_alloc(size_t size);
+static void mblock_free(mblock_t * b);
 static mblock_t * extend(mblock_t * last, size_t size);
 static mblock_t * find_mblock(mblock_t ** last, size_t size);
 static void split_mblock(mblock_t * b, size_t s);
@@ -304,14 +399,346 @@ static int valid_addr(void * p)
 
     /* Validation */
     return (p == (get_mblock(p)->ptr) &&
-            get_mblock(p)->signature == KM_SIGNATURE_VALID);
+            (get_mblock(p)->signature == KM_SIGNATURE_VALID ||
+             get_mblock(p)->signature == KM_SIGNATURE_SLAB));
 }
 
-void * kmalloc(size_t size)
+#ifdef configKMALLOC_SLAB
+/**
+ * Get the slab class for an allocation size.
+ * @return A pointer to the slab class; NULL if size is too large for slabs.
+ */
+static struct kmalloc_slab_class * slab_class_get(size_t size)
+{
+    for (size_t i = 0; i < num_elem(slab_class); i++) {
+        if (size <= slab_class[i].size)
+            return &slab_class[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * Create a new slab for a class.
+ * The slab memory is allocated with the mblock allocator.
+ */
+static struct kmalloc_slab * slab_create(struct kmalloc_slab_class * cls)
+{
+    const size_t hdr_size = memalign(sizeof(struct kmalloc_slab));
+    const size_t stride = MBLOCK_SIZE + cls->size;
+    const unsigned nr_objs = imax((SLAB_SIZE - hdr_size) / stride,
+                                  SLAB_MIN_OBJS);
+    struct kmalloc_slab * slab;
+    mblock_t * sb;
+    uint8_t * p;
+
+    sb = mblock_alloc(hdr_size + nr_objs * stride);
+    if (!sb)
+        return NULL;
+
+    slab = (struct kmalloc_slab *)sb->data;
+    slab->cls = cls;
+    slab->free = NULL;
+    slab->nr_free = nr_objs;
+    slab->nr_objs = nr_objs;
+
+    p = (uint8_t *)slab + hdr_size;
+    for (unsigned i = 0; i < nr_objs; i++) {
+        mblock_t * b = (mblock_t *)(p + i * stride);
+
+        b->signature = KM_SIGNATURE_SLAB;
+        b->size = cls->size;
+        b->prev = (mblock_t *)slab;
+        b->refcount = ATOMIC_INIT(0);
+        b->ptr = b->data;
+        b->next = slab->free;
+        slab->free = b;
+    }
+
+    return slab;
+}
+
+/**
+ * Get a batch of free objects from the slabs of a class.
+ * @param[out] objs is an array for the objects.
+ * @param[in] n     is the maximum number of objects returned.
+ * @return The number of objects returned in objs.
+ */
+static unsigned slab_get_batch(struct kmalloc_slab_class * cls,
+                               mblock_t ** objs, unsigned n)
+{
+    unsigned count = 0;
+
+    mtx_lock(&cls->lock);
+    while (count < n) {
+        struct kmalloc_slab * slab = TAILQ_FIRST(&cls->partial);
+        mblock_t * b;
+
+        if (!slab)
+            break;
+
+        if (slab->nr_free == slab->nr_objs)
+            cls->nr_empty--;
+
+        b = slab->free;
+        slab->free = b->next;
+        b->next = NULL;
+        if (--slab->nr_free == 0)
+            TAILQ_REMOVE(&cls->partial, slab, link);
+        cls->nr_free--;
+
+        objs[count++] = b;
+    }
+    mtx_unlock(&cls->lock);
+
+    return count;
+}
+
+/**
+ * Return a batch of objects to their slabs.
+ * Completely free slabs are released if the class has another empty slab
+ * already.
+ */
+static void slab_put_batch(struct kmalloc_slab_class * cls,
+                           mblock_t ** objs, unsigned n)
+{
+    struct slab_list release = TAILQ_HEAD_INITIALIZER(release);
+    struct kmalloc_slab * slab;
+
+    mtx_lock(&cls->lock);
+    for (unsigned i = 0; i < n; i++) {
+        mblock_t * b = objs[i];
+
+        slab = (struct kmalloc_slab *)b->prev;
+        b->next = slab->free;
+        slab->free = b;
+        cls->nr_free++;
+        if (slab->nr_free++ == 0) {
+            /* Prefer partially used slabs for allocation. */
+            TAILQ_INSERT_HEAD(&cls->partial, slab, link);
+        }
+
+        if (slab->nr_free == slab->nr_objs) {
+            if (cls->nr_empty > 0) {
+                TAILQ_REMOVE(&cls->partial, slab, link);
+                cls->nr_objs -= slab->nr_objs;
+                cls->nr_free -= slab->nr_objs;
+                cls->nr_bytes -= get_mblock(slab)->size;
+                TAILQ_INSERT_TAIL(&release, slab, link);
+            } else {
+                cls->nr_empty++;
+                TAILQ_REMOVE(&cls->partial, slab, link);
+                TAILQ_INSERT_TAIL(&cls->partial, slab, link);
+            }
+        }
+    }
+    mtx_unlock(&cls->lock);
+
+    while ((slab = TAILQ_FIRST(&release))) {
+        TAILQ_REMOVE(&release, slab, link);
+        mblock_free(get_mblock(slab));
+    }
+}
+
+/**
+ * Allocate an object from a slab class.
+ */
+static mblock_t * slab_alloc(struct kmalloc_slab_class * cls)
+{
+    mblock_t * batch[SLAB_MAG_BATCH];
+    unsigned n;
+    istate_t istate;
+    struct kmalloc_slab_mag * mag;
+    mblock_t * b;
+
+    /*
+     * Interrupts are disabled only to keep the thread on the same CPU while
+     * accessing the magazine, no lock can be taken while they are disabled.
+     */
+    istate = get_interrupt_state();
+    disable_interrupt();
+    mag = &cls->mag[get_cpu_index()];
+    if (mag->nr > 0) {
+        b = mag->obj[--mag->nr];
+        mag->hits++;
+        set_interrupt_state(istate);
+        goto out;
+    }
+    set_interrupt_state(istate);
+
+    while ((n = slab_get_batch(cls, batch, num_elem(batch))) == 0) {
+        struct kmalloc_slab * slab;
+
+        slab = slab_create(cls);
+        if (!slab)
+            return NULL;
+
+        mtx_lock(&cls->lock);
+        TAILQ_INSERT_HEAD(&cls->partial, slab, link);
+        cls->nr_objs += slab->nr_objs;
+        cls->nr_free += slab->nr_objs;
+        cls->nr_bytes += get_mblock(slab)->size;
+        cls->nr_empty++;
+        mtx_unlock(&cls->lock);
+    }
+    b = batch[--n];
+
+    /* Put the rest of the batch to the magazine of the current CPU. */
+    istate = get_interrupt_state();
+    disable_interrupt();
+    mag = &cls->mag[get_cpu_index()];
+    while (n > 0 && mag->nr < SLAB_MAG_SIZE) {
+        mag->obj[mag->nr++] = batch[--n];
+    }
+    set_interrupt_state(istate);
+
+    mtx_lock(&cls->lock);
+    cls->misses++;
+    mtx_unlock(&cls->lock);
+
+    /* The magazine was refilled by someone else meanwhile. */
+    if (n > 0)
+        slab_put_batch(cls, batch, n);
+
+out:
+    atomic_set(&b->refcount, 1);
+    return b;
+}
+
+/**
+ * Free a slab object.
+ */
+static void slab_free(mblock_t * b)
+{
+    struct kmalloc_slab_class * cls = ((struct kmalloc_slab *)b->prev)->cls;
+    mblock_t * batch[SLAB_MAG_BATCH + 1];
+    unsigned n = 0;
+    istate_t istate;
+    struct kmalloc_slab_mag * mag;
+
+    istate = get_interrupt_state();
+    disable_interrupt();
+    mag = &cls->mag[get_cpu_index()];
+    if (mag->nr < SLAB_MAG_SIZE) {
+        mag->obj[mag->nr++] = b;
+        set_interrupt_state(istate);
+        return;
+    }
+
+    /* The magazine is full, flush a batch back to the slabs. */
+    while (n < SLAB_MAG_BATCH) {
+        batch[n++] = mag->obj[--mag->nr];
+    }
+    set_interrupt_state(istate);
+    batch[n++] = b;
+
+    slab_put_batch(cls, batch, n);
+}
+
+static int sysctl_slab_hits(SYSCTL_HANDLER_ARGS)
+{
+    struct kmalloc_slab_class * cls = (struct kmalloc_slab_class *)arg1;
+    unsigned hits = 0;
+
+    for (size_t i = 0; i < num_elem(cls->mag); i++) {
+        hits += cls->mag[i].hits;
+    }
+
+    return sysctl_handle_int(oidp, &hits, sizeof(hits), req);
+}
+
+/**
+ * Get the number of objects in the slabs of a class that are not currently
+ * allocated, including the objects cached in magazines.
+ */
+static unsigned slab_nr_unused(struct kmalloc_slab_class * cls)
+{
+    unsigned nr_unused = cls->nr_free;
+
+    for (size_t i = 0; i < num_elem(cls->mag); i++) {
+        nr_unused += cls->mag[i].nr;
+    }
+
+    return imin(nr_unused, cls->nr_objs);
+}
+
+/*
+ * Fragmentation is the percentage of object slots in the slabs of a class that
+ * are not currently allocated.
+ */
+static int sysctl_slab_fragm(SYSCTL_HANDLER_ARGS)
+{
+    struct kmalloc_slab_class * cls = (struct kmalloc_slab_class *)arg1;
+    unsigned nr_objs = cls->nr_objs;
+    int fragm = 0;
+
+    if (nr_objs > 0)
+        fragm = (slab_nr_unused(cls) * 100) / nr_objs;
+
+    return sysctl_handle_int(oidp, &fragm, sizeof(fragm), req);
+}
+
+#define SLAB_CLASS_SYSCTL(_idx_, _size_)                                    \
+    SYSCTL_NODE(_vm_kmalloc, OID_AUTO, slab##_size_, CTLFLAG_RW, 0,        \
+                "kmalloc slab class stats");                                \
+    SYSCTL_PROC(_vm_kmalloc_slab##_size_, OID_AUTO, hits,                   \
+                CTLTYPE_UINT | CTLFLAG_RD, &slab_class[_idx_], 0,           \
+                sysctl_slab_hits, "IU",                                     \
+                "Allocations served from per-CPU magazines.");              \
+    SYSCTL_UINT(_vm_kmalloc_slab##_size_, OID_AUTO, misses, CTLFLAG_RD,     \
+                &slab_class[_idx_].misses, 0,                               \
+                "Allocations that had to refill a magazine.");              \
+    SYSCTL_UINT(_vm_kmalloc_slab##_size_, OID_AUTO, objs, CTLFLAG_RD,       \
+                &slab_class[_idx_].nr_objs, 0,                              \
+                "Number of objects in the slabs of the class.");            \
+    SYSCTL_PROC(_vm_kmalloc_slab##_size_, OID_AUTO, fragm,                  \
+                CTLTYPE_INT | CTLFLAG_RD, &slab_class[_idx_], 0,            \
+                sysctl_slab_fragm, "I",                                     \
+                "Percentage of unallocated objects in the slabs.")
+
+SLAB_CLASS_SYSCTL(0, 32);
+SLAB_CLASS_SYSCTL(1, 64);
+SLAB_CLASS_SYSCTL(2, 128);
+SLAB_CLASS_SYSCTL(3, 256);
+SLAB_CLASS_SYSCTL(4, 512);
+SLAB_CLASS_SYSCTL(5, 1024);
+SLAB_CLASS_SYSCTL(6, 2048);
+#endif /* configKMALLOC_SLAB */
+
+/*
+ * The mblocks of the slabs are counted in kms_mem_alloc as a whole, so replace
+ * them with the objects currently allocated from the slabs.
+ */
+static int sysctl_kmalloc_alloc(SYSCTL_HANDLER_ARGS)
+{
+    size_t alloc = kmalloc_stat.kms_mem_alloc;
+    unsigned retval;
+
+#ifdef configKMALLOC_SLAB
+    for (size_t i = 0; i < num_elem(slab_class); i++) {
+        struct kmalloc_slab_class * cls = &slab_class[i];
+        const size_t nr_used = cls->nr_objs - slab_nr_unused(cls);
+
+        alloc -= cls->nr_bytes;
+        alloc += nr_used * cls->size;
+    }
+#endif
+    retval = alloc;
+
+    return sysctl_handle_int(oidp, &retval, sizeof(retval), req);
+}
+
+SYSCTL_PROC(_vm_kmalloc, OID_AUTO, alloc, CTLTYPE_UINT | CTLFLAG_RD,
+        NULL, 0, sysctl_kmalloc_alloc, "IU",
+        "Amount of memory currectly allocated with kmalloc.");
+
+/**
+ * Allocate a memory block with the mblock allocator.
+ */
+static mblock_t * mblock_alloc(size_t s)
 {
     mblock_t * b;
     mblock_t * last;
-    size_t s = memalign(size);
 
     mtx_lock(&kmalloc_giant_lock);
     if (kmalloc_base) {
@@ -347,7 +774,22 @@ void * kmalloc(size_t size)
     atomic_set(&b->refcount, 1);
     mtx_unlock(&kmalloc_giant_lock);
 
-    return b->data;
+    return b;
+}
+
+void * kmalloc(size_t size)
+{
+    mblock_t * b;
+    size_t s = memalign(size);
+#ifdef configKMALLOC_SLAB
+    struct kmalloc_slab_class * cls = slab_class_get(s);
+
+    b = (cls) ? slab_alloc(cls) : mblock_alloc(s);
+#else
+    b = mblock_alloc(s);
+#endif
+
+    return (b) ? b->data : NULL;
 }
 
 void * kcalloc(size_t nelem, size_t elsize)
@@ -402,6 +844,21 @@ void kfree(void * p)
     if (atomic_read(&b->refcount) > 0)
         return;
 
+#ifdef configKMALLOC_SLAB
+    if (b->signature == KM_SIGNATURE_SLAB) {
+        slab_free(b);
+        return;
+    }
+#endif
+
+    mblock_free(b);
+}
+
+/**
+ * Free a memory block allocated with the mblock allocator.
+ */
+static void mblock_free(mblock_t * b)
+{
     mtx_lock(&kmalloc_giant_lock);
 
     update_stat_down(&(kmalloc_stat.kms_mem_alloc), b->size);
@@ -499,6 +956,15 @@ void * krealloc(void * p, size_t size)
     s = memalign(size);
     b = get_mblock(p);
 
+    if (b->signature == KM_SIGNATURE_SLAB) {
+        /* Slab objects can't be resized in place. */
+        if (b->size >= s) {
+            retval = p;
+            goto out;
+        }
+        goto alloc_new_block;
+    }
+
     if (b->size >= s) { /* Requested to shrink. */
         if (b->size - s >= (MBLOCK_SIZE + sizeof(void *))) {
             mtx_lock(&kmalloc_giant_lock);
@@ -1,5 +1,6 @@
 # Base system
-base-SRC-y += $(wildcard ./*.c)
+base-SRC-y += $(filter-out ./klocks_prof.c,$(wildcard ./*.c))
+base-SRC-$(configLOCK_PROFILE) += klocks_prof.c
 base-SRC-y += $(wildcard sched/*.c)
 
 # Kernel logging
@@ -33,11 +33,97 @@
 
 #include <errno.h>
 #include <bitmap.h>
+#include <libkern.h>
 
 #define SIZEOF_BITMAP_T (8 * sizeof(bitmap_t))
 
-#define BIT2WORDI(i)    ((i - (i & (SIZEOF_BITMAP_T - 1))) / SIZEOF_BITMAP_T)
-#define BIT2WBITOFF(i)  (i & (SIZEOF_BITMAP_T - 1))
+#define BIT2WORDI(i)    ((i) / SIZEOF_BITMAP_T)
+#define BIT2WBITOFF(i)  ((i) & (SIZEOF_BITMAP_T - 1))
+
+#define BITMAP_ONES     ((bitmap_t)~(bitmap_t)0)
+
+/**
+ * Search for block_len zero bits in bitmap[start_bit..end_bit).
+ * The bitmap is scanned a word at a time; full words are skipped, CTZ is
+ * used to extend a run from the previous word and CLZ to find a run
+ * continuing to the next word.
+ */
+static int block_search(size_t start_bit, size_t end_bit, size_t * retval,
+                        size_t block_len, const bitmap_t * bitmap)
+{
+    size_t i = BIT2WORDI(start_bit);
+    const size_t last = BIT2WORDI(end_bit - 1);
+    size_t run = 0;
+    size_t run_start = 0;
+
+    if (block_len == 0)
+        block_len = 1;
+    if (start_bit >= end_bit || end_bit - start_bit < block_len)
+        return 1;
+
+    for (; i <= last; i++) {
+        const size_t base = i * SIZEOF_BITMAP_T;
+        bitmap_t w = bitmap[i];
+        size_t pos;
+
+        if (i == BIT2WORDI(start_bit) && BIT2WBITOFF(start_bit))
+            w |= BITMAP_ONES >> (SIZEOF_BITMAP_T - BIT2WBITOFF(start_bit));
+        if (i == last && BIT2WBITOFF(end_bit))
+            w |= BITMAP_ONES << BIT2WBITOFF(end_bit);
+
+        if (w == 0) {
+            if (run == 0)
+                run_start = base;
+            run += SIZEOF_BITMAP_T;
+            if (run >= block_len)
+                goto found;
+            continue;
+        }
+        if (w == BITMAP_ONES) {
+            run = 0;
+            continue;
+        }
+
+        /* Zeros in the bottom of the word extend the run. */
+        pos = __builtin_ctz(w);
+        if (run == 0)
+            run_start = base;
+        run += pos;
+        if (run >= block_len)
+            goto found;
+
+        /* Runs inside the word. */
+        if (block_len < SIZEOF_BITMAP_T - 1) {
+            while (pos < SIZEOF_BITMAP_T) {
+                bitmap_t v = w >> pos;
+                size_t z;
+
+                /* Skip ones; v has bit 0 set. */
+                pos += __builtin_ctz(~v);
+                if (pos >= SIZEOF_BITMAP_T)
+                    break;
+                v = w >> pos;
+                z = (v == 0) ? SIZEOF_BITMAP_T - pos : __builtin_ctz(v);
+                if (z >= block_len) {
+                    *retval = base + pos;
+                    return 0;
+                }
+                pos += z;
+            }
+        }
+
+        /* Zeros in the top of the word may continue to the next word. */
+        run = __builtin_clz(w);
+        run_start = base + SIZEOF_BITMAP_T - run;
+        if (run > 0 && run >= block_len)
+            goto found;
+    }
+
+    return 1;
+found:
+    *retval = run_start;
+    return 0;
+}
 
 int bitmap_block_search(size_t * retval, size_t block_len,
                         const bitmap_t * bitmap, size_t size)
@@ -48,32 +134,29 @@ int bitmap_block_search(size_t * retval, size_t block_len,
 int bitmap_block_search_s(size_t start, size_t * retval, size_t block_len,
                           const bitmap_t * bitmap, size_t size)
 {
-    size_t i, j;
-    bitmap_t * cur;
-    size_t end = 0;
-
-    j = BIT2WBITOFF(start);
-    cur = &start;
-    for (i = BIT2WORDI(start); i < (size / sizeof(bitmap_t)); i++) {
-        for (; j <= SIZEOF_BITMAP_T; j++) {
-            if ((bitmap[i] & (1 << j)) == 0) {
-                *cur = i * SIZEOF_BITMAP_T + j;
-                cur = &end;
-
-                if ((end - start >= block_len) && (end >= start)) {
-                    *retval = start;
-                    return 0;
-                }
-            } else {
-                start = 0;
-                end = 0;
-                cur = &start;
-            }
-        }
-        j = 0;
+    const size_t nbits = (size / sizeof(bitmap_t)) * SIZEOF_BITMAP_T;
+
+    return block_search(start, nbits, retval, block_len, bitmap);
+}
+
+int bitmap_block_search_nf(size_t * hint, size_t * retval, size_t block_len,
+                           const bitmap_t * bitmap, size_t size)
+{
+    const size_t nbits = (size / sizeof(bitmap_t)) * SIZEOF_BITMAP_T;
+    size_t start = *hint;
+
+    if (start >= nbits)
+        start = 0;
+
+    if (block_search(start, nbits, retval, block_len, bitmap) &&
+        (start == 0 ||
+         block_search(0, min(start + block_len - 1, nbits), retval, block_len,
+                      bitmap))) {
+        return 1;
     }
 
-    return 1;
+    *hint = *retval + ((block_len) ? block_len : 1);
+    return 0;
 }
 
 int bitmap_status(const bitmap_t * bitmap, size_t pos, size_t size)
@@ -116,32 +199,25 @@ int bitmap_clear(bitmap_t * bitmap, size_t pos, size_t size)
 int bitmap_block_update(bitmap_t * bitmap, unsigned int mark, size_t start,
                         size_t len, size_t size)
 {
-    size_t i;
-    size_t j;
-    size_t k;
-    size_t n;
-    bitmap_t  tmp;
+    size_t i = BIT2WORDI(start);
+    size_t n = BIT2WBITOFF(start); /* start mod size of bitmap_t in bits */
 
     if (start + len > size * SIZEOF_BITMAP_T)
         return -EINVAL;
 
-    mark &= 1;
-    k = BIT2WORDI(start);
-    n = BIT2WBITOFF(start); /* start mod size of bitmap_t in bits */
+    while (len > 0) {
+        const size_t nbits = min(len, SIZEOF_BITMAP_T - n);
+        const bitmap_t mask = (BITMAP_ONES >> (SIZEOF_BITMAP_T - nbits)) << n;
 
-    j = 0;
-    i = k;
-    do {
-        while (n < SIZEOF_BITMAP_T) {
-            tmp = mark << n;
-            bitmap[i] &= ~(1 << n);
-            bitmap[i] |= tmp;
-            n++;
-            if (++j >= len)
-                return 0;
-        }
+        if (mark & 1)
+            bitmap[i] |= mask;
+        else
+            bitmap[i] &= ~mask;
+
+        len -= nbits;
         n = 0;
-    } while (i++);
+        i++;
+    }
 
     return 0;
 }
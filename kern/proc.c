@@ -567,6 +567,7 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
     mtx_lock(&mm->regions_lock);
     for (int i = 0; i < mm->nr_regions; i++) {
         struct buf * region = (*mm->regions)[i];
+        struct buf * clone;
         uintptr_t reg_start, reg_end;
         char uap[5];
 
@@ -588,6 +589,19 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
          * This is the correct region.
          */
 
+        if (MMU_ABORT_IS_TRANSLATION_FAULT(abo->fsr) &&
+            region->b_fill_map && region->vm_ops->rfill) {
+            /*
+             * First access to a page of a demand paged region.
+             * A page that can't be read is a bus error for the process.
+             */
+            mtx_unlock(&mm->regions_lock);
+            err = vm_fill_page(abo->proc, region, vaddr);
+
+            KERROR_DBG("Page fill done (%d)\n", err);
+            return (err) ? -EFAULT : 0;
+        }
+
         if (MMU_ABORT_IS_TRANSLATION_FAULT(abo->fsr)) { /* Translation fault */
             /*
              * Sometimes we see translation faults due to ordering of region
@@ -609,6 +623,20 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
             return 0;
         }
 
+        /*
+         * Copy only the written page of a COW region if the region supports
+         * page granular COW.
+         */
+        if (!(region->b_uflags & VM_PROT_COR) &&
+            ((region->b_uflags & VM_PROT_COW) || region->b_cow_src) &&
+            region->vm_ops->rcow) {
+            mtx_unlock(&mm->regions_lock);
+            err = vm_resolve_cow(abo->proc, i, region, vaddr);
+
+            KERROR_DBG("COW page done (%d)\n", err);
+            return err;
+        }
+
         /* Test for COW and COR flags. */
         if ((region->b_uflags & (VM_PROT_COW | VM_PROT_COR)) == 0) {
             KERROR_DBG("Memory protection error\n");
@@ -626,19 +654,28 @@ int proc_abo_handler(const struct mmu_abo_param * restrict abo)
             goto fail;
         }
 
-        region = region->vm_ops->rclone(region);
-        if (!region) {
+        /*
+         * Cloning may read the unread pages of a demand paged region from
+         * the file, which can sleep, so the region is cloned without holding
+         * the spin lock.
+         */
+        if (region->vm_ops->rref)
+            region->vm_ops->rref(region);
+        mtx_unlock(&mm->regions_lock);
+
+        clone = region->vm_ops->rclone(region);
+        if (region->vm_ops->rfree)
+            region->vm_ops->rfree(region);
+        if (!clone) {
             KERROR_DBG("Can't clone region; COW failed\n");
-            err = -ENOMEM; /* Can't clone region; COW failed. */
-            goto fail;
+            return -ENOMEM; /* Can't clone region; COW failed. */
         }
         /*
          * The old region remains marked as COW|COR as it would be racy to
          * change its state at this point.
          */
 
-        mtx_unlock(&mm->regions_lock);
-        err = vm_replace_region(abo->proc, region, i, VM_INSOP_MAP_REG);
+        err = vm_replace_region(abo->proc, clone, i, VM_INSOP_MAP_REG);
 
         KERROR_DBG("COW done (%d)\n", err);
         return err; /* COW done. */
@@ -135,6 +135,16 @@ static int clone_regions_from(struct proc_info * new_proc,
          */
         if (vm_reg_tmp->b_uflags & VM_PROT_WRITE) {
             if (cow_enabled) { /* Set COW bit if the feature is enabled. */
+                /*
+                 * A region still sharing pages with a region it was copied
+                 * from must be completed before it can be shared again.
+                 */
+                err = vr_cow_flush(old_proc, vm_reg_tmp);
+                if (err) {
+                    KERROR(KERROR_ERR,
+                           "Failed to complete a COW copy (%d)\n", err);
+                }
+
                 vm_reg_tmp->b_uflags |= VM_PROT_COW;
 
                 /*
@@ -34,6 +34,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <sys/dev_major.h>
 #include <sys/ioctl.h>
 #include <sys/tree.h>
@@ -53,10 +54,13 @@ static ssize_t ptymaster_read(struct file * file, struct uio * uio,
                               size_t count);
 static ssize_t ptymaster_write(struct file * file, struct uio * uio,
                                size_t count);
+static int ptymaster_poll(struct file * file, int events,
+                          struct poll_table * pt);
 
 static vnode_ops_t ptmx_vnode_ops = {
     .read = ptymaster_read,
     .write = ptymaster_write,
+    .poll = ptymaster_poll,
 };
 
 /**
@@ -166,6 +170,32 @@ static ssize_t ptymaster_write(struct file * file, struct uio * uio,
     return fs_queue_write(ptydev->fsq_ms, buf, count, flags);
 }
 
+/**
+ * Poll a pty end.
+ * @param rdq is the queue read by this end.
+ * @param wrq is the queue written by this end.
+ */
+static int pty_poll(struct fs_queue * rdq, struct fs_queue * wrq, int events,
+                    struct poll_table * pt)
+{
+    const int rdev = POLLIN | POLLRDNORM;
+    const int wrev = POLLOUT | POLLWRNORM;
+
+    return fs_queue_poll(rdq, events & rdev, pt) |
+           fs_queue_poll(wrq, events & wrev, pt);
+}
+
+static int ptymaster_poll(struct file * file, int events,
+                          struct poll_table * pt)
+{
+    struct pty_device * ptydev = (struct pty_device *)file->stream;
+
+    if (!ptydev)
+        return POLLNVAL;
+
+    return pty_poll(ptydev->fsq_sm, ptydev->fsq_ms, events, pt);
+}
+
 static int ptyslave_read(struct tty * tty, off_t blkno,
                          uint8_t * buf, size_t bcount, int oflags)
 {
@@ -184,6 +214,14 @@ static int ptyslave_write(struct tty * tty, off_t blkno,
     return fs_queue_write(ptydev->fsq_sm, buf, bcount, flags);
 }
 
+static int ptyslave_poll(struct file * file, struct tty * tty, int events,
+                         struct poll_table * pt)
+{
+    struct pty_device * ptydev = SLAVE_TTY2PTY(tty);
+
+    return pty_poll(ptydev->fsq_ms, ptydev->fsq_sm, events, pt);
+}
+
 /*
  * TODO if user unlinks the pty slave we will leak some memory.
  * As a solution, we should have a delete event handler here
@@ -233,6 +271,7 @@ static void creat_pty(file_t * file, struct tty * tty)
      */
     slave_tty->read = ptyslave_read;
     slave_tty->write = ptyslave_write;
+    slave_tty->poll = ptyslave_poll;
 
     /*
      * Create queues.
@@ -32,18 +32,27 @@
  *******************************************************************************
  */
 
-/* TODO Idle thread/sched is not MP safe. */
+/*
+ * There is an idle thread and an idle scheduler for each CPU but the idle tasks
+ * are not necessarily MP safe.
+ */
 
 #include <errno.h>
 #include <buf.h>
 #include <hal/core.h>
 #include <kerror.h>
+#include <kmalloc.h>
 #include <ksched.h>
 #include <idle.h>
+#include <kstring.h>
+#include <libkern.h>
 
 SET_DECLARE(_idle_tasks, struct _idle_task_desc);
 
-struct thread_info * idle_info;
+struct sched_idle {
+    struct scheduler sched;
+    struct thread_info * idle_info; /*!< The idle thread of this CPU. */
+};
 
 void * idle_thread(void * arg)
 {
@@ -63,18 +72,27 @@ void * idle_thread(void * arg)
 
 static int idle_insert(struct scheduler * sobj, struct thread_info * thread)
 {
-    if (idle_info)
+    struct sched_idle * idle = containerof(sobj, struct sched_idle, sched);
+
+    if (idle->idle_info)
         return -ENOTSUP;
 
     thread_flags_set(thread, SCHED_INTERNAL_FLAG);
-    idle_info = thread;
+    idle->idle_info = thread;
 
     return 0;
 }
 
+static void idle_remove(struct scheduler * sobj, struct thread_info * thread)
+{
+    /* The idle thread is never removed. */
+}
+
 static struct thread_info * idle_schedule(struct scheduler * sobj)
 {
-    return idle_info;
+    struct sched_idle * idle = containerof(sobj, struct sched_idle, sched);
+
+    return idle->idle_info;
 }
 
 static unsigned get_nr_active(struct scheduler * sobj)
@@ -82,19 +100,30 @@ static unsigned get_nr_active(struct scheduler * sobj)
     return 0;
 }
 
-static struct scheduler sched_idle = {
-    .name = "sched_idle",
-    .insert = idle_insert,
-    .run = idle_schedule,
-    .get_nr_active_threads = get_nr_active,
+static const struct sched_idle sched_idle_init = {
+    .sched.name = "sched_idle",
+    .sched.insert = idle_insert,
+    .sched.remove = idle_remove,
+    .sched.run = idle_schedule,
+    .sched.get_nr_active_threads = get_nr_active,
 };
 
-struct scheduler * sched_create_idle(void)
+struct scheduler * sched_create_idle(int cpu_index)
 {
+    struct sched_idle * sched;
     struct _sched_pthread_create_args tdef_idle;
     struct buf * bp;
 
+    sched = kmalloc(sizeof(struct sched_idle));
+    if (!sched)
+        return NULL;
+    *sched = sched_idle_init;
+
     bp = geteblk(MMU_PGSIZE_COARSE);
+    if (!bp) {
+        kfree(sched);
+        return NULL;
+    }
 
     tdef_idle = (struct _sched_pthread_create_args){
         .param.sched_policy   = SCHED_OTHER + 1,
@@ -102,12 +131,14 @@ struct scheduler * sched_create_idle(void)
         .stack_addr = (void *)bp->b_data,
         .stack_size = bp->b_bufsize,
         .flags      = 0,
+        .cpu_affinity = 1u << cpu_index, /* The idle thread never migrates. */
         .start      = idle_thread,
         .arg1       = 0,
         .del_thread = NULL,
     };
+    ksprintf(tdef_idle.name, sizeof(tdef_idle.name), "idle%d", cpu_index);
 
     thread_create(&tdef_idle, THREAD_MODE_PRIV);
 
-    return &sched_idle;
+    return &sched->sched;
 }
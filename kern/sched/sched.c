@@ -59,9 +59,9 @@ SYSCTL_NODE(_kern, OID_AUTO, sched, CTLFLAG_RW, 0, "Scheduler");
 /*
  * Scheduler constructors.
  */
-extern struct scheduler * sched_create_fifo(void);
-extern struct scheduler * sched_create_rr(void);
-extern struct scheduler * sched_create_idle(void);
+extern struct scheduler * sched_create_fifo(int cpu_index);
+extern struct scheduler * sched_create_rr(int cpu_index);
+extern struct scheduler * sched_create_idle(int cpu_index);
 
 /**
  * An array of scheduler constructors in order of desired execution order.
@@ -93,14 +93,21 @@ static sched_constructor * const sched_ctor_arr[] = {
  * for execution, namely the idle thread.
  */
 struct cpu_sched {
+    int index; /*!< Index of this CPU. */
+    int online; /*!< Set when this CPU has entered the scheduler. */
+
     /**
-     * A map of threads scheduled in the context of this processor.
+     * A map of threads.
+     * Threads are distributed over the per CPU maps by thread id, so that a
+     * lookup only needs to take a single lock and migrating a thread to
+     * another CPU doesn't need to touch the maps.
      */
     RB_HEAD(threadmap, thread_info) threadmap_head;
     /**
      * A queue of threads ready for execution, and waiting for timer interrupt.
      */
     STAILQ_HEAD(readyq_head, thread_info) readyq;
+    unsigned nr_ready; /*!< Number of threads in readyq. */
 
     /**
      * An array of schedulers in order of execution.
@@ -126,17 +133,69 @@ struct cpu_sched {
      */
     unsigned sched_time_avg;
 
+    /**
+     * Per policy scheduling time averages.
+     * Average time spent in run() of each scheduler in sched_arr.
+     */
+    unsigned policy_time_avg[NR_SCHEDULERS];
+
+    uint32_t loadavg[3]; /*!< Load averages of this CPU. */
+
+    /*
+     * Idle statistics.
+     * Collected over a window of about one second by the CPU itself.
+     */
+    uint64_t idle_enter; /*!< Time when the idle thread was selected. */
+    uint64_t idle_time; /*!< Idle time in the current window. */
+    uint64_t stat_window_start; /*!< Start time of the current window. */
+    unsigned nr_idle_wakeups; /*!< Idle wakeups in the current window. */
+    unsigned idle_residency; /*!< Idle residency of the last window, %. */
+    unsigned idle_wakeups; /*!< Idle wakeups per second in the last window. */
+
+#ifdef configSCHED_TICKLESS
+    int tick_stretched; /*!< The next tick is beyond the periodic tick. */
+    int tick_modified; /*!< The next tick is not the periodic tick. */
+    uint64_t next_event; /*!< Time of the next tick if stretched. */
+#endif
+
     mtx_t lock;
 };
 
 static struct cpu_sched cpu[KSCHED_CPU_COUNT];
 #define CURRENT_CPU (&cpu[get_cpu_index()])
 
+/**
+ * Get the CPU holding a thread in its threadmap.
+ */
+#define THREADMAP_CPU(thread_id) (&cpu[(unsigned)(thread_id) % KSCHED_CPU_COUNT])
+
 /*
- * TODO Support MP.
+ * Apply a macro for each CPU at compile time.
  */
-#define FOREACH_CPU(apply) \
-    apply((&cpu[0]), cpu0)
+#define FOREACH_CPU_N(apply, n, name) apply((&cpu[n]), name)
+#if KSCHED_CPU_COUNT > 1
+#define FOREACH_CPU_1(apply) FOREACH_CPU_N(apply, 1, cpu1)
+#else
+#define FOREACH_CPU_1(apply)
+#endif
+#if KSCHED_CPU_COUNT > 2
+#define FOREACH_CPU_2(apply) FOREACH_CPU_N(apply, 2, cpu2)
+#else
+#define FOREACH_CPU_2(apply)
+#endif
+#if KSCHED_CPU_COUNT > 3
+#define FOREACH_CPU_3(apply) FOREACH_CPU_N(apply, 3, cpu3)
+#else
+#define FOREACH_CPU_3(apply)
+#endif
+#if KSCHED_CPU_COUNT > 4
+#error FOREACH_CPU supports max 4 CPUs
+#endif
+#define FOREACH_CPU(apply)                  \
+    FOREACH_CPU_N(apply, 0, cpu0)           \
+    FOREACH_CPU_1(apply)                    \
+    FOREACH_CPU_2(apply)                    \
+    FOREACH_CPU_3(apply)
 
 #define TKSTACK_SIZE ((configTKSTACK_END - configTKSTACK_START) + 1)
 
@@ -166,18 +225,25 @@ static unsigned nr_threads;
 SYSCTL_UINT(_kern_sched, OID_AUTO, nr_threads, CTLFLAG_RD,
             &nr_threads, 0, "Number of threads.");
 
+/*
+ * Idle CPUs can steal threads concurrently.
+ */
+static atomic_t nr_steals = ATOMIC_INIT(0);
+SYSCTL_INT(_kern_sched, OID_AUTO, nr_steals, CTLFLAG_RD,
+            &nr_steals, 0, "Number of threads stolen by idle CPUs.");
+
 /*
  * Load average calculation.
  * FEXP_N = 2^11/(2^(interval * log_2(e/N)))
  */
 #if defined(configSCHED_LAVGPERIOD_5SEC)
-#define LOAD_FREQ (5 * (int)configSCHED_HZ)
+#define LOAD_FREQ   5       /*!< Calculation period in seconds. */
 #define FSHIFT      11      /*!< nr of bits of precision */
 #define FEXP_1      1884    /*!< 1/exp(5sec/1min) */
 #define FEXP_5      2014    /*!< 1/exp(5sec/5min) */
 #define FEXP_15     2037    /*!< 1/exp(5sec/15min) */
 #elif defined(configSCHED_LAVGPERIOD_11SEC)
-#define LOAD_FREQ (11 * (int)configSCHED_HZ)
+#define LOAD_FREQ   11
 #define FSHIFT      11
 #define FEXP_1      1704
 #define FEXP_5      1974
@@ -197,10 +263,13 @@ SYSCTL_UINT(_kern_sched, OID_AUTO, nr_threads, CTLFLAG_RD,
 /**
  * Pointer to the currently active thread.
  */
+#if KSCHED_CPU_COUNT > 1
+struct thread_info * current_thread_arr[KSCHED_CPU_COUNT];
+#else
 struct thread_info * current_thread;
+#endif
 
 static rwlock_t loadavg_lock;
-static uint32_t loadavg[3] = { 0, 0, 0 }; /*!< CPU load averages. */
 
 RB_PROTOTYPE_STATIC(threadmap, thread_info, sched.ttentry_, thread_id_compare);
 RB_GENERATE_STATIC(threadmap, thread_info, sched.ttentry_, thread_id_compare);
@@ -214,8 +283,11 @@ int __kinit__ sched_init(void)
 
     /*
      * Init cpu schedulers.
+     * All CPU structs must be initialized before any of the schedulers is
+     * created because the scheduler constructors may create threads.
      */
     for (size_t i = 0; i < num_elem(cpu); i++) {
+        cpu[i].index = i;
         mtx_init(&cpu[i].lock, MTX_TYPE_SPIN, MTX_OPT_DINT);
         RB_INIT(&cpu[i].threadmap_head);
         STAILQ_INIT(&cpu[i].readyq);
@@ -224,11 +296,15 @@ int __kinit__ sched_init(void)
             queue_create(cpu[i].thread_free_queue_data,
                          sizeof(struct thread_info *),
                          configSCHED_FREEQ_SIZE * sizeof(struct thread_info *));
+    }
+    /* The boot CPU is obviously online. */
+    CURRENT_CPU->online = 1;
 
+    for (size_t i = 0; i < num_elem(cpu); i++) {
         for (size_t j = 0; j < NR_SCHEDULERS; j++) {
             struct scheduler * sched;
 
-            sched = sched_ctor_arr[j]();
+            sched = sched_ctor_arr[j](i);
             if (!sched)
                 return -ENOMEM;
 
@@ -246,7 +322,72 @@ int thread_id_compare(struct thread_info * a, struct thread_info * b)
 
 int get_cpu_index(void)
 {
-    return 0; /* TODO Return CPU index. */
+#if KSCHED_CPU_COUNT > 1
+    return cpu_get_index();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Get the number of threads currently active on a CPU.
+ * This is only a heuristic value if called for another CPU.
+ */
+static unsigned cpu_nr_active(struct cpu_sched * cpu_sched)
+{
+    unsigned nr = READ_ONCE(cpu_sched->nr_ready);
+
+    for (size_t i = 0; i < NR_SCHEDULERS; i++) {
+        struct scheduler * sched = cpu_sched->sched_arr[i];
+
+        if (sched)
+            nr += sched->get_nr_active_threads(sched);
+    }
+
+    return nr;
+}
+
+/**
+ * Select a CPU for a thread.
+ * Select the least loaded online CPU allowed by the affinity mask of the
+ * thread, preferring the CPU that was previously scheduling the thread.
+ */
+static struct cpu_sched * sched_select_cpu(struct thread_info * thread)
+{
+    const uint32_t mask = thread->cpu_affinity & KSCHED_CPU_MASK_ALL;
+    struct cpu_sched * best = NULL;
+    unsigned best_nr = 0;
+
+    if (KSCHED_CPU_COUNT == 1)
+        return &cpu[0];
+
+    if (mask & (1u << thread->sched.cpu) && cpu[thread->sched.cpu].online) {
+        best = &cpu[thread->sched.cpu];
+        best_nr = cpu_nr_active(best);
+    }
+
+    for (size_t i = 0; i < num_elem(cpu); i++) {
+        unsigned nr;
+
+        if (!(mask & (1u << i)) || !cpu[i].online)
+            continue;
+
+        nr = cpu_nr_active(&cpu[i]);
+        if (!best || nr < best_nr) {
+            best = &cpu[i];
+            best_nr = nr;
+        }
+    }
+
+    if (!best) {
+        /*
+         * None of the allowed CPUs is online yet, so the thread will wait
+         * in the readyq of the first allowed CPU.
+         */
+        best = (mask) ? &cpu[ffs(mask) - 1] : CURRENT_CPU;
+    }
+
+    return best;
 }
 
 static void update_nr_threads(uintptr_t arg)
@@ -263,28 +404,30 @@ IDLE_TASK(update_nr_threads, 0);
  */
 static void sched_calc_loads(void)
 {
-    static int count = LOAD_FREQ;
+    static uint64_t next_calc = LOAD_FREQ * 1000000ULL;
+    const uint64_t now = get_utime();
     uint32_t active_threads = 0; /* Fixed-point value. */
 
-    count--;
-    if (count >= 0)
+    /*
+     * The period is measured in time rather than in ticks because the ticks
+     * are not periodic when the tickless idle is enabled.
+     */
+    if (now < next_calc)
         return;
 
     if (rwlock_trywrlock(&loadavg_lock) == 0) {
-        count = LOAD_FREQ;
+        next_calc = now + LOAD_FREQ * 1000000ULL;
 
-        for (size_t i = 0; i < NR_SCHEDULERS; i++) {
-            struct scheduler * sched = CURRENT_CPU->sched_arr[i];
-            unsigned nr;
+        for (size_t i = 0; i < num_elem(cpu); i++) {
+            uint32_t * loadavg = cpu[i].loadavg;
 
-            nr = sched->get_nr_active_threads(sched);
-            active_threads += (uint32_t)nr * FIXED_1;
-        }
+            active_threads = (uint32_t)cpu_nr_active(&cpu[i]) * FIXED_1;
 
-        /* Load averages. */
-        CALC_LOAD(loadavg[0], FEXP_1, active_threads);
-        CALC_LOAD(loadavg[1], FEXP_5, active_threads);
-        CALC_LOAD(loadavg[2], FEXP_15, active_threads);
+            /* Load averages. */
+            CALC_LOAD(loadavg[0], FEXP_1, active_threads);
+            CALC_LOAD(loadavg[1], FEXP_5, active_threads);
+            CALC_LOAD(loadavg[2], FEXP_15, active_threads);
+        }
 
         rwlock_wrunlock(&loadavg_lock);
         rwlock_wrunwait(&loadavg_lock);
@@ -297,23 +440,191 @@ TIMER_TASK(sched_calc_loads);
 
 void sched_get_loads(uint32_t loads[3])
 {
+    uint32_t loadavg[3] = { 0, 0, 0 };
+
     rwlock_rdlock(&loadavg_lock);
+    for (size_t i = 0; i < num_elem(cpu); i++) {
+        loadavg[0] += cpu[i].loadavg[0];
+        loadavg[1] += cpu[i].loadavg[1];
+        loadavg[2] += cpu[i].loadavg[2];
+    }
+    rwlock_rdunlock(&loadavg_lock);
+
     loads[0] = SCALE_LOAD(loadavg[0]);
     loads[1] = SCALE_LOAD(loadavg[1]);
     loads[2] = SCALE_LOAD(loadavg[2]);
-    rwlock_rdunlock(&loadavg_lock);
 }
 
+/*
+ * A macro to create a function that gets the CPU specific 1 min load average.
+ */
+#define SYSCTL_CPU_LOADAVG(cpu, name)                           \
+static int sysctl_loadavg_##name(SYSCTL_HANDLER_ARGS)           \
+{                                                               \
+    unsigned load;                                              \
+    int error;                                                  \
+    rwlock_rdlock(&loadavg_lock);                               \
+    load = SCALE_LOAD(cpu->loadavg[0]);                         \
+    rwlock_rdunlock(&loadavg_lock);                             \
+    error = sysctl_handle_int(oidp, &load, sizeof(load), req);  \
+    return error;                                               \
+}                                                               \
+SYSCTL_PROC(_kern_sched, OID_AUTO, loadavg_##name,              \
+            CTLTYPE_INT | CTLFLAG_RD, NULL, 0,                  \
+            sysctl_loadavg_##name,                              \
+            "I", "1 min load average of the CPU scaled to 100.");
+
+FOREACH_CPU(SYSCTL_CPU_LOADAVG)
+
+#define SYSCTL_CPU_IDLE_STATS(cpu, name)                        \
+SYSCTL_UINT(_kern_sched, OID_AUTO, idle_residency_##name,       \
+            CTLFLAG_RD, &(cpu)->idle_residency, 0,              \
+            "Percentage of time the CPU was idle.");            \
+SYSCTL_UINT(_kern_sched, OID_AUTO, idle_wakeups_##name,         \
+            CTLFLAG_RD, &(cpu)->idle_wakeups, 0,                \
+            "Wakeups per second from the idle thread.");
+
+FOREACH_CPU(SYSCTL_CPU_IDLE_STATS)
+
+/**
+ * Update the idle statistics of a CPU.
+ * @param cs is the current CPU.
+ * @param prev is the thread that was interrupted.
+ * @param next is the thread selected for execution.
+ * @param now is the current time.
+ */
+static void sched_idle_stats(struct cpu_sched * cs, struct thread_info * prev,
+                             struct thread_info * next, uint64_t now)
+{
+    uint64_t window;
+
+    if (prev && thread_flags_is_set(prev, SCHED_INTERNAL_FLAG)) {
+        cs->idle_time += now - cs->idle_enter;
+        cs->nr_idle_wakeups++;
+    }
+    if (thread_flags_is_set(next, SCHED_INTERNAL_FLAG))
+        cs->idle_enter = now;
+
+    window = now - cs->stat_window_start;
+    if (window >= 1000000) {
+        cs->idle_residency = (unsigned)((cs->idle_time * 100) / window);
+        cs->idle_wakeups = (unsigned)((cs->nr_idle_wakeups * 1000000ULL) /
+                                      window);
+        cs->idle_time = 0;
+        cs->nr_idle_wakeups = 0;
+        cs->stat_window_start = now;
+    }
+}
+
+#ifdef configSCHED_TICKLESS
+#define SCHED_TICK_US       (1000000 / configSCHED_HZ)
+#define SCHED_TICK_MIN_US   50
+
+static unsigned tickless_max_ms = 500;
+SYSCTL_UINT(_kern_sched, OID_AUTO, tickless_max_ms, CTLFLAG_RW,
+            &tickless_max_ms, 0,
+            "Maximum time an idle CPU can sleep without a tick.");
+
+/**
+ * Test if all CPUs are idle.
+ * The scheduling timer is shared by all CPUs, so the tick can be stretched
+ * only if none of the CPUs has anything to do.
+ */
+static int sched_all_idle(void)
+{
+    for (size_t i = 0; i < num_elem(cpu); i++) {
+        if (READ_ONCE(cpu[i].nr_ready) > 0 || cpu_nr_active(&cpu[i]) > 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Program the next scheduler timer event.
+ * A busy CPU gets the periodic tick unless a timer expires before it, and
+ * an idle CPU sleeps until the earliest timer expires.
+ * @param cs is the current CPU.
+ * @param next is the thread selected for execution.
+ * @param now is the current time.
+ */
+static void sched_program_tick(struct cpu_sched * cs,
+                               struct thread_info * next, uint64_t now)
+{
+    const int idle = thread_flags_is_set(next, SCHED_INTERNAL_FLAG) &&
+                     sched_all_idle();
+    uint64_t expires;
+    uint64_t delay;
+    int err;
+
+    err = timers_next_expiry(&expires);
+    if (err == -EAGAIN) {
+        delay = SCHED_TICK_US; /* Can't know better. */
+    } else if (err) {
+        delay = idle ? (uint64_t)tickless_max_ms * 1000 : SCHED_TICK_US;
+    } else {
+        delay = (expires > now) ? expires - now : 0;
+        if (!idle && delay > SCHED_TICK_US)
+            delay = SCHED_TICK_US;
+        else if (delay > (uint64_t)tickless_max_ms * 1000)
+            delay = (uint64_t)tickless_max_ms * 1000;
+    }
+    if (delay < SCHED_TICK_MIN_US)
+        delay = SCHED_TICK_MIN_US;
+
+    if (delay == SCHED_TICK_US && !cs->tick_modified)
+        return;
+
+    if (hw_timers_set_next_event(delay))
+        return;
+    cs->next_event = now + delay;
+    cs->tick_modified = delay != SCHED_TICK_US;
+    cs->tick_stretched = delay > SCHED_TICK_US;
+}
+
+void sched_timers_deadline(uint64_t expires)
+{
+    const uint64_t now = get_utime();
+
+    for (size_t i = 0; i < num_elem(cpu); i++) {
+        struct cpu_sched * cs = &cpu[i];
+        uint64_t delay;
+
+        if (!READ_ONCE(cs->tick_stretched) || expires >= cs->next_event)
+            continue;
+
+        delay = (expires > now) ? expires - now : 0;
+        if (delay < SCHED_TICK_MIN_US)
+            delay = SCHED_TICK_MIN_US;
+        if (hw_timers_set_next_event(delay))
+            continue;
+        cs->next_event = now + delay;
+        cs->tick_stretched = delay > SCHED_TICK_US;
+    }
+}
+
+/**
+ * Make a CPU sleeping with a stretched tick to reschedule soon.
+ */
+static void sched_kick_cpu(struct cpu_sched * cs)
+{
+    if (READ_ONCE(cs->tick_stretched)) {
+        cs->tick_stretched = 0;
+        hw_timers_set_next_event(SCHED_TICK_MIN_US);
+    }
+}
+#endif
+
 #ifdef configSCHED_TIME_AVG
 #define SCHED_TIME_AVG_N 10
 
 /**
- * Update per CPU avg scheduling time.
+ * Update an avg scheduling time.
+ * @param sched_time_avg is a pointer to the average to be updated.
  */
-static void calc_sched_time_avg(struct cpu_sched * cpu,
+static void calc_sched_time_avg(unsigned * sched_time_avg,
                                 uint64_t start, uint64_t end)
 {
-    unsigned * sched_time_avg = &cpu->sched_time_avg;
     unsigned avg = *sched_time_avg;
     unsigned delta = end - start;
 
@@ -348,7 +659,162 @@ SYSCTL_PROC(_kern_sched, OID_AUTO, sched_time_avg_##name,   \
 
 FOREACH_CPU(CPU_SCHED_TIME_AVG)
 
+static int sysctl_policy_time_avg(SYSCTL_HANDLER_ARGS)
+{
+    struct cpu_sched * cpu = (struct cpu_sched *)arg1;
+    unsigned avg = cpu->policy_time_avg[arg2] >> SCHED_TIME_AVG_N;
+    int error;
+
+    error = sysctl_handle_int(oidp, &avg, sizeof(avg), req);
+    return error;
+}
+
+/*
+ * Export per CPU and per policy scheduling time averages to sysctl.
+ */
+#define CPU_POLICY_TIME_AVG(cpu, name)                                  \
+SYSCTL_PROC(_kern_sched, OID_AUTO, sched_time_avg_##name##_fifo,        \
+            CTLTYPE_INT | CTLFLAG_RD, cpu, SCHED_FIFO,                  \
+            sysctl_policy_time_avg,                                     \
+            "I", "Average scheduling time of sched_fifo [us].");        \
+SYSCTL_PROC(_kern_sched, OID_AUTO, sched_time_avg_##name##_rr,          \
+            CTLTYPE_INT | CTLFLAG_RD, cpu, SCHED_RR,                    \
+            sysctl_policy_time_avg,                                     \
+            "I", "Average scheduling time of sched_rr [us].");
+
+FOREACH_CPU(CPU_POLICY_TIME_AVG)
+
+#endif
+
+/**
+ * Insert a thread to the scheduler of its policy on the current CPU.
+ */
+static void sched_insert_thread(struct thread_info * thread)
+{
+    const size_t policy = thread->param.sched_policy;
+    struct scheduler * sched;
+
+    KASSERT(policy < num_elem(CURRENT_CPU->sched_arr), "policy is valid");
+    sched = CURRENT_CPU->sched_arr[policy];
+    thread_state_set(thread, THREAD_STATE_EXEC);
+    if (sched->insert(sched, thread)) {
+        KERROR(KERROR_ERR, "Failed to schedule a thread (%d) to \"%s\"\n",
+               thread->id, sched->name);
+    }
+}
+
+/**
+ * Insert a ready thread to the readyq of a CPU.
+ * A thread can be moved to another CPU only if it's not in a run queue
+ * of the CPU that was previously scheduling it.
+ */
+static void sched_enqueue_ready(struct thread_info * thread)
+{
+    struct cpu_sched * target;
+
+    if (READ_ONCE(thread->sched.policy_flags) == 0) {
+        target = sched_select_cpu(thread);
+        thread->sched.cpu = target->index;
+    } else {
+        target = &cpu[thread->sched.cpu];
+    }
+
+    mtx_lock(&target->lock);
+    STAILQ_INSERT_TAIL(&target->readyq, thread, sched.readyq_entry_);
+    target->nr_ready++;
+    mtx_unlock(&target->lock);
+
+#ifdef configSCHED_TICKLESS
+    sched_kick_cpu(target);
 #endif
+}
+
+/**
+ * Test if a thread is allowed to run on the current CPU.
+ */
+static int sched_cpu_allowed(struct thread_info * thread)
+{
+    return (thread->cpu_affinity & (1u << CURRENT_CPU->index)) ||
+           thread_flags_is_set(thread, SCHED_INTERNAL_FLAG);
+}
+
+/**
+ * Move a thread selected by a policy to another CPU if the thread is not
+ * allowed to run on the current CPU anymore.
+ * @param sched is the policy that selected the thread.
+ * @return Returns 1 if the thread was moved; Otherwise 0.
+ */
+static int sched_migrate(struct scheduler * sched, struct thread_info * thread)
+{
+    if (KSCHED_CPU_COUNT == 1 || sched_cpu_allowed(thread))
+        return 0;
+
+    sched->remove(sched, thread);
+    thread_state_set(thread, THREAD_STATE_READY);
+    sched_enqueue_ready(thread);
+
+    return 1;
+}
+
+/**
+ * Steal a ready thread from the busiest CPU.
+ * A thread can be stolen only if it's allowed to run on the current CPU and
+ * it's not in a run queue of the victim CPU anymore.
+ * @return A pointer to the stolen thread or NULL.
+ */
+static struct thread_info * sched_steal_ready(void)
+{
+    struct cpu_sched * const thief = CURRENT_CPU;
+    const uint32_t thief_mask = 1u << thief->index;
+    struct cpu_sched * victim = NULL;
+    unsigned victim_nr = 1; /* The victim should keep at least one thread. */
+    struct thread_info * thread;
+    struct thread_info * prev = NULL;
+
+    for (size_t i = 0; i < num_elem(cpu); i++) {
+        unsigned nr;
+
+        if (&cpu[i] == thief || READ_ONCE(cpu[i].nr_ready) == 0)
+            continue;
+
+        nr = cpu_nr_active(&cpu[i]);
+        if (nr > victim_nr) {
+            victim = &cpu[i];
+            victim_nr = nr;
+        }
+    }
+    if (!victim)
+        return NULL;
+
+    /*
+     * Never wait for the lock of another CPU here, the lock order between
+     * CPUs is not defined.
+     */
+    if (mtx_trylock(&victim->lock))
+        return NULL;
+
+    STAILQ_FOREACH(thread, &victim->readyq, sched.readyq_entry_) {
+        if ((thread->cpu_affinity & thief_mask) &&
+            READ_ONCE(thread->sched.policy_flags) == 0) {
+            if (prev) {
+                STAILQ_REMOVE_AFTER(&victim->readyq, prev,
+                                    sched.readyq_entry_);
+            } else {
+                STAILQ_REMOVE_HEAD(&victim->readyq, sched.readyq_entry_);
+            }
+            victim->nr_ready--;
+            thread->sched.cpu = thief->index;
+            break;
+        }
+        prev = thread;
+    }
+    mtx_unlock(&victim->lock);
+
+    if (thread)
+        atomic_inc(&nr_steals);
+
+    return thread;
+}
 
 void sched_handler(void)
 {
@@ -358,11 +824,18 @@ void sched_handler(void)
 
     sched_start_time = get_utime();
 
-    if (unlikely(!current_thread)) {
+    if (unlikely(!current_thread) && get_cpu_index() == 0) {
         current_thread = thread_lookup(0);
         if (!current_thread)
             panic("No thread 0\n");
     }
+    /*
+     * Other CPUs start with no current thread and the first thread they'll
+     * pick is their idle thread.
+     */
+    if (unlikely(!CURRENT_CPU->online)) {
+        CURRENT_CPU->online = 1;
+    }
 
     /*
      * Run pre-scheduling tasks.
@@ -372,26 +845,35 @@ void sched_handler(void)
         task();
     }
 
-    if (current_thread->sched.ts_counter != -1) {
+    if (current_thread && current_thread->sched.ts_counter != -1) {
         current_thread->sched.ts_counter--;
     }
 
     /*
-     * Exhaust global readyq.
+     * Exhaust the readyq of this CPU.
+     * A thread that is not allowed to run on this CPU anymore is passed to
+     * another CPU unless it's still in a run queue of this CPU, in which case
+     * sched_migrate() will move it once it's selected.
      */
     for (struct thread_info * thread = thread_remove_ready();
          thread;
          thread = thread_remove_ready()) {
-        const size_t policy = thread->param.sched_policy;
-        struct scheduler * sched;
-
-        KASSERT(policy < num_elem(CURRENT_CPU->sched_arr), "policy is valid");
-        sched = CURRENT_CPU->sched_arr[policy];
-        thread_state_set(thread, THREAD_STATE_EXEC);
-        if (sched->insert(sched, thread)) {
-            KERROR(KERROR_ERR, "Failed to schedule a thread (%d) to \"%s\"\n",
-                   thread->id, sched->name);
+        if (!sched_cpu_allowed(thread) &&
+            READ_ONCE(thread->sched.policy_flags) == 0) {
+            sched_enqueue_ready(thread);
+            continue;
         }
+        sched_insert_thread(thread);
+    }
+
+    /*
+     * Steal some work if this CPU would be otherwise idle.
+     */
+    if (KSCHED_CPU_COUNT > 1 && cpu_nr_active(CURRENT_CPU) == 0) {
+        struct thread_info * thread = sched_steal_ready();
+
+        if (thread)
+            sched_insert_thread(thread);
     }
 
     /*
@@ -400,13 +882,28 @@ void sched_handler(void)
     for (size_t i = 0; i < num_elem(CURRENT_CPU->sched_arr); i++) {
         struct scheduler * const sched = CURRENT_CPU->sched_arr[i];
         struct thread_info * next_thread;
+#ifdef configSCHED_TIME_AVG
+        const uint64_t run_start_time = get_utime();
+#endif
 
-        next_thread = sched->run(sched);
+        do {
+            next_thread = sched->run(sched);
+        } while (next_thread && sched_migrate(sched, next_thread));
+#ifdef configSCHED_TIME_AVG
+        calc_sched_time_avg(&CURRENT_CPU->policy_time_avg[i],
+                            run_start_time, get_utime());
+#endif
         if (next_thread) {
             current_thread = next_thread;
             break;
         }
     }
+    sched_idle_stats(CURRENT_CPU, prev_thread, current_thread,
+                     sched_start_time);
+#ifdef configSCHED_TICKLESS
+    sched_program_tick(CURRENT_CPU, current_thread, sched_start_time);
+#endif
+
     /* Check if we need to remap the kstack. */
     if (current_thread != prev_thread) {
         mmu_map_region(&current_thread->kstack_region->b_mmu);
@@ -421,7 +918,8 @@ void sched_handler(void)
     }
 
 #ifdef configSCHED_TIME_AVG
-    calc_sched_time_avg(CURRENT_CPU, sched_start_time, get_utime());
+    calc_sched_time_avg(&CURRENT_CPU->sched_time_avg,
+                        sched_start_time, get_utime());
 #endif
 }
 
@@ -551,6 +1049,10 @@ pthread_t thread_create(struct _sched_pthread_create_args * thread_def,
     struct thread_info * tp;
     thread_cdtor_t ** thread_ctor_p;
 
+    if (thread_def->cpu_affinity &&
+        !(thread_def->cpu_affinity & KSCHED_CPU_MASK_ALL))
+        return -EINVAL;
+
     /* TODO The following error should not be allowed to happen. */
     thread_id = atomic_inc(&next_thread_id);
     if (thread_id < 0)
@@ -597,6 +1099,15 @@ pthread_t thread_create(struct _sched_pthread_create_args * thread_def,
 
     tp->wait_tim = TMNOVAL;
 
+    if (parent && (thread_def->flags & PTHREAD_INHERIT_SCHED)) {
+        tp->cpu_affinity = parent->cpu_affinity;
+    } else if (thread_def->cpu_affinity & KSCHED_CPU_MASK_ALL) {
+        tp->cpu_affinity = thread_def->cpu_affinity & KSCHED_CPU_MASK_ALL;
+    } else {
+        tp->cpu_affinity = KSCHED_CPU_MASK_ALL;
+    }
+    tp->sched.cpu = get_cpu_index();
+
     /* Update parent and child pointers. */
     thread_set_inheritance(tp, parent, pid_owner);
 
@@ -632,9 +1143,9 @@ pthread_t thread_create(struct _sched_pthread_create_args * thread_def,
         ctor(tp);
     }
 
-    mtx_lock(&CURRENT_CPU->lock);
-    RB_INSERT(threadmap, &CURRENT_CPU->threadmap_head, tp);
-    mtx_unlock(&CURRENT_CPU->lock);
+    mtx_lock(&THREADMAP_CPU(tp->id)->lock);
+    RB_INSERT(threadmap, &THREADMAP_CPU(tp->id)->threadmap_head, tp);
+    mtx_unlock(&THREADMAP_CPU(tp->id)->lock);
 
     /* Put thread into readyq */
     if (thread_ready(tp->id)) {
@@ -675,11 +1186,12 @@ struct thread_info * thread_fork(pid_t new_pid)
     }
 
     init_sched_data(&new_thread->sched);
+    new_thread->sched.cpu = get_cpu_index();
     thread_set_inheritance(new_thread, NULL, new_pid);
 
-    mtx_lock(&CURRENT_CPU->lock);
-    RB_INSERT(threadmap, &CURRENT_CPU->threadmap_head, new_thread);
-    mtx_unlock(&CURRENT_CPU->lock);
+    mtx_lock(&THREADMAP_CPU(new_id)->lock);
+    RB_INSERT(threadmap, &THREADMAP_CPU(new_id)->threadmap_head, new_thread);
+    mtx_unlock(&THREADMAP_CPU(new_id)->lock);
 
     /*
      * Run other fork handlers registered.
@@ -699,14 +1211,15 @@ struct thread_info * thread_fork(pid_t new_pid)
 
 struct thread_info * thread_lookup(pthread_t thread_id)
 {
+    struct cpu_sched * const map_cpu = THREADMAP_CPU(thread_id);
     struct thread_info * thread = NULL;
     struct thread_info find = { .id = thread_id };
 
-    mtx_lock(&CURRENT_CPU->lock);
-    if (!RB_EMPTY(&CURRENT_CPU->threadmap_head)) {
-        thread = RB_FIND(threadmap, &CURRENT_CPU->threadmap_head, &find);
+    mtx_lock(&map_cpu->lock);
+    if (!RB_EMPTY(&map_cpu->threadmap_head)) {
+        thread = RB_FIND(threadmap, &map_cpu->threadmap_head, &find);
     }
-    mtx_unlock(&CURRENT_CPU->lock);
+    mtx_unlock(&map_cpu->lock);
 
     return thread;
 }
@@ -724,34 +1237,37 @@ int thread_ready(pthread_t thread_id)
         return 0;
     }
 
-    mtx_lock(&CURRENT_CPU->lock);
-    STAILQ_INSERT_TAIL(&CURRENT_CPU->readyq, thread, sched.readyq_entry_);
-    mtx_unlock(&CURRENT_CPU->lock);
+    sched_enqueue_ready(thread);
 
     return 0;
 }
 
 struct thread_info * thread_remove_ready(void)
 {
+    struct cpu_sched * const cpu_sched = CURRENT_CPU;
     struct thread_info * thread;
 
-    mtx_lock(&CURRENT_CPU->lock);
-    if (STAILQ_EMPTY(&CURRENT_CPU->readyq)) {
-        mtx_unlock(&CURRENT_CPU->lock);
+    mtx_lock(&cpu_sched->lock);
+    if (STAILQ_EMPTY(&cpu_sched->readyq)) {
+        mtx_unlock(&cpu_sched->lock);
         return NULL;
     }
 
-    thread = STAILQ_FIRST(&CURRENT_CPU->readyq);
-    STAILQ_REMOVE_HEAD(&CURRENT_CPU->readyq, sched.readyq_entry_);
+    thread = STAILQ_FIRST(&cpu_sched->readyq);
+    STAILQ_REMOVE_HEAD(&cpu_sched->readyq, sched.readyq_entry_);
+    cpu_sched->nr_ready--;
 
-    mtx_unlock(&CURRENT_CPU->lock);
+    mtx_unlock(&cpu_sched->lock);
     return thread;
 }
 
-void thread_wait(void)
+void thread_block(void)
 {
     thread_state_set(current_thread, THREAD_STATE_BLOCKED);
+}
 
+void thread_wait_blocked(void)
+{
     /*
      * Make sure we don't get stuck here.
      * This is mainly here to handle race conditions in exec().
@@ -763,6 +1279,12 @@ void thread_wait(void)
     }
 }
 
+void thread_wait(void)
+{
+    thread_block();
+    thread_wait_blocked();
+}
+
 void thread_release(pthread_t thread_id)
 {
     thread_ready(thread_id);
@@ -859,6 +1381,39 @@ unsigned thread_get_policy(pthread_t thread_id)
     return thread->param.sched_policy;
 }
 
+int thread_set_affinity(pthread_t thread_id, uint32_t mask)
+{
+    struct thread_info * thread = thread_lookup(thread_id);
+
+    if (!thread || thread_flags_not_set(thread, SCHED_IN_USE_FLAG))
+        return -ESRCH;
+
+    mask &= KSCHED_CPU_MASK_ALL;
+    if (mask == 0)
+        return -EINVAL;
+
+    thread->cpu_affinity = mask;
+#ifdef configSCHED_TICKLESS
+    /* The thread is moved by the next scheduling round of its CPU. */
+    if (!(mask & (1u << thread->sched.cpu)))
+        sched_kick_cpu(&cpu[thread->sched.cpu]);
+#endif
+
+    return 0;
+}
+
+int thread_get_affinity(pthread_t thread_id, uint32_t * mask)
+{
+    struct thread_info * thread = thread_lookup(thread_id);
+
+    if (!thread || thread_flags_not_set(thread, SCHED_IN_USE_FLAG))
+        return -ESRCH;
+
+    *mask = thread->cpu_affinity;
+
+    return 0;
+}
+
 int thread_set_priority(pthread_t thread_id, int priority)
 {
     struct thread_info * thread = thread_lookup(thread_id);
@@ -1055,9 +1610,9 @@ void thread_remove(pthread_t thread_id)
         dtor(thread);
     }
 
-    mtx_lock(&CURRENT_CPU->lock);
-    RB_REMOVE(threadmap, &CURRENT_CPU->threadmap_head, thread);
-    mtx_unlock(&CURRENT_CPU->lock);
+    mtx_lock(&THREADMAP_CPU(thread_id)->lock);
+    RB_REMOVE(threadmap, &THREADMAP_CPU(thread_id)->threadmap_head, thread);
+    mtx_unlock(&THREADMAP_CPU(thread_id)->lock);
 
     if (!queue_push(&CURRENT_CPU->thread_free_queue, &thread)) {
         KERROR(KERROR_ERR,
@@ -1383,6 +1938,57 @@ static intptr_t sys_thread_getpriority(__user void * user_args)
     return prio;
 }
 
+static intptr_t sys_thread_setaffinity(__user void * user_args)
+{
+    struct _set_affinity_args args;
+    struct thread_info * thread;
+    int err;
+
+    if ((err = copyin(user_args, &args, sizeof(args)))) {
+        set_errno(-err);
+        return -1;
+    }
+
+    thread = thread_lookup(args.id);
+    if (!thread) {
+        set_errno(ESRCH);
+        return -1;
+    }
+
+    if ((curproc->pid != thread->pid_owner &&
+         (err = priv_check(&curproc->cred, PRIV_SCHED_SET))) ||
+        (err = thread_set_affinity(args.id, args.mask))) {
+        set_errno(-err);
+        return -1;
+    }
+
+    return 0;
+}
+
+static intptr_t sys_thread_getaffinity(__user void * user_args)
+{
+    struct _set_affinity_args args;
+    int err;
+
+    if ((err = copyin(user_args, &args, sizeof(args)))) {
+        set_errno(-err);
+        return -1;
+    }
+
+    err = thread_get_affinity(args.id, &args.mask);
+    if (err) {
+        set_errno(-err);
+        return -1;
+    }
+
+    if ((err = copyout(&args, user_args, sizeof(args)))) {
+        set_errno(-err);
+        return -1;
+    }
+
+    return 0;
+}
+
 static const syscall_handler_t thread_sysfnmap[] = {
     ARRDECL_SYSCALL_HNDL(SYSCALL_THREAD_CREATE, sys_thread_create),
     ARRDECL_SYSCALL_HNDL(SYSCALL_THREAD_DIE, sys_thread_die),
@@ -1393,5 +1999,7 @@ static const syscall_handler_t thread_sysfnmap[] = {
     ARRDECL_SYSCALL_HNDL(SYSCALL_THREAD_GETPOLICY, sys_thread_getpolicy),
     ARRDECL_SYSCALL_HNDL(SYSCALL_THREAD_SETPRIORITY, sys_thread_setpriority),
     ARRDECL_SYSCALL_HNDL(SYSCALL_THREAD_GETPRIORITY, sys_thread_getpriority),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_THREAD_SETAFFINITY, sys_thread_setaffinity),
+    ARRDECL_SYSCALL_HNDL(SYSCALL_THREAD_GETAFFINITY, sys_thread_getaffinity),
 };
 SYSCALL_HANDLERDEF(thread_syscall, thread_sysfnmap)
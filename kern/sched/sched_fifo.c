@@ -31,52 +31,42 @@
  */
 
 #include <stddef.h>
-#include <sys/tree.h>
 #include <kerror.h>
 #include <kmalloc.h>
 #include <ksched.h>
+#include <ksched_prioq.h>
 #include <libkern.h>
 #include <thread.h>
 
 #define SCHED_POLFLAG_INFIFORQ  0x01 /*!< Thread in run queue. */
 
-#define FIFORUNQ_ENTRY  sched.fifo.runq_entry_
-
 struct sched_fifo {
     struct scheduler sched;
     unsigned nr_active;
-    RB_HEAD(fiforunq, thread_info) runq_head;
+    struct sched_prioq runq;
 };
 
-static int fifo_prio_compare(struct thread_info * a, struct thread_info * b)
-{
-    return a->sched.fifo.prio - b->sched.fifo.prio;
-}
-
-RB_PROTOTYPE_STATIC(fiforunq, thread_info, FIFORUNQ_ENTRY, fifo_prio_compare);
-RB_GENERATE_STATIC(fiforunq, thread_info, FIFORUNQ_ENTRY, fifo_prio_compare);
-
 static int fifo_insert(struct scheduler * sobj, struct thread_info * thread)
 {
     struct sched_fifo * fifo = containerof(sobj, struct sched_fifo, sched);
 
     if (!thread_test_polflag(thread, SCHED_POLFLAG_INFIFORQ)) {
-        RB_INSERT(fiforunq, &fifo->runq_head, thread);
         thread->sched.ts_counter = -1; /* Not used. */
 
         /*
          * The priority of a process is static until it's removed from the queue
          * and it can only change on reinsert.
          */
-        thread->sched.fifo.prio = thread_p_get_scheduling_priority(thread);
+        thread->sched.prio = thread_p_get_scheduling_priority(thread);
+        sched_prioq_insert_tail(&fifo->runq, thread);
 
         thread->sched.policy_flags |= SCHED_POLFLAG_INFIFORQ;
         fifo->nr_active++;
     } else {
         /* Reinsert should update the priority. */
-        RB_REMOVE(fiforunq, &fifo->runq_head, thread);
-        thread->sched.fifo.prio = thread_p_get_scheduling_priority(thread);
-        RB_INSERT(fiforunq, &fifo->runq_head, thread);
+        sched_prioq_remove(&fifo->runq, thread);
+        thread->sched.prio = thread_p_get_scheduling_priority(thread);
+        sched_prioq_insert_tail(&fifo->runq, thread);
     }
 
     return 0;
@@ -87,7 +77,7 @@ static void fifo_remove(struct scheduler * sobj, struct thread_info * thread)
     struct sched_fifo * fifo = containerof(sobj, struct sched_fifo, sched);
 
     if (thread_test_polflag(thread, SCHED_POLFLAG_INFIFORQ)) {
-        RB_REMOVE(fiforunq, &fifo->runq_head, thread);
+        sched_prioq_remove(&fifo->runq, thread);
         thread->sched.policy_flags &= ~SCHED_POLFLAG_INFIFORQ;
         fifo->nr_active--;
     }
@@ -96,12 +86,10 @@ static void fifo_remove(struct scheduler * sobj, struct thread_info * thread)
 static struct thread_info * fifo_schedule(struct scheduler * sobj)
 {
     struct sched_fifo * fifo = containerof(sobj, struct sched_fifo, sched);
+    struct sched_prioq_level yieldq = TAILQ_HEAD_INITIALIZER(yieldq);
     struct thread_info * thread;
 
-    if (RB_EMPTY(&fifo->runq_head))
-        return NULL;
-
-    while ((thread = RB_MIN(fiforunq, &fifo->runq_head))) {
+    while ((thread = sched_prioq_first(&fifo->runq))) {
         const enum thread_state state = thread_state_get(thread);
         const int yield = thread_flags_is_set(thread, SCHED_YIELD_FLAG);
 
@@ -110,12 +98,18 @@ static struct thread_info * fifo_schedule(struct scheduler * sobj)
             fifo_remove(sobj, thread);
             break;
         case THREAD_STATE_EXEC:
-            if (!yield) {
-                if (thread_flags_is_set(thread, SCHED_IN_USE_FLAG)) {
-                    return thread; /* select */
-                }
+            if (thread_flags_not_set(thread, SCHED_IN_USE_FLAG)) {
+                fifo_remove(sobj, thread);
+            } else if (!yield) {
+                goto out; /* select */
             } else {
+                /*
+                 * A yielding thread gives its turn to the other threads and
+                 * goes to the tail of its priority level.
+                 */
                 thread_flags_clear(thread, SCHED_YIELD_FLAG);
+                sched_prioq_remove(&fifo->runq, thread);
+                TAILQ_INSERT_TAIL(&yieldq, thread, SCHED_PRIOQ_ENTRY);
             }
             break;
         case THREAD_STATE_BLOCKED:
@@ -132,7 +126,10 @@ static struct thread_info * fifo_schedule(struct scheduler * sobj)
         }
     }
 
-    return NULL;
+out:
+    sched_prioq_requeue(&fifo->runq, &yieldq);
+
+    return thread;
 }
 
 static unsigned get_nr_active(struct scheduler * sobj)
@@ -148,11 +145,12 @@ static unsigned get_nr_active(struct scheduler * sobj)
 static const struct sched_fifo sched_fifo_init = {
     .sched.name = "sched_fifo",
     .sched.insert = fifo_insert,
+    .sched.remove = fifo_remove,
     .sched.run = fifo_schedule,
     .sched.get_nr_active_threads = get_nr_active,
 };
 
-struct scheduler * sched_create_fifo(void)
+struct scheduler * sched_create_fifo(int cpu_index)
 {
     struct sched_fifo * sched;
 
@@ -161,7 +159,7 @@ struct scheduler * sched_create_fifo(void)
         return NULL;
 
     *sched = sched_fifo_init; /* init */
-    RB_INIT(&sched->runq_head);
+    sched_prioq_init(&sched->runq);
 
     return &sched->sched;
 }
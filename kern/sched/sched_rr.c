@@ -34,22 +34,53 @@
 #include <kerror.h>
 #include <kmalloc.h>
 #include <ksched.h>
+#include <ksched_prioq.h>
 #include <libkern.h>
 #include <thread.h>
 
 #define SCHED_POLFLAG_INRRRQ  0x01 /*!< Thread in run queue. */
+#define SCHED_POLFLAG_INRQ1   0x02 /*!< Thread in runq[1]; Otherwise runq[0]. */
 
-#define RRRUNQ_ENTRY    sched.rr.runq_entry_
-
+/**
+ * RR scheduler state.
+ * The run queue is split in an active and an expired priority queue.
+ * Threads are selected from the active queue by priority and a thread that
+ * exhausts its time slice is moved to the expired queue. Once the active
+ * queue runs empty the queues are swapped, so every thread gets its time
+ * slice on each round and a higher priority thread can't starve the lower
+ * priority threads.
+ */
 struct sched_rr {
     struct scheduler sched;
     unsigned nr_active;
-    TAILQ_HEAD(runq, thread_info) runq_head;
+    int active; /*!< Index of the active run queue. */
+    struct sched_prioq runq[2];
 };
 
 static inline int get_tts(struct thread_info * thread)
 {
-    return 21 + thread_p_get_scheduling_priority(thread);
+    /* At least one tick, otherwise rr_schedule() could rotate forever. */
+    return imax(21 + thread_p_get_scheduling_priority(thread), 1);
+}
+
+static inline int get_runq_index(struct thread_info * thread)
+{
+    return thread_test_polflag(thread, SCHED_POLFLAG_INRQ1) ? 1 : 0;
+}
+
+/**
+ * Insert a thread to the tail of its level in a run queue.
+ * @param rr    is the scheduler.
+ * @param qi    is the index of the run queue.
+ */
+static void rr_runq_insert(struct sched_rr * rr, int qi,
+                           struct thread_info * thread)
+{
+    sched_prioq_insert_tail(&rr->runq[qi], thread);
+    if (qi)
+        thread->sched.policy_flags |= SCHED_POLFLAG_INRQ1;
+    else
+        thread->sched.policy_flags &= ~SCHED_POLFLAG_INRQ1;
 }
 
 static int rr_insert(struct scheduler * sobj, struct thread_info * thread)
@@ -57,8 +88,14 @@ static int rr_insert(struct scheduler * sobj, struct thread_info * thread)
     struct sched_rr * rr = containerof(sobj, struct sched_rr, sched);
 
     if (!thread_test_polflag(thread, SCHED_POLFLAG_INRRRQ)) {
-        TAILQ_INSERT_TAIL(&rr->runq_head, thread, RRRUNQ_ENTRY);
-        thread->sched.ts_counter = get_tts(thread);
+        thread->sched.prio = thread_p_get_scheduling_priority(thread);
+        /*
+         * A thread keeps what is left of its time slice over blocking, so
+         * it can't gain more than one slice per round by blocking.
+         */
+        if (thread->sched.ts_counter <= 0)
+            thread->sched.ts_counter = get_tts(thread);
+        rr_runq_insert(rr, rr->active, thread);
         thread->sched.policy_flags |= SCHED_POLFLAG_INRRRQ;
         rr->nr_active++;
     }
@@ -71,12 +108,16 @@ static void rr_remove(struct scheduler * sobj, struct thread_info * thread)
     struct sched_rr * rr = containerof(sobj, struct sched_rr, sched);
 
     if (thread_test_polflag(thread, SCHED_POLFLAG_INRRRQ)) {
-        TAILQ_REMOVE(&rr->runq_head, thread, RRRUNQ_ENTRY);
+        sched_prioq_remove(&rr->runq[get_runq_index(thread)], thread);
         thread->sched.policy_flags &= ~SCHED_POLFLAG_INRRRQ;
         rr->nr_active--;
     }
 }
 
+/**
+ * Handle a thread that can't be selected for execution.
+ * The thread is always removed from the run queue.
+ */
 static void rr_thread_act(struct scheduler * sobj, struct thread_info * thread,
                           enum thread_state state)
 {
@@ -86,9 +127,8 @@ static void rr_thread_act(struct scheduler * sobj, struct thread_info * thread,
         rr_remove(sobj, thread);
         break;
     case THREAD_STATE_EXEC:
-        if (thread->sched.ts_counter <= 0) {
-            thread->sched.ts_counter = get_tts(thread);
-        }
+        /* Thread is being removed from the system. */
+        rr_remove(sobj, thread);
         break;
     case THREAD_STATE_BLOCKED:
         rr_remove(sobj, thread);
@@ -107,29 +147,67 @@ static void rr_thread_act(struct scheduler * sobj, struct thread_info * thread,
 static struct thread_info * rr_schedule(struct scheduler * sobj)
 {
     struct sched_rr * rr = containerof(sobj, struct sched_rr, sched);
+    struct sched_prioq_level yieldq = TAILQ_HEAD_INITIALIZER(yieldq);
     struct thread_info * next;
-    struct thread_info * tmp;
+    struct thread_info * thread;
+
+    /*
+     * Every thread inspected here is either selected, expired once or
+     * removed from the run queue, so the amortized cost of a selection is
+     * constant.
+     */
+    for (;;) {
+        struct sched_prioq * active = &rr->runq[rr->active];
+        enum thread_state state;
+
+        next = sched_prioq_first(active);
+        if (!next) {
+            /* Start a new round if there are expired threads. */
+            if (rr->runq[rr->active ^ 1].bmap == 0)
+                break;
+            rr->active ^= 1;
+            continue;
+        }
 
-    TAILQ_FOREACH_SAFE(next, &rr->runq_head, RRRUNQ_ENTRY, tmp) {
-        const enum thread_state state = thread_state_get(next);
-        const int yield = thread_flags_is_set(next, SCHED_YIELD_FLAG);
+        state = thread_state_get(next);
 
         if (thread_flags_not_set(next, SCHED_IN_USE_FLAG)) {
             rr_thread_act(sobj, next, state);
             continue;
         }
 
-        if (!yield) {
-            if (state == THREAD_STATE_EXEC && next->sched.ts_counter > 0) {
-                return next;
-            }
-            rr_thread_act(sobj, next, state);
-        } else {
+        if (thread_flags_is_set(next, SCHED_YIELD_FLAG)) {
+            /*
+             * Skip this thread for this turn and put it to the tail of its
+             * level once we are done.
+             */
             thread_flags_clear(next, SCHED_YIELD_FLAG);
+            sched_prioq_remove(active, next);
+            TAILQ_INSERT_TAIL(&yieldq, next, SCHED_PRIOQ_ENTRY);
+            continue;
+        }
+
+        if (state != THREAD_STATE_EXEC) {
+            rr_thread_act(sobj, next, state);
+            continue;
         }
+
+        if (next->sched.ts_counter > 0)
+            break; /* select */
+
+        /* Time slice exhausted, move to the expired queue. */
+        next->sched.ts_counter = get_tts(next);
+        sched_prioq_remove(active, next);
+        rr_runq_insert(rr, rr->active ^ 1, next);
+    }
+
+    /* Yielded threads go back to the queue they were taken from. */
+    while ((thread = TAILQ_FIRST(&yieldq))) {
+        TAILQ_REMOVE(&yieldq, thread, SCHED_PRIOQ_ENTRY);
+        sched_prioq_insert_tail(&rr->runq[get_runq_index(thread)], thread);
     }
 
-    return NULL;
+    return next;
 }
 
 static unsigned get_nr_active(struct scheduler * sobj)
@@ -145,11 +223,12 @@ static unsigned get_nr_active(struct scheduler * sobj)
 static const struct sched_rr sched_rr_init = {
     .sched.name = "sched_rr",
     .sched.insert = rr_insert,
+    .sched.remove = rr_remove,
     .sched.run = rr_schedule,
     .sched.get_nr_active_threads = get_nr_active,
 };
 
-struct scheduler * sched_create_rr(void)
+struct scheduler * sched_create_rr(int cpu_index)
 {
     struct sched_rr * sched;
 
@@ -158,7 +237,8 @@ struct scheduler * sched_create_rr(void)
         return NULL;
 
     *sched = sched_rr_init; /* init */
-    TAILQ_INIT(&sched->runq_head);
+    sched_prioq_init(&sched->runq[0]);
+    sched_prioq_init(&sched->runq[1]);
 
     return &sched->sched;
 }
@@ -96,6 +96,7 @@ static int mmap_file(file_t * file, size_t blkno, size_t bsize,
 {
     vnode_t * vnode = file->vnode;
     struct buf * bp = NULL;
+    int err;
 
     /*
      * We have to do a clone or something because we don't want to share
@@ -117,7 +118,16 @@ static int mmap_file(file_t * file, size_t blkno, size_t bsize,
     bp->b_mmu.control = MMU_CTRL_MEMTYPE_WB;
     BUF_UNLOCK(bp);
 
-    bio_readin(bp);
+    if (S_ISREG(vnode->vn_mode)) {
+        /* Pages of a regular file are read when they are first accessed. */
+        err = vr_fill_setup(bp, 0, bsize);
+        if (err) {
+            bp->vm_ops->rfree(bp);
+            return err;
+        }
+    } else {
+        bio_readin(bp);
+    }
 
     *bp_out = bp;
     return 0;
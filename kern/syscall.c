@@ -56,7 +56,8 @@
     apply(SYSCALL_GROUP_IOCTL, ioctl_syscall)       \
     apply(SYSCALL_GROUP_SHMEM, shmem_syscall)       \
     apply(SYSCALL_GROUP_TIME, time_syscall)         \
-    apply(SYSCALL_GROUP_PRIV, priv_syscall)
+    apply(SYSCALL_GROUP_PRIV, priv_syscall)         \
+    apply(SYSCALL_GROUP_FUTEX, futex_syscall)
 
 /*
  * Declare prototypes of syscall handlers.
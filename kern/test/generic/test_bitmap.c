@@ -6,10 +6,177 @@
 #if 0
 #include <time.h>
 #endif
+#include <hal/hw_timers.h>
 #include <libkern.h>
 #include <kunit.h>
 #include <bitmap.h>
 
+#define BENCH_WORDS     256
+#define BENCH_ROUNDS    1000
+
+static char * test_search_word_boundary(void)
+{
+    bitmap_t bmap[2] = { 0x7fffffff, 0xfffffffe };
+    size_t retval;
+    int err;
+
+    ku_test_description("Test that a block crossing a word boundary is found.");
+
+    err = bitmap_block_search(&retval, 2, bmap, sizeof(bmap));
+    ku_assert_equal("No error", err, 0);
+    ku_assert_equal("retval ok", retval, 31);
+
+    err = bitmap_block_search(&retval, 3, bmap, sizeof(bmap));
+    ku_assert("No block of 3 bits", err != 0);
+
+    bmap[0] = 0xffffffff;
+    bmap[1] = 0xffffffff;
+    err = bitmap_block_search(&retval, 1, bmap, sizeof(bmap));
+    ku_assert("Full bitmap", err != 0);
+
+    return NULL;
+}
+
+static char * test_search_s(void)
+{
+    bitmap_t bmap[4];
+    size_t retval;
+    int err;
+
+    ku_test_description("Test that bitmap_block_search_s() starts from the given bit.");
+
+    memset(bmap, 0, sizeof(bmap));
+    bitmap_block_update(bmap, 1, 40, 10, sizeof(bmap));
+
+    err = bitmap_block_search_s(35, &retval, 5, bmap, sizeof(bmap));
+    ku_assert_equal("No error", err, 0);
+    ku_assert_equal("Found before the reserved block", retval, 35);
+
+    err = bitmap_block_search_s(36, &retval, 5, bmap, sizeof(bmap));
+    ku_assert_equal("No error", err, 0);
+    ku_assert_equal("Found after the reserved block", retval, 50);
+
+    err = bitmap_block_search_s(100, &retval, 29, bmap, sizeof(bmap));
+    ku_assert("No block past the end", err != 0);
+
+    return NULL;
+}
+
+static char * test_search_nf(void)
+{
+    bitmap_t bmap[4];
+    size_t hint = 0;
+    size_t retval;
+    int err;
+
+    ku_test_description("Test that the next-fit search wraps around.");
+
+    memset(bmap, 0, sizeof(bmap));
+
+    err = bitmap_block_search_nf(&hint, &retval, 100, bmap, sizeof(bmap));
+    ku_assert_equal("No error", err, 0);
+    ku_assert_equal("retval ok", retval, 0);
+    ku_assert_equal("hint ok", hint, 100);
+    bitmap_block_update(bmap, 1, retval, 100, sizeof(bmap));
+
+    err = bitmap_block_search_nf(&hint, &retval, 20, bmap, sizeof(bmap));
+    ku_assert_equal("No error", err, 0);
+    ku_assert_equal("Next fit", retval, 100);
+    bitmap_block_update(bmap, 1, retval, 20, sizeof(bmap));
+
+    bitmap_block_update(bmap, 0, 10, 10, sizeof(bmap));
+    err = bitmap_block_search_nf(&hint, &retval, 10, bmap, sizeof(bmap));
+    ku_assert_equal("No error", err, 0);
+    ku_assert_equal("Wrapped around", retval, 10);
+
+    return NULL;
+}
+
+static char * test_update(void)
+{
+    bitmap_t bmap[3];
+
+    ku_test_description("Test that bitmap_block_update() crosses words.");
+
+    memset(bmap, 0, sizeof(bmap));
+
+    bitmap_block_update(bmap, 1, 0, 40, sizeof(bmap));
+    ku_assert_equal("First word set", bmap[0], 0xffffffff);
+    ku_assert_equal("Second word partially set", bmap[1], 0xff);
+
+    bitmap_block_update(bmap, 0, 4, 60, sizeof(bmap));
+    ku_assert_equal("First word cleared", bmap[0], 0xf);
+    ku_assert_equal("Second word cleared", bmap[1], 0);
+    ku_assert_equal("Third word untouched", bmap[2], 0);
+
+    return NULL;
+}
+
+/**
+ * Bit at a time search for comparison.
+ */
+static int search_bitwise(size_t * retval, size_t block_len,
+                          const bitmap_t * bitmap, size_t size)
+{
+    size_t run = 0;
+
+    for (size_t i = 0; i < size * 8; i++) {
+        if (bitmap[i / 32] & (1u << (i % 32))) {
+            run = 0;
+        } else if (++run >= block_len) {
+            *retval = i + 1 - block_len;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static char * bench_fragmented(void)
+{
+    static bitmap_t bmap[BENCH_WORDS];
+    static const size_t lens[] = { 1, 8, 40 };
+    uint32_t seed = 1;
+
+    /*
+     * Mostly allocated bitmap with short holes and a long free block at the
+     * end, like a dynmem or vralloc map after a long uptime.
+     */
+    for (size_t i = 0; i < BENCH_WORDS; i++) {
+        seed = seed * 1103515245 + 12345;
+        bmap[i] = (i % 8 == 7) ? ~(0x3u << (seed >> 27)) : 0xffffffff;
+    }
+    bitmap_block_update(bmap, 0, (BENCH_WORDS - 4) * 32, 4 * 32,
+                        sizeof(bmap));
+
+    for (size_t k = 0; k < num_elem(lens); k++) {
+        uint64_t start, t_word, t_bit;
+        size_t r1 = 0, r2 = 0;
+
+        start = get_utime();
+        for (size_t i = 0; i < BENCH_ROUNDS; i++) {
+            ku_assert_equal("Found", bitmap_block_search(&r1, lens[k], bmap,
+                                                         sizeof(bmap)), 0);
+        }
+        t_word = get_utime() - start;
+
+        start = get_utime();
+        for (size_t i = 0; i < BENCH_ROUNDS; i++) {
+            ku_assert_equal("Found", search_bitwise(&r2, lens[k], bmap,
+                                                    sizeof(bmap)), 0);
+        }
+        t_bit = get_utime() - start;
+
+        ku_assert_equal("Same block found", r1, r2);
+        printf("len %u: word search %u ns/op, bitwise search %u ns/op\n",
+               (unsigned)lens[k],
+               (unsigned)(t_word * 1000 / BENCH_ROUNDS),
+               (unsigned)(t_bit * 1000 / BENCH_ROUNDS));
+    }
+
+    return NULL;
+}
+
 #if 0
 static void rnd_allocs(int n);
 #endif
@@ -119,6 +286,11 @@ static void all_tests(void)
 {
     ku_def_test(test_search, KU_RUN);
     ku_def_test(test_alloc, KU_RUN);
+    ku_def_test(test_search_word_boundary, KU_RUN);
+    ku_def_test(test_search_s, KU_RUN);
+    ku_def_test(test_search_nf, KU_RUN);
+    ku_def_test(test_update, KU_RUN);
+    ku_def_test(bench_fragmented, KU_RUN);
 #if 0
     ku_def_test(perf_test, KU_RUN);
 #endif
@@ -0,0 +1,182 @@
+/**
+ * @file test_timers.c
+ * @brief Test kernel timers.
+ */
+
+#include <kunit.h>
+#include <hal/core.h>
+#include <hal/hw_timers.h>
+#include <libkern.h>
+#include <thread.h>
+#include <timers.h>
+
+#define BENCH_TICKS 1000
+#define HOUR_USEC   (3600ULL * 1000000ULL)
+
+static int fired;
+static int tims[configTIMERS_MAX];
+static size_t nr_tims;
+static istate_t s_entry;
+
+static void count_event(void * arg)
+{
+    fired++;
+}
+
+static void release_timers(void)
+{
+    for (size_t i = 0; i < nr_tims; i++) {
+        timers_release(tims[i]);
+    }
+    nr_tims = 0;
+}
+
+/*
+ * Interrupts are kept disabled during a test so that the timer tick can't
+ * call timers_run() in the middle of the test.
+ */
+static void setup(void)
+{
+    fired = 0;
+    nr_tims = 0;
+    s_entry = get_interrupt_state();
+    disable_interrupt();
+}
+
+static void teardown(void)
+{
+    release_timers();
+    set_interrupt_state(s_entry);
+}
+
+static int add_timer(timers_flags_t flags, uint64_t usec)
+{
+    int tim = timers_add(count_event, NULL, flags, usec);
+
+    if (tim >= 0)
+        tims[nr_tims++] = tim;
+    return tim;
+}
+
+static char * test_oneshot_fires_once(void)
+{
+    ku_assert("Timer allocated",
+              add_timer(TIMERS_FLAG_ENABLED | TIMERS_FLAG_ONESHOT, 0) >= 0);
+
+    timers_run();
+    timers_run();
+    ku_assert_equal("One-shot timer fired once", fired, 1);
+
+    return NULL;
+}
+
+static char * test_periodic_rearms(void)
+{
+    ku_assert("Timer allocated",
+              add_timer(TIMERS_FLAG_ENABLED | TIMERS_FLAG_PERIODIC, 0) >= 0);
+
+    timers_run();
+    ku_assert_equal("Fired only once per tick", fired, 1);
+    timers_run();
+    ku_assert_equal("Re-armed", fired, 2);
+
+    return NULL;
+}
+
+static char * test_start_stop(void)
+{
+    int tim;
+
+    tim = add_timer(TIMERS_FLAG_ONESHOT, 0);
+    ku_assert("Timer allocated", tim >= 0);
+
+    timers_run();
+    ku_assert_equal("Not started timer doesn't fire", fired, 0);
+
+    timers_start(tim);
+    timers_stop(tim);
+    timers_run();
+    ku_assert_equal("Stopped timer doesn't fire", fired, 0);
+
+    timers_start(tim);
+    timers_run();
+    ku_assert_equal("Started timer fires", fired, 1);
+
+    return NULL;
+}
+
+static char * test_expiry_order(void)
+{
+    int far, near;
+
+    far = add_timer(TIMERS_FLAG_ENABLED, HOUR_USEC);
+    near = add_timer(TIMERS_FLAG_ENABLED, 0);
+    ku_assert("Timers allocated", far >= 0 && near >= 0);
+
+    timers_run();
+    ku_assert_equal("Only the expired timer fired", fired, 1);
+
+    timers_release(far);
+    timers_run();
+    ku_assert_equal("Released timer doesn't fire", fired, 1);
+
+    return NULL;
+}
+
+/**
+ * Measure the tick overhead with n armed timers that don't expire.
+ */
+static void bench_tick(size_t n)
+{
+    uint64_t start = 0, end = 0;
+    int ok = 1;
+
+    for (size_t i = 0; i < n; i++) {
+        if (add_timer(TIMERS_FLAG_ENABLED, HOUR_USEC + i) < 0) {
+            ok = 0;
+            break;
+        }
+    }
+
+    if (ok) {
+        start = get_utime();
+        for (size_t i = 0; i < BENCH_TICKS; i++) {
+            timers_run();
+        }
+        end = get_utime();
+    }
+    release_timers();
+
+    /* Don't print with interrupts disabled. */
+    set_interrupt_state(s_entry);
+    if (ok) {
+        printf("%u timers: %u ns/tick\n", (unsigned)n,
+               (unsigned)((end - start) * 1000 / BENCH_TICKS));
+    } else {
+        printf("%u timers: skipped, out of timers\n", (unsigned)n);
+    }
+    disable_interrupt();
+}
+
+/*
+ * The largest run leaves a quarter of the timers for the rest of the system.
+ */
+static char * bench_tick_overhead(void)
+{
+    bench_tick(configTIMERS_MAX / 16);
+    bench_tick(configTIMERS_MAX / 4);
+    bench_tick(configTIMERS_MAX * 3 / 4);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_oneshot_fires_once, KU_RUN);
+    ku_def_test(test_periodic_rearms, KU_RUN);
+    ku_def_test(test_start_stop, KU_RUN);
+    ku_def_test(test_expiry_order, KU_RUN);
+    ku_def_test(bench_tick_overhead, KU_RUN);
+}
+
+TEST_MODULE(generic, timers);
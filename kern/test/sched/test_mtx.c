@@ -0,0 +1,176 @@
+#include <kerror.h>
+#include <klocks.h>
+#include <kunit.h>
+#include <libkern.h>
+#include <thread.h>
+
+#define MTX_TEST_THREADS    2
+#define MTX_TEST_ROUNDS     1000
+
+static mtx_t lock;
+static int counter;
+static atomic_t done;
+
+static void setup(void)
+{
+    mtx_init(&lock, MTX_TYPE_ADAPTIVE, 0);
+    counter = 0;
+    done = ATOMIC_INIT(0);
+}
+
+static void teardown(void)
+{
+}
+
+static char * test_adaptive_trylock(void)
+{
+    ku_test_description("Test that mtx_trylock() works with an adaptive mutex.");
+
+    ku_assert_equal("Lock OK.", mtx_lock(&lock), 0);
+    ku_assert("Lock is set.", mtx_test(&lock));
+    ku_assert_equal("Trylock fails when locked.", mtx_trylock(&lock), 1);
+    mtx_unlock(&lock);
+    ku_assert("Lock is cleared.", !mtx_test(&lock));
+
+    ku_assert_equal("Trylock OK.", mtx_trylock(&lock), 0);
+    mtx_unlock(&lock);
+    ku_assert_equal("Lock OK after trylock.", mtx_lock(&lock), 0);
+    mtx_unlock(&lock);
+
+    return NULL;
+}
+
+static void * adaptive_thread(void * arg)
+{
+    for (int i = 0; i < MTX_TEST_ROUNDS; i++) {
+        int tmp;
+
+        mtx_lock(&lock);
+        tmp = counter;
+        /* Give the other threads a chance to contend the lock. */
+        if ((i & 0xf) == 0)
+            thread_yield(THREAD_YIELD_IMMEDIATE);
+        counter = tmp + 1;
+        mtx_unlock(&lock);
+    }
+    atomic_inc(&done);
+
+    return NULL;
+}
+
+static char * test_adaptive_contended(void)
+{
+    struct sched_param param = {
+        .sched_policy = SCHED_RR,
+        .sched_priority = 0,
+    };
+
+    ku_test_description("Test that a contended adaptive mutex excludes other threads.");
+
+    for (int i = 0; i < MTX_TEST_THREADS; i++) {
+        pthread_t tid;
+
+        tid = kthread_create("mtx_test", &param, 0, adaptive_thread, NULL);
+        ku_assert("Thread created.", tid >= 0);
+    }
+
+    for (int i = 0; i < 500 && atomic_read(&done) < MTX_TEST_THREADS; i++) {
+        thread_sleep(10);
+    }
+    ku_assert_equal("All threads done.", atomic_read(&done), MTX_TEST_THREADS);
+    ku_assert_equal("No lost updates.", counter,
+                    MTX_TEST_THREADS * MTX_TEST_ROUNDS);
+    ku_assert("Lock is free.", !mtx_test(&lock));
+
+    return NULL;
+}
+
+#define PI_OWNER_PRIO   10
+#define PI_WAITER_PRIO  (-10)
+
+static atomic_t owner_locked;
+static atomic_t owner_release;
+static int owner_prio_after;
+
+static void * pi_owner_thread(void * arg)
+{
+    mtx_lock(&lock);
+    atomic_set(&owner_locked, 1);
+    for (int i = 0; i < 500 && !atomic_read(&owner_release); i++) {
+        thread_sleep(10);
+    }
+    mtx_unlock(&lock);
+    owner_prio_after = thread_get_priority(current_thread->id);
+    atomic_inc(&done);
+
+    return NULL;
+}
+
+static void * pi_waiter_thread(void * arg)
+{
+    mtx_lock(&lock);
+    mtx_unlock(&lock);
+    atomic_inc(&done);
+
+    return NULL;
+}
+
+static char * test_adaptive_pi(void)
+{
+    struct sched_param owner_param = {
+        .sched_policy = SCHED_RR,
+        .sched_priority = PI_OWNER_PRIO,
+    };
+    struct sched_param waiter_param = {
+        .sched_policy = SCHED_RR,
+        .sched_priority = PI_WAITER_PRIO,
+    };
+    pthread_t owner;
+    pthread_t tid;
+    int boosted_prio = NICE_ERR;
+
+    ku_test_description("Test that a blocked waiter lends its priority to the owner of an adaptive mutex until the owner unlocks.");
+
+    owner_locked = ATOMIC_INIT(0);
+    owner_release = ATOMIC_INIT(0);
+    owner_prio_after = NICE_ERR;
+
+    owner = kthread_create("mtx_test_owner", &owner_param, 0,
+                           pi_owner_thread, NULL);
+    ku_assert("Thread created.", owner >= 0);
+    for (int i = 0; i < 500 && !atomic_read(&owner_locked); i++) {
+        thread_sleep(10);
+    }
+    ku_assert("Owner has the lock.", atomic_read(&owner_locked));
+
+    tid = kthread_create("mtx_test_waiter", &waiter_param, 0,
+                         pi_waiter_thread, NULL);
+    ku_assert("Thread created.", tid >= 0);
+    for (int i = 0; i < 500; i++) {
+        boosted_prio = thread_get_priority(owner);
+        if (boosted_prio == PI_WAITER_PRIO)
+            break;
+        thread_sleep(10);
+    }
+    atomic_set(&owner_release, 1);
+    ku_assert_equal("Owner is boosted.", boosted_prio, PI_WAITER_PRIO);
+
+    for (int i = 0; i < 500 && atomic_read(&done) < 2; i++) {
+        thread_sleep(10);
+    }
+    ku_assert_equal("All threads done.", atomic_read(&done), 2);
+    ku_assert_equal("Boost dropped on unlock.", owner_prio_after,
+                    PI_OWNER_PRIO);
+    ku_assert("Lock is free.", !mtx_test(&lock));
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_adaptive_trylock, KU_RUN);
+    ku_def_test(test_adaptive_contended, KU_RUN);
+    ku_def_test(test_adaptive_pi, KU_RUN);
+}
+
+TEST_MODULE(sched, mtx);
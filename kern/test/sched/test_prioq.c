@@ -0,0 +1,104 @@
+/**
+ * @file test_prioq.c
+ * @brief Test the priority run queue used by the schedulers.
+ */
+
+#include <kunit.h>
+#include <ksched_prioq.h>
+#include <libkern.h>
+#include <thread.h>
+
+static struct sched_prioq q;
+static struct thread_info threads[4];
+
+static void setup(void)
+{
+    sched_prioq_init(&q);
+    memset(threads, 0, sizeof(threads));
+    for (size_t i = 0; i < num_elem(threads); i++) {
+        threads[i].id = i;
+    }
+}
+
+static void teardown(void)
+{
+}
+
+static char * test_prioq_empty(void)
+{
+    ku_assert("Empty queue returns NULL", sched_prioq_first(&q) == NULL);
+    ku_assert("bitmap is clear", q.bmap == 0);
+
+    return NULL;
+}
+
+static char * test_prioq_order(void)
+{
+    threads[0].sched.prio = 10;
+    threads[1].sched.prio = NICE_MIN;
+    threads[2].sched.prio = 0;
+    threads[3].sched.prio = NICE_MIN;
+
+    for (size_t i = 0; i < num_elem(threads); i++) {
+        sched_prioq_insert_tail(&q, &threads[i]);
+    }
+
+    ku_assert("Highest priority first", sched_prioq_first(&q) == &threads[1]);
+    sched_prioq_remove(&q, &threads[1]);
+    ku_assert("FIFO order inside a level",
+              sched_prioq_first(&q) == &threads[3]);
+    sched_prioq_remove(&q, &threads[3]);
+    ku_assert("Next level", sched_prioq_first(&q) == &threads[2]);
+    sched_prioq_remove(&q, &threads[2]);
+    ku_assert("Last level", sched_prioq_first(&q) == &threads[0]);
+    sched_prioq_remove(&q, &threads[0]);
+    ku_assert("Empty after removals", sched_prioq_first(&q) == NULL);
+    ku_assert("bitmap is clear", q.bmap == 0);
+
+    return NULL;
+}
+
+static char * test_prioq_requeue(void)
+{
+    struct sched_prioq_level list = TAILQ_HEAD_INITIALIZER(list);
+
+    threads[0].sched.prio = 0;
+    threads[1].sched.prio = 0;
+    sched_prioq_insert_tail(&q, &threads[0]);
+    sched_prioq_insert_tail(&q, &threads[1]);
+
+    sched_prioq_remove(&q, &threads[0]);
+    TAILQ_INSERT_TAIL(&list, &threads[0], SCHED_PRIOQ_ENTRY);
+    sched_prioq_requeue(&q, &list);
+
+    ku_assert("List is empty", TAILQ_EMPTY(&list));
+    ku_assert("Requeued to the tail", sched_prioq_first(&q) == &threads[1]);
+
+    return NULL;
+}
+
+static char * test_prioq_clamp(void)
+{
+    threads[0].sched.prio = NICE_ERR;
+    threads[1].sched.prio = NICE_MAX + 100;
+
+    sched_prioq_insert_tail(&q, &threads[1]);
+    sched_prioq_insert_tail(&q, &threads[0]);
+
+    ku_assert("Out of range prio is clamped to the highest level",
+              sched_prioq_first(&q) == &threads[0]);
+    ku_assert("Out of range prio is clamped to the lowest level",
+              TAILQ_FIRST(&q.level[SCHED_PRIOQ_NLEVELS - 1]) == &threads[1]);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_prioq_empty, KU_RUN);
+    ku_def_test(test_prioq_order, KU_RUN);
+    ku_def_test(test_prioq_requeue, KU_RUN);
+    ku_def_test(test_prioq_clamp, KU_RUN);
+}
+
+TEST_MODULE(sched, prioq);
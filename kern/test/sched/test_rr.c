@@ -0,0 +1,81 @@
+/**
+ * @file test_rr.c
+ * @brief Test the RR scheduler.
+ */
+
+#include <kerror.h>
+#include <kunit.h>
+#include <libkern.h>
+#include <thread.h>
+
+static atomic_t low_ran;
+static atomic_t stop;
+static atomic_t done;
+
+static void setup(void)
+{
+    low_ran = ATOMIC_INIT(0);
+    stop = ATOMIC_INIT(0);
+    done = ATOMIC_INIT(0);
+}
+
+static void teardown(void)
+{
+}
+
+static void * hog_thread(void * arg)
+{
+    /* Never block nor yield. */
+    while (!atomic_read(&stop));
+    atomic_inc(&done);
+
+    return NULL;
+}
+
+static void * low_thread(void * arg)
+{
+    atomic_set(&low_ran, 1);
+    atomic_inc(&done);
+
+    return NULL;
+}
+
+static char * test_low_prio_runs(void)
+{
+    struct sched_param hog_param = {
+        .sched_policy = SCHED_RR,
+        .sched_priority = NICE_MIN,
+    };
+    struct sched_param low_param = {
+        .sched_policy = SCHED_RR,
+        .sched_priority = NICE_MAX,
+    };
+    pthread_t tid;
+
+    ku_test_description("Test that a busy high priority thread doesn't starve a low priority thread.");
+
+    tid = kthread_create("rr_test_hog", &hog_param, 0, hog_thread, NULL);
+    ku_assert("Thread created.", tid >= 0);
+    tid = kthread_create("rr_test_low", &low_param, 0, low_thread, NULL);
+    ku_assert("Thread created.", tid >= 0);
+
+    for (int i = 0; i < 500 && !atomic_read(&low_ran); i++) {
+        thread_sleep(10);
+    }
+    atomic_set(&stop, 1);
+    ku_assert_equal("Low priority thread ran.", atomic_read(&low_ran), 1);
+
+    for (int i = 0; i < 500 && atomic_read(&done) < 2; i++) {
+        thread_sleep(10);
+    }
+    ku_assert_equal("All threads done.", atomic_read(&done), 2);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_low_prio_runs, KU_RUN);
+}
+
+TEST_MODULE(sched, rr);
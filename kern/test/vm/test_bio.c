@@ -38,6 +38,30 @@ static char * test_geteblk(void)
     return NULL;
 }
 
+static char * test_geteblk_reuse(void)
+{
+    struct buf * bp;
+    const uint8_t * p;
+
+    ku_test_description("Test that a reused buffer is zeroed by geteblk().");
+
+    bp = geteblk_noclear(4096);
+    ku_assert("A new buffer was returned", bp);
+    memset((void *)bp->b_data, 0xaa, bp->b_bufsize);
+    bp->vm_ops->rfree(bp);
+
+    /* Likely gets the same pages from the vralloc cache. */
+    bp = geteblk(4096);
+    ku_assert("A new buffer was returned", bp);
+    p = (const uint8_t *)bp->b_data;
+    for (size_t i = 0; i < bp->b_bufsize; i++) {
+        ku_assert("Buffer is zeroed", p[i] == 0);
+    }
+    bp->vm_ops->rfree(bp);
+
+    return NULL;
+}
+
 static char * test_getblk(void)
 {
     vnode_t * vndev;
@@ -89,11 +113,44 @@ static char * test_bread(void)
     return NULL;
 }
 
+static char * test_breadn(void)
+{
+    vnode_t * vndev;
+    struct buf * bp;
+    struct buf * rabp;
+    struct proc_info * proc;
+    size_t rablks[] = { 4096, 8192 };
+    int rasizes[] = { 4096, 4096 };
+    int err;
+
+    ku_test_description("Test that breadn() reads and reads ahead.");
+
+    proc = proc_ref(0);
+    proc_unref(proc);
+
+    ku_assert("lookup failed",
+              !lookup_vnode(&vndev, proc->croot,
+                            "/dev/zero", O_RDWR));
+    err = breadn(vndev, 0, 4096, rablks, rasizes, num_elem(rablks), &bp);
+    ku_assert_equal("no error", err, 0);
+    ku_assert("got a buffer", bp);
+    brelse(bp);
+
+    rabp = incore(vndev, rablks[0]);
+    ku_assert("read-ahead block is in core", rabp);
+    ku_assert_equal("read-ahead completes", biowait(rabp), 0);
+    ku_assert("read-ahead block is valid", rabp->b_flags & B_CACHE);
+
+    return NULL;
+}
+
 static void all_tests(void)
 {
     ku_def_test(test_geteblk, KU_RUN);
+    ku_def_test(test_geteblk_reuse, KU_RUN);
     ku_def_test(test_getblk, KU_RUN);
     ku_def_test(test_bread, KU_SKIP);
+    ku_def_test(test_breadn, KU_SKIP);
 }
 
 TEST_MODULE(vm, bio);
@@ -0,0 +1,220 @@
+/**
+ * @file test_dynmem.c
+ * @brief Test the dynmem buddy allocator.
+ */
+
+#include <dynmem.h>
+#include <hal/mmu.h>
+#include <kstring.h>
+#include <kunit.h>
+#include <libkern.h>
+#include <sys/sysctl.h>
+
+#define NR_REGIONS  16
+
+static void * regions[NR_REGIONS];
+
+static void setup(void)
+{
+    memset(regions, 0, sizeof(regions));
+}
+
+static void teardown(void)
+{
+    for (size_t i = 0; i < num_elem(regions); i++) {
+        if (regions[i])
+            dynmem_free_region(regions[i]);
+    }
+}
+
+static void * alloc_pages(size_t count)
+{
+    return dynmem_alloc_region(count, MMU_AP_RWNA, MMU_CTRL_MEMTYPE_WB);
+}
+
+/**
+ * Get the number of free blocks of each order and the number of free bytes.
+ * @return 0 if succeed; Otherwise a negative errno.
+ */
+static int get_free_blocks(unsigned nr[DYNMEM_MAX_ORDER + 1], unsigned * free)
+{
+    char name[40];
+    size_t len;
+    int err;
+
+    for (int i = 0; i <= DYNMEM_MAX_ORDER; i++) {
+        ksprintf(name, sizeof(name), "vm.dynmem.free_blocks.order%d", i);
+        len = sizeof(unsigned);
+        err = kernel_sysctlbyname(NULL, name, &nr[i], &len, NULL, 0, NULL, 0);
+        if (err)
+            return err;
+    }
+
+    strlcpy(name, "vm.dynmem.free", sizeof(name));
+    len = sizeof(unsigned);
+    return kernel_sysctlbyname(NULL, name, free, &len, NULL, 0, NULL, 0);
+}
+
+/**
+ * Check that the free blocks account for all free dynmem.
+ */
+static int free_blocks_match(const unsigned nr[DYNMEM_MAX_ORDER + 1],
+                             unsigned free)
+{
+    size_t pages = 0;
+
+    for (int i = 0; i <= DYNMEM_MAX_ORDER; i++) {
+        pages += (size_t)nr[i] << i;
+    }
+
+    return pages * DYNMEM_PAGE_SIZE == free;
+}
+
+static char * test_split_merge(void)
+{
+    unsigned before[DYNMEM_MAX_ORDER + 1];
+    unsigned after[DYNMEM_MAX_ORDER + 1];
+    unsigned free_before, free_after;
+    int j;
+
+    ku_test_description("Test that a block is split on allocation and merged back on free.");
+
+    ku_assert_equal("Got free blocks",
+                    get_free_blocks(before, &free_before), 0);
+    ku_assert("Free blocks match free memory",
+              free_blocks_match(before, free_before));
+
+    for (j = 0; j <= DYNMEM_MAX_ORDER && before[j] == 0; j++);
+    if (j > DYNMEM_MAX_ORDER)
+        return NULL; /* Out of dynmem. */
+
+    regions[0] = alloc_pages(1);
+    ku_assert("Allocation succeeds", regions[0] != NULL);
+
+    ku_assert_equal("Got free blocks", get_free_blocks(after, &free_after), 0);
+    ku_assert_equal("One page allocated",
+                    free_after, free_before - DYNMEM_PAGE_SIZE);
+    ku_assert("Free blocks match free memory",
+              free_blocks_match(after, free_after));
+    ku_assert_equal("Smallest free block was taken", after[j], before[j] - 1);
+    for (int i = 0; i < j; i++) {
+        ku_assert_equal("Split half was freed", after[i], before[i] + 1);
+    }
+
+    dynmem_free_region(regions[0]);
+    regions[0] = NULL;
+
+    ku_assert_equal("Got free blocks", get_free_blocks(after, &free_after), 0);
+    ku_assert_equal("Free memory restored", free_after, free_before);
+    ku_assert_array_equal("Buddies were merged", after, before,
+                          num_elem(before));
+
+    return NULL;
+}
+
+static char * test_odd_sized_run(void)
+{
+    unsigned before[DYNMEM_MAX_ORDER + 1];
+    unsigned after[DYNMEM_MAX_ORDER + 1];
+    unsigned free_before, free_after;
+
+    ku_test_description("Test that the tail of a block is returned when an odd-sized run is allocated and freed.");
+
+    ku_assert_equal("Got free blocks",
+                    get_free_blocks(before, &free_before), 0);
+    if (free_before < 3 * DYNMEM_PAGE_SIZE)
+        return NULL; /* Out of dynmem. */
+
+    regions[0] = alloc_pages(3);
+    if (!regions[0])
+        return NULL; /* Too fragmented. */
+
+    ku_assert_equal("Got free blocks", get_free_blocks(after, &free_after), 0);
+    ku_assert_equal("Only three pages allocated",
+                    free_after, free_before - 3 * DYNMEM_PAGE_SIZE);
+    ku_assert("Free blocks match free memory",
+              free_blocks_match(after, free_after));
+
+    dynmem_free_region(regions[0]);
+    regions[0] = NULL;
+
+    ku_assert_equal("Got free blocks", get_free_blocks(after, &free_after), 0);
+    ku_assert_equal("Free memory restored", free_after, free_before);
+    ku_assert_array_equal("Buddies were merged", after, before,
+                          num_elem(before));
+
+    return NULL;
+}
+
+static char * test_exhaust_order(void)
+{
+    unsigned before[DYNMEM_MAX_ORDER + 1];
+    unsigned after[DYNMEM_MAX_ORDER + 1];
+    unsigned free_before, free_after;
+    size_t n = 0;
+    int j;
+
+    ku_test_description("Test that a larger block is split once an order is exhausted.");
+
+    ku_assert_equal("Got free blocks",
+                    get_free_blocks(before, &free_before), 0);
+    for (j = 2; j <= DYNMEM_MAX_ORDER && before[j] == 0; j++);
+    if (before[1] >= NR_REGIONS || j > DYNMEM_MAX_ORDER)
+        return NULL; /* Can't exhaust order 1 with the regions available. */
+
+    while (n < before[1]) {
+        regions[n] = alloc_pages(2);
+        ku_assert("Allocation succeeds", regions[n] != NULL);
+        n++;
+    }
+
+    ku_assert_equal("Got free blocks", get_free_blocks(after, &free_after), 0);
+    ku_assert_equal("Order 1 exhausted", after[1], 0);
+    ku_assert_equal("No larger block was split", after[j], before[j]);
+
+    regions[n] = alloc_pages(2);
+    ku_assert("Allocation succeeds", regions[n] != NULL);
+    n++;
+
+    ku_assert_equal("Got free blocks", get_free_blocks(after, &free_after), 0);
+    ku_assert_equal("Larger block was split", after[j], before[j] - 1);
+    for (int i = 1; i < j; i++) {
+        ku_assert_equal("Split half was freed",
+                        after[i], (i == 1) ? 1 : before[i] + 1);
+    }
+    ku_assert("Free blocks match free memory",
+              free_blocks_match(after, free_after));
+
+    while (n > 0) {
+        n--;
+        dynmem_free_region(regions[n]);
+        regions[n] = NULL;
+    }
+
+    ku_assert_equal("Got free blocks", get_free_blocks(after, &free_after), 0);
+    ku_assert_equal("Free memory restored", free_after, free_before);
+    ku_assert_array_equal("Buddies were merged", after, before,
+                          num_elem(before));
+
+    return NULL;
+}
+
+static char * test_too_large(void)
+{
+    ku_test_description("Test that a run larger than the max order fails.");
+
+    regions[0] = alloc_pages(((size_t)1 << DYNMEM_MAX_ORDER) + 1);
+    ku_assert("Allocation fails", regions[0] == NULL);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_split_merge, KU_RUN);
+    ku_def_test(test_odd_sized_run, KU_RUN);
+    ku_def_test(test_exhaust_order, KU_RUN);
+    ku_def_test(test_too_large, KU_RUN);
+}
+
+TEST_MODULE(vm, dynmem);
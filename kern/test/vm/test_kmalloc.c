@@ -0,0 +1,106 @@
+/**
+ * @file test_kmalloc.c
+ * @brief Test kmalloc.
+ */
+
+#include <kunit.h>
+#include <kmalloc.h>
+#include <kstring.h>
+#include <libkern.h>
+
+#define NR_OBJS 64
+
+static void * objs[NR_OBJS];
+
+static void setup(void)
+{
+    memset(objs, 0, sizeof(objs));
+}
+
+static void teardown(void)
+{
+    for (size_t i = 0; i < num_elem(objs); i++) {
+        kfree(objs[i]);
+    }
+}
+
+static char * test_small_allocs_distinct(void)
+{
+    for (size_t i = 0; i < num_elem(objs); i++) {
+        objs[i] = kmalloc(24);
+        ku_assert("Allocation succeeds", objs[i] != NULL);
+        memset(objs[i], (int)i, 24);
+    }
+
+    for (size_t i = 0; i < num_elem(objs); i++) {
+        const uint8_t * p = objs[i];
+
+        ku_assert("Object not overwritten",
+                  p[0] == (uint8_t)i && p[23] == (uint8_t)i);
+    }
+
+    return NULL;
+}
+
+static char * test_alloc_after_free(void)
+{
+    for (size_t i = 0; i < num_elem(objs); i++) {
+        objs[i] = kmalloc(100);
+        ku_assert("Allocation succeeds", objs[i] != NULL);
+    }
+    for (size_t i = 0; i < num_elem(objs); i++) {
+        kfree(objs[i]);
+        objs[i] = NULL;
+    }
+    for (size_t i = 0; i < num_elem(objs); i++) {
+        objs[i] = kmalloc(100);
+        ku_assert("Allocation after free succeeds", objs[i] != NULL);
+    }
+
+    return NULL;
+}
+
+static char * test_krealloc_grow(void)
+{
+    uint8_t * p;
+
+    objs[0] = kmalloc(16);
+    ku_assert("Allocation succeeds", objs[0] != NULL);
+    memset(objs[0], 0xa5, 16);
+
+    p = krealloc(objs[0], 8192);
+    ku_assert("Reallocation succeeds", p != NULL);
+    objs[0] = p;
+    ku_assert("Data is preserved", p[0] == 0xa5 && p[15] == 0xa5);
+
+    return NULL;
+}
+
+static char * test_kpalloc_ref(void)
+{
+    uint32_t * p;
+
+    p = kmalloc(sizeof(uint32_t));
+    ku_assert("Allocation succeeds", p != NULL);
+    *p = 0xdeadbeef;
+
+    kpalloc(p);
+    kfree(p);
+    ku_assert("Still referenced", *p == 0xdeadbeef);
+
+    objs[0] = kmalloc(sizeof(uint32_t));
+    ku_assert("A new object is not the referenced one", objs[0] != p);
+    kfree(p);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    ku_def_test(test_small_allocs_distinct, KU_RUN);
+    ku_def_test(test_alloc_after_free, KU_RUN);
+    ku_def_test(test_krealloc_grow, KU_RUN);
+    ku_def_test(test_kpalloc_ref, KU_RUN);
+}
+
+TEST_MODULE(vm, kmalloc);
@@ -32,12 +32,24 @@
  *******************************************************************************
  */
 
-/* TODO MP version, per CPU timers */
+/*
+ * Armed timers are kept in a binary min-heap ordered by the expiration time,
+ * so a tick that doesn't expire anything only needs to look at the root of
+ * the heap and the work done per tick scales with the number of expiring
+ * timers rather than with configTIMERS_MAX. Released timer slots are kept
+ * in a free stack, so allocating a timer is O(1) and arming or stopping one
+ * is O(log n).
+ *
+ * TODO MP version, per CPU timers
+ */
 
+#include <errno.h>
 #include <sys/linker_set.h>
+#include <sys/sysctl.h>
 #include <machine/atomic.h>
+#include <hal/core.h>
 #include <hal/hw_timers.h>
-#include <kinit.h>
+#include <klocks.h>
 #include <ksched.h>
 #include <thread.h>
 #include <timers.h>
@@ -56,42 +68,211 @@ struct timer_cb {
     void * event_arg;           /*!< Argument for event handler. */
     uint64_t interval;          /*!< Timer interval. */
     uint64_t start;             /*!< Timer start value. */
+    int heap_idx;               /*!< Index in timers_heap or -1. */
+    int next_free;              /*!< Next timer in the free stack. */
+    int next_rearm;             /*!< Next timer in the re-arm list. */
 };
 
-static struct timer_cb timers_array[configTIMERS_MAX] = {
-    [0 ... (configTIMERS_MAX - 1)] = {
-        .flags = ATOMIC_INIT(0),
-        .event_fn = NULL,
-        .interval = 0,
-        .start = 0,
-    }
+/** Timer heap node. */
+struct timer_heap_node {
+    uint64_t expires;           /*!< Copy of start + interval. */
+    int tim;                    /*!< Timer index. */
 };
+
+static struct timer_cb timers_array[configTIMERS_MAX];
+static struct timer_heap_node timers_heap[configTIMERS_MAX];
+static size_t timers_heap_len;
+static int timers_free_head = TMNOVAL;
+static int timers_nr_slots; /*!< Number of timer slots ever allocated. */
+static mtx_t timers_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, 0);
 #define VALID_TIMER_ID(x) ((x) < configTIMERS_MAX && (x) >= 0)
 
+static unsigned timers_nr_armed;
+static unsigned timers_nr_fired;
+
+SYSCTL_DECL(_kern);
+SYSCTL_NODE(_kern, OID_AUTO, timers, CTLFLAG_RW, 0,
+            "Kernel timers");
+
+SYSCTL_UINT(_kern_timers, OID_AUTO, armed, CTLFLAG_RD,
+            &timers_nr_armed, 0, "Number of armed timers");
+SYSCTL_UINT(_kern_timers, OID_AUTO, fired, CTLFLAG_RD,
+            &timers_nr_fired, 0, "Number of timer events fired");
+
+static void heap_set(size_t i, struct timer_heap_node node)
+{
+    timers_heap[i] = node;
+    timers_array[node.tim].heap_idx = i;
+}
+
+static void heap_sift_up(size_t i)
+{
+    const struct timer_heap_node node = timers_heap[i];
+
+    while (i > 0) {
+        const size_t parent = (i - 1) / 2;
+
+        if (timers_heap[parent].expires <= node.expires)
+            break;
+        heap_set(i, timers_heap[parent]);
+        i = parent;
+    }
+    heap_set(i, node);
+}
+
+static void heap_sift_down(size_t i)
+{
+    const struct timer_heap_node node = timers_heap[i];
+
+    while (1) {
+        size_t child = 2 * i + 1;
+
+        if (child >= timers_heap_len)
+            break;
+        if (child + 1 < timers_heap_len &&
+            timers_heap[child + 1].expires < timers_heap[child].expires)
+            child++;
+        if (node.expires <= timers_heap[child].expires)
+            break;
+        heap_set(i, timers_heap[child]);
+        i = child;
+    }
+    heap_set(i, node);
+}
+
+/**
+ * Insert a timer to the heap.
+ * timers_lock must be held.
+ * @return Boolean true if the timer is the earliest one.
+ */
+static int heap_insert(int tim)
+{
+    struct timer_cb * const timer = &timers_array[tim];
+    const size_t i = timers_heap_len++;
+
+    timers_heap[i] = (struct timer_heap_node){
+        .expires = timer->start + timer->interval,
+        .tim = tim,
+    };
+    timer->heap_idx = i;
+    heap_sift_up(i);
+    timers_nr_armed = timers_heap_len;
+
+    return timer->heap_idx == 0;
+}
+
+/**
+ * Arm a timer.
+ * The scheduler is notified if the timer is the earliest one, as the tick
+ * might be stretched beyond its expiration time.
+ * timers_lock must be held and interrupts disabled.
+ */
+static void timers_arm(int tim)
+{
+    if (heap_insert(tim)) {
+#ifdef configSCHED_TICKLESS
+        sched_timers_deadline(timers_heap[0].expires);
+#endif
+    }
+}
+
+/**
+ * Remove a timer from the heap.
+ * timers_lock must be held.
+ */
+static void heap_remove(int tim)
+{
+    struct timer_cb * const timer = &timers_array[tim];
+    const int i = timer->heap_idx;
+    const size_t last = --timers_heap_len;
+
+    timer->heap_idx = -1;
+    if ((size_t)i != last) {
+        const uint64_t old = timers_heap[i].expires;
+
+        heap_set(i, timers_heap[last]);
+        if (timers_heap[i].expires < old)
+            heap_sift_up(i);
+        else
+            heap_sift_down(i);
+    }
+    timers_nr_armed = timers_heap_len;
+}
+
+static istate_t timers_lock_dint(void)
+{
+    istate_t s = get_interrupt_state();
+
+    disable_interrupt();
+    mtx_lock(&timers_lock);
+
+    return s;
+}
+
+static void timers_unlock_dint(istate_t s)
+{
+    mtx_unlock(&timers_lock);
+    set_interrupt_state(s);
+}
+
 void timers_run(void)
 {
-    size_t i = 0;
-    uint64_t now = get_utime();
+    const uint64_t now = get_utime();
     const int enflags = TIMERS_FLAG_INUSE | TIMERS_FLAG_ENABLED;
+    int rearm = TMNOVAL;
+
+    /*
+     * Timers can be modified with interrupts disabled only, so the lock can
+     * be only held by another CPU. Rather than waiting for it we just try
+     * again on the next tick.
+     */
+    if (mtx_trylock(&timers_lock))
+        return;
 
-    do {
-        struct timer_cb * const timer = &timers_array[i];
-        timers_flags_t flags = atomic_read(&timer->flags);
-
-        if ((flags & enflags) == enflags) {
-            if ((now - timer->start) >= timer->interval) {
-                timer->event_fn(timer->event_arg);
-
-                if (!(flags & TIMERS_FLAG_PERIODIC)) {
-                    /* Stop the timer */
-                    timer->flags &= ~TIMERS_FLAG_ENABLED;
-                } else {
-                    /* Repeating timer */
-                    timer->start = get_utime();
-                }
-            }
+    while (timers_heap_len > 0 && timers_heap[0].expires <= now) {
+        const int tim = timers_heap[0].tim;
+        struct timer_cb * const timer = &timers_array[tim];
+        timers_flags_t flags;
+
+        heap_remove(tim);
+        flags = atomic_read(&timer->flags);
+        if (!(flags & TIMERS_FLAG_PERIODIC)) {
+            /* Stop the timer */
+            atomic_and(&timer->flags, ~TIMERS_FLAG_ENABLED);
+        } else {
+            /*
+             * Periodic timers are re-armed only after all expired timers have
+             * been processed to guarantee that a timer can fire only once
+             * per tick.
+             */
+            timer->next_rearm = rearm;
+            rearm = tim;
+        }
+        timers_nr_fired++;
+
+        /*
+         * The event handler may add, stop or release timers, including the
+         * one being fired.
+         */
+        mtx_unlock(&timers_lock);
+        timer->event_fn(timer->event_arg);
+        mtx_lock(&timers_lock);
+    }
+
+    while (rearm != TMNOVAL) {
+        struct timer_cb * const timer = &timers_array[rearm];
+        const int tim = rearm;
+
+        rearm = timer->next_rearm;
+        if ((atomic_read(&timer->flags) & enflags) == enflags &&
+            timer->heap_idx < 0) {
+            /* Repeating timer */
+            timer->start = get_utime();
+            heap_insert(tim);
         }
-    } while (++i < configTIMERS_MAX);
+    }
+
+    mtx_unlock(&timers_lock);
 }
 SCHED_PRE_SCHED_TASK(timers_run);
 
@@ -99,26 +280,52 @@ int timers_add(void (*event_fn)(void *), void * event_arg,
                timers_flags_t flags, uint64_t usec)
 {
     struct timer_cb * timer;
-    size_t i = 0;
+    istate_t s;
+    int tim;
 
     flags &= TIMERS_EXT_FLAGS; /* Allow only external flags to be set */
 
-    do { /* Locate first free timer */
-        timer = &timers_array[i];
+    s = timers_lock_dint();
+    tim = timers_free_head;
+    if (tim != TMNOVAL) {
+        timer = &timers_array[tim];
+        timers_free_head = timer->next_free;
+    } else if (timers_nr_slots < configTIMERS_MAX) {
+        tim = timers_nr_slots++;
+        timer = &timers_array[tim];
+        timer->heap_idx = -1;
+    } else {
+        timers_unlock_dint(s);
+        return TMNOVAL;
+    }
 
-        if (atomic_cmpxchg(&timer->flags, 0, flags) == 0) {
-            timer->event_fn = event_fn;
-            timer->event_arg = event_arg;
-            timer->interval = usec;
-            timer->start = get_utime();
-            flags |= TIMERS_FLAG_INUSE;
-            atomic_set(&timer->flags, flags);
+    timer->event_fn = event_fn;
+    timer->event_arg = event_arg;
+    timer->interval = usec;
+    timer->start = get_utime();
+    atomic_set(&timer->flags, flags | TIMERS_FLAG_INUSE);
+    if (flags & TIMERS_FLAG_ENABLED)
+        timers_arm(tim);
+    timers_unlock_dint(s);
 
-            return i;
-        }
-    } while (++i < configTIMERS_MAX);
+    return tim;
+}
+
+int timers_next_expiry(uint64_t * expires)
+{
+    int retval = 0;
 
-    return TMNOVAL;
+    if (mtx_trylock(&timers_lock))
+        return -EAGAIN;
+
+    if (timers_heap_len > 0)
+        *expires = timers_heap[0].expires;
+    else
+        retval = -ENOENT;
+
+    mtx_unlock(&timers_lock);
+
+    return retval;
 }
 
 int64_t timers_get_split(int tim)
@@ -137,24 +344,56 @@ int64_t timers_get_split(int tim)
 
 void timers_start(int tim)
 {
+    struct timer_cb * timer;
+    istate_t s;
+
     if (!VALID_TIMER_ID(tim))
         return;
 
-    atomic_add(&timers_array[tim].flags, TIMERS_FLAG_ENABLED);
+    timer = &timers_array[tim];
+    s = timers_lock_dint();
+    if ((atomic_read(&timer->flags) & TIMERS_FLAG_INUSE) &&
+        timer->heap_idx < 0) {
+        atomic_or(&timer->flags, TIMERS_FLAG_ENABLED);
+        timers_arm(tim);
+    }
+    timers_unlock_dint(s);
 }
 
 void timers_stop(int tim)
 {
+    struct timer_cb * timer;
+    istate_t s;
+
     if (!VALID_TIMER_ID(tim))
         return;
 
-    atomic_sub(&timers_array[tim].flags, TIMERS_FLAG_ENABLED);
+    timer = &timers_array[tim];
+    s = timers_lock_dint();
+    if (atomic_read(&timer->flags) & TIMERS_FLAG_INUSE) {
+        atomic_and(&timer->flags, ~TIMERS_FLAG_ENABLED);
+        if (timer->heap_idx >= 0)
+            heap_remove(tim);
+    }
+    timers_unlock_dint(s);
 }
 
 void timers_release(int tim)
 {
+    struct timer_cb * timer;
+    istate_t s;
+
     if (!VALID_TIMER_ID(tim))
         return;
 
-    atomic_set(&timers_array[tim].flags, 0);
+    timer = &timers_array[tim];
+    s = timers_lock_dint();
+    if (atomic_read(&timer->flags) & TIMERS_FLAG_INUSE) {
+        if (timer->heap_idx >= 0)
+            heap_remove(tim);
+        atomic_set(&timer->flags, 0);
+        timer->next_free = timers_free_head;
+        timers_free_head = tim;
+    }
+    timers_unlock_dint(s);
 }
@@ -32,6 +32,7 @@
 
 #include <sys/types.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/priv.h>
 #include <sys/ioctl.h>
 #include <termios.h>
@@ -55,6 +56,8 @@ static void tty_close_callback(struct proc_info * p, file_t * file,
                                struct dev_info * devnfo);
 static int tty_ioctl(struct dev_info * devnfo, uint32_t request,
                      void * arg, size_t arg_len);
+static int tty_poll(file_t * file, struct dev_info * devnfo, int events,
+                    struct poll_table * pt);
 
 struct tty * tty_alloc(const char * drv_name, dev_t dev_id,
                        const char * dev_name, size_t data_size)
@@ -78,6 +81,7 @@ struct tty * tty_alloc(const char * drv_name, dev_t dev_id,
     dev->open_callback = tty_open_callback;
     dev->close_callback = tty_close_callback;
     dev->ioctl = tty_ioctl;
+    dev->poll = tty_poll;
     dev->opt_data = tty;
     /*
      * Linux defaults:
@@ -224,6 +228,19 @@ static void tty_close_callback(struct proc_info * p, file_t * file,
         tty->close_callback(file, tty);
 }
 
+static int tty_poll(file_t * file, struct dev_info * devnfo, int events,
+                    struct poll_table * pt)
+{
+    struct tty * tty = (struct tty *)devnfo->opt_data;
+
+    KASSERT(tty, "opt_data should have a tty");
+
+    if (tty->poll)
+        return tty->poll(file, tty, events, pt);
+
+    return events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+}
+
 static int tty_ioctl(struct dev_info * devnfo, uint32_t request,
                      void * arg, size_t arg_len)
 {
@@ -31,9 +31,12 @@
  */
 
 #include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
 #include <buf.h>
 #include <kerror.h>
 #include <kstring.h>
+#include <libkern.h>
 #include <proc.h>
 #include <uio.h>
 #include <vm/vm.h>
@@ -70,6 +73,58 @@ int uio_init_ubuf(struct uio * uio, __user void * ubuf, size_t size,
     return 0;
 }
 
+int uio_init_uvec(struct uio * uio, const struct iovec * iov, int iovcnt,
+                  int rw)
+{
+    struct proc_info * proc = curproc;
+    size_t total = 0;
+
+    KASSERT(proc != NULL, "proc must be set");
+
+    if (iovcnt <= 0 || iovcnt > IOV_MAX)
+        return -EINVAL;
+
+    if (iovcnt == 1)
+        return uio_init_ubuf(uio, iov[0].iov_base, iov[0].iov_len, rw);
+
+    for (int i = 0; i < iovcnt; i++) {
+        const size_t len = iov[i].iov_len;
+
+        if (len > SSIZE_MAX - total)
+            return -EINVAL;
+        total += len;
+
+        if (!useracc_proc(iov[i].iov_base, len, proc, rw))
+            return -EFAULT;
+    }
+
+    *uio = (struct uio){
+        .kbuf = NULL,
+        .ubuf = NULL,
+        .proc = proc,
+        .bufsize = total,
+        .iov = iov,
+        .iovcnt = iovcnt,
+    };
+
+    return 0;
+}
+
+void uio_get_seg(struct uio * uio, int i, struct uio * seg)
+{
+    if (uio->iovcnt == 0) {
+        *seg = *uio;
+        return;
+    }
+
+    *seg = (struct uio){
+        .kbuf = NULL,
+        .ubuf = uio->iov[i].iov_base,
+        .proc = uio->proc,
+        .bufsize = uio->iov[i].iov_len,
+    };
+}
+
 int uio_buf2kuio(struct buf * bp, struct uio * uio)
 {
     if (bp->b_data == 0) {
@@ -82,6 +137,40 @@ int uio_buf2kuio(struct buf * bp, struct uio * uio)
     return 0;
 }
 
+/**
+ * Copy between a kernel address and a multi-segment UIO buffer.
+ * @param out selects the direction; non-zero to copy to the UIO buffer.
+ */
+static int uio_copy_vec(struct uio * uio, void * kaddr, size_t offset,
+                        size_t size, int out)
+{
+    const struct iovec * iov = uio->iov;
+    int i = 0;
+
+    /* Find the first segment. */
+    while (i < uio->iovcnt && offset >= iov[i].iov_len) {
+        offset -= iov[i].iov_len;
+        i++;
+    }
+
+    for (; size > 0 && i < uio->iovcnt; i++) {
+        __user uint8_t * uaddr = (__user uint8_t *)iov[i].iov_base + offset;
+        const size_t n = min(size, iov[i].iov_len - offset);
+        int err;
+
+        err = (out) ? copyout_proc(uio->proc, kaddr, uaddr, n)
+                    : copyin_proc(uio->proc, uaddr, kaddr, n);
+        if (err)
+            return err;
+
+        kaddr = (uint8_t *)kaddr + n;
+        size -= n;
+        offset = 0;
+    }
+
+    return (size == 0) ? 0 : -EIO;
+}
+
 int uio_copyout(const void * src, struct uio * uio, size_t offset,
                    size_t size)
 {
@@ -89,6 +178,8 @@ int uio_copyout(const void * src, struct uio * uio, size_t offset,
 
     if (offset + size > uio->bufsize) {
         retval = -EIO;
+    } else if (uio->iovcnt > 0) {
+        retval = uio_copy_vec(uio, (void *)src, offset, size, 1);
     } else if (uio->kbuf) {
         memmove((uint8_t *)uio->kbuf + offset, src, size);
         retval = 0;
@@ -109,6 +200,8 @@ int uio_copyin(struct uio * uio, void * dst, size_t offset, size_t size)
 
     if (offset + size > uio->bufsize) {
         retval = -EIO;
+    } else if (uio->iovcnt > 0) {
+        retval = uio_copy_vec(uio, dst, offset, size, 0);
     } else if (uio->kbuf) {
         memmove(dst, (uint8_t *)uio->kbuf + offset, size);
         retval = 0;
@@ -127,9 +220,18 @@ int uio_get_kaddr(struct uio * uio, __kernel void ** addr)
 {
     int retval = 0;
 
-    if (uio->kbuf) {
+    if (uio->iovcnt > 0) {
+        retval = -EINVAL;
+    } else if (uio->kbuf) {
         *addr = uio->kbuf;
     } else if (uio->ubuf) {
+        /*
+         * The buffer might be written through the kernel address so all the
+         * pages must be private and present.
+         */
+        retval = vm_prepare_write(uio->proc, uio->ubuf, uio->bufsize);
+        if (retval)
+            return retval;
         *addr = vm_uaddr2kaddr(uio->proc, uio->ubuf, uio->bufsize);
     } else {
         retval = -EINVAL;
@@ -81,7 +81,8 @@ int copyin_proc(struct proc_info * proc, __user const void * uaddr,
 {
     void * phys_uaddr;
 
-    if (!useracc_proc(uaddr, len, proc, VM_PROT_READ)) {
+    if (!useracc_proc(uaddr, len, proc, VM_PROT_READ) ||
+        vm_prepare_read(proc, uaddr, len)) {
         return -EFAULT;
     }
 
@@ -102,8 +103,16 @@ int copyout(__kernel const void * kaddr, __user void * uaddr, size_t len)
 int copyout_proc(struct proc_info * proc, __kernel const void * kaddr,
                  __user void * uaddr, size_t len)
 {
-    /* TODO Handle possible cow flag? */
     void * phys_uaddr;
+    int err;
+
+    /*
+     * The kernel writes through the kernel mapping so COW pages must be
+     * copied first.
+     */
+    err = vm_prepare_write(proc, uaddr, len);
+    if (err)
+        return err;
 
     if (!useracc_proc(uaddr, len, proc, VM_PROT_WRITE)) {
         return -EFAULT;
@@ -130,7 +139,8 @@ int copyinstr(__user const char * uaddr, __kernel char * kaddr, size_t len,
 
     while (off < len) {
         if (((uintptr_t)uaddr >> NBITS(MMU_PGSIZE_COARSE)) != last_prefix) {
-            if (!useracc(uaddr, 1, VM_PROT_READ)) {
+            if (!useracc(uaddr, 1, VM_PROT_READ) ||
+                vm_prepare_read(curproc, uaddr, 1)) {
                 return -EFAULT;
             }
 
@@ -179,6 +189,9 @@ int copyoutstr(__kernel char * kaddr, __user const char * uaddr, size_t len,
 
             last_prefix = (uintptr_t)uaddr >> NBITS(MMU_PGSIZE_COARSE);
 
+            if (vm_prepare_write(curproc, uaddr, 1))
+                return -EFAULT;
+
             phys_uaddr = vm_uaddr2kaddr(curproc, uaddr, MMU_PGSIZE_COARSE);
             if (!phys_uaddr) {
                 return -EFAULT;
@@ -763,6 +776,94 @@ out:
     return retval;
 }
 
+int vm_resolve_cow(struct proc_info * proc, int region_nr, struct buf * region,
+                   uintptr_t vaddr)
+{
+    struct vm_pt * vpt;
+    struct buf * new_region;
+    int err;
+
+    if (!region->vm_ops->rcow)
+        return -ENOTSUP;
+
+    vpt = ptlist_get_pt(&proc->mm, region->b_mmu.vaddr,
+                        region->b_bufsize, VM_PT_CREAT);
+    if (!vpt)
+        return -ENOMEM;
+
+    err = region->vm_ops->rcow(region, vaddr - region->b_mmu.vaddr, vpt,
+                               &new_region);
+    if (err || !new_region)
+        return err;
+
+    return vm_replace_region(proc, new_region, region_nr, VM_INSOP_MAP_REG);
+}
+
+int vm_fill_page(struct proc_info * proc, struct buf * region, uintptr_t vaddr)
+{
+    struct vm_pt * vpt;
+
+    if (!region->vm_ops->rfill)
+        return -ENOTSUP;
+
+    vpt = ptlist_get_pt(&proc->mm, region->b_mmu.vaddr,
+                        region->b_bufsize, VM_PT_CREAT);
+    if (!vpt)
+        return -ENOMEM;
+
+    return region->vm_ops->rfill(region, vaddr - region->b_mmu.vaddr, vpt);
+}
+
+/**
+ * Make the pages of a user space range accessible for the kernel.
+ * @param cow if set COW pages are copied too.
+ */
+static int vm_prepare_range(struct proc_info * proc, __user const void * uaddr,
+                            size_t len, int cow)
+{
+    uintptr_t addr = (uintptr_t)uaddr;
+    const uintptr_t end = addr + len;
+
+    while (addr < end) {
+        struct buf * region;
+        int region_nr, err;
+
+        region_nr = vm_find_reg(proc, addr, &region);
+        if (region_nr < 0)
+            return -EFAULT;
+
+        /* Pages already mapped for this process have been read. */
+        if (region->b_fill_map &&
+            !vm_uaddr2kaddr(proc, (__user void *)addr, 1)) {
+            err = vm_fill_page(proc, region, addr);
+            if (err)
+                return err;
+        }
+
+        if (cow && ((region->b_uflags & VM_PROT_COW) || region->b_cow_src)) {
+            err = vm_resolve_cow(proc, region_nr, region, addr);
+            if (err && err != -EACCES)
+                return err;
+        }
+
+        addr = (addr + MMU_PGSIZE_COARSE) & ~(MMU_PGSIZE_COARSE - 1);
+    }
+
+    return 0;
+}
+
+int vm_prepare_read(struct proc_info * proc, __user const void * uaddr,
+                    size_t len)
+{
+    return vm_prepare_range(proc, uaddr, len, 0);
+}
+
+int vm_prepare_write(struct proc_info * proc, __user const void * uaddr,
+                     size_t len)
+{
+    return vm_prepare_range(proc, uaddr, len, 1);
+}
+
 void vm_fixmemmap_proc(struct proc_info * proc)
 {
     struct vm_mm_struct * mm = &proc->mm;
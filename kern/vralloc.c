@@ -32,18 +32,22 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/queue.h>
 #include <sys/sysctl.h>
 #include <bitmap.h>
 #include <buf.h>
 #include <dynmem.h>
+#include <hal/hw_timers.h>
 #include <hal/mmu.h>
+#include <idle.h>
 #include <kerror.h>
 #include <kmalloc.h>
 #include <kstring.h>
 #include <libkern.h>
 #include <proc.h>
 #include <ptmapper.h>
+#include <uio.h>
 #include <vm/vm.h>
 
 /**
@@ -62,6 +66,7 @@ struct vregion {
     unsigned magic;
 #endif
     size_t size;        /*!< Size of allocation bitmap in bytes. */
+    size_t hint;        /*!< Next-fit hint for map. */
     bitmap_t map[0];    /*!< Bitmap of reserved pages. */
 };
 
@@ -84,14 +89,70 @@ struct vregion {
 
 #define ROUND_UP(N, S) ((((N) + (S) - 1) / (S)) * (S))
 
+/**
+ * Max size of a freed page run kept in the vralloc cache, in pages.
+ * Each run size has its own free lists.
+ */
+#define VR_CACHE_CLASSES    16
+
+/**
+ * Max number of pages kept in the vralloc cache.
+ */
+#define VR_CACHE_MAX_PAGES  256
+
+/**
+ * Number of single pages kept zeroed by the idle task.
+ */
+#define VR_ZERO_RESERVE     8
+
+/**
+ * Number of allocation latency histogram buckets.
+ * Bucket n counts allocations that took less than 2^n usec.
+ */
+#define VR_LAT_BUCKETS      16
+
+/**
+ * A free page run in the vralloc cache.
+ * The descriptor is stored in the first bytes of the run itself.
+ */
+struct vr_cached_run {
+    LIST_ENTRY(vr_cached_run) entry_;
+    struct vregion * vreg;
+};
+
+LIST_HEAD(vr_cached_list, vr_cached_run);
+
+/**
+ * Free lists of a run size.
+ */
+struct vr_cache_class {
+    struct vr_cached_list zeroed;   /*!< Runs cleared by the idle task. */
+    struct vr_cached_list dirty;    /*!< Runs with old data. */
+};
+
 static struct vregion * vreg_alloc_node(size_t count);
 static void vrref(struct buf * region);
 static struct buf * vr_rclone(struct buf * old_region);
+static int vr_rcow(struct buf * region, size_t off, struct vm_pt * pt,
+                   struct buf ** new_region);
+static int vr_rfill(struct buf * region, size_t off, struct vm_pt * pt);
 
 /** List of all allocations done by vralloc. */
 static LIST_HEAD(vrlisthead, vregion) vrlist_head =
     LIST_HEAD_INITIALIZER(vrlisthead);
-static mtx_t vr_big_lock = MTX_INITIALIZER(MTX_TYPE_TICKET, MTX_OPT_DINT);
+static mtx_t vr_big_lock = MTX_INITIALIZER(MTX_TYPE_ADAPTIVE, 0);
+
+/** Free lists of recently freed page runs indexed by the page count - 1. */
+static struct vr_cache_class vr_cache[VR_CACHE_CLASSES];
+static size_t vr_cache_pages; /*!< Number of pages in the cache. */
+static size_t vr_cache_zeroed; /*!< Number of zeroed single pages cached. */
+/**
+ * Lock protecting the vralloc cache.
+ * Can be taken while holding vr_big_lock but not the other way around.
+ */
+static mtx_t vr_cache_lock = MTX_INITIALIZER(MTX_TYPE_SPIN, 0);
+
+static atomic_t vr_lat_hist[VR_LAT_BUCKETS];
 
 SYSCTL_DECL(_vm_vralloc);
 SYSCTL_NODE(_vm, OID_AUTO, vralloc, CTLFLAG_RW, 0,
@@ -103,7 +164,92 @@ SYSCTL_UINT(_vm_vralloc, OID_AUTO, reserved, CTLFLAG_RD, &vralloc_all, 0,
 
 static size_t vralloc_used;
 SYSCTL_UINT(_vm_vralloc, OID_AUTO, used, CTLFLAG_RD, &vralloc_used, 0,
-            "Amount of vralloc memory used");
+            "Amount of vralloc memory used, including the cache");
+
+static unsigned vr_cow_faults;
+SYSCTL_UINT(_vm_vralloc, OID_AUTO, cow_faults, CTLFLAG_RD, &vr_cow_faults, 0,
+            "Number of COW faults resolved by copying a page");
+
+static unsigned vr_cow_pages_copied;
+SYSCTL_UINT(_vm_vralloc, OID_AUTO, cow_pages_copied, CTLFLAG_RD,
+            &vr_cow_pages_copied, 0, "Number of pages copied by COW");
+
+static unsigned vr_cow_reused;
+SYSCTL_UINT(_vm_vralloc, OID_AUTO, cow_reused, CTLFLAG_RD, &vr_cow_reused, 0,
+            "Number of COW regions reused without copying");
+
+static unsigned vr_fill_faults;
+SYSCTL_UINT(_vm_vralloc, OID_AUTO, fill_faults, CTLFLAG_RD, &vr_fill_faults, 0,
+            "Number of faults on demand paged regions");
+
+static unsigned vr_fill_pages;
+SYSCTL_UINT(_vm_vralloc, OID_AUTO, fill_pages, CTLFLAG_RD, &vr_fill_pages, 0,
+            "Number of pages read by demand paging");
+
+static unsigned vr_cache_hits;
+SYSCTL_UINT(_vm_vralloc, OID_AUTO, cache_hits, CTLFLAG_RD, &vr_cache_hits, 0,
+            "Number of allocations served from the free run cache");
+
+static unsigned vr_cache_misses;
+SYSCTL_UINT(_vm_vralloc, OID_AUTO, cache_misses, CTLFLAG_RD,
+            &vr_cache_misses, 0,
+            "Number of allocations that searched the vregions");
+
+static unsigned vr_prezeroed;
+SYSCTL_UINT(_vm_vralloc, OID_AUTO, prezeroed, CTLFLAG_RD, &vr_prezeroed, 0,
+            "Number of pages zeroed by the idle task");
+
+static int sysctl_vr_cached(SYSCTL_HANDLER_ARGS)
+{
+    unsigned bytes = VREG_BYTESIZE(vr_cache_pages);
+
+    return sysctl_handle_int(oidp, &bytes, sizeof(bytes), req);
+}
+SYSCTL_PROC(_vm_vralloc, OID_AUTO, cached, CTLTYPE_UINT | CTLFLAG_RD,
+            NULL, 0, sysctl_vr_cached, "IU",
+            "Amount of freed vralloc memory kept in the cache");
+
+/**
+ * Get a percentile of the allocation latency.
+ * @param pct is the percentile.
+ * @return Returns the upper bound of the latency in usec.
+ */
+static unsigned vr_lat_percentile(unsigned pct)
+{
+    unsigned hist[VR_LAT_BUCKETS];
+    uint64_t total = 0;
+    uint64_t n = 0;
+
+    for (size_t i = 0; i < VR_LAT_BUCKETS; i++) {
+        hist[i] = (unsigned)atomic_read(&vr_lat_hist[i]);
+        total += hist[i];
+    }
+    if (total == 0)
+        return 0;
+
+    for (size_t i = 0; i < VR_LAT_BUCKETS; i++) {
+        n += hist[i];
+        if (n * 100 >= total * pct)
+            return 1u << i;
+    }
+
+    return 1u << (VR_LAT_BUCKETS - 1);
+}
+
+#define SYSCTL_VR_LAT(pct)                                                  \
+static int sysctl_vr_lat_p##pct(SYSCTL_HANDLER_ARGS)                        \
+{                                                                           \
+    unsigned lat = vr_lat_percentile(pct);                                  \
+    return sysctl_handle_int(oidp, &lat, sizeof(lat), req);                 \
+}                                                                           \
+SYSCTL_PROC(_vm_vralloc, OID_AUTO, alloc_lat_p##pct,                        \
+            CTLTYPE_UINT | CTLFLAG_RD, NULL, 0,                             \
+            sysctl_vr_lat_p##pct, "IU",                                     \
+            #pct "th percentile of the buffer allocation latency in usec")
+
+SYSCTL_VR_LAT(50);
+SYSCTL_VR_LAT(90);
+SYSCTL_VR_LAT(99);
 
 /**
  * VRA specific operations for allocated vm regions.
@@ -113,6 +259,8 @@ static const vm_ops_t vra_ops = {
     .rclone = vr_rclone,
     .rfree = vrfree,
     .rmmap = vrmmap,
+    .rcow = vr_rcow,
+    .rfill = vr_rfill,
 };
 
 
@@ -125,6 +273,11 @@ void vralloc_init(void)
     extern void _bio_init(void);
     struct vregion * vreg;
 
+    for (size_t i = 0; i < VR_CACHE_CLASSES; i++) {
+        LIST_INIT(&vr_cache[i].zeroed);
+        LIST_INIT(&vr_cache[i].dirty);
+    }
+
     mtx_lock(&vr_big_lock);
     vreg = vreg_alloc_node(DMEM_BLOCK_SIZE);
     if (!vreg) {
@@ -174,6 +327,56 @@ static struct vregion * vreg_alloc_node(size_t count)
     return vreg;
 }
 
+/**
+ * Return all the runs in the vralloc cache to their vregions.
+ * @note vr_big_lock must be held.
+ * @return Returns the number of pages returned.
+ */
+static size_t vr_cache_drain(void)
+{
+    size_t pages = 0;
+
+    KASSERT(mtx_test(&vr_big_lock), "vr_big_lock should be locked");
+
+    for (size_t i = 0; i < VR_CACHE_CLASSES; i++) {
+        const size_t pcount = i + 1;
+        struct vr_cache_class * class = &vr_cache[i];
+
+        while (1) {
+            struct vr_cached_run * run;
+            struct vregion * vreg;
+            size_t iblock;
+            int err;
+
+            mtx_lock(&vr_cache_lock);
+            run = LIST_FIRST(&class->dirty);
+            if (!run) {
+                run = LIST_FIRST(&class->zeroed);
+                if (run && pcount == 1)
+                    vr_cache_zeroed--;
+            }
+            if (run) {
+                LIST_REMOVE(run, entry_);
+                vr_cache_pages -= pcount;
+            }
+            mtx_unlock(&vr_cache_lock);
+            if (!run)
+                break;
+
+            vreg = run->vreg;
+            iblock = VREG_ADDR2I(vreg, (uintptr_t)run);
+            err = bitmap_block_update(vreg->map, 0, iblock, pcount,
+                                      vreg->size);
+            KASSERT(err == 0, "vreg map update OOB");
+            vreg->count -= pcount;
+            vralloc_used -= VREG_BYTESIZE(pcount);
+            pages += pcount;
+        }
+    }
+
+    return pages;
+}
+
 /**
  * Get pcount number of unallocated pages.
  * @note needs to get vr_big_lock.
@@ -191,14 +394,16 @@ static struct vregion * get_iblocks(size_t * iblock, size_t pcount)
 
 retry:
     LIST_FOREACH(vreg_temp, &vrlist_head, _entry) {
-        if (bitmap_block_search(iblock, pcount, vreg_temp->map,
-                                vreg_temp->size) == 0) {
+        if (bitmap_block_search_nf(&vreg_temp->hint, iblock, pcount,
+                                   vreg_temp->map, vreg_temp->size) == 0) {
             vreg = vreg_temp;
             break; /* Found a block */
         }
     }
 
     if (!vreg) { /* Not found */
+        if (vr_cache_drain())
+            goto retry;
         vreg = vreg_alloc_node(pcount);
         if (!vreg)
             goto out;
@@ -214,6 +419,141 @@ out:
     return vreg;
 }
 
+/**
+ * Get a run of pages from the vralloc cache.
+ * @param[out] iblock is the returned index of the run.
+ * @param pcount is the number of pages requested.
+ * @param clear tells if the caller prefers a zeroed run.
+ * @param[out] zeroed is set if the run returned is zeroed.
+ * @return Returns a pointer to the vreg of the run; NULL if not cached.
+ */
+static struct vregion * vr_cache_get(size_t * iblock, size_t pcount, int clear,
+                                     int * zeroed)
+{
+    struct vr_cache_class * class;
+    struct vr_cached_run * run;
+    struct vregion * vreg;
+
+    if (pcount == 0 || pcount > VR_CACHE_CLASSES)
+        return NULL;
+    class = &vr_cache[pcount - 1];
+
+    mtx_lock(&vr_cache_lock);
+    if (clear) {
+        run = LIST_FIRST(&class->zeroed);
+        *zeroed = !!run;
+        if (!run)
+            run = LIST_FIRST(&class->dirty);
+    } else {
+        run = LIST_FIRST(&class->dirty);
+        *zeroed = !run;
+        if (!run)
+            run = LIST_FIRST(&class->zeroed);
+    }
+    if (run) {
+        LIST_REMOVE(run, entry_);
+        vr_cache_pages -= pcount;
+        if (*zeroed && pcount == 1)
+            vr_cache_zeroed--;
+    }
+    mtx_unlock(&vr_cache_lock);
+
+    if (!run)
+        return NULL;
+
+    vreg = run->vreg;
+    *iblock = VREG_ADDR2I(vreg, (uintptr_t)run);
+    return vreg;
+}
+
+/**
+ * Put a run of pages to the vralloc cache.
+ * @param zeroed tells if the run is zeroed.
+ * @return Returns 0 if the run was cached; Otherwise -ENOMEM.
+ */
+static int vr_cache_put(struct vregion * vreg, size_t iblock, size_t pcount,
+                        int zeroed)
+{
+    struct vr_cached_run * run = (struct vr_cached_run *)VREG_I2ADDR(vreg,
+                                                                    iblock);
+    struct vr_cache_class * class;
+
+    if (pcount == 0 || pcount > VR_CACHE_CLASSES)
+        return -ENOMEM;
+    class = &vr_cache[pcount - 1];
+
+    mtx_lock(&vr_cache_lock);
+    if (vr_cache_pages + pcount > VR_CACHE_MAX_PAGES) {
+        mtx_unlock(&vr_cache_lock);
+        return -ENOMEM;
+    }
+    run->vreg = vreg;
+    if (zeroed) {
+        LIST_INSERT_HEAD(&class->zeroed, run, entry_);
+        if (pcount == 1)
+            vr_cache_zeroed++;
+    } else {
+        LIST_INSERT_HEAD(&class->dirty, run, entry_);
+    }
+    vr_cache_pages += pcount;
+    mtx_unlock(&vr_cache_lock);
+
+    return 0;
+}
+
+/**
+ * Zero cached runs and keep a reserve of zeroed pages.
+ * Zeroes at most one run per call to allow other idle tasks to run as well.
+ */
+static void vr_prezero(uintptr_t arg)
+{
+    struct vregion * vreg = NULL;
+    size_t iblock;
+    size_t pcount;
+    int zeroed;
+
+    /* Zero the smallest dirty run first. */
+    for (pcount = 1; pcount <= VR_CACHE_CLASSES; pcount++) {
+        if (LIST_EMPTY(&vr_cache[pcount - 1].dirty))
+            continue;
+        vreg = vr_cache_get(&iblock, pcount, 0, &zeroed);
+        if (vreg && zeroed) {
+            /* Raced with an allocation. */
+            (void)vr_cache_put(vreg, iblock, pcount, 1);
+            return;
+        }
+        break;
+    }
+
+    if (!vreg) {
+        /* Don't grow vralloc just for the reserve. */
+        if (vr_cache_zeroed >= VR_ZERO_RESERVE ||
+            vr_cache_pages >= VR_CACHE_MAX_PAGES ||
+            vralloc_all - vralloc_used < VREG_BYTESIZE(DMEM_BLOCK_SIZE))
+            return;
+
+        pcount = 1;
+        vreg = get_iblocks(&iblock, pcount);
+        if (!vreg)
+            return;
+    }
+
+    memset((void *)VREG_I2ADDR(vreg, iblock), 0, VREG_BYTESIZE(pcount));
+    vr_prezeroed += pcount;
+
+    if (vr_cache_put(vreg, iblock, pcount, 1)) {
+        int err;
+
+        mtx_lock(&vr_big_lock);
+        err = bitmap_block_update(vreg->map, 0, iblock, pcount, vreg->size);
+        KASSERT(err == 0, "vreg map update OOB");
+        vreg->count -= pcount;
+        vralloc_used -= VREG_BYTESIZE(pcount);
+        mtx_unlock(&vr_big_lock);
+    }
+}
+IDLE_TASK(vr_prezero, 0);
+
 /**
  * vregion free callback.
  * This function is called by kobj.
@@ -226,7 +566,17 @@ static void vreg_free_callback(struct kobj * obj)
     size_t iblock;
     int err;
 
-    mtx_lock(&vr_big_lock);
+    /* Release the original region of a partial COW copy. */
+    if (bp->b_cow_src) {
+        vrfree(bp->b_cow_src);
+        kfree(bp->b_cow_map);
+    }
+
+    /* Release the file of a demand paged region. */
+    if (bp->b_fill_map) {
+        vrele(bp->b_file.vnode);
+        kfree(bp->b_fill_map);
+    }
 
 #ifdef configVRALLOC_DEBUG
     KASSERT(vreg->magic == VREG_MAGIC_VALUE, "magic is correct");
@@ -235,6 +585,14 @@ static void vreg_free_callback(struct kobj * obj)
     /* Get the iblock no. */
     iblock = VREG_ADDR2I(vreg, bp->b_data);
 
+    /* Keep small runs for reuse. */
+    if (vr_cache_put(vreg, iblock, bcount, 0) == 0) {
+        kfree(bp);
+        return;
+    }
+
+    mtx_lock(&vr_big_lock);
+
     err = bitmap_block_update(vreg->map, 0, iblock, bcount, vreg->size);
     KASSERT(err == 0, "vreg map update OOB");
     vreg->count -= bcount;
@@ -256,14 +614,35 @@ static void vreg_free_callback(struct kobj * obj)
     kfree(bp);
 }
 
-struct buf * geteblk(size_t size)
+/**
+ * Record the latency of an allocation.
+ */
+static void vr_lat_record(uint64_t start)
 {
+    const uint64_t usec = get_utime() - start;
+    size_t i = 0;
+
+    while (i < VR_LAT_BUCKETS - 1 && usec >= ((uint64_t)1 << i)) {
+        i++;
+    }
+    atomic_inc(&vr_lat_hist[i]);
+}
+
+/**
+ * Allocate a new vregion buffer.
+ * @param size is the size of the buffer.
+ * @param clear if set the buffer is zeroed.
+ */
+static struct buf * vr_alloc(size_t size, int clear)
+{
+    const uint64_t start = get_utime();
     size_t iblock; /* Block index of the allocation */
     const size_t orig_size = size;
     size = memalign_size(size, MMU_PGSIZE_COARSE);
     const size_t pcount = VREG_PCOUNT(size);
     struct vregion * vreg;
     struct buf * bp;
+    int zeroed = 0;
 
     bp = kzalloc(sizeof(struct buf));
     if (!bp) {
@@ -271,15 +650,21 @@ struct buf * geteblk(size_t size)
         return NULL;
     }
 
-    vreg = get_iblocks(&iblock, pcount);
-    if (!vreg) {
-        KERROR_DBG("%s: Can't get vregion for a new buffer\n",
-                   __func__);
-        kfree(bp);
-        return NULL;
+    vreg = vr_cache_get(&iblock, pcount, clear, &zeroed);
+    if (vreg) {
+        vr_cache_hits++;
+    } else {
+        vr_cache_misses++;
+        vreg = get_iblocks(&iblock, pcount);
+        if (!vreg) {
+            KERROR_DBG("%s: Can't get vregion for a new buffer\n",
+                       __func__);
+            kfree(bp);
+            return NULL;
+        }
     }
 
-    mtx_init(&bp->lock, MTX_TYPE_TICKET, 0);
+    mtx_init(&bp->lock, MTX_TYPE_ADAPTIVE, 0);
 
     /* Update target struct */
     bp->b_mmu.paddr = VREG_I2ADDR(vreg, iblock);
@@ -296,11 +681,26 @@ struct buf * geteblk(size_t size)
     vm_updateusr_ap(bp);
 
     /* Clear allocated pages. */
-    memset((void *)bp->b_data, 0, bp->b_bufsize);
+    if (clear) {
+        memset((void *)bp->b_data, 0,
+               (zeroed) ? sizeof(struct vr_cached_run) : bp->b_bufsize);
+    }
+
+    vr_lat_record(start);
 
     return bp;
 }
 
+struct buf * geteblk(size_t size)
+{
+    return vr_alloc(size, 1);
+}
+
+struct buf * geteblk_noclear(size_t size)
+{
+    return vr_alloc(size, 0);
+}
+
 /**
  * Increment reference count of a vr allocated vm_region.
  * @param region is a pointer to the vregion.
@@ -311,6 +711,37 @@ static void vrref(struct buf * bp)
         panic("vrref error");
 }
 
+/**
+ * Get the kernel address holding the current data of a page of a region.
+ * The page might be still shared with the original region if the region is
+ * a COW copy.
+ */
+static uintptr_t vr_page_kaddr(struct buf * region, size_t pg)
+{
+    const size_t mapsize = BUF_PAGEMAP_SIZE(region);
+
+    if (region->b_cow_src &&
+        bitmap_status(region->b_cow_map, pg, mapsize) == 1)
+        return region->b_cow_src->b_data + VREG_BYTESIZE(pg);
+    return region->b_data + VREG_BYTESIZE(pg);
+}
+
+/**
+ * Copy the attributes of a region to its copy.
+ * COW|COR needs to be cleared on clone.
+ */
+static void vr_copy_attrs(struct buf * new_region, struct buf * old_region)
+{
+    new_region->b_uflags = ~(VM_PROT_COW | VM_PROT_COR) & old_region->b_uflags;
+    new_region->b_mmu.vaddr = old_region->b_mmu.vaddr;
+    /* num_pages already set */
+    new_region->b_mmu.ap = old_region->b_mmu.ap;
+    new_region->b_mmu.control = old_region->b_mmu.control;
+    /* paddr already set */
+    new_region->b_mmu.pt = old_region->b_mmu.pt;
+    vm_updateusr_ap(new_region);
+}
+
 /**
  * Clone a vregion.
  * @param old_region is the old region to be cloned.
@@ -322,7 +753,10 @@ static struct buf * vr_rclone(struct buf * old_region)
     struct buf * new_region;
     const size_t rsize = old_region->b_bufsize;
 
-    new_region = geteblk(rsize);
+    if (vr_fill_flush(old_region))
+        return NULL;
+
+    new_region = vr_alloc(rsize, 0);
     if (!new_region) {
         KERROR(KERROR_ERR, "%s: Out of memory, tried to allocate %d bytes\n",
                __func__, (unsigned)rsize);
@@ -334,23 +768,470 @@ static struct buf * vr_rclone(struct buf * old_region)
                (unsigned)rsize);
 
     /* Copy data */
-    memcpy((void *)(new_region->b_data), (void *)(old_region->b_data),
-           rsize);
+    if (!old_region->b_cow_src) {
+        memcpy((void *)(new_region->b_data), (void *)(old_region->b_data),
+               rsize);
+    } else {
+        for (size_t pg = 0; pg < VREG_PCOUNT(rsize); pg++) {
+            memcpy((void *)(new_region->b_data + VREG_BYTESIZE(pg)),
+                   (void *)vr_page_kaddr(old_region, pg), MMU_PGSIZE_COARSE);
+        }
+    }
+
+    vr_copy_attrs(new_region, old_region);
+
+    return new_region;
+}
+
+/**
+ * Copy a page from the original region of a COW copy.
+ * @note region->lock must be held.
+ */
+static void vr_cow_copy_page(struct buf * region, size_t pg)
+{
+    const size_t mapsize = BUF_PAGEMAP_SIZE(region);
+    const size_t off = VREG_BYTESIZE(pg);
+
+    memcpy((void *)(region->b_data + off),
+           (void *)(region->b_cow_src->b_data + off), MMU_PGSIZE_COARSE);
+    bitmap_clear(region->b_cow_map, pg, mapsize);
+    region->b_cow_pending--;
+    vr_cow_pages_copied++;
+}
+
+/**
+ * Detach a COW copy from its original region once all pages are copied.
+ * @note region->lock must be held.
+ * @return Returns the original region that should be freed with vrfree()
+ *         once the region has been remapped.
+ */
+static struct buf * vr_cow_detach(struct buf * region)
+{
+    struct buf * src = region->b_cow_src;
+
+    kfree(region->b_cow_map);
+    region->b_cow_map = NULL;
+    region->b_cow_src = NULL;
+    region->b_cow_pending = 0;
+
+    return src;
+}
+
+/**
+ * Find the next run of pages having the given status in a page bitmap.
+ * @param region is the region.
+ * @param map is the page bitmap of the region.
+ * @param[in,out] pg is the first page to be checked and it's set to the
+ *                first page of the run found.
+ * @param status is the bit status searched.
+ * @return Returns the number of pages in the run; Zero if no run was found.
+ */
+static size_t vr_next_run(struct buf * region, const bitmap_t * map,
+                          size_t * pg, int status)
+{
+    const size_t pcount = VREG_PCOUNT(region->b_bufsize);
+    const size_t mapsize = BUF_PAGEMAP_SIZE(region);
+    size_t n = 0;
+
+    while (*pg < pcount && bitmap_status(map, *pg, mapsize) != status) {
+        (*pg)++;
+    }
+    while (*pg + n < pcount && bitmap_status(map, *pg + n, mapsize) == status) {
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * Map the pages of a COW copy that are still shared with the original region.
+ * The shared pages are mapped read-only from the original region.
+ * @note region->lock must be held.
+ */
+static int vr_cow_map_pending(struct buf * region,
+                              const mmu_region_t * mmu_region)
+{
+    mmu_region_t shared = *mmu_region;
+    size_t pg = 0;
+    size_t n;
+
+    if (shared.ap == MMU_AP_RWRW)
+        shared.ap = MMU_AP_RORO;
+
+    while ((n = vr_next_run(region, region->b_cow_map, &pg, 1))) {
+        int err;
+
+        shared.vaddr = mmu_region->vaddr + VREG_BYTESIZE(pg);
+        shared.paddr = region->b_cow_src->b_mmu.paddr + VREG_BYTESIZE(pg);
+        shared.num_pages = n;
+        err = mmu_map_region(&shared);
+        if (err)
+            return err;
+        pg += n;
+    }
+
+    return 0;
+}
+
+/**
+ * Create a private copy of a shared COW region.
+ * Only the page pg is copied and the rest of the pages are copied on demand.
+ */
+static int vr_cow_clone(struct buf * region, size_t pg,
+                        struct buf ** new_region)
+{
+    const size_t pcount = VREG_PCOUNT(region->b_bufsize);
+    const size_t mapsize = BUF_PAGEMAP_SIZE(region);
+    struct buf * clone;
+    struct buf * src = NULL;
+    int err;
+
+    KASSERT(!region->b_cow_src, "A shared region can't be a partial copy");
 
     /*
-     * Copy attributes.
-     * COW|COR needs to be cleared on clone.
+     * The pending pages of the clone are mapped from the original region so
+     * the original region can't have unread pages.
      */
-    new_region->b_uflags = ~(VM_PROT_COW | VM_PROT_COR) & old_region->b_uflags;
-    new_region->b_mmu.vaddr = old_region->b_mmu.vaddr;
-    /* num_pages already set */
-    new_region->b_mmu.ap = old_region->b_mmu.ap;
-    new_region->b_mmu.control = old_region->b_mmu.control;
-    /* paddr already set */
-    new_region->b_mmu.pt = old_region->b_mmu.pt;
-    vm_updateusr_ap(new_region);
+    err = vr_fill_flush(region);
+    if (err)
+        return err;
+
+    clone = vr_alloc(region->b_bufsize, 0);
+    if (!clone)
+        return -ENOMEM;
+
+    clone->b_cow_map = kzalloc(mapsize);
+    if (!clone->b_cow_map) {
+        vrfree(clone);
+        return -ENOMEM;
+    }
+    bitmap_block_update(clone->b_cow_map, 1, 0, pcount, mapsize);
+    clone->b_cow_pending = pcount;
+    vrref(region);
+    clone->b_cow_src = region;
+    clone->b_bcount = region->b_bcount;
+    vr_copy_attrs(clone, region);
+
+    mtx_lock(&clone->lock);
+    vr_cow_copy_page(clone, pg);
+    if (clone->b_cow_pending == 0)
+        src = vr_cow_detach(clone);
+    mtx_unlock(&clone->lock);
+    if (src)
+        vrfree(src);
+
+    *new_region = clone;
+    return 0;
+}
 
-    return new_region;
+static int vr_rcow(struct buf * region, size_t off, struct vm_pt * pt,
+                   struct buf ** new_region)
+{
+    const size_t pg = VREG_PCOUNT(off);
+    const size_t mapsize = BUF_PAGEMAP_SIZE(region);
+    mmu_region_t page;
+    struct buf * src = NULL;
+
+    *new_region = NULL;
+
+    if (off >= region->b_bufsize)
+        return -EINVAL;
+
+    if (region->b_uflags & VM_PROT_COW) {
+        if (kobj_refcnt(&region->b_obj) == 1) {
+            /*
+             * Nobody else is using this region anymore, e.g. the child
+             * called exec(), so the region can be just made writable again.
+             */
+            mtx_lock(&region->lock);
+            region->b_uflags &= ~VM_PROT_COW;
+            mtx_unlock(&region->lock);
+            vr_cow_reused++;
+
+            return vrmmap(region, pt);
+        }
+
+        vr_cow_faults++;
+        return vr_cow_clone(region, pg, new_region);
+    }
+
+    mtx_lock(&region->lock);
+    if (!region->b_cow_src ||
+        bitmap_status(region->b_cow_map, pg, mapsize) != 1) {
+        mtx_unlock(&region->lock);
+        return -EACCES;
+    }
+
+    vr_cow_faults++;
+    vr_cow_copy_page(region, pg);
+    if (region->b_cow_pending == 0)
+        src = vr_cow_detach(region);
+
+    page = region->b_mmu;
+    page.vaddr += VREG_BYTESIZE(pg);
+    page.paddr += VREG_BYTESIZE(pg);
+    page.num_pages = 1;
+    page.pt = &(pt->pt);
+    mtx_unlock(&region->lock);
+
+    /* Remap the copied page writable. */
+    mmu_map_region(&page);
+
+    if (src)
+        vrfree(src);
+
+    return 0;
+}
+
+int vr_cow_flush(struct proc_info * proc, struct buf * region)
+{
+    const size_t pcount = VREG_PCOUNT(region->b_bufsize);
+    const size_t mapsize = BUF_PAGEMAP_SIZE(region);
+    struct buf * src;
+    int err;
+
+    if (!region->b_cow_src)
+        return 0;
+
+    mtx_lock(&region->lock);
+    if (!region->b_cow_src) {
+        mtx_unlock(&region->lock);
+        return 0;
+    }
+    for (size_t pg = 0; pg < pcount; pg++) {
+        if (bitmap_status(region->b_cow_map, pg, mapsize) == 1)
+            vr_cow_copy_page(region, pg);
+    }
+    src = vr_cow_detach(region);
+    mtx_unlock(&region->lock);
+
+    /*
+     * The original region can be freed only after none of the pages is
+     * mapped from it anymore.
+     */
+    err = vm_mapproc_region(proc, region);
+    vrfree(src);
+
+    return err;
+}
+
+int vr_fill_setup(struct buf * region, size_t off, size_t len)
+{
+    const size_t pcount = VREG_PCOUNT(region->b_bufsize);
+    bitmap_t * map;
+
+    KASSERT(region->vm_ops == &vra_ops, "region must be vrallocated");
+    KASSERT(region->b_file.vnode, "b_file must be set");
+
+    if (off > region->b_bufsize)
+        return -EINVAL;
+
+    map = kzalloc(BUF_PAGEMAP_SIZE(region));
+    if (!map)
+        return -ENOMEM;
+    bitmap_block_update(map, 1, 0, pcount, BUF_PAGEMAP_SIZE(region));
+
+    if (vref(region->b_file.vnode)) {
+        kfree(map);
+        return -ENOLINK;
+    }
+
+    mtx_lock(&region->lock);
+    region->b_fill_off = off;
+    region->b_fill_len = min(len, region->b_bufsize - off);
+    region->b_fill_map = map;
+    region->b_fill_pending = pcount;
+    mtx_unlock(&region->lock);
+
+    return 0;
+}
+
+/**
+ * Read a page of a demand paged region from the file.
+ * The part of the page not covered by the file data is zeroed.
+ * The file read may sleep, so it's done into a temporary buffer without
+ * holding region->lock and the data is copied to the page only if the page
+ * wasn't read by another thread meanwhile.
+ * @note region->lock must not be held.
+ */
+static int vr_fill_page(struct buf * region, size_t pg)
+{
+    const size_t pg_start = VREG_BYTESIZE(pg);
+    const size_t pg_end = pg_start + MMU_PGSIZE_COARSE;
+    size_t data_start, data_end;
+    file_t file;
+    vnode_t * vnode;
+    uint8_t * tmp = NULL;
+    size_t nread = 0;
+
+    mtx_lock(&region->lock);
+    if (!region->b_fill_map ||
+        bitmap_status(region->b_fill_map, pg, BUF_PAGEMAP_SIZE(region)) == 0) {
+        mtx_unlock(&region->lock);
+        return 0; /* Already read. */
+    }
+    data_start = max(pg_start, region->b_fill_off);
+    data_end = min(pg_end, region->b_fill_off + region->b_fill_len);
+    file = region->b_file; /* Don't share the seek position. */
+    vnode = file.vnode;
+    if (vref(vnode)) {
+        mtx_unlock(&region->lock);
+        return -ENOLINK;
+    }
+    mtx_unlock(&region->lock);
+
+    if (data_start < data_end) {
+        const size_t foff = region->b_blkno + (data_start - region->b_fill_off);
+        struct uio uio;
+        ssize_t retval;
+
+        tmp = kmalloc(data_end - data_start);
+        if (!tmp) {
+            vrele(vnode);
+            return -ENOMEM;
+        }
+
+        if (vnode->vnode_ops->lseek(&file, foff, SEEK_SET) < 0) {
+            retval = -EIO;
+        } else {
+            uio_init_kbuf(&uio, tmp, data_end - data_start);
+            retval = vnode->vnode_ops->read(&file, &uio,
+                                            data_end - data_start);
+        }
+        if (retval < 0) {
+            kfree(tmp);
+            vrele(vnode);
+            return retval;
+        }
+        nread = retval;
+    }
+    vrele(vnode);
+
+    mtx_lock(&region->lock);
+    if (region->b_fill_map &&
+        bitmap_status(region->b_fill_map, pg, BUF_PAGEMAP_SIZE(region)) == 1) {
+        uint8_t * page = (uint8_t *)(region->b_data + pg_start);
+
+        memset(page, 0, MMU_PGSIZE_COARSE);
+        if (nread > 0)
+            memcpy(page + (data_start - pg_start), tmp, nread);
+
+        bitmap_clear(region->b_fill_map, pg, BUF_PAGEMAP_SIZE(region));
+        region->b_fill_pending--;
+        vr_fill_pages++;
+    }
+    mtx_unlock(&region->lock);
+    kfree(tmp);
+
+    return 0;
+}
+
+/**
+ * Detach a demand paged region from its file once all pages are read.
+ * @note region->lock must be held.
+ * @return Returns the vnode that should be released with vrele().
+ */
+static vnode_t * vr_fill_detach(struct buf * region)
+{
+    kfree(region->b_fill_map);
+    region->b_fill_map = NULL;
+    region->b_fill_pending = 0;
+
+    /* b_file is kept as it's still needed for writing back shared mappings. */
+    return region->b_file.vnode;
+}
+
+/**
+ * Map the pages of a demand paged region that have been read.
+ * The rest of the pages are left unmapped to catch the first access.
+ * @note region->lock must be held.
+ */
+static int vr_fill_map_ready(struct buf * region,
+                             const mmu_region_t * mmu_region)
+{
+    mmu_region_t ready = *mmu_region;
+    size_t pg = 0;
+    size_t n;
+    int err;
+
+    err = mmu_unmap_region(mmu_region);
+    if (err)
+        return err;
+
+    while ((n = vr_next_run(region, region->b_fill_map, &pg, 0))) {
+        ready.vaddr = mmu_region->vaddr + VREG_BYTESIZE(pg);
+        ready.paddr = mmu_region->paddr + VREG_BYTESIZE(pg);
+        ready.num_pages = n;
+        err = mmu_map_region(&ready);
+        if (err)
+            return err;
+        pg += n;
+    }
+
+    return 0;
+}
+
+static int vr_rfill(struct buf * region, size_t off, struct vm_pt * pt)
+{
+    const size_t pg = VREG_PCOUNT(off);
+    mmu_region_t page;
+    vnode_t * vnode = NULL;
+    int err;
+
+    if (off >= region->b_bufsize)
+        return -EINVAL;
+
+    vm_updateusr_ap(region);
+
+    vr_fill_faults++;
+    err = vr_fill_page(region, pg);
+    if (err)
+        return err;
+
+    mtx_lock(&region->lock);
+    if (region->b_fill_map && region->b_fill_pending == 0)
+        vnode = vr_fill_detach(region);
+
+    page = region->b_mmu;
+    page.vaddr += VREG_BYTESIZE(pg);
+    page.paddr += VREG_BYTESIZE(pg);
+    page.num_pages = 1;
+    page.pt = &(pt->pt);
+    err = mmu_map_region(&page);
+
+    mtx_unlock(&region->lock);
+
+    if (vnode)
+        vrele(vnode);
+
+    return err;
+}
+
+int vr_fill_flush(struct buf * region)
+{
+    const size_t pcount = VREG_PCOUNT(region->b_bufsize);
+    vnode_t * vnode = NULL;
+
+    if (!region->b_fill_map)
+        return 0;
+
+    for (size_t pg = 0; pg < pcount; pg++) {
+        int err;
+
+        err = vr_fill_page(region, pg);
+        if (err)
+            return err;
+    }
+
+    mtx_lock(&region->lock);
+    if (region->b_fill_map && region->b_fill_pending == 0)
+        vnode = vr_fill_detach(region);
+    mtx_unlock(&region->lock);
+
+    if (vnode)
+        vrele(vnode);
+
+    return 0;
 }
 
 void allocbuf(struct buf * bp, size_t size)
@@ -376,7 +1257,7 @@ void allocbuf(struct buf * bp, size_t size)
 
         if (bitmap_block_search_s(sblock, &iblock, blockdiff, vreg->map,
                     vreg->size) == 0) {
-            if (iblock == sblock + 1) {
+            if (iblock == sblock) {
                 int err;
                 err = bitmap_block_update(vreg->map, 1, sblock, blockdiff,
                                           vreg->size);
@@ -441,6 +1322,7 @@ void vrfree(struct buf * bp)
 int vrmmap(struct buf * region, struct vm_pt * pt)
 {
     mmu_region_t mmu_region;
+    int err;
 
     KASSERT(region, "region can't be null\n");
 
@@ -450,9 +1332,17 @@ int vrmmap(struct buf * region, struct vm_pt * pt)
     mmu_region = region->b_mmu; /* Make a copy. */
     mmu_region.pt = &(pt->pt);
 
+    if (region->b_fill_map) {
+        err = vr_fill_map_ready(region, &mmu_region);
+    } else {
+        err = mmu_map_region(&mmu_region);
+        if (!err && region->b_cow_src)
+            err = vr_cow_map_pending(region, &mmu_region);
+    }
+
     mtx_unlock(&region->lock);
 
-    return mmu_map_region(&mmu_region);
+    return err;
 }
 
 int clone2vr(struct buf * src, struct buf ** out)
@@ -475,7 +1365,7 @@ int clone2vr(struct buf * src, struct buf ** out)
          */
         const size_t rsize = src->b_bufsize;
 
-        new = geteblk(rsize);
+        new = geteblk_noclear(rsize);
         if (!new) {
             return -ENOMEM;
         }
@@ -20,6 +20,7 @@ $(wildcard libc/malloc/*.c) \
 $(wildcard libc/math/*.c) \
 $(wildcard libc/mman/*.c) \
 $(wildcard libc/mount/*.c) \
+$(wildcard libc/poll/*.c) \
 $(wildcard libc/priv/*.c) \
 $(wildcard libc/pthread/*.c) \
 $(wildcard libc/pwd/*.c) \
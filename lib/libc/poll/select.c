@@ -0,0 +1,125 @@
+/**
+ *******************************************************************************
+ * @file    select.c
+ * @author  Olli Vanhoja
+ * @brief   Synchronous I/O multiplexing on top of poll().
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/select.h>
+
+int select(int nfds, fd_set * restrict readfds, fd_set * restrict writefds,
+           fd_set * restrict errorfds, struct timeval * restrict timeout)
+{
+    struct pollfd * fds;
+    nfds_t n = 0;
+    int timeout_ms = -1;
+    int retval;
+
+    if (nfds < 0 || nfds > FD_SETSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (timeout) {
+        if (timeout->tv_sec < 0 || timeout->tv_usec < 0 ||
+            timeout->tv_usec >= 1000000) {
+            errno = EINVAL;
+            return -1;
+        }
+        timeout_ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+    }
+
+    fds = calloc(nfds + 1, sizeof(struct pollfd));
+    if (!fds) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    for (int fd = 0; fd < nfds; fd++) {
+        short events = 0;
+
+        if (readfds && FD_ISSET(fd, readfds))
+            events |= POLLIN;
+        if (writefds && FD_ISSET(fd, writefds))
+            events |= POLLOUT;
+        if (errorfds && FD_ISSET(fd, errorfds))
+            events |= POLLPRI;
+        if (!events)
+            continue;
+
+        fds[n].fd = fd;
+        fds[n].events = events;
+        n++;
+    }
+
+    retval = poll(fds, n, timeout_ms);
+    if (retval < 0)
+        goto out;
+
+    if (readfds)
+        FD_ZERO(readfds);
+    if (writefds)
+        FD_ZERO(writefds);
+    if (errorfds)
+        FD_ZERO(errorfds);
+
+    retval = 0;
+    for (nfds_t i = 0; i < n; i++) {
+        const int fd = fds[i].fd;
+        const short revents = fds[i].revents;
+
+        if (revents & POLLNVAL) {
+            errno = EBADF;
+            retval = -1;
+            goto out;
+        }
+
+        if (readfds && (fds[i].events & POLLIN) &&
+            (revents & (POLLIN | POLLHUP | POLLERR))) {
+            FD_SET(fd, readfds);
+            retval++;
+        }
+        if (writefds && (fds[i].events & POLLOUT) &&
+            (revents & (POLLOUT | POLLERR))) {
+            FD_SET(fd, writefds);
+            retval++;
+        }
+        if (errorfds && (fds[i].events & POLLPRI) &&
+            (revents & (POLLPRI | POLLERR))) {
+            FD_SET(fd, errorfds);
+            retval++;
+        }
+    }
+
+out:
+    free(fds);
+    return retval;
+}
@@ -0,0 +1,7 @@
+#include <threads.h>
+#include <pthread.h>
+
+int cnd_broadcast(cnd_t *cond)
+{
+    return (pthread_cond_broadcast(cond)) ? thrd_error : thrd_success;
+}
@@ -0,0 +1,7 @@
+#include <threads.h>
+#include <pthread.h>
+
+void cnd_destroy(cnd_t *cond)
+{
+    pthread_cond_destroy(cond);
+}
@@ -0,0 +1,7 @@
+#include <threads.h>
+#include <pthread.h>
+
+int cnd_init(cnd_t *cond)
+{
+    return (pthread_cond_init(cond, NULL)) ? thrd_error : thrd_success;
+}
@@ -0,0 +1,89 @@
+/**
+ *******************************************************************************
+ * @file    futex.c
+ * @author  Olli Vanhoja
+ * @brief   Futex wait and wake.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#define __SYSCALL_DEFS__
+#include <errno.h>
+#include <sys/futex.h>
+#include <syscall.h>
+#include <time.h>
+#include "pthread_futex.h"
+
+int futex_wait(int * uaddr, int val, const struct timespec * timeout)
+{
+    struct _futex_wait_args args = {
+        .uaddr = uaddr,
+        .val = val,
+        .timed = !!timeout,
+    };
+
+    if (timeout)
+        args.timeout = *timeout;
+
+    return syscall(SYSCALL_FUTEX_WAIT, &args);
+}
+
+int futex_wake(int * uaddr, int count)
+{
+    struct _futex_wake_args args = {
+        .uaddr = uaddr,
+        .count = count,
+    };
+
+    return syscall(SYSCALL_FUTEX_WAKE, &args);
+}
+
+int _futex_timedwait(int * uaddr, int val, const struct timespec * abstime)
+{
+    struct timespec now, rel;
+
+    if (!abstime)
+        return futex_wait(uaddr, val, NULL);
+
+    if (abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    rel.tv_sec = abstime->tv_sec - now.tv_sec;
+    rel.tv_nsec = abstime->tv_nsec - now.tv_nsec;
+    if (rel.tv_nsec < 0) {
+        rel.tv_sec--;
+        rel.tv_nsec += 1000000000;
+    }
+    if (rel.tv_sec < 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    return futex_wait(uaddr, val, &rel);
+}
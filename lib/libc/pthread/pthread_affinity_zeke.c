@@ -0,0 +1,79 @@
+/**
+ *******************************************************************************
+ * @file    pthread_affinity_zeke.c
+ * @author  Olli Vanhoja
+ * @brief   Thread CPU affinity.
+ * @section LICENSE
+ * Copyright (c) 2020 Olli Vanhoja <olli.vanhoja@alumni.helsinki.fi>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************
+ */
+
+#define __SYSCALL_DEFS__
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <syscall.h>
+
+int pthread_setaffinity_zeke(pthread_t thread, uint32_t mask)
+{
+    struct _set_affinity_args args = {
+        .id = thread,
+        .mask = mask,
+    };
+
+    if (syscall(SYSCALL_THREAD_SETAFFINITY, &args))
+        return errno;
+
+    return 0;
+}
+
+int pthread_getaffinity_zeke(pthread_t thread, uint32_t * mask)
+{
+    struct _set_affinity_args args = {
+        .id = thread,
+    };
+
+    if (syscall(SYSCALL_THREAD_GETAFFINITY, &args))
+        return errno;
+
+    *mask = args.mask;
+
+    return 0;
+}
+
+int pthread_attr_setaffinity_zeke(pthread_attr_t * attr, uint32_t mask)
+{
+    attr->cpu_affinity = mask;
+
+    return 0;
+}
+
+int pthread_attr_getaffinity_zeke(const pthread_attr_t * attr,
+                                  uint32_t * mask)
+{
+    *mask = attr->cpu_affinity;
+
+    return 0;
+}
@@ -40,6 +40,7 @@ int pthread_attr_init(pthread_attr_t * attr)
         .stack_addr = NULL,
         .stack_size = 0,
         .flags = PTHREAD_CREATE_JOINABLE,
+        .cpu_affinity = 0,
     };
 
     return 0;
@@ -47,6 +47,7 @@ int pthread_create(pthread_t * thread, const pthread_attr_t * attr,
         .stack_addr = attr->stack_addr,
         .stack_size = attr->stack_size,
         .flags      = attr->flags,
+        .cpu_affinity = attr->cpu_affinity,
         .start      = start_routine,
         .arg1       = (uintptr_t)arg,
         .del_thread = pthread_exit
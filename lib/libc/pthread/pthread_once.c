@@ -30,26 +30,28 @@
  *******************************************************************************
  */
 
-#include <errno.h>
+#include <limits.h>
+#include <machine/atomic.h>
 #include <pthread.h>
+#include <sys/futex.h>
 
 int pthread_once(pthread_once_t * once_control, void (*init_routine)(void))
 {
-    int * pe;
+    int state;
 
-    if (once_control->state == PTHREAD_NEEDS_INIT &&
-        pthread_key_create(&once_control->key, NULL)) {
-        errno = ENOMEM;
-        return -1;
-    }
-    once_control->state = PTHREAD_DONE_INIT;
-    pe = pthread_getspecific(once_control->key);
-    if (pe == NULL) {
-        if (pthread_setspecific(once_control->key, (void *)1)) {
-            errno = ENOMEM;
-            return -1;
-        }
+    state = atomic_cmpxchg(&once_control->state, PTHREAD_NEEDS_INIT,
+                           PTHREAD_DOING_INIT);
+    if (state == PTHREAD_NEEDS_INIT) {
         init_routine();
+        atomic_set(&once_control->state, PTHREAD_DONE_INIT);
+        futex_wake(&once_control->state, INT_MAX);
+        return 0;
+    }
+
+    /* Another thread is running init_routine. */
+    while (state == PTHREAD_DOING_INIT) {
+        futex_wait(&once_control->state, PTHREAD_DOING_INIT, NULL);
+        state = atomic_read(&once_control->state);
     }
 
     return 0;
@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 static bool readf(_PDCLIB_fd_t fd, void * buf, size_t length,
                   size_t * numBytesRead)
@@ -37,6 +38,18 @@ static bool writef(_PDCLIB_fd_t fd, const void * buf, size_t length,
     return true;
 }
 
+static bool writevf(_PDCLIB_fd_t fd, const struct iovec * iov, int iovcnt,
+                    size_t * numBytesWritten)
+{
+    ssize_t res = writev(fd.sval, iov, iovcnt);
+    if (res == -1) {
+        return false;
+    }
+
+    *numBytesWritten = res;
+    return true;
+}
+
 /* Note: Assumes being compiled with an OFF64 programming model */
 
 static bool seekf(_PDCLIB_fd_t fd, int_fast64_t offset, int whence,
@@ -61,4 +74,5 @@ const _PDCLIB_fileops_t _PDCLIB_fileops = {
     .write = writef,
     .seek  = seekf,
     .close = closef,
+    .writev = writevf,
 };
@@ -13,7 +13,63 @@
 #include <sys/_PDCLIB_glue.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/uio.h>
+
+/* Write the buffered data followed by total bytes from ptr with the writev
+   file op, bypassing the stream buffer. Returns the number of bytes of ptr
+   written. Data left unwritten from the stream buffer stays buffered.
+*/
+static size_t fwrite_direct( const char * ptr, size_t total, FILE * stream )
+{
+    struct iovec iov[2] = {
+        { .iov_base = stream->buffer, .iov_len = stream->bufidx },
+        { .iov_base = (void *)ptr, .iov_len = total },
+    };
+    size_t written = 0;
+
+    while ( iov[1].iov_len > 0 )
+    {
+        const int first = ( iov[0].iov_len == 0 );
+        size_t justWrote = 0;
+        bool res;
+
+        res = stream->ops->writev( stream->handle, iov + first, 2 - first,
+                                   &justWrote );
+        stream->pos.offset += justWrote;
+
+        /* A write that makes no progress would loop forever. */
+        if ( justWrote == 0 )
+        {
+            res = false;
+        }
+        else if ( justWrote < iov[0].iov_len )
+        {
+            iov[0].iov_base = (char *)iov[0].iov_base + justWrote;
+            iov[0].iov_len -= justWrote;
+        }
+        else
+        {
+            justWrote -= iov[0].iov_len;
+            iov[0].iov_len = 0;
+            iov[1].iov_base = (char *)iov[1].iov_base + justWrote;
+            iov[1].iov_len -= justWrote;
+            written += justWrote;
+        }
+
+        if ( !res )
+        {
+            stream->status |= _PDCLIB_ERRORFLAG;
+            break;
+        }
+    }
+
+    memmove( stream->buffer, iov[0].iov_base, iov[0].iov_len );
+    stream->bufidx = iov[0].iov_len;
+
+    return written;
+}
 
 //TODO OS(2012-08-01): Ascertain purpose of lineend & potentially remove
 
@@ -25,6 +81,22 @@ size_t _PDCLIB_fwrite_unlocked( const void * _PDCLIB_restrict ptr,
     {
         return 0;
     }
+
+    /* A write that doesn't fit in the buffer is passed to the backend in a
+       single writev together with the buffered data. Line-buffered streams
+       and streams needing EOL translation take the slow path below.
+    */
+    if ( stream->ops->writev && !( stream->status & _IOLBF ) &&
+#if defined(_PDCLIB_NEED_EOL_TRANSLATION)
+         ( stream->status & _PDCLIB_FBIN ) &&
+#endif
+         size > 0 && nmemb <= SIZE_MAX / size &&
+         ( ( stream->status & _IONBF ) ||
+           size * nmemb > stream->bufsize - stream->bufidx ) )
+    {
+        return fwrite_direct( ptr, size * nmemb, stream ) / size;
+    }
+
     _PDCLIB_size_t offset = 0;
     //bool lineend = false;
     size_t nmemb_i;
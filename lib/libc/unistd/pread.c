@@ -32,23 +32,16 @@
  *******************************************************************************
 */
 
-#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 ssize_t pread(int fildes, void * buf, size_t nbytes, off_t offset)
 {
-    off_t old;
-    ssize_t retval;
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = nbytes,
+    };
 
-    if ((old = lseek(fildes, offset, SEEK_SET)) == -1)
-        return -1;
-
-    if ((retval = read(fildes, buf, nbytes)) == -1)
-        return -1;
-
-    if (lseek(fildes, old, SEEK_SET) == -1)
-        return -1;
-
-    return retval;
+    return preadv(fildes, &iov, 1, offset);
 }
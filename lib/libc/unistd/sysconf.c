@@ -112,7 +112,7 @@ long sysconf(int name)
         value = (long)HOST_NAME_MAX;
         break;
     case _SC_IOV_MAX:
-        /* TODO _SC_IOV_MAX */
+        value = (long)IOV_MAX;
         break;
     case _SC_LINE_MAX:
         value = (long)LINE_MAX;
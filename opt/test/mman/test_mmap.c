@@ -2,6 +2,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include "punit.h"
 
 char * data;
@@ -84,6 +85,34 @@ static char * test_mmap_file(void)
     return NULL;
 }
 
+static char * test_mmap_file_lazy(void)
+{
+    struct stat stat_buf;
+    size_t size;
+    int c;
+
+    fp = fopen("/root/README.markdown", "r");
+    pu_assert("fp not NULL", fp != NULL);
+    pu_assert("fstat ok", fstat(fileno(fp), &stat_buf) == 0);
+    size = stat_buf.st_size;
+
+    errno = 0;
+    data = mmap(NULL, size + 1, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    pu_assert("a new memory region returned", data != MAP_FAILED);
+
+    /* Access the last page first. */
+    fseek(fp, size - 1, SEEK_SET);
+    c = fgetc(fp);
+    pu_assert("Last byte is equal", data[size - 1] == (char)c);
+    pu_assert("Mapping is zero filled after EOF", data[size] == '\0');
+
+    fseek(fp, 0, SEEK_SET);
+    c = fgetc(fp);
+    pu_assert("First byte is equal", data[0] == (char)c);
+
+    return NULL;
+}
+
 static char * test_mmap_anon_huge(void)
 {
     const size_t size = 2097152;
@@ -104,6 +133,7 @@ static void all_tests()
     pu_def_test(test_mmap_anon, PU_RUN);
     pu_def_test(test_mmap_anon_fixed, PU_RUN);
     pu_def_test(test_mmap_file, PU_RUN);
+    pu_def_test(test_mmap_file_lazy, PU_RUN);
     pu_def_test(test_mmap_anon_huge, PU_RUN);
 }
 
@@ -0,0 +1,186 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/cdefs.h>
+#include <time.h>
+#include <unistd.h>
+#include <zeke.h>
+#include "punit.h"
+
+#define MAX_THREADS     32
+#define BENCH_ITER      200
+
+static char stacks[MAX_THREADS][4096];
+static pthread_mutex_t mtx;
+static pthread_cond_t cond;
+static int counter;
+static int ready;
+
+/* Hand-off bookkeeping; Protected by mtx. */
+static pthread_t last_owner;
+static struct timespec released_at;
+static int64_t handoff_ns;
+static unsigned handoffs;
+
+static void setup(void)
+{
+    pthread_mutex_init(&mtx, NULL);
+    pthread_cond_init(&cond, NULL);
+    counter = 0;
+    ready = 0;
+    last_owner = -1;
+    handoff_ns = 0;
+    handoffs = 0;
+}
+
+static void teardown(void)
+{
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mtx);
+}
+
+static int64_t ts_diff_ns(const struct timespec * a, const struct timespec * b)
+{
+    return (int64_t)(b->tv_sec - a->tv_sec) * 1000000000 +
+           (b->tv_nsec - a->tv_nsec);
+}
+
+static void * contender(void * arg)
+{
+    const pthread_t self = pthread_self();
+
+    for (int i = 0; i < BENCH_ITER; i++) {
+        struct timespec now;
+
+        pthread_mutex_lock(&mtx);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (last_owner != -1 && last_owner != self) {
+            handoff_ns += ts_diff_ns(&released_at, &now);
+            handoffs++;
+        }
+        counter++;
+        last_owner = self;
+        clock_gettime(CLOCK_MONOTONIC, &released_at);
+        pthread_mutex_unlock(&mtx);
+    }
+
+    return NULL;
+}
+
+static char * run_contenders(int nr_threads)
+{
+    pthread_t tids[MAX_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < nr_threads; i++) {
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setstack(&attr, stacks[i], sizeof(stacks[i]));
+        pu_assert_equal("Thread created",
+                        pthread_create(&tids[i], &attr, contender, NULL), 0);
+    }
+    for (int i = 0; i < nr_threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pu_assert_equal("No lost updates", counter, nr_threads * BENCH_ITER);
+
+    printf("%d threads: %d acquisitions in %lld us, "
+           "hand-off latency: %lld ns (%u hand-offs)\n",
+           nr_threads, counter, ts_diff_ns(&start, &end) / 1000,
+           handoffs ? handoff_ns / handoffs : 0, handoffs);
+
+    return NULL;
+}
+
+static char * test_mutex_bench_2(void)
+{
+    return run_contenders(2);
+}
+
+static char * test_mutex_bench_8(void)
+{
+    return run_contenders(8);
+}
+
+static char * test_mutex_bench_32(void)
+{
+    return run_contenders(32);
+}
+
+static void * cond_waiter(void * arg)
+{
+    pthread_mutex_lock(&mtx);
+    while (!ready) {
+        pthread_cond_wait(&cond, &mtx);
+    }
+    counter++;
+    pthread_mutex_unlock(&mtx);
+
+    return NULL;
+}
+
+static char * test_cond_broadcast(void)
+{
+    pthread_t tids[4];
+
+    for (int i = 0; i < (int)num_elem(tids); i++) {
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setstack(&attr, stacks[i], sizeof(stacks[i]));
+        pu_assert_equal("Thread created",
+                        pthread_create(&tids[i], &attr, cond_waiter, NULL), 0);
+    }
+
+    pthread_mutex_lock(&mtx);
+    ready = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mtx);
+
+    for (int i = 0; i < (int)num_elem(tids); i++) {
+        pthread_join(tids[i], NULL);
+    }
+    pu_assert_equal("All waiters woke up", counter, (int)num_elem(tids));
+
+    return NULL;
+}
+
+static char * test_cond_timedwait(void)
+{
+    struct timespec abstime;
+    int err;
+
+    clock_gettime(CLOCK_REALTIME, &abstime);
+    abstime.tv_nsec += 10000000;
+    if (abstime.tv_nsec >= 1000000000) {
+        abstime.tv_sec++;
+        abstime.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&mtx);
+    err = pthread_cond_timedwait(&cond, &mtx, &abstime);
+    pthread_mutex_unlock(&mtx);
+    pu_assert_equal("Timed out", err, ETIMEDOUT);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    pu_def_test(test_mutex_bench_2, PU_RUN);
+    pu_def_test(test_mutex_bench_8, PU_RUN);
+    pu_def_test(test_mutex_bench_32, PU_RUN);
+    pu_def_test(test_cond_broadcast, PU_RUN);
+    pu_def_test(test_cond_timedwait, PU_RUN);
+}
+
+int main(int argc, char **argv)
+{
+    return pu_run_tests(&all_tests);
+}
@@ -0,0 +1,267 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "punit.h"
+
+#define SRC_FILE    "/tmp/test_cfr_src"
+#define DST_FILE    "/tmp/test_cfr_dst"
+#define FAT_FILE    "/bin/sh"
+#define BENCH_SIZE  (1024 * 1024)
+#define BENCH_BUF   4096
+
+static int fd_in = -1;
+static int fd_out = -1;
+static int fd[2];
+
+static void setup(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static void teardown(void)
+{
+    if (fd_in >= 0)
+        close(fd_in);
+    fd_in = -1;
+
+    if (fd_out >= 0)
+        close(fd_out);
+    fd_out = -1;
+
+    if (fd[0] > 0)
+        close(fd[0]);
+    fd[0] = 0;
+
+    if (fd[1] > 0)
+        close(fd[1]);
+    fd[1] = 0;
+
+    unlink(SRC_FILE);
+    unlink(DST_FILE);
+}
+
+static long long ts_diff_us(const struct timespec * a,
+                            const struct timespec * b)
+{
+    return (long long)(b->tv_sec - a->tv_sec) * 1000000LL +
+           (b->tv_nsec - a->tv_nsec) / 1000;
+}
+
+static char * make_src(size_t size)
+{
+    char buf[256];
+
+    fd_in = open(SRC_FILE, O_CREAT | O_RDWR, 0600);
+    pu_assert("Source created", fd_in >= 0);
+
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (char)i;
+    }
+    for (size_t i = 0; i < size; i += sizeof(buf)) {
+        pu_assert_equal("Source written",
+                        (int)write(fd_in, buf, sizeof(buf)), (int)sizeof(buf));
+    }
+    lseek(fd_in, 0, SEEK_SET);
+
+    fd_out = open(DST_FILE, O_CREAT | O_RDWR, 0600);
+    pu_assert("Target created", fd_out >= 0);
+
+    return NULL;
+}
+
+static char * test_copy(void)
+{
+    char * err;
+    char buf[16];
+
+    if ((err = make_src(1024)))
+        return err;
+
+    pu_assert_equal("Copy all", (int)copy_file_range(fd_in, NULL, fd_out, NULL,
+                                                     4096, 0), 1024);
+    pu_assert_equal("EOF", (int)copy_file_range(fd_in, NULL, fd_out, NULL,
+                                                4096, 0), 0);
+    pu_assert_equal("Source offset updated",
+                    (int)lseek(fd_in, 0, SEEK_CUR), 1024);
+    pu_assert_equal("Target offset updated",
+                    (int)lseek(fd_out, 0, SEEK_CUR), 1024);
+
+    pu_assert_equal("Read back", (int)pread(fd_out, buf, sizeof(buf), 512),
+                    (int)sizeof(buf));
+    pu_assert_equal("Data copied", buf[1], 1);
+
+    return NULL;
+}
+
+static char * test_copy_offset(void)
+{
+    char * err;
+    off_t off_in = 100;
+    char c;
+
+    if ((err = make_src(256)))
+        return err;
+
+    pu_assert_equal("Copy 10 bytes",
+                    (int)copy_file_range(fd_in, &off_in, fd_out, NULL, 10, 0),
+                    10);
+    pu_assert_equal("off_in updated", (int)off_in, 110);
+    pu_assert_equal("Source offset unchanged",
+                    (int)lseek(fd_in, 0, SEEK_CUR), 0);
+    pu_assert_equal("Read back", (int)pread(fd_out, &c, 1, 0), 1);
+    pu_assert_equal("Data copied from the offset", c, 100);
+
+    return NULL;
+}
+
+static char * test_copy_shared(void)
+{
+    char * err;
+    char c;
+
+    if ((err = make_src(2 * 4096 + 256)))
+        return err;
+
+    pu_assert_equal("Copy all",
+                    (int)copy_file_range(fd_in, NULL, fd_out, NULL,
+                                         3 * 4096, 0),
+                    2 * 4096 + 256);
+    pu_assert_equal("Target offset updated",
+                    (int)lseek(fd_out, 0, SEEK_CUR), 2 * 4096 + 256);
+    pu_assert_equal("Read back", (int)pread(fd_out, &c, 1, 4096 + 1), 1);
+    pu_assert_equal("Data copied", c, 1);
+    pu_assert_equal("Read back the tail",
+                    (int)pread(fd_out, &c, 1, 2 * 4096 + 2), 1);
+    pu_assert_equal("Tail copied", c, 2);
+
+    c = 'a';
+    pu_assert_equal("Source written", (int)pwrite(fd_in, &c, 1, 1), 1);
+    pu_assert_equal("Read back", (int)pread(fd_out, &c, 1, 1), 1);
+    pu_assert_equal("Target not changed", c, 1);
+
+    c = 'b';
+    pu_assert_equal("Target written", (int)pwrite(fd_out, &c, 1, 4096), 1);
+    pu_assert_equal("Read back", (int)pread(fd_in, &c, 1, 4096), 1);
+    pu_assert_equal("Source not changed", c, 0);
+
+    return NULL;
+}
+
+static char * test_copy_errors(void)
+{
+    char * err;
+    off_t off = 0;
+
+    if ((err = make_src(256)))
+        return err;
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+
+    errno = 0;
+    pu_assert_equal("flags must be 0",
+                    (int)copy_file_range(fd_in, NULL, fd_out, NULL, 1, 1), -1);
+    pu_assert_equal("errno is EINVAL", errno, EINVAL);
+
+    errno = 0;
+    pu_assert_equal("No offset on a pipe",
+                    (int)copy_file_range(fd_in, NULL, fd[1], &off, 1, 0), -1);
+    pu_assert_equal("errno is ESPIPE", errno, ESPIPE);
+
+    pu_assert_equal("sendfile() to a pipe",
+                    (int)sendfile(fd[1], fd_in, &off, 16), 16);
+    pu_assert_equal("offset updated", (int)off, 16);
+
+    return NULL;
+}
+
+/*
+ * Copy throughput with read() and write() compared to copy_file_range().
+ */
+static char * bench(int in, const char * name)
+{
+    struct timespec start, end;
+    char * buf;
+    ssize_t n;
+    size_t rw_bytes = 0, cfr_bytes = 0;
+    long long rw_us, cfr_us;
+
+    buf = malloc(BENCH_BUF);
+    pu_assert("buf allocated", buf);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((n = read(in, buf, BENCH_BUF)) > 0) {
+        pu_assert_equal("write ok", (int)write(fd_out, buf, n), (int)n);
+        rw_bytes += n;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    rw_us = ts_diff_us(&start, &end);
+    free(buf);
+
+    /* Copy to an empty file again so that both passes do the same work. */
+    lseek(in, 0, SEEK_SET);
+    close(fd_out);
+    unlink(DST_FILE);
+    fd_out = open(DST_FILE, O_CREAT | O_RDWR, 0600);
+    pu_assert("Target recreated", fd_out >= 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((n = copy_file_range(in, NULL, fd_out, NULL, SIZE_MAX >> 1, 0)) > 0) {
+        cfr_bytes += n;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    cfr_us = ts_diff_us(&start, &end);
+
+    pu_assert_equal("Same amount copied", (int)cfr_bytes, (int)rw_bytes);
+
+    printf("%s: %u bytes, read/write: %lld us (%lld kB/s), "
+           "copy_file_range: %lld us (%lld kB/s)\n",
+           name, (unsigned)rw_bytes,
+           rw_us, rw_us ? (long long)rw_bytes * 1000 / 1024 * 1000 / rw_us : 0,
+           cfr_us,
+           cfr_us ? (long long)cfr_bytes * 1000 / 1024 * 1000 / cfr_us : 0);
+
+    return NULL;
+}
+
+static char * test_bench_ramfs(void)
+{
+    char * err;
+
+    if ((err = make_src(BENCH_SIZE)))
+        return err;
+
+    return bench(fd_in, "ramfs -> ramfs");
+}
+
+static char * test_bench_fat(void)
+{
+    fd_out = open(DST_FILE, O_CREAT | O_RDWR, 0600);
+    pu_assert("Target created", fd_out >= 0);
+
+    fd_in = open(FAT_FILE, O_RDONLY);
+    pu_assert("FAT source opened", fd_in >= 0);
+
+    return bench(fd_in, "fatfs -> ramfs");
+}
+
+static void all_tests(void)
+{
+    pu_def_test(test_copy, PU_RUN);
+    pu_def_test(test_copy_offset, PU_RUN);
+    pu_def_test(test_copy_shared, PU_RUN);
+    pu_def_test(test_copy_errors, PU_RUN);
+    pu_def_test(test_bench_ramfs, PU_RUN);
+    pu_def_test(test_bench_fat, PU_RUN);
+}
+
+int main(int argc, char **argv)
+{
+    return pu_run_tests(&all_tests);
+}
@@ -0,0 +1 @@
+TEST-SRC += test_copy_file_range.c
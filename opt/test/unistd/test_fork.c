@@ -1,11 +1,17 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/sysctl.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include "punit.h"
 
+#define BENCH_FORKS     20
+#define BENCH_BUF_SIZE  (1024 * 1024)
+
 pid_t pids[10];
+static char bench_buf[BENCH_BUF_SIZE];
 
 static void setup(void)
 {
@@ -84,10 +90,72 @@ static char * test_fork_multi(void)
     return NULL;
 }
 
+static unsigned get_pages_copied(void)
+{
+    int mib[CTL_MAXNAME];
+    int len;
+    unsigned value = 0;
+    size_t value_len = sizeof(value);
+
+    len = sysctlnametomib("vm.vralloc.cow_pages_copied", mib, num_elem(mib));
+    if (len < 0 || sysctl(mib, len, &value, &value_len, NULL, 0))
+        return 0;
+
+    return value;
+}
+
+static long long timespec2us(const struct timespec * ts)
+{
+    return (long long)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+/*
+ * Measure the latency of fork() + _exit() + wait() when the child writes to
+ * a single page of a large data region, and how many pages are copied.
+ */
+static char * test_fork_cow_bench(void)
+{
+    struct timespec start, end;
+    unsigned copied_start, copied_end;
+    long long total = 0;
+
+    for (size_t i = 0; i < sizeof(bench_buf); i += 4096) {
+        bench_buf[i] = 1;
+    }
+
+    copied_start = get_pages_copied();
+    for (int i = 0; i < BENCH_FORKS; i++) {
+        pid_t pid;
+        int status;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pid = fork();
+        pu_assert("Fork created", pid != -1);
+        if (pid == 0) {
+            bench_buf[0] = 2;
+            _exit(0);
+        }
+        waitpid(pid, &status, 0);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        pu_assert("Child wasn't killed by a signal", WIFSIGNALED(status) == 0);
+        total += timespec2us(&end) - timespec2us(&start);
+    }
+    copied_end = get_pages_copied();
+
+    printf("fork latency: %lld us, pages copied: %u per fork\n",
+           total / BENCH_FORKS, (copied_end - copied_start) / BENCH_FORKS);
+    pu_assert("The parent memory is not modified by the child",
+              bench_buf[0] == 1);
+
+    return NULL;
+}
+
 static void all_tests()
 {
     pu_def_test(test_fork_created, PU_RUN);
     pu_def_test(test_fork_multi, PU_RUN);
+    pu_def_test(test_fork_cow_bench, PU_RUN);
 }
 
 int main(int argc, char **argv)
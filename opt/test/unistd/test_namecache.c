@@ -0,0 +1,93 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "punit.h"
+
+#define TEST_DIR    "/tmp/test_nc"
+#define TEST_FILE   TEST_DIR "/file"
+#define TEST_SUBDIR TEST_DIR "/dir"
+
+static void setup(void)
+{
+    mkdir(TEST_DIR, 0700);
+}
+
+static void teardown(void)
+{
+    unlink(TEST_FILE);
+    rmdir(TEST_SUBDIR);
+    rmdir(TEST_DIR);
+}
+
+static char * test_negative_create(void)
+{
+    struct stat st;
+    int fd;
+
+    errno = 0;
+    pu_assert_equal("File doesn't exist", stat(TEST_FILE, &st), -1);
+    pu_assert_equal("errno is ENOENT", errno, ENOENT);
+    pu_assert_equal("Still doesn't exist", stat(TEST_FILE, &st), -1);
+
+    fd = open(TEST_FILE, O_CREAT | O_WRONLY, 0600);
+    pu_assert("File created", fd >= 0);
+    close(fd);
+
+    pu_assert_equal("Negative entry was purged", stat(TEST_FILE, &st), 0);
+
+    return NULL;
+}
+
+static char * test_positive_unlink(void)
+{
+    struct stat st;
+    int fd;
+
+    fd = open(TEST_FILE, O_CREAT | O_WRONLY, 0600);
+    pu_assert("File created", fd >= 0);
+    close(fd);
+
+    pu_assert_equal("File exists", stat(TEST_FILE, &st), 0);
+    pu_assert_equal("File exists", stat(TEST_FILE, &st), 0);
+    pu_assert_equal("unlink ok", unlink(TEST_FILE), 0);
+
+    errno = 0;
+    pu_assert_equal("Positive entry was purged", stat(TEST_FILE, &st), -1);
+    pu_assert_equal("errno is ENOENT", errno, ENOENT);
+
+    return NULL;
+}
+
+static char * test_dir(void)
+{
+    struct stat st;
+
+    pu_assert_equal("mkdir ok", mkdir(TEST_SUBDIR, 0700), 0);
+    pu_assert_equal("Dir exists", stat(TEST_SUBDIR, &st), 0);
+    pu_assert("Is a dir", S_ISDIR(st.st_mode));
+    pu_assert_equal("Nothing in the dir",
+                    stat(TEST_SUBDIR "/x", &st), -1);
+
+    pu_assert_equal("rmdir ok", rmdir(TEST_SUBDIR), 0);
+    pu_assert_equal("Dir was purged", stat(TEST_SUBDIR, &st), -1);
+
+    pu_assert_equal("mkdir again", mkdir(TEST_SUBDIR, 0700), 0);
+    pu_assert_equal("Dir exists again", stat(TEST_SUBDIR, &st), 0);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    pu_def_test(test_negative_create, PU_RUN);
+    pu_def_test(test_positive_unlink, PU_RUN);
+    pu_def_test(test_dir, PU_RUN);
+}
+
+int main(int argc, char **argv)
+{
+    return pu_run_tests(&all_tests);
+}
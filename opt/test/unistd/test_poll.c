@@ -0,0 +1,260 @@
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/event.h>
+#include <sys/select.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <zeke.h>
+#include "punit.h"
+
+static int fd[2];
+static int kq;
+
+static void setup(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static void teardown(void)
+{
+    if (fd[0] > 0)
+        close(fd[0]);
+    fd[0] = 0;
+
+    if (fd[1] > 0)
+        close(fd[1]);
+    fd[1] = 0;
+
+    if (kq > 0)
+        close(kq);
+    kq = 0;
+}
+
+static char * test_poll_empty(void)
+{
+    struct pollfd pfd[2];
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+
+    pfd[0] = (struct pollfd){ .fd = fd[0], .events = POLLIN };
+    pfd[1] = (struct pollfd){ .fd = fd[1], .events = POLLOUT };
+    pu_assert_equal("Only the write end is ready", poll(pfd, 2, 0), 1);
+    pu_assert_equal("No POLLIN", pfd[0].revents, 0);
+    pu_assert_equal("POLLOUT", pfd[1].revents, POLLOUT);
+
+    return NULL;
+}
+
+static char * test_poll_timeout(void)
+{
+    struct pollfd pfd = { .events = POLLIN };
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    pfd.fd = fd[0];
+
+    pu_assert_equal("poll() times out", poll(&pfd, 1, 20), 0);
+
+    return NULL;
+}
+
+static char * test_poll_readable(void)
+{
+    struct pollfd pfd = { .events = POLLIN };
+    char c = 'x';
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    pfd.fd = fd[0];
+
+    write(fd[1], &c, sizeof(c));
+    pu_assert_equal("poll() returns one fd", poll(&pfd, 1, -1), 1);
+    pu_assert_equal("POLLIN", pfd.revents, POLLIN);
+
+    return NULL;
+}
+
+static char * test_poll_hup(void)
+{
+    struct pollfd pfd = { .events = POLLIN };
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    pfd.fd = fd[0];
+
+    close(fd[1]);
+    fd[1] = 0;
+    pu_assert_equal("poll() returns one fd", poll(&pfd, 1, 0), 1);
+    pu_assert("POLLHUP", pfd.revents & POLLHUP);
+
+    return NULL;
+}
+
+static char * test_poll_nval(void)
+{
+    struct pollfd pfd = { .fd = 1000, .events = POLLIN };
+
+    pu_assert_equal("poll() returns one fd", poll(&pfd, 1, 0), 1);
+    pu_assert_equal("POLLNVAL", pfd.revents, POLLNVAL);
+
+    return NULL;
+}
+
+static char * test_poll_wakeup(void)
+{
+    struct pollfd pfd = { .events = POLLIN };
+    pid_t pid;
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    pfd.fd = fd[0];
+
+    pid = fork();
+    pu_assert("PID OK\n", pid != -1);
+    if (pid == 0) {
+        char c = 'x';
+
+        close(fd[0]);
+        msleep(10);
+        write(fd[1], &c, sizeof(c));
+
+        _exit(0);
+    }
+
+    pu_assert_equal("poll() is woken up", poll(&pfd, 1, 5000), 1);
+    pu_assert_equal("POLLIN", pfd.revents, POLLIN);
+
+    wait(NULL);
+
+    return NULL;
+}
+
+static char * test_select(void)
+{
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 0 };
+    fd_set rfds, wfds;
+    char c = 'x';
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    FD_SET(fd[0], &rfds);
+    FD_SET(fd[1], &wfds);
+    pu_assert_equal("Only the write end is ready",
+                    select(fd[1] + 1, &rfds, &wfds, NULL, &tv), 1);
+    pu_assert("read end not set", !FD_ISSET(fd[0], &rfds));
+    pu_assert("write end set", FD_ISSET(fd[1], &wfds));
+
+    write(fd[1], &c, sizeof(c));
+    FD_ZERO(&rfds);
+    FD_SET(fd[0], &rfds);
+    pu_assert_equal("The read end is ready",
+                    select(fd[0] + 1, &rfds, NULL, NULL, NULL), 1);
+    pu_assert("read end set", FD_ISSET(fd[0], &rfds));
+
+    return NULL;
+}
+
+static char * test_kqueue(void)
+{
+    const struct timespec ts = { .tv_sec = 0, .tv_nsec = 0 };
+    struct kevent kev;
+    char c = 'x';
+    int udata;
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    kq = kqueue();
+    pu_assert("kqueue created", kq > 0);
+
+    EV_SET(&kev, fd[0], EVFILT_READ, EV_ADD, 0, 0, &udata);
+    pu_assert_equal("No events yet", kevent(kq, &kev, 1, &kev, 1, &ts), 0);
+
+    write(fd[1], &c, sizeof(c));
+    pu_assert_equal("One event", kevent(kq, NULL, 0, &kev, 1, NULL), 1);
+    pu_assert_equal("ident", (int)kev.ident, fd[0]);
+    pu_assert_equal("filter", kev.filter, EVFILT_READ);
+    pu_assert_ptr_equal("udata", kev.udata, &udata);
+
+    /* Level-triggered until the data is read. */
+    pu_assert_equal("Still ready", kevent(kq, NULL, 0, &kev, 1, &ts), 1);
+    read(fd[0], &c, sizeof(c));
+    pu_assert_equal("Not ready", kevent(kq, NULL, 0, &kev, 1, &ts), 0);
+
+    EV_SET(&kev, fd[0], EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    pu_assert_equal("Deleted", kevent(kq, &kev, 1, NULL, 0, NULL), 0);
+
+    return NULL;
+}
+
+static char * test_kqueue_oneshot(void)
+{
+    const struct timespec ts = { .tv_sec = 0, .tv_nsec = 0 };
+    struct kevent kev;
+    char c = 'x';
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    kq = kqueue();
+    pu_assert("kqueue created", kq > 0);
+
+    write(fd[1], &c, sizeof(c));
+    EV_SET(&kev, fd[0], EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, NULL);
+    pu_assert_equal("One event", kevent(kq, &kev, 1, &kev, 1, &ts), 1);
+    pu_assert_equal("Gone after the first event",
+                    kevent(kq, NULL, 0, &kev, 1, &ts), 0);
+
+    EV_SET(&kev, fd[0], EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    pu_assert_equal("Already deleted", kevent(kq, &kev, 1, NULL, 0, NULL), -1);
+
+    return NULL;
+}
+
+static char * test_kqueue_disable(void)
+{
+    const struct timespec ts = { .tv_sec = 0, .tv_nsec = 0 };
+    struct kevent kev;
+    char c = 'x';
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+    kq = kqueue();
+    pu_assert("kqueue created", kq > 0);
+
+    write(fd[1], &c, sizeof(c));
+    EV_SET(&kev, fd[0], EVFILT_READ, EV_ADD | EV_DISABLE, 0, 0, NULL);
+    pu_assert_equal("No events when added disabled",
+                    kevent(kq, &kev, 1, &kev, 1, &ts), 0);
+
+    EV_SET(&kev, fd[0], EVFILT_READ, EV_ENABLE, 0, 0, NULL);
+    pu_assert_equal("One event after enable",
+                    kevent(kq, &kev, 1, &kev, 1, &ts), 1);
+
+    EV_SET(&kev, fd[0], EVFILT_READ, EV_DISABLE, 0, 0, NULL);
+    pu_assert_equal("No events after disable",
+                    kevent(kq, &kev, 1, &kev, 1, &ts), 0);
+    write(fd[1], &c, sizeof(c));
+    pu_assert_equal("No events while disabled",
+                    kevent(kq, NULL, 0, &kev, 1, &ts), 0);
+
+    EV_SET(&kev, fd[0], EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    pu_assert_equal("Deleted", kevent(kq, &kev, 1, NULL, 0, NULL), 0);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    pu_def_test(test_poll_empty, PU_RUN);
+    pu_def_test(test_poll_timeout, PU_RUN);
+    pu_def_test(test_poll_readable, PU_RUN);
+    pu_def_test(test_poll_hup, PU_RUN);
+    pu_def_test(test_poll_nval, PU_RUN);
+    pu_def_test(test_poll_wakeup, PU_RUN);
+    pu_def_test(test_select, PU_RUN);
+    pu_def_test(test_kqueue, PU_RUN);
+    pu_def_test(test_kqueue_oneshot, PU_RUN);
+    pu_def_test(test_kqueue_disable, PU_RUN);
+}
+
+int main(int argc, char **argv)
+{
+    return pu_run_tests(&all_tests);
+}
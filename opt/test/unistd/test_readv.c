@@ -0,0 +1,111 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "punit.h"
+
+#define TEST_FILE "/tmp/test_readv"
+
+static int fd[2];
+static int file = -1;
+
+static void setup(void)
+{
+    /* Intentionally unimplemented... */
+}
+
+static void teardown(void)
+{
+    if (fd[0] > 0)
+        close(fd[0]);
+    fd[0] = 0;
+
+    if (fd[1] > 0)
+        close(fd[1]);
+    fd[1] = 0;
+
+    if (file >= 0) {
+        close(file);
+        unlink(TEST_FILE);
+    }
+    file = -1;
+}
+
+static char * test_pipe_writev_readv(void)
+{
+    char a[] = "abc";
+    char b[] = "defgh";
+    char c[4];
+    char d[4];
+    struct iovec wiov[] = {
+        { .iov_base = a, .iov_len = 3 },
+        { .iov_base = b, .iov_len = 5 },
+    };
+    struct iovec riov[] = {
+        { .iov_base = c, .iov_len = sizeof(c) },
+        { .iov_base = d, .iov_len = sizeof(d) },
+    };
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+
+    pu_assert_equal("writev() writes all segments", writev(fd[1], wiov, 2), 8);
+    pu_assert_equal("readv() reads all segments", readv(fd[0], riov, 2), 8);
+    pu_assert("First segment", memcmp(c, "abcd", 4) == 0);
+    pu_assert("Second segment", memcmp(d, "efgh", 4) == 0);
+
+    return NULL;
+}
+
+static char * test_readv_einval(void)
+{
+    char c;
+    struct iovec iov = { .iov_base = &c, .iov_len = 1 };
+
+    pu_assert_equal("pipe creation ok", pipe(fd), 0);
+
+    errno = 0;
+    pu_assert_equal("iovcnt 0 fails", readv(fd[0], &iov, 0), -1);
+    pu_assert_equal("errno is EINVAL", errno, EINVAL);
+
+    errno = 0;
+    pu_assert_equal("preadv() on a pipe fails",
+                    preadv(fd[0], &iov, 1, 0), -1);
+    pu_assert_equal("errno is ESPIPE", errno, ESPIPE);
+
+    return NULL;
+}
+
+static char * test_pread_pwrite(void)
+{
+    char buf[4];
+
+    file = open(TEST_FILE, O_CREAT | O_RDWR, 0600);
+    pu_assert("File created", file >= 0);
+
+    pu_assert_equal("write ok", write(file, "0123456789", 10), 10);
+    pu_assert_equal("pwrite() at 2", pwrite(file, "ab", 2, 2), 2);
+    pu_assert_equal("The offset is unchanged",
+                    (int)lseek(file, 0, SEEK_CUR), 10);
+
+    pu_assert_equal("pread() at 1", pread(file, buf, 4, 1), 4);
+    pu_assert("pread() data", memcmp(buf, "1ab4", 4) == 0);
+    pu_assert_equal("The offset is unchanged",
+                    (int)lseek(file, 0, SEEK_CUR), 10);
+
+    return NULL;
+}
+
+static void all_tests(void)
+{
+    pu_def_test(test_pipe_writev_readv, PU_RUN);
+    pu_def_test(test_readv_einval, PU_RUN);
+    pu_def_test(test_pread_pwrite, PU_RUN);
+}
+
+int main(int argc, char **argv)
+{
+    return pu_run_tests(&all_tests);
+}